@@ -7,6 +7,21 @@ load("//3rdparty/bazel-rules-http-parser:repos.bzl", http_parser="repos")
 load("//3rdparty/bazel-rules-libevent:repos.bzl", libevent="repos")
 load("//3rdparty/stout:repos.bzl", stout="repos")
 
+_CONCURRENTQUEUE_BUILD = """
+load("@rules_cc//cc:defs.bzl", "cc_library")
+
+cc_library(
+    name = "concurrentqueue",
+    hdrs = [
+        "blockingconcurrentqueue.h",
+        "concurrentqueue.h",
+        "lightweightsemaphore.h",
+    ],
+    includes = ["."],
+    visibility = ["//visibility:public"],
+)
+"""
+
 def repos(*, external = True, repo_mapping = {}):
     http_parser(repo_mapping = repo_mapping)
     libevent(repo_mapping = repo_mapping)
@@ -30,6 +45,18 @@ def repos(*, external = True, repo_mapping = {}):
             repo_mapping = repo_mapping,
         )
 
+    # Only needed when building with `--define=lock_free_run_queue=true`
+    # (see BUILD.bazel), in which case `RunQueue` uses the header-only
+    # moodycamel::ConcurrentQueue.
+    if "com_github_cameron314_concurrentqueue" not in native.existing_rules():
+        git_repository(
+            name = "com_github_cameron314_concurrentqueue",
+            tag = "v1.0.4",
+            remote = "https://github.com/cameron314/concurrentqueue",
+            build_file_content = _CONCURRENTQUEUE_BUILD,
+            repo_mapping = repo_mapping,
+        )
+
     if external and "com_github_3rdparty_libprocess" not in native.existing_rules():
         git_repository(
             name = "com_github_3rdparty_libprocess",
@@ -42,11 +42,17 @@ namespace process {
 //          }
 //          return Continue();
 //        });
-inline Future<Nothing> after(const Duration& duration)
+//
+// A `slack` lets the future complete up to that much later, see
+// `Clock::timer`. Use it when the exact timing doesn't matter so
+// that the timer can share an event loop wakeup with others.
+inline Future<Nothing> after(
+    const Duration& duration,
+    const Duration& slack)
 {
   std::shared_ptr<Promise<Nothing>> promise(new Promise<Nothing>());
 
-  Timer timer = Clock::timer(duration, [=]() {
+  Timer timer = Clock::timer(duration, slack, [=]() {
     promise->set(Nothing());
   });
 
@@ -67,6 +73,12 @@ inline Future<Nothing> after(const Duration& duration)
   return promise->future();
 }
 
+
+inline Future<Nothing> after(const Duration& duration)
+{
+  return after(duration, Duration::zero());
+}
+
 } // namespace process {
 
 #endif // __PROCESS_AFTER_HPP__
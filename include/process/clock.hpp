@@ -73,6 +73,20 @@ public:
       const Duration& duration,
       const lambda::function<void()>& thunk);
 
+  /**
+   * Like `timer` above, but lets the timer elapse up to `slack` late
+   * so that it can share an event loop wakeup with other timers. The
+   * timeout gets rounded up to a multiple of the largest power of two
+   * nanoseconds that does not exceed `slack`, hence timers with about
+   * the same timeout end up with the exact same one.
+   *
+   * The slack is ignored while the clock is paused.
+   */
+  static Timer timer(
+      const Duration& duration,
+      const Duration& slack,
+      const lambda::function<void()>& thunk);
+
   static bool cancel(const Timer& timer);
 
   /**
@@ -13,13 +13,19 @@
 #ifndef __PROCESS_EVENT_HPP__
 #define __PROCESS_EVENT_HPP__
 
+#include <cstddef>
 #include <memory> // TODO(benh): Replace shared_ptr with unique_ptr.
+#include <new>
+#include <type_traits>
+#include <utility>
 
 #include <process/future.hpp>
 #include <process/http.hpp>
 #include <process/message.hpp>
 #include <process/socket.hpp>
 
+#include <glog/logging.h>
+
 #include <stout/abort.hpp>
 #include <stout/json.hpp>
 #include <stout/lambda.hpp>
@@ -61,6 +67,12 @@ struct Event
 {
   virtual ~Event() {}
 
+  // Events get created and destroyed at a very high rate so they get
+  // allocated from a pool of memory rather than the heap, see
+  // src/memory_pool.hpp.
+  static void* operator new(size_t size);
+  static void operator delete(void* pointer, size_t size);
+
   virtual void visit(EventVisitor* visitor) const = 0;
   virtual void consume(EventConsumer* consumer) && = 0;
 
@@ -175,10 +187,185 @@ struct HttpEvent : Event
 };
 
 
+namespace internal {
+
+// The function that gets invoked as the result of a dispatch. Like a
+// `lambda::CallableOnce<void(ProcessBase*)>` it can only be invoked
+// once, but functions (including anything they've captured) of up to
+// `INLINE_SIZE` bytes get stored inline rather than on the heap, which
+// saves an allocation for the vast majority of dispatches.
+class DispatchFunction
+{
+public:
+  static constexpr size_t INLINE_SIZE = 96;
+
+  template <
+      typename F,
+      typename std::enable_if<
+          !std::is_same<
+              typename std::decay<F>::type,
+              DispatchFunction>::value, int>::type = 0>
+  explicit DispatchFunction(F&& f)
+  {
+    typedef typename std::decay<F>::type T;
+
+    construct<T>(
+        std::forward<F>(f),
+        std::integral_constant<bool, inlined<T>()>());
+  }
+
+  DispatchFunction(DispatchFunction&& that) : ops(that.ops)
+  {
+    if (ops != nullptr) {
+      ops->move(&that.storage, &storage);
+      that.ops = nullptr;
+    }
+  }
+
+  DispatchFunction& operator=(DispatchFunction&& that)
+  {
+    if (this != &that) {
+      reset();
+
+      ops = that.ops;
+
+      if (ops != nullptr) {
+        ops->move(&that.storage, &storage);
+        that.ops = nullptr;
+      }
+    }
+
+    return *this;
+  }
+
+  DispatchFunction(const DispatchFunction&) = delete;
+  DispatchFunction& operator=(const DispatchFunction&) = delete;
+
+  ~DispatchFunction()
+  {
+    reset();
+  }
+
+  void operator()(ProcessBase* process) &&
+  {
+    CHECK(ops != nullptr);
+    ops->invoke(&storage, process);
+    reset();
+  }
+
+private:
+  // Operations on the stored function, one instance per type of
+  // function (and whether or not it's stored inline).
+  struct Ops
+  {
+    void (*invoke)(void* storage, ProcessBase* process);
+    void (*move)(void* from, void* to);
+    void (*destroy)(void* storage);
+  };
+
+  template <typename T>
+  static constexpr bool inlined()
+  {
+    return sizeof(T) <= INLINE_SIZE &&
+      alignof(T) <= alignof(std::max_align_t) &&
+      std::is_nothrow_move_constructible<T>::value;
+  }
+
+  template <typename T>
+  struct Inline
+  {
+    static void invoke(void* storage, ProcessBase* process)
+    {
+      std::move(*static_cast<T*>(storage))(process);
+    }
+
+    static void move(void* from, void* to)
+    {
+      new (to) T(std::move(*static_cast<T*>(from)));
+      static_cast<T*>(from)->~T();
+    }
+
+    static void destroy(void* storage)
+    {
+      static_cast<T*>(storage)->~T();
+    }
+
+    static const Ops ops;
+  };
+
+  template <typename T>
+  struct Allocated
+  {
+    static void invoke(void* storage, ProcessBase* process)
+    {
+      std::move(**static_cast<T**>(storage))(process);
+    }
+
+    static void move(void* from, void* to)
+    {
+      *static_cast<T**>(to) = *static_cast<T**>(from);
+    }
+
+    static void destroy(void* storage)
+    {
+      delete *static_cast<T**>(storage);
+    }
+
+    static const Ops ops;
+  };
+
+  template <typename T, typename F>
+  void construct(F&& f, std::true_type)
+  {
+    new (&storage) T(std::forward<F>(f));
+    ops = &Inline<T>::ops;
+  }
+
+  template <typename T, typename F>
+  void construct(F&& f, std::false_type)
+  {
+    *reinterpret_cast<T**>(&storage) = new T(std::forward<F>(f));
+    ops = &Allocated<T>::ops;
+  }
+
+  void reset()
+  {
+    if (ops != nullptr) {
+      ops->destroy(&storage);
+      ops = nullptr;
+    }
+  }
+
+  const Ops* ops = nullptr;
+
+  typename std::aligned_storage<
+      INLINE_SIZE,
+      alignof(std::max_align_t)>::type storage;
+};
+
+
+template <typename T>
+const DispatchFunction::Ops DispatchFunction::Inline<T>::ops = {
+  &DispatchFunction::Inline<T>::invoke,
+  &DispatchFunction::Inline<T>::move,
+  &DispatchFunction::Inline<T>::destroy,
+};
+
+
+template <typename T>
+const DispatchFunction::Ops DispatchFunction::Allocated<T>::ops = {
+  &DispatchFunction::Allocated<T>::invoke,
+  &DispatchFunction::Allocated<T>::move,
+  &DispatchFunction::Allocated<T>::destroy,
+};
+
+} // namespace internal {
+
+
 struct DispatchEvent : Event
 {
   DispatchEvent(
-      std::unique_ptr<lambda::CallableOnce<void(ProcessBase*)>> _f,
+      internal::DispatchFunction&& _f,
       const Option<const std::type_info*>& _functionType)
     : f(std::move(_f)),
       functionType(_functionType)
@@ -200,7 +387,7 @@ struct DispatchEvent : Event
   }
 
   // Function to get invoked as a result of this dispatch event.
-  std::unique_ptr<lambda::CallableOnce<void(ProcessBase*)>> f;
+  internal::DispatchFunction f;
 
   Option<const std::type_info*> functionType;
 };
@@ -61,6 +61,13 @@ enum class Scheme {
 };
 
 
+// Version of HTTP spoken on a connection, see `connect`.
+enum class Protocol {
+  HTTP_1_1,
+  HTTP_2
+};
+
+
 namespace authentication {
 
 class Authenticator;
@@ -277,16 +284,20 @@ struct Status
 // reader must "keep up" with the writer in order to avoid
 // unbounded memory growth.
 //
+// A pipe can instead be created with a capacity, i.e., a high-water
+// mark for the number of bytes written but not yet read. Writes to
+// a bounded pipe still always succeed, but a writer that waits for
+// `Writer::writable` before each write never buffers much more than
+// the capacity. Reads from a bounded pipe return all of the buffered
+// writes (up to the capacity) at once, so that a reader that falls
+// behind catches up with fewer, larger reads.
+//
 // The writer can induce a failure on the reader in order to signal
 // that an error has occurred. For example, if we are receiving a
 // response but a disconnection occurs before the response is
 // completed, we want the reader to detect that a disconnection
 // occurred!
 //
-// TODO(bmahler): Consider aggregating writes into larger reads to
-// help the reader keep up (a process::Stream abstraction with
-// backpressure would obviate the need for this).
-//
 // TODO(bmahler): Add a more general process::Stream<T> abstraction
 // to represent asynchronous finite/infinite streams (possibly
 // with "backpressure" on the writer). This is broadly useful
@@ -361,6 +372,12 @@ public:
     // was unable to continue reading!
     Future<Nothing> readerClosed() const;
 
+    // Returns Nothing once fewer bytes than the capacity of the pipe
+    // are buffered, i.e., once the reader has caught up enough for
+    // the writer to write more. This is always the case for a pipe
+    // without a capacity, or if either end of the pipe is closed.
+    Future<Nothing> writable() const;
+
     // Comparison operators useful for checking connection equality.
     bool operator==(const Writer& other) const { return data == other.data; }
     bool operator!=(const Writer& other) const { return !(*this == other); }
@@ -381,7 +398,11 @@ public:
   };
 
   Pipe()
-    : data(new Data()) {}
+    : data(new Data(None())) {}
+
+  // Creates a bounded pipe, see above.
+  explicit Pipe(size_t capacity)
+    : data(new Data(capacity)) {}
 
   Reader reader() const;
   Writer writer() const;
@@ -392,8 +413,8 @@ public:
 private:
   struct Data
   {
-    Data()
-      : readEnd(Reader::OPEN), writeEnd(Writer::OPEN) {}
+    explicit Data(const Option<size_t>& _capacity)
+      : readEnd(Reader::OPEN), writeEnd(Writer::OPEN), capacity(_capacity) {}
 
     // Rather than use a process to serialize access to the pipe's
     // internal data we use a 'std::atomic_flag'.
@@ -409,6 +430,14 @@ private:
     // empty strings as they serve as a signal for end-of-file.
     std::queue<std::string> writes;
 
+    // High-water mark for the size of `writes` if the pipe is
+    // bounded, and their current size in bytes.
+    const Option<size_t> capacity;
+    size_t size = 0;
+
+    // Represents writers waiting for the pipe to become writable.
+    std::queue<Owned<Promise<Nothing>>> writables;
+
     // Signals when the read-end is closed before the write-end.
     Promise<Nothing> readerClosure;
 
@@ -945,7 +974,9 @@ std::string encode(const hashmap<std::string, std::string>& query);
 
 /**
  * Represents a connection to an HTTP server. Pipelining will be
- * used when there are multiple requests in-flight.
+ * used when there are multiple requests in-flight over HTTP/1.1,
+ * over HTTP/2 every request gets its own stream so the responses
+ * can arrive in any order.
  *
  * TODO(bmahler): This does not prevent pipelining with HTTP/1.0.
  */
@@ -979,16 +1010,22 @@ public:
   const network::Address localAddress;
   const network::Address peerAddress;
 
+  // The version of HTTP spoken, which is HTTP/1.1 if HTTP/2 was asked
+  // for but the server didn't agree to it.
+  const Protocol protocol;
+
 private:
   Connection(
       const network::Socket& s,
       const network::Address& _localAddress,
-      const network::Address& _peerAddress);
+      const network::Address& _peerAddress,
+      Protocol _protocol);
 
   friend Future<Connection> connect(
       const network::Address& address,
       Scheme scheme,
-      const Option<std::string>& peer_hostname);
+      const Option<std::string>& peer_hostname,
+      Protocol protocol);
   friend Future<Connection> connect(const URL&);
 
   // Forward declaration.
@@ -1004,6 +1041,17 @@ Future<Connection> connect(
     const Option<std::string>& peer_hostname);
 
 
+// Connects with the specified version of HTTP. HTTP/2 over HTTPS gets
+// negotiated with ALPN, falling back to HTTP/1.1 if the server doesn't
+// support it, whereas over HTTP the server must support it ("prior
+// knowledge", see section 3.4 of RFC 7540).
+Future<Connection> connect(
+    const network::Address& address,
+    Scheme scheme,
+    const Option<std::string>& peer_hostname,
+    Protocol protocol);
+
+
 Future<Connection> connect(const network::Address& address, Scheme scheme);
 
 
@@ -1012,9 +1060,19 @@ Future<Connection> connect(const URL& url);
 
 namespace internal {
 
+// Serves HTTP/2 as well as HTTP/1.1 if `enableHttp2` is true, telling them
+// apart by whether the client starts with the HTTP/2 connection
+// preface.
 Future<Nothing> serve(
     network::Socket s,
-    std::function<Future<Response>(const Request&)>&& f);
+    std::function<Future<Response>(const Request&)>&& f,
+    bool enableHttp2);
+
+
+// Returns true if the 'Connection' header includes the "close"
+// option. Connection options are case-insensitive and can be listed
+// along with others, e.g., 'Connection: Keep-Alive, Close'.
+bool closesConnection(const Headers& headers);
 
 } // namespace internal {
 
@@ -1036,6 +1094,9 @@ Future<Nothing> serve(
 // pipelining you must explicitly sequence/serialize the requests to
 // wait for previous responses yourself.
 //
+// NOTE: This only serves HTTP/1.1, see `Server::CreateOptions` for
+// serving HTTP/2 as well.
+//
 // NOTE: The `Request` passed to the handler is of type `PIPE` and should
 // always be read using `Request.reader`.
 template <typename F>
@@ -1043,7 +1104,8 @@ Future<Nothing> serve(const network::Socket& s, F&& f)
 {
   return internal::serve(
       s,
-      std::function<Future<Response>(const Request&)>(std::forward<F>(f)));
+      std::function<Future<Response>(const Request&)>(std::forward<F>(f)),
+      false);
 }
 
 
@@ -1064,6 +1126,20 @@ public:
   {
     Scheme scheme;
     size_t backlog;
+
+    // Number of sockets that listen on the address, sharing it using
+    // SO_REUSEPORT so that the kernel spreads incoming connections
+    // across them. Only used when creating a server with an address,
+    // 0 is treated like 1.
+    size_t listeners;
+
+    // Whether to serve HTTP/2 as well as HTTP/1.1, i.e., to clients
+    // that start with the HTTP/2 connection preface: over HTTP those
+    // with prior knowledge, over HTTPS those that negotiate "h2" with
+    // ALPN (which is only offered if this is set). HTTP/2 responses
+    // get sent as soon as they are ready rather than in the order of
+    // the requests.
+    bool http2;
   };
 
   static CreateOptions DEFAULT_CREATE_OPTIONS()
@@ -1071,6 +1147,8 @@ public:
     return {
       /* .scheme = */ Scheme::HTTP,
       /* .backlog = */ 16384,
+      /* .listeners = */ 1,
+      /* .http2 = */ false,
     };
   };
 
@@ -1158,10 +1236,11 @@ public:
 
 private:
   Server(
-      network::Socket&& socket,
+      std::vector<network::Socket>&& sockets,
       std::function<Future<Response>(
           const network::Socket&,
-          const Request&)>&& f);
+          const Request&)>&& f,
+      bool enableHttp2);
 
   network::Socket socket;
   Owned<ServerProcess> process;
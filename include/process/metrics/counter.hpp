@@ -13,9 +13,12 @@
 #ifndef __PROCESS_METRICS_COUNTER_HPP__
 #define __PROCESS_METRICS_COUNTER_HPP__
 
+#include <atomic>
 #include <memory>
 #include <string>
 
+#include <process/clock.hpp>
+
 #include <process/metrics/metric.hpp>
 
 namespace process {
@@ -23,6 +26,15 @@ namespace metrics {
 
 // A Metric that represents an integer value that can be incremented and
 // decremented.
+//
+// Counters get bumped on hot paths from many threads at once, so a
+// counter starts out as a single atomic and spreads out over a number
+// of cache line sized stripes once threads contend on it (the value is
+// the sum of all stripes). For the same reason, changes don't get
+// recorded in the history, if any, as they happen; instead the value
+// gets sampled periodically (see `MetricsProcess`) and whenever a
+// snapshot is taken. While the clock is paused every change is
+// still recorded so that tests see a deterministic history.
 class Counter : public Metric
 {
 public:
@@ -33,19 +45,28 @@ public:
     : Metric(name, window),
       data(new Data())
   {
-    push(static_cast<double>(data->value.load()));
+    push(static_cast<double>(data->load()));
   }
 
   ~Counter() override {}
 
   Future<double> value() const override
   {
-    return static_cast<double>(data->value.load());
+    return static_cast<double>(data->load());
   }
 
+  void sample() override
+  {
+    if (!Clock::paused()) {
+      push(static_cast<double>(data->load()));
+    }
+  }
+
+  // NOTE: increments that happen concurrently with a reset might not
+  // get reset.
   void reset()
   {
-    data->value.store(0);
+    data->store(0);
     push(0);
   }
 
@@ -63,17 +84,98 @@ public:
 
   Counter& operator+=(int64_t v)
   {
-    int64_t prev = data->value.fetch_add(v);
-    push(static_cast<double>(prev + v));
+    data->add(v);
+
+    if (Clock::paused()) {
+      push(static_cast<double>(data->load()));
+    }
+
     return *this;
   }
 
 private:
   struct Data
   {
-    explicit Data() : value(0) {}
+    // Number of stripes of a contended counter.
+    static constexpr size_t STRIPES = 16;
+
+    // We align stripes to 64 bytes (x86 cache line size) so that
+    // threads incrementing different stripes don't contend.
+    struct alignas(64) Stripe
+    {
+      Stripe() : value(0) {}
+
+      std::atomic<int64_t> value;
+    };
+
+    explicit Data() : value(0), stripes(nullptr) {}
+
+    ~Data()
+    {
+      delete[] stripes.load();
+    }
+
+    void add(int64_t v)
+    {
+      Stripe* striped = stripes.load(std::memory_order_acquire);
+
+      if (striped == nullptr) {
+        // Uncontended, i.e., the common case for most counters.
+        int64_t current = value.load(std::memory_order_relaxed);
+        if (value.compare_exchange_strong(current, current + v)) {
+          return;
+        }
+
+        Stripe* allocated = new Stripe[STRIPES];
+        if (stripes.compare_exchange_strong(striped, allocated)) {
+          striped = allocated;
+        } else {
+          delete[] allocated;
+        }
+      }
+
+      striped[stripe()].value.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    int64_t load() const
+    {
+      int64_t sum = value.load();
+
+      Stripe* striped = stripes.load(std::memory_order_acquire);
+
+      if (striped != nullptr) {
+        for (size_t i = 0; i < STRIPES; i++) {
+          sum += striped[i].value.load();
+        }
+      }
+
+      return sum;
+    }
+
+    void store(int64_t v)
+    {
+      Stripe* striped = stripes.load(std::memory_order_acquire);
+
+      if (striped != nullptr) {
+        for (size_t i = 0; i < STRIPES; i++) {
+          striped[i].value.store(0);
+        }
+      }
+
+      value.store(v);
+    }
+
+    // The stripe of the calling thread, threads get assigned one in a
+    // round-robin fashion the first time they use any counter.
+    static size_t stripe()
+    {
+      static std::atomic<size_t> next(0);
+      static thread_local size_t index = next.fetch_add(1) % STRIPES;
+      return index;
+    }
 
     std::atomic<int64_t> value;
+    std::atomic<Stripe*> stripes;
   };
 
   std::shared_ptr<Data> data;
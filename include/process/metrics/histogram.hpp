@@ -0,0 +1,287 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __PROCESS_METRICS_HISTOGRAM_HPP__
+#define __PROCESS_METRICS_HISTOGRAM_HPP__
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+#include <stdint.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <process/future.hpp>
+#include <process/statistics.hpp>
+
+#include <process/metrics/metric.hpp>
+
+#include <stout/option.hpp>
+
+namespace process {
+namespace metrics {
+
+// A Metric that represents the distribution of a value (e.g., request
+// latencies), exposed as percentiles in snapshots. Its value is the
+// number of values recorded.
+//
+// Unlike the statistics of a metric with a window, which get computed
+// by sorting the values of the window, a histogram counts the values
+// in fixed log-linear buckets: values below 64 get a bucket each and
+// every power of two above gets split into 32 buckets, which bounds
+// the error of the percentiles to about 3% of the value. Recording a
+// value is O(1), never allocates and only contends with threads that
+// record a value of the same bucket. The percentiles cover all values
+// recorded since the histogram got created (or reset).
+//
+// Histograms can be merged, e.g., to aggregate per-thread histograms.
+class Histogram : public Metric
+{
+public:
+  // 'name' is the unique name for the instance of Histogram being
+  // constructed. This is what will be used as the key in the JSON
+  // endpoint.
+  //
+  // 'resolution' is the smallest difference between values that the
+  // histogram distinguishes, values get rounded down to a multiple of
+  // it (e.g., 0.001 for a histogram of milliseconds to distinguish
+  // microseconds). Negative values get recorded as 0.
+  explicit Histogram(const std::string& name, double resolution = 1.0)
+    : Metric(name, None()),
+      data(new Data(resolution)) {}
+
+  ~Histogram() override {}
+
+  Future<double> value() const override
+  {
+    return static_cast<double>(data->count());
+  }
+
+  Option<Statistics<double>> statistics() const override
+  {
+    std::vector<uint64_t> counts(BUCKETS);
+
+    uint64_t count = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+      counts[i] = data->buckets[i].load(std::memory_order_relaxed);
+      count += counts[i];
+    }
+
+    // Just like `Statistics::from` we need at least 2 values.
+    if (count < 2) {
+      return None();
+    }
+
+    // NOTE: the minimum and maximum might be slightly out of sync with
+    // the counts if values get recorded concurrently.
+    const int64_t min = data->min.load();
+    const int64_t max = std::max(min, data->max.load());
+
+    // Estimates the value of the given percentile as the middle of
+    // the bucket it falls into.
+    auto percentile = [&](double fraction) {
+      const uint64_t rank = static_cast<uint64_t>(fraction * (count - 1));
+
+      uint64_t seen = 0;
+      for (size_t i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+
+        if (seen > rank) {
+          const int64_t middle = lower(i) + (width(i) - 1) / 2;
+          return std::min(std::max(middle, min), max) * data->resolution;
+        }
+      }
+
+      return max * data->resolution;
+    };
+
+    Statistics<double> statistics;
+
+    statistics.count = count;
+
+    statistics.min = min * data->resolution;
+    statistics.max = max * data->resolution;
+
+    statistics.p25 = percentile(0.25);
+    statistics.p50 = percentile(0.5);
+    statistics.p75 = percentile(0.75);
+    statistics.p90 = percentile(0.90);
+    statistics.p95 = percentile(0.95);
+    statistics.p99 = percentile(0.99);
+    statistics.p999 = percentile(0.999);
+    statistics.p9999 = percentile(0.9999);
+
+    return statistics;
+  }
+
+  void record(double value)
+  {
+    int64_t units = 0;
+
+    if (value > 0) {
+      const double scaled = value / data->resolution;
+
+      units = scaled < static_cast<double>(std::numeric_limits<int64_t>::max())
+        ? static_cast<int64_t>(scaled)
+        : std::numeric_limits<int64_t>::max();
+    }
+
+    data->buckets[index(units)].fetch_add(1, std::memory_order_relaxed);
+
+    update(units, units);
+  }
+
+  // Adds the values recorded by 'that' to this histogram. The two
+  // histograms must have the same resolution.
+  void merge(const Histogram& that)
+  {
+    CHECK_EQ(data->resolution, that.data->resolution);
+
+    for (size_t i = 0; i < BUCKETS; i++) {
+      const uint64_t count =
+        that.data->buckets[i].load(std::memory_order_relaxed);
+
+      if (count > 0) {
+        data->buckets[i].fetch_add(count, std::memory_order_relaxed);
+      }
+    }
+
+    update(that.data->min.load(), that.data->max.load());
+  }
+
+  // NOTE: values that get recorded concurrently with a reset might
+  // not get reset.
+  void reset()
+  {
+    for (size_t i = 0; i < BUCKETS; i++) {
+      data->buckets[i].store(0);
+    }
+
+    data->min.store(std::numeric_limits<int64_t>::max());
+    data->max.store(0);
+  }
+
+private:
+  // Number of bits of the buckets a power of two gets split into.
+  static constexpr int SUB_BITS = 5;
+  static constexpr int64_t SUB_BUCKETS = int64_t(1) << SUB_BITS;
+
+  // Values below `2 * SUB_BUCKETS` get a bucket each, followed by
+  // `SUB_BUCKETS` buckets for each power of two up to 2^62.
+  static constexpr size_t BUCKETS =
+    (62 - SUB_BITS) * SUB_BUCKETS + 2 * SUB_BUCKETS;
+
+  static size_t index(int64_t value)
+  {
+    if (value < 2 * SUB_BUCKETS) {
+      return static_cast<size_t>(value);
+    }
+
+    const int shift = highest(static_cast<uint64_t>(value)) - SUB_BITS;
+
+    return static_cast<size_t>(
+        (static_cast<int64_t>(shift) << SUB_BITS) + (value >> shift));
+  }
+
+  // Returns the smallest value of the bucket at 'index'.
+  static int64_t lower(size_t index)
+  {
+    if (index < 2 * SUB_BUCKETS) {
+      return static_cast<int64_t>(index);
+    }
+
+    const int shift = static_cast<int>(index >> SUB_BITS) - 1;
+
+    return (static_cast<int64_t>(index) - (int64_t(shift) << SUB_BITS))
+      << shift;
+  }
+
+  // Returns the number of values of the bucket at 'index'.
+  static int64_t width(size_t index)
+  {
+    if (index < 2 * SUB_BUCKETS) {
+      return 1;
+    }
+
+    return int64_t(1) << ((index >> SUB_BITS) - 1);
+  }
+
+  // Returns the index of the highest set bit of 'bits'.
+  static int highest(uint64_t bits)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(bits);
+#endif // _MSC_VER
+  }
+
+  // Updates the minimum and maximum, which only needs an atomic
+  // operation if they change.
+  void update(int64_t min, int64_t max)
+  {
+    int64_t current = data->min.load(std::memory_order_relaxed);
+    while (min < current && !data->min.compare_exchange_weak(current, min)) {}
+
+    current = data->max.load(std::memory_order_relaxed);
+    while (max > current && !data->max.compare_exchange_weak(current, max)) {}
+  }
+
+  struct Data
+  {
+    explicit Data(double _resolution)
+      : resolution(_resolution),
+        buckets(new std::atomic<uint64_t>[BUCKETS]),
+        min(std::numeric_limits<int64_t>::max()),
+        max(0)
+    {
+      CHECK_GT(resolution, 0);
+
+      for (size_t i = 0; i < BUCKETS; i++) {
+        buckets[i].store(0);
+      }
+    }
+
+    uint64_t count() const
+    {
+      uint64_t count = 0;
+      for (size_t i = 0; i < BUCKETS; i++) {
+        count += buckets[i].load(std::memory_order_relaxed);
+      }
+      return count;
+    }
+
+    const double resolution;
+
+    const std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+
+    std::atomic<int64_t> min;
+    std::atomic<int64_t> max;
+  };
+
+  std::shared_ptr<Data> data;
+};
+
+} // namespace metrics {
+} // namespace process {
+
+#endif // __PROCESS_METRICS_HISTOGRAM_HPP__
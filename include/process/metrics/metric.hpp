@@ -41,7 +41,18 @@ public:
     return data->name;
   }
 
-  Option<Statistics<double>> statistics() const
+  // Records the current value in the history, if any, for metrics
+  // that don't do so whenever their value changes (see `Counter`).
+  virtual void sample() {}
+
+  // Whether this metric keeps a history of its values, i.e., it was
+  // created with a window.
+  bool windowed() const
+  {
+    return data->history.isSome();
+  }
+
+  virtual Option<Statistics<double>> statistics() const
   {
     Option<Statistics<double>> statistics = None();
 
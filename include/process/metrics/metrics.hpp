@@ -50,6 +50,10 @@ protected:
 private:
   static std::string help();
 
+  // Samples the windowed metrics (see `Metric::sample`) and schedules
+  // the next sampling a second later.
+  void sample();
+
   MetricsProcess(
       const Option<Owned<RateLimiter>>& _limiter,
       const Option<std::string>& _authenticationRealm)
@@ -77,6 +81,10 @@ private:
   // The Owned<Metric> is an explicit copy of the Metric passed to 'add'.
   std::map<std::string, Owned<Metric>> metrics;
 
+  // The subset of 'metrics' that keep a history, which are the only
+  // ones that need to get sampled.
+  std::map<std::string, Owned<Metric>> windowed;
+
   // Used to rate limit the snapshot endpoint.
   Option<Owned<RateLimiter>> limiter;
 
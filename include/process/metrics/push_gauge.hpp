@@ -48,8 +48,12 @@ public:
   // The user of `Gauge` must ensure that `f` is safe to execute up until
   // the removal of the `Gauge` (via `process::metrics::remove(...)`) is
   // complete.
-  explicit PushGauge(const std::string& name)
-    : Metric(name, None()), data(new Data()) {}
+  //
+  // 'window' is the amount of history to keep for this Metric.
+  explicit PushGauge(
+      const std::string& name,
+      const Option<Duration>& window = None())
+    : Metric(name, window), data(new Data()) {}
 
   ~PushGauge() override {}
 
@@ -20,6 +20,7 @@
 #include <process/clock.hpp>
 #include <process/future.hpp>
 
+#include <process/metrics/histogram.hpp>
 #include <process/metrics/metric.hpp>
 
 #include <stout/duration.hpp>
@@ -42,6 +43,19 @@ public:
     : Metric(name + "_" + T::units(), window),
       data(new Data()) {}
 
+  // Like above, but also records every timed event in 'histogram'
+  // (in the unit of the Timer), which is a metric in its own right
+  // and needs to be added separately.
+  Timer(
+      const std::string& name,
+      const Histogram& histogram,
+      const Option<Duration>& window = None())
+    : Metric(name + "_" + T::units(), window),
+      data(new Data())
+  {
+    data->histogram = histogram;
+  }
+
   Future<double> value() const override
   {
     Future<double> value;
@@ -84,6 +98,10 @@ public:
 
     push(value);
 
+    if (data->histogram.isSome()) {
+      data->histogram->record(value);
+    }
+
     return t;
   }
 
@@ -105,6 +123,9 @@ private:
     std::atomic_flag lock = ATOMIC_FLAG_INIT;
     Time start;
     Option<double> lastValue;
+
+    // Only set on construction.
+    Option<Histogram> histogram;
   };
 
   static void _time(Time start, Timer that)
@@ -119,6 +140,10 @@ private:
     }
 
     that.push(value);
+
+    if (that.data->histogram.isSome()) {
+      that.data->histogram->record(value);
+    }
   }
 
   std::shared_ptr<Data> data;
@@ -15,7 +15,9 @@
 
 #include <stdint.h>
 
+#include <functional>
 #include <iosfwd>
+#include <memory>
 #include <string>
 
 #include <boost/functional/hash.hpp>
@@ -108,6 +110,10 @@ struct UPID
 
   // A copy-on-write string for performance.
   //
+  // The hash of the string is computed once when the ID is set so
+  // that looking up a process by its ID (see `ProcessManager::use`)
+  // does not need to rehash the string every time.
+  //
   // TODO(benh): Factor this out into a generic copy-on-write string.
   struct ID
   {
@@ -116,17 +122,29 @@ struct UPID
     ID() = default;
 
     ID(const std::string& s)
-      : id(std::make_shared<std::string>(s)) {}
+      : id(std::make_shared<std::string>(s)),
+        hash_(std::hash<std::string>()(*id)) {}
 
     ID(std::string&& s)
-      : id(std::make_shared<std::string>(std::move(s))) {}
+      : id(std::make_shared<std::string>(std::move(s))),
+        hash_(std::hash<std::string>()(*id)) {}
 
     ID& operator=(std::string&& that)
     {
       id = std::make_shared<std::string>(std::move(that));
+      hash_ = std::hash<std::string>()(*id);
       return *this;
     }
 
+    // Returns `std::hash<std::string>` of the ID.
+    size_t hash() const
+    {
+      if (!id) {
+        return std::hash<std::string>()(EMPTY);
+      }
+      return hash_;
+    }
+
     bool operator==(const std::string& that) const
     {
       if (!id) {
@@ -166,6 +184,7 @@ struct UPID
 
   private:
     std::shared_ptr<std::string> id;
+    size_t hash_ = 0;
   } id;
 
   // TODO(asridharan): Ideally, the following `address` field should be of
@@ -332,7 +351,7 @@ struct hash<process::UPID>
   result_type operator()(const argument_type& upid) const
   {
     size_t seed = 0;
-    boost::hash_combine(seed, (const std::string&) upid.id);
+    boost::hash_combine(seed, upid.id.hash());
     boost::hash_combine(seed, std::hash<net::IP>()(upid.address.ip));
     boost::hash_combine(seed, upid.address.port);
     return seed;
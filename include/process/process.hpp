@@ -44,6 +44,8 @@ namespace process {
 class EventQueue;
 class Gate;
 class Logging;
+class PinnedThread;
+struct RunQueueTicket;
 class Sequence;
 
 namespace firewall {
@@ -78,6 +80,18 @@ public:
 
   const UPID& self() const { return pid; }
 
+  /**
+   * Pins this process to a thread of its own so that it does not get
+   * run on (and does not move between) the worker threads shared by
+   * all other processes. This is useful for "hot" processes which
+   * benefit from keeping their state in the caches of the CPU that
+   * their thread is running on.
+   *
+   * **NOTE**: must be invoked before the process is spawned. The
+   * thread exits once the process has terminated.
+   */
+  void pin();
+
 protected:
   /**
    * Invoked when an event is serviced.
@@ -397,6 +411,7 @@ protected:
 private:
   friend class SocketManager;
   friend class ProcessManager;
+  friend class RunQueue;
   friend void* schedule(void*);
 
   // Process states.
@@ -491,6 +506,17 @@ private:
 
   std::shared_ptr<Gate> gate;
 
+  // Set if this process has been pinned to its own thread, see `pin()`.
+  std::shared_ptr<PinnedThread> pinned;
+
+  // Index of the worker thread that last ran this process, or -1 if
+  // unknown. Only tracked when process affinity is enabled.
+  std::atomic<long> worker = ATOMIC_VAR_INIT(-1L);
+
+  // Set while this process is enqueued on the lock-free run queue so
+  // that it can be extracted, see `RunQueue::extract`.
+  std::atomic<RunQueueTicket*> ticket = ATOMIC_VAR_INIT(nullptr);
+
   // Whether or not the runtime should delete this process after it
   // has terminated. Note that failure to spawn the process will leave
   // the process unmanaged and thus it may leak!
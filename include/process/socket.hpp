@@ -19,6 +19,8 @@
 #endif // __WINDOWS__
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <process/address.hpp>
 #include <process/future.hpp>
@@ -27,7 +29,9 @@
 
 #include <stout/abort.hpp>
 #include <stout/error.hpp>
+#include <stout/none.hpp>
 #include <stout/nothing.hpp>
+#include <stout/option.hpp>
 #include <stout/try.hpp>
 #include <stout/unreachable.hpp>
 #ifdef __WINDOWS__
@@ -164,6 +168,49 @@ public:
   virtual Future<size_t> send(const char* data, size_t size) = 0;
   virtual Future<size_t> sendfile(int_fd fd, off_t offset, size_t size) = 0;
 
+  /**
+   * Returns a future that becomes ready once there is data (or EOF)
+   * to receive, i.e., once `recv` shouldn't have to wait. This lets
+   * callers hold off on allocating a buffer to receive into until
+   * there is something to receive, which matters when there are many
+   * idle connections. The default implementation is ready right away.
+   */
+  virtual Future<Nothing> readable();
+
+  /**
+   * Receives the data that is available right away, if any, without
+   * waiting. Returns `None` if `recv` would have to wait, in which
+   * case callers can wait until the socket is `readable`. Returns 0
+   * on EOF just like `recv`. The default implementation always
+   * returns `None`.
+   */
+  virtual Try<Option<size_t>> try_recv(char* data, size_t size);
+
+  /**
+   * A contiguous range of data to send, see the vectored `send`.
+   */
+  struct Buffer
+  {
+    const char* data;
+    size_t size;
+  };
+
+  /**
+   * A vectored overload of `send`, which sends the data of as many of
+   * the specified buffers as possible, in order, as if they were one
+   * contiguous range of data. Implementations that support it do so
+   * with a single system call (e.g., `sendmsg`), the default
+   * implementation only sends (some of) the first buffer.
+   *
+   * @param buffers The specified (non-empty) buffers to send. The
+   *     data of the buffers must stay valid until the returned future
+   *     has completed but the vector itself need not.
+   *
+   * @return The number of bytes sent or an error in case the sending
+   *     fails.
+   */
+  virtual Future<size_t> send(const std::vector<Buffer>& buffers);
+
   /**
    * An overload of `recv`, which receives data based on the specified
    * 'size' parameter.
@@ -209,6 +256,26 @@ public:
 
   virtual Kind kind() const = 0;
 
+  /**
+   * Sets the application protocols to negotiate with ALPN (e.g., "h2"
+   * and "http/1.1"), in order of preference. A client offers them when
+   * connecting, a listening socket picks the first of them that the
+   * client offers for every connection it accepts. Must be called
+   * before connecting or listening. Only sockets that do TLS support
+   * ALPN, the default implementation ignores the protocols.
+   */
+  virtual void setApplicationProtocols(
+      const std::vector<std::string>& protocols) {}
+
+  /**
+   * Returns the application protocol negotiated with ALPN once the
+   * socket is connected (or accepted), if any.
+   */
+  virtual Option<std::string> applicationProtocol() const
+  {
+    return None();
+  }
+
 protected:
   explicit SocketImpl(int_fd _s) : s(_s) { CHECK(s >= 0); }
 
@@ -391,6 +458,16 @@ public:
     return impl->recv(data, size);
   }
 
+  Future<Nothing> readable() const
+  {
+    return impl->readable();
+  }
+
+  Try<Option<size_t>> try_recv(char* data, size_t size) const
+  {
+    return impl->try_recv(data, size);
+  }
+
   Future<size_t> send(const char* data, size_t size) const
   {
     return impl->send(data, size);
@@ -401,6 +478,11 @@ public:
     return impl->sendfile(fd, offset, size);
   }
 
+  Future<size_t> send(const std::vector<SocketImpl::Buffer>& buffers) const
+  {
+    return impl->send(buffers);
+  }
+
   Future<std::string> recv(const Option<ssize_t>& size = None())
   {
     return impl->recv(size);
@@ -411,6 +493,16 @@ public:
     return impl->send(data);
   }
 
+  void setApplicationProtocols(const std::vector<std::string>& protocols)
+  {
+    impl->setApplicationProtocols(protocols);
+  }
+
+  Option<std::string> applicationProtocol() const
+  {
+    return impl->applicationProtocol();
+  }
+
   enum class Shutdown
   {
     READ,
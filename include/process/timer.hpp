@@ -16,6 +16,9 @@
 #include <stdint.h>
 #include <stdlib.h> // For abort.
 
+#include <atomic>
+#include <memory>
+
 #include <process/pid.hpp>
 #include <process/timeout.hpp>
 
@@ -64,7 +67,11 @@ private:
         const Timeout& _t,
         const process::UPID& _pid,
         const lambda::function<void()>& _thunk)
-    : id(_id), t(_t), pid(_pid), thunk(_thunk)
+    : id(_id),
+      t(_t),
+      pid(_pid),
+      thunk(_thunk),
+      pending(std::make_shared<std::atomic_bool>(true))
   {}
 
   uint64_t id; // Used for equality.
@@ -79,6 +86,11 @@ private:
   process::UPID pid;
 
   lambda::function<void()> thunk;
+
+  // Whether the timer has neither expired nor been canceled yet. This
+  // is shared by all copies of the timer so that canceling a timer
+  // doesn't need to find it among the pending timers.
+  std::shared_ptr<std::atomic_bool> pending;
 };
 
 } // namespace process {
@@ -0,0 +1,250 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __PROCESS_BUFFER_POOL_HPP__
+#define __PROCESS_BUFFER_POOL_HPP__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include <process/future.hpp>
+#include <process/socket.hpp>
+
+#include <stout/option.hpp>
+#include <stout/synchronized.hpp>
+#include <stout/try.hpp>
+
+namespace process {
+
+// A pool of the buffers that sockets (and files) receive data into.
+//
+// Most connections are idle most of the time so rather than owning a
+// receive buffer for as long as they're open the receive loops only
+// borrow a buffer while there is data to receive (see `recv`) and
+// give it back once they've handled the data. That bounds the number
+// of buffers by the number of connections that are receiving at once
+// rather than the number of open connections.
+//
+// Like the `MemoryPool` every thread caches the buffers it gives back
+// and moves them to (or takes them from) a global depot in batches,
+// so borrowing a buffer usually doesn't need any synchronization.
+class BufferPool
+{
+public:
+  // Size of every buffer.
+  static constexpr size_t SIZE = 80 * 1024;
+
+  static char* acquire()
+  {
+    statistics().borrowed.fetch_add(1, std::memory_order_relaxed);
+
+    Cache* cache = local();
+
+    if (cache != nullptr) {
+      if (cache->count == 0) {
+        depot()->take(cache);
+      }
+
+      if (cache->count > 0) {
+        return cache->buffers[--cache->count];
+      }
+    }
+
+    statistics().allocated.fetch_add(1, std::memory_order_relaxed);
+    return new char[SIZE];
+  }
+
+  static void release(char* buffer)
+  {
+    if (buffer == nullptr) {
+      return;
+    }
+
+    statistics().borrowed.fetch_sub(1, std::memory_order_relaxed);
+
+    Cache* cache = local();
+
+    if (cache == nullptr) {
+      deallocate(buffer);
+      return;
+    }
+
+    if (cache->count == LOCAL_LIMIT) {
+      depot()->put(cache, BATCH_SIZE);
+    }
+
+    cache->buffers[cache->count++] = buffer;
+  }
+
+  // Receives from the `socket` into a borrowed buffer which gets
+  // stored in `*buffer`; the caller gives it back once it's done with
+  // the data or the receive failed. We first try to receive without
+  // waiting since a busy connection usually has data buffered, and
+  // only give the buffer back and wait for the socket to become
+  // readable when it doesn't.
+  static Future<size_t> recv(
+      const network::Socket& socket,
+      char** buffer,
+      size_t size = SIZE)
+  {
+    *buffer = acquire();
+
+    Try<Option<size_t>> length = socket.try_recv(*buffer, size);
+
+    if (length.isError()) {
+      return Failure(length.error());
+    } else if (length->isSome()) {
+      return length->get();
+    }
+
+    release(*buffer);
+    *buffer = nullptr;
+
+    return socket.readable()
+      .then([=]() {
+        *buffer = acquire();
+        return socket.recv(*buffer, size);
+      });
+  }
+
+  // Number of buffers currently borrowed.
+  static size_t borrowed()
+  {
+    return statistics().borrowed.load(std::memory_order_relaxed);
+  }
+
+  // Number of buffers allocated, i.e., borrowed or cached.
+  static size_t allocated()
+  {
+    return statistics().allocated.load(std::memory_order_relaxed);
+  }
+
+private:
+  // Maximum number of buffers a thread caches, and the number of
+  // buffers moved to or from the depot at once.
+  static constexpr size_t LOCAL_LIMIT = 16;
+  static constexpr size_t BATCH_SIZE = 8;
+
+  // Maximum number of buffers the depot keeps, any more get freed.
+  static constexpr size_t DEPOT_LIMIT = 256;
+
+  static_assert(BATCH_SIZE <= LOCAL_LIMIT, "Invalid BATCH_SIZE");
+
+  struct Statistics
+  {
+    std::atomic<size_t> allocated{0};
+    std::atomic<size_t> borrowed{0};
+  };
+
+  struct Cache
+  {
+    ~Cache()
+    {
+      // Hand off what we've cached so other threads can use it. Any
+      // buffers given back on this thread from now on (e.g., from
+      // other thread local destructors) get freed.
+      while (count > 0) {
+        depot()->put(
+            this,
+            std::min(count, static_cast<size_t>(BATCH_SIZE)));
+      }
+
+      destroyed() = true;
+    }
+
+    std::array<char*, LOCAL_LIMIT> buffers;
+    size_t count = 0;
+  };
+
+  class Depot
+  {
+  public:
+    // Moves up to a batch of buffers into the (empty) `cache`.
+    void take(Cache* cache)
+    {
+      synchronized (mutex) {
+        while (!buffers.empty() && cache->count < BATCH_SIZE) {
+          cache->buffers[cache->count++] = buffers.back();
+          buffers.pop_back();
+        }
+      }
+    }
+
+    // Moves `count` buffers out of the `cache`, keeping them or
+    // freeing them if the depot is full.
+    void put(Cache* cache, size_t count)
+    {
+      synchronized (mutex) {
+        while (count > 0 && buffers.size() < DEPOT_LIMIT) {
+          buffers.push_back(cache->buffers[--cache->count]);
+          count--;
+        }
+      }
+
+      while (count > 0) {
+        deallocate(cache->buffers[--cache->count]);
+        count--;
+      }
+    }
+
+  private:
+    std::mutex mutex;
+    std::vector<char*> buffers;
+  };
+
+  static void deallocate(char* buffer)
+  {
+    delete[] buffer;
+    statistics().allocated.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // NOTE: the statistics and the depot get intentionally leaked so
+  // that they outlive any thread that might still use them during
+  // process exit.
+  static Statistics& statistics()
+  {
+    static Statistics* statistics = new Statistics();
+    return *statistics;
+  }
+
+  static Depot* depot()
+  {
+    static Depot* depot = new Depot();
+    return depot;
+  }
+
+  static bool& destroyed()
+  {
+    static thread_local bool destroyed = false;
+    return destroyed;
+  }
+
+  // Returns this thread's cache or `nullptr` if it has already been
+  // destroyed because this thread is exiting.
+  static Cache* local()
+  {
+    if (destroyed()) {
+      return nullptr;
+    }
+
+    static thread_local Cache cache;
+    return &cache;
+  }
+};
+
+} // namespace process {
+
+#endif // __PROCESS_BUFFER_POOL_HPP__
@@ -12,10 +12,15 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
+#include <vector>
 
 #include <process/clock.hpp>
 #include <process/pid.hpp>
@@ -31,18 +36,19 @@
 #include <stout/unreachable.hpp>
 
 #include "event_loop.hpp"
+#include "timer_wheel.hpp"
 
 using std::list;
 using std::map;
 using std::recursive_mutex;
 using std::set;
+using std::vector;
 
 namespace process {
 
-// We store the timers in a map of lists indexed by the timeout of the
-// timer so that we can have two timers that have the same timeout. We
-// exploit that the map is SORTED!
-static map<Time, list<Timer>>* timers = new map<Time, list<Timer>>();
+// The pending timers, see `TimerWheel`, and the mutex that protects
+// them as well as the clock related variables below.
+static TimerWheel* timers = new TimerWheel();
 static recursive_mutex* timers_mutex = new recursive_mutex();
 
 
@@ -59,7 +65,10 @@ Time* current = new Time(Time::epoch());
 
 Duration* advanced = new Duration(Duration::zero());
 
-bool paused = false;
+// NOTE: this is only modified while holding `timers_mutex` but it is
+// atomic so that `Clock::now` and `Clock::timer` can check it without
+// taking the lock.
+std::atomic_bool paused(false);
 
 // For supporting Clock::settled(), false if we're not currently
 // settling (or we're not paused), true if we're currently attempting
@@ -76,33 +85,138 @@ lambda::function<void(const list<Timer>&)>* callback =
 // scheduled 'ticks'.
 set<Time>* ticks = new set<Time>();
 
+// The earliest of the scheduled 'ticks' (in nanoseconds since the
+// epoch), or the maximum if none is scheduled or a 'tick' is running,
+// which lets `Clock::timer` tell without taking `timers_mutex` whether
+// a 'tick' will add a new timer to 'timers' in time.
+std::atomic<int64_t> scheduled(std::numeric_limits<int64_t>::max());
 
-// Helper for determining the time when the next timer elapses,
-// or None if no timers are pending, or the clock is paused and no
-// timers are expired. Note that we don't manipulate 'timers' directly
-// so that it's clear from the callsite that the use of 'timers' is
-// within a 'synchronized' block.
-//
-// TODO(benh): Create a generic 'Timers' abstraction which hides this
-// and more away (i.e., all manipulations of 'timers' below).
-Option<Time> next(const map<Time, list<Timer>>& timers)
+
+// Timers get created on all threads, so rather than adding them to
+// 'timers' right away (which needs `timers_mutex`) each thread appends
+// them to a buffer of its own, and the buffers get drained whenever
+// 'timers' get used (e.g., by every 'tick').
+struct Buffer
 {
-  if (!timers.empty()) {
-    Time first = timers.begin()->first;
-
-    // If the clock is paused and no timers are expired, the
-    // timers cannot fire until the clock is advanced, so we
-    // return None() here. Note that we pass nullptr to ensure
-    // that this looks at the global clock, since this can be
-    // called from a Process context through Clock::timer.
-    if (Clock::paused() && first > Clock::now(nullptr)) {
-      return None();
+  std::mutex mutex;
+  vector<TimerWheel::Entry*> entries;
+};
+
+
+// Maximum number of timers a thread buffers before adding them (and
+// all other buffered timers) to 'timers' itself.
+constexpr size_t BUFFER_LIMIT = 1024;
+
+
+// The buffers of all threads, the first of which takes over the timers
+// of the threads that have exited.
+std::mutex* buffers_mutex = new std::mutex();
+vector<Buffer*>* buffers = new vector<Buffer*>({new Buffer()});
+
+
+// The buffer of a thread, which gets registered on first use and hands
+// its timers over when the thread exits.
+struct LocalBuffer
+{
+  LocalBuffer()
+  {
+    synchronized (buffers_mutex) {
+      buffers->push_back(&buffer);
     }
+  }
 
-    return first;
+  ~LocalBuffer()
+  {
+    synchronized (buffers_mutex) {
+      buffers->erase(std::find(buffers->begin(), buffers->end(), &buffer));
+
+      Buffer* orphans = buffers->front();
+
+      synchronized (orphans->mutex) {
+        synchronized (buffer.mutex) {
+          orphans->entries.insert(
+              orphans->entries.end(),
+              buffer.entries.begin(),
+              buffer.entries.end());
+        }
+      }
+    }
   }
 
-  return None();
+  Buffer buffer;
+};
+
+
+Buffer* local()
+{
+  static thread_local LocalBuffer buffer;
+  return &buffer.buffer;
+}
+
+
+// Adds the buffered timers to 'timers'. Note that we don't manipulate
+// 'timers' directly so that it's clear from the callsite that this
+// needs to be called within a 'synchronized' block.
+void drain(TimerWheel* timers)
+{
+  vector<TimerWheel::Entry*> entries;
+
+  synchronized (buffers_mutex) {
+    foreach (Buffer* buffer, *buffers) {
+      synchronized (buffer->mutex) {
+        if (entries.empty()) {
+          entries.swap(buffer->entries);
+        } else {
+          entries.insert(
+              entries.end(),
+              buffer->entries.begin(),
+              buffer->entries.end());
+
+          buffer->entries.clear();
+        }
+      }
+    }
+  }
+
+  if (entries.empty()) {
+    return;
+  }
+
+  // Catch up an empty wheel with the current time first so that the
+  // new timers don't all end up at its cursor (see `TimerWheel`).
+  if (timers->size() == 0) {
+    list<Timer> expired;
+    timers->advance(Clock::now(nullptr), &expired);
+    CHECK(expired.empty());
+  }
+
+  foreach (TimerWheel::Entry* entry, entries) {
+    timers->insert(entry);
+  }
+
+  timers->compact();
+}
+
+
+// Helper for determining the time when the next timer elapses (see
+// `TimerWheel::next`), or None if no timers are pending, or the clock
+// is paused and no timers are expired. Note that we don't manipulate
+// 'timers' directly so that it's clear from the callsite that the use
+// of 'timers' is within a 'synchronized' block.
+Option<Time> next(TimerWheel* timers)
+{
+  Option<Time> first = timers->next();
+
+  // If the clock is paused and no timers are expired, the timers
+  // cannot fire until the clock is advanced, so we return None()
+  // here. Note that we pass nullptr to ensure that this looks at
+  // the global clock, since this can be called from a Process
+  // context through Clock::timer.
+  if (first.isSome() && Clock::paused() && first.get() > Clock::now(nullptr)) {
+    return None();
+  }
+
+  return first;
 }
 
 
@@ -116,8 +230,10 @@ void tick(const Time& time);
 // a 'synchronized' block.
 // TODO(bmahler): Consider taking an optional 'now' to avoid
 // excessive syscalls via Clock::now(nullptr).
-void scheduleTick(const map<Time, list<Timer>>& timers, set<Time>* ticks)
+void scheduleTick(TimerWheel* timers, set<Time>* ticks)
 {
+  drain(timers);
+
   // Determine when the next 'tick' should fire.
   const Option<Time> next = clock::next(timers);
 
@@ -133,6 +249,11 @@ void scheduleTick(const map<Time, list<Timer>>& timers, set<Time>* ticks)
       EventLoop::delay(delay, lambda::bind(tick, next.get()));
     }
   }
+
+  scheduled.store(
+      ticks->empty()
+        ? std::numeric_limits<int64_t>::max()
+        : ticks->begin()->duration().ns());
 }
 
 
@@ -151,36 +272,29 @@ void tick(const Time& time)
 
     VLOG(3) << "Handling timers up to " << now;
 
-    foreachkey (const Time& timeout, *timers) {
-      if (timeout > now) {
-        break;
-      }
-
-      VLOG(3) << "Have timeout(s) at " << timeout;
-
-      // Need to toggle 'settling' so that we don't prematurely say
-      // we're settled until after the timers are executed below,
-      // outside of the critical section.
-      if (clock::paused) {
-        clock::settling = true;
-      }
-
-      timedout.splice(timedout.end(), (*timers)[timeout]);
-    }
-
-    // Now erase the range of timers that timed out.
-    timers->erase(timers->begin(), timers->upper_bound(now));
-
-    // Okay, so the timeout for the next timer should not have fired.
-    CHECK(timers->empty() || (timers->begin()->first > now));
-
     // Remove this tick from the scheduled 'ticks', it may have
     // been removed already if the clock was paused / manipulated
     // in the interim.
     ticks->erase(time);
 
+    // Any timer that gets buffered after we've drained the buffers
+    // below must not count on this 'tick' (see `Clock::timer`).
+    scheduled.store(std::numeric_limits<int64_t>::max());
+
+    drain(timers);
+
+    timers->advance(now, &timedout);
+
+    // Need to toggle 'settling' so that we don't prematurely say
+    // we're settled until after the timers are executed below,
+    // outside of the critical section.
+    if (!timedout.empty() && clock::paused) {
+      VLOG(3) << "Have " << timedout.size() << " timeout(s)";
+      clock::settling = true;
+    }
+
     // Schedule another "tick" if necessary.
-    scheduleTick(*timers, ticks);
+    scheduleTick(timers, ticks);
   }
 
   (*clock::callback)(timedout);
@@ -191,11 +305,13 @@ void tick(const Time& time)
   // that will expire before the paused time and we've finished
   // executing expired timers.
   synchronized (timers_mutex) {
-    if (clock::paused &&
-        (timers->size() == 0 ||
-         timers->begin()->first > *clock::current)) {
-      VLOG(3) << "Clock has settled";
-      clock::settling = false;
+    if (clock::paused) {
+      Option<Time> next = timers->next();
+
+      if (next.isNone() || next.get() > *clock::current) {
+        VLOG(3) << "Clock has settled";
+        clock::settling = false;
+      }
     }
   }
 }
@@ -221,7 +337,8 @@ void Clock::finalize()
     // This, along with the `timers_mutex`, is all that is required to clean
     // up any pending timers.  Timers are triggered via "ticks".  However,
     // we do not need to clear `ticks` because a "tick" with an empty `timers`
-    // map will effectively be a no-op.
+    // wheel will effectively be a no-op.
+    clock::drain(timers);
     timers->clear();
   }
 }
@@ -235,16 +352,18 @@ Time Clock::now()
 
 Time Clock::now(ProcessBase* process)
 {
-  synchronized (timers_mutex) {
-    if (Clock::paused()) {
-      if (process != nullptr) {
-        if (clock::currents->count(process) != 0) {
-          return (*clock::currents)[process];
+  if (Clock::paused()) {
+    synchronized (timers_mutex) {
+      if (Clock::paused()) {
+        if (process != nullptr) {
+          if (clock::currents->count(process) != 0) {
+            return (*clock::currents)[process];
+          } else {
+            return (*clock::currents)[process] = *clock::initial;
+          }
         } else {
-          return (*clock::currents)[process] = *clock::initial;
+          return *clock::current;
         }
-      } else {
-        return *clock::current;
       }
     }
   }
@@ -265,6 +384,15 @@ Time Clock::now(ProcessBase* process)
 Timer Clock::timer(
     const Duration& duration,
     const lambda::function<void()>& thunk)
+{
+  return timer(duration, Duration::zero(), thunk);
+}
+
+
+Timer Clock::timer(
+    const Duration& duration,
+    const Duration& slack,
+    const lambda::function<void()>& thunk)
 {
   // Start at 1 since Timer() instances use id 0.
   static std::atomic<uint64_t> id(1);
@@ -272,6 +400,27 @@ Timer Clock::timer(
   // Assumes Clock::now() does Clock::now(__process__).
   Timeout timeout = Timeout::in(duration);
 
+  // Round the timeout up into a bucket of (at most) 'slack' so that
+  // timers that elapse at about the same time get handled by the
+  // same 'tick'. We don't round while the clock is paused so that
+  // tests can advance the clock exactly to a timeout.
+  if (slack > Duration::zero() &&
+      !Clock::paused() &&
+      timeout.time() != Time::max()) {
+    int64_t bucket = 1;
+    while (bucket <= slack.ns() / 2) {
+      bucket *= 2;
+    }
+
+    const int64_t ns = timeout.time().duration().ns();
+    const int64_t remainder = ns % bucket;
+
+    if (remainder != 0 &&
+        ns <= std::numeric_limits<int64_t>::max() - bucket) {
+      timeout = Timeout(timeout.time() + Nanoseconds(bucket - remainder));
+    }
+  }
+
   UPID pid = __process__ != nullptr ? __process__->self() : UPID();
 
   Timer timer(id.fetch_add(1), timeout, pid, thunk);
@@ -279,20 +428,40 @@ Timer Clock::timer(
   VLOG(3) << "Created a timer for " << pid << " in " << stringify(duration)
           << " in the future (" << timeout.time() << ")";
 
-  // Add the timer.
-  synchronized (timers_mutex) {
-    if (timers->size() == 0 ||
-        timer.timeout().time() < timers->begin()->first) {
-      // Need to interrupt the loop to update/set timer repeat.
-      (*timers)[timer.timeout().time()].push_back(timer);
+  TimerWheel::Entry* entry =
+    new TimerWheel::Entry(timer, timer.pending, timer.id);
 
-      // Schedule another "tick" if necessary.
-      clock::scheduleTick(*timers, clock::ticks);
-    } else {
-      // Timer repeat is adequate, just add the timeout.
-      CHECK(timers->size() >= 1);
-      (*timers)[timer.timeout().time()].push_back(timer);
+  // Buffer the timer unless the clock is paused (in which case the
+  // 'ticks' don't follow the timers). If a 'tick' is scheduled to
+  // fire no later than the timer it adds the timer to 'timers' in
+  // time, otherwise we need to add it (and schedule a 'tick') now.
+  if (!Clock::paused()) {
+    clock::Buffer* buffer = clock::local();
+
+    bool full = false;
+
+    synchronized (buffer->mutex) {
+      buffer->entries.push_back(entry);
+      full = buffer->entries.size() >= clock::BUFFER_LIMIT;
     }
+
+    if (!full &&
+        timer.timeout().time().duration().ns() >= clock::scheduled.load()) {
+      return timer;
+    }
+
+    synchronized (timers_mutex) {
+      clock::scheduleTick(timers, clock::ticks);
+    }
+
+    return timer;
+  }
+
+  synchronized (timers_mutex) {
+    timers->insert(entry);
+
+    // Schedule another "tick" if necessary.
+    clock::scheduleTick(timers, clock::ticks);
   }
 
   return timer;
@@ -301,22 +470,20 @@ Timer Clock::timer(
 
 bool Clock::cancel(const Timer& timer)
 {
-  bool canceled = false;
-  synchronized (timers_mutex) {
-    // Check if the timeout is still pending, and if so, erase it. In
-    // addition, erase an empty list if we just removed the last
-    // timeout.
-    Time time = timer.timeout().time();
-    if (timers->count(time) > 0) {
-      canceled = true;
-      (*timers)[time].remove(timer);
-      if ((*timers)[time].empty()) {
-        timers->erase(time);
-      }
-    }
+  // A timer that is pending is somewhere in 'timers' (or buffered),
+  // we only flag it as canceled and the wheel deletes it later.
+  if (timer.pending == nullptr) {
+    return false;
+  }
+
+  bool pending = true;
+
+  if (timer.pending->compare_exchange_strong(pending, false)) {
+    timers->canceled();
+    return true;
   }
 
-  return canceled;
+  return false;
 }
 
 
@@ -337,6 +504,7 @@ void Clock::pause()
       // that fire immediately will be scheduled while the clock
       // is paused.
       clock::ticks->clear();
+      clock::scheduled.store(std::numeric_limits<int64_t>::max());
     }
   }
 
@@ -365,7 +533,7 @@ void Clock::resume()
       clock::currents->clear();
 
       // Schedule another "tick" if necessary.
-      clock::scheduleTick(*timers, clock::ticks);
+      clock::scheduleTick(timers, clock::ticks);
     }
   }
 }
@@ -383,7 +551,7 @@ void Clock::advance(const Duration& duration)
       // Schedule another "tick" if necessary. Only "ticks" that
       // fire immediately will be scheduled here, since the clock
       // is paused.
-      clock::scheduleTick(*timers, clock::ticks);
+      clock::scheduleTick(timers, clock::ticks);
     }
   }
 }
@@ -420,7 +588,7 @@ void Clock::update(const Time& time)
         // Schedule another "tick" if necessary. Only "ticks" that
         // fire immediately will be scheduled here, since the clock
         // is paused.
-        clock::scheduleTick(*timers, clock::ticks);
+        clock::scheduleTick(timers, clock::ticks);
       }
     }
   }
@@ -460,8 +628,17 @@ bool Clock::settled()
     if (clock::settling) {
       VLOG(3) << "Clock still not settled";
       return false;
-    } else if (timers->size() == 0 ||
-               timers->begin()->first > *clock::current) {
+    }
+
+    // Add any buffered timers and make sure a 'tick' fires for the
+    // expired ones. Note that `TimerWheel::next` might underestimate
+    // when the next timer elapses, in which case the 'tick' catches
+    // up the wheel and we're settled the next time around.
+    clock::scheduleTick(timers, clock::ticks);
+
+    Option<Time> next = timers->next();
+
+    if (next.isNone() || next.get() > *clock::current) {
       VLOG(3) << "Clock is settled";
       return true;
     }
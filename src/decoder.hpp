@@ -21,18 +21,24 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cctype>
 #include <deque>
 #include <limits>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <process/http.hpp>
+#include <process/message.hpp>
 
 #include <stout/foreach.hpp>
 #include <stout/gzip.hpp>
 #include <stout/option.hpp>
 #include <stout/try.hpp>
 
+#include "encoder.hpp"
+
 
 #if !(HTTP_PARSER_VERSION_MAJOR >= 2)
 #error HTTP Parser version >= 2 required.
@@ -49,6 +55,130 @@ namespace http_parsing {
 constexpr int SUCCESS = 0;
 constexpr int FAILURE = 1;
 
+
+// Collects the header fields and values of a message as spans of a
+// single buffer that (like the vector of spans) keeps its capacity
+// across the messages of a connection, so that no allocations are
+// needed while parsing the headers of a message, only when they get
+// flushed into the `http::Headers` of the message.
+class HeaderArena
+{
+public:
+  void clear()
+  {
+    buffer.clear();
+    headers.clear();
+    state = FIELD;
+  }
+
+  // NOTE: http_parser may invoke these several times per field or
+  // value if it got split across reads.
+  void field(const char* data, size_t length)
+  {
+    if (headers.empty() || state != FIELD) {
+      headers.push_back({{buffer.size(), 0}, {buffer.size(), 0}});
+      state = FIELD;
+    }
+
+    buffer.append(data, length);
+    headers.back().field.length += length;
+    headers.back().value.offset = buffer.size();
+  }
+
+  void value(const char* data, size_t length)
+  {
+    // Values without a field are rejected by http_parser.
+    CHECK(!headers.empty());
+
+    buffer.append(data, length);
+    headers.back().value.length += length;
+    state = VALUE;
+  }
+
+  // Adds the collected headers to `result`, a later header with the
+  // same (case insensitive) field overwriting an earlier one.
+  void flush(http::Headers* result)
+  {
+    result->reserve(result->size() + headers.size());
+
+    foreach (const Header& header, headers) {
+      const char* field = buffer.data() + header.field.offset;
+
+      const std::string* interned = intern(field, header.field.length);
+
+      std::string& value = interned != nullptr
+        ? (*result)[*interned]
+        : (*result)[std::string(field, header.field.length)];
+
+      value.assign(
+          buffer.data() + header.value.offset,
+          header.value.length);
+    }
+
+    clear();
+  }
+
+private:
+  // Returns the canonical spelling of common header fields, looked
+  // up without allocating, so that their names need not be copied
+  // out of the buffer.
+  static const std::string* intern(const char* data, size_t length)
+  {
+    static const std::vector<std::string>* names =
+      new std::vector<std::string>({
+          "Accept",
+          "Accept-Encoding",
+          "Accept-Language",
+          "Authorization",
+          "Cache-Control",
+          "Connection",
+          "Content-Encoding",
+          "Content-Length",
+          "Content-Type",
+          "Cookie",
+          "Host",
+          "Libprocess-From",
+          "Origin",
+          "Referer",
+          "Transfer-Encoding",
+          "User-Agent"});
+
+    auto equal = [](unsigned char a, unsigned char b) {
+      return ::tolower(a) == ::tolower(b);
+    };
+
+    foreach (const std::string& name, *names) {
+      if (name.size() == length &&
+          std::equal(name.begin(), name.end(), data, equal)) {
+        return &name;
+      }
+    }
+
+    return nullptr;
+  }
+
+  struct Span
+  {
+    size_t offset;
+    size_t length;
+  };
+
+  struct Header
+  {
+    Span field;
+    Span value;
+  };
+
+  std::string buffer;
+  std::vector<Header> headers;
+
+  enum
+  {
+    FIELD,
+    VALUE
+  } state = FIELD;
+};
+
 } // namespace http_parsing {
 
 // TODO(benh): Make DataDecoder abstract and make RequestDecoder a
@@ -94,13 +224,9 @@ public:
       failure = true;
     }
 
-    if (!requests.empty()) {
-      std::deque<http::Request*> result = requests;
-      requests.clear();
-      return result;
-    }
-
-    return std::deque<http::Request*>();
+    std::deque<http::Request*> result;
+    std::swap(result, requests);
+    return result;
   }
 
   bool failed() const
@@ -115,9 +241,7 @@ private:
 
     CHECK(!decoder->failure);
 
-    decoder->header = HEADER_FIELD;
-    decoder->field.clear();
-    decoder->value.clear();
+    decoder->headers.clear();
     decoder->query.clear();
     decoder->url.clear();
 
@@ -157,14 +281,7 @@ private:
     DataDecoder* decoder = (DataDecoder*) p->data;
     CHECK_NOTNULL(decoder->request);
 
-    if (decoder->header != HEADER_FIELD) {
-      decoder->request->headers[decoder->field] = decoder->value;
-      decoder->field.clear();
-      decoder->value.clear();
-    }
-
-    decoder->field.append(data, length);
-    decoder->header = HEADER_FIELD;
+    decoder->headers.field(data, length);
 
     return http_parsing::SUCCESS;
   }
@@ -173,8 +290,7 @@ private:
   {
     DataDecoder* decoder = (DataDecoder*) p->data;
     CHECK_NOTNULL(decoder->request);
-    decoder->value.append(data, length);
-    decoder->header = HEADER_VALUE;
+    decoder->headers.value(data, length);
     return http_parsing::SUCCESS;
   }
 
@@ -184,10 +300,7 @@ private:
 
     CHECK_NOTNULL(decoder->request);
 
-    // Add final header.
-    decoder->request->headers[decoder->field] = decoder->value;
-    decoder->field.clear();
-    decoder->value.clear();
+    decoder->headers.flush(&decoder->request->headers);
 
     decoder->request->method =
       http_method_str((http_method) decoder->parser.method);
@@ -280,14 +393,8 @@ private:
   http_parser parser;
   http_parser_settings settings;
 
-  enum
-  {
-    HEADER_FIELD,
-    HEADER_VALUE
-  } header;
+  http_parsing::HeaderArena headers;
 
-  std::string field;
-  std::string value;
   std::string query;
   std::string url;
 
@@ -339,13 +446,9 @@ public:
       failure = true;
     }
 
-    if (!responses.empty()) {
-      std::deque<http::Response*> result = responses;
-      responses.clear();
-      return result;
-    }
-
-    return std::deque<http::Response*>();
+    std::deque<http::Response*> result;
+    std::swap(result, responses);
+    return result;
   }
 
   bool failed() const
@@ -513,8 +616,14 @@ private:
 class StreamingResponseDecoder
 {
 public:
-  StreamingResponseDecoder()
-    : failure(false), header(HEADER_FIELD), response(nullptr)
+  // The response bodies are written into pipes with the specified
+  // capacity, if any, see `http::Pipe`.
+  explicit StreamingResponseDecoder(
+      const Option<size_t>& _capacity = None())
+    : failure(false),
+      header(HEADER_FIELD),
+      response(nullptr),
+      capacity(_capacity)
   {
     http_parser_settings_init(&settings);
 
@@ -573,13 +682,9 @@ public:
       }
     }
 
-    if (!responses.empty()) {
-      std::deque<http::Response*> result = responses;
-      responses.clear();
-      return result;
-    }
-
-    return std::deque<http::Response*>();
+    std::deque<http::Response*> result;
+    std::swap(result, responses);
+    return result;
   }
 
   bool failed() const
@@ -594,6 +699,17 @@ public:
     return writer.isSome();
   }
 
+  // Returns Nothing once the response body that is currently being
+  // written (if any) can be written to, see `Pipe::Writer::writable`.
+  Future<Nothing> writable() const
+  {
+    if (writer.isNone()) {
+      return Nothing();
+    }
+
+    return writer->writable();
+  }
+
 private:
   static int on_message_begin(http_parser* p)
   {
@@ -705,7 +821,10 @@ private:
 
     CHECK_NONE(decoder->writer);
 
-    http::Pipe pipe;
+    http::Pipe pipe = decoder->capacity.isSome()
+      ? http::Pipe(decoder->capacity.get())
+      : http::Pipe();
+
     decoder->writer = pipe.writer();
     decoder->response->reader = pipe.reader();
 
@@ -771,6 +890,8 @@ private:
   Option<http::Pipe::Writer> writer;
 
   std::deque<http::Response*> responses;
+
+  const Option<size_t> capacity;
 };
 
 
@@ -782,7 +903,7 @@ class StreamingRequestDecoder
 {
 public:
   explicit StreamingRequestDecoder()
-    : failure(false), header(HEADER_FIELD), request(nullptr)
+    : failure(false), request(nullptr)
   {
     http_parser_settings_init(&settings);
 
@@ -838,13 +959,9 @@ public:
       }
     }
 
-    if (!requests.empty()) {
-      std::deque<http::Request*> result = requests;
-      requests.clear();
-      return result;
-    }
-
-    return std::deque<http::Request*>();
+    std::deque<http::Request*> result;
+    std::swap(result, requests);
+    return result;
   }
 
   bool failed() const
@@ -859,9 +976,7 @@ private:
 
     CHECK(!decoder->failure);
 
-    decoder->header = HEADER_FIELD;
-    decoder->field.clear();
-    decoder->value.clear();
+    decoder->headers.clear();
     decoder->query.clear();
     decoder->url.clear();
 
@@ -914,14 +1029,7 @@ private:
       return http_parsing::FAILURE;
     }
 
-    if (decoder->header != HEADER_FIELD) {
-      decoder->request->headers[decoder->field] = decoder->value;
-      decoder->field.clear();
-      decoder->value.clear();
-    }
-
-    decoder->field.append(data, length);
-    decoder->header = HEADER_FIELD;
+    decoder->headers.field(data, length);
 
     return http_parsing::SUCCESS;
   }
@@ -936,8 +1044,7 @@ private:
       return http_parsing::FAILURE;
     }
 
-    decoder->value.append(data, length);
-    decoder->header = HEADER_VALUE;
+    decoder->headers.value(data, length);
     return http_parsing::SUCCESS;
   }
 
@@ -949,10 +1056,7 @@ private:
     // but also that `on_headers_complete` is not called more than once.
     CHECK_NOTNULL(decoder->request);
 
-    // Add final header.
-    decoder->request->headers[decoder->field] = decoder->value;
-    decoder->field.clear();
-    decoder->value.clear();
+    decoder->headers.flush(&decoder->request->headers);
 
     decoder->request->method =
       http_method_str((http_method) decoder->parser.method);
@@ -1087,14 +1191,8 @@ private:
   http_parser parser;
   http_parser_settings settings;
 
-  enum
-  {
-    HEADER_FIELD,
-    HEADER_VALUE
-  } header;
+  http_parsing::HeaderArena headers;
 
-  std::string field;
-  std::string value;
   std::string query;
   std::string url;
 
@@ -1105,6 +1203,112 @@ private:
   std::deque<http::Request*> requests;
 };
 
+
+// Decodes messages encoded using `BinaryMessageEncoder`. The 'to' of
+// the decoded messages only has its ID set, it's up to the caller to
+// set its address.
+class BinaryMessageDecoder
+{
+public:
+  // Upper bound of the size of a frame we accept by default, which
+  // keeps a peer from making us buffer up to 16GB by announcing large
+  // lengths and then sending the frame slowly (or never).
+  static constexpr size_t DEFAULT_MAX_FRAME_SIZE = 256 * 1024 * 1024;
+
+  explicit BinaryMessageDecoder(
+      size_t _maxFrameSize = DEFAULT_MAX_FRAME_SIZE)
+    : maxFrameSize(_maxFrameSize), failure(false) {}
+
+  std::deque<Message*> decode(const char* data, size_t length)
+  {
+    std::deque<Message*> messages;
+
+    if (failure) {
+      return messages;
+    }
+
+    buffer.append(data, length);
+
+    size_t index = 0;
+
+    while (buffer.size() - index >= BinaryMessageEncoder::HEADER_SIZE) {
+      const char* frame = buffer.data() + index;
+
+      if (frame[0] != BinaryMessageEncoder::MAGIC ||
+          frame[1] != BinaryMessageEncoder::VERSION) {
+        failure = true;
+        break;
+      }
+
+      const uint64_t from = read(frame + 2);
+      const uint64_t to = read(frame + 6);
+      const uint64_t name = read(frame + 10);
+      const uint64_t body = read(frame + 14);
+
+      const uint64_t size =
+        BinaryMessageEncoder::HEADER_SIZE + from + to + name + body;
+
+      if (size > maxFrameSize) {
+        failure = true;
+        break;
+      }
+
+      // Wait for the rest of the frame.
+      if (buffer.size() - index < size) {
+        break;
+      }
+
+      const char* field = frame + BinaryMessageEncoder::HEADER_SIZE;
+
+      Message* message = new Message();
+      message->from = UPID(std::string(field, from));
+      field += from;
+      message->to.id = std::string(field, to);
+      field += to;
+      message->name.assign(field, name);
+      field += name;
+      message->body.assign(field, body);
+
+      index += size;
+
+      if (!message->from) {
+        delete message;
+        failure = true;
+        break;
+      }
+
+      messages.push_back(message);
+    }
+
+    buffer.erase(0, index);
+
+    return messages;
+  }
+
+  bool failed() const
+  {
+    return failure;
+  }
+
+private:
+  static uint32_t read(const char* data)
+  {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+
+    return (static_cast<uint32_t>(bytes[0]) << 24) |
+           (static_cast<uint32_t>(bytes[1]) << 16) |
+           (static_cast<uint32_t>(bytes[2]) << 8) |
+           static_cast<uint32_t>(bytes[3]);
+  }
+
+  const size_t maxFrameSize;
+
+  bool failure;
+
+  // Holds any partially received frame.
+  std::string buffer;
+};
+
 }  // namespace process {
 
 #endif // __DECODER_HPP__
@@ -17,8 +17,9 @@
 #include <time.h>
 
 #include <limits>
-#include <map>
-#include <sstream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <process/http.hpp>
 #include <process/process.hpp>
@@ -28,12 +29,18 @@
 #include <stout/hashmap.hpp>
 #include <stout/numify.hpp>
 #include <stout/os.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
 
 
 namespace process {
 
 const uint32_t GZIP_MINIMUM_BODY_LENGTH = 1024;
 
+// Message bodies at least this long are shared with (rather than
+// copied into) the encoded message, see `DataEncoder`.
+const size_t SHARED_BODY_MINIMUM_LENGTH = 4096;
+
 
 class Encoder
 {
@@ -56,14 +63,28 @@ public:
 };
 
 
+// Encodes data made up of one or more immutable, reference counted
+// segments (i.e., a rope) so that large data, e.g., the body of a
+// message, can be sent without copying it into a contiguous buffer.
+// Each call to `next` returns (the rest of) the next segment.
 class DataEncoder : public Encoder
 {
 public:
   DataEncoder(const std::string& _data)
-    : data(_data), index(0) {}
+    : DataEncoder(std::string(_data)) {}
 
   DataEncoder(std::string&& _data)
-    : data(std::move(_data)), index(0) {}
+  {
+    append(std::move(_data));
+  }
+
+  // Encodes the concatenation of the data without copying it.
+  explicit DataEncoder(std::vector<std::string>&& _data)
+  {
+    foreach (std::string& data, _data) {
+      append(std::move(data));
+    }
+  }
 
   ~DataEncoder() override {}
 
@@ -74,37 +95,114 @@ public:
 
   virtual const char* next(size_t* length)
   {
-    size_t temp = index;
-    index = data.size();
-    *length = data.size() - temp;
-    return data.data() + temp;
+    // Skip any segments we've sent completely.
+    while (segment < segments.size() &&
+           offset == segments[segment]->size()) {
+      segment++;
+      offset = 0;
+    }
+
+    if (segment == segments.size()) {
+      *length = 0;
+      return nullptr;
+    }
+
+    const std::string& data = *segments[segment];
+
+    *length = data.size() - offset;
+
+    const char* result = data.data() + offset;
+
+    index += *length;
+    offset = data.size();
+
+    return result;
   }
 
   void backup(size_t length) override
   {
     if (index >= length) {
       index -= length;
+
+      while (length > offset) {
+        length -= offset;
+        offset = segments[--segment]->size();
+      }
+
+      offset -= length;
     }
   }
 
   size_t remaining() const override
   {
-    return data.size() - index;
+    return size - index;
+  }
+
+protected:
+  DataEncoder() = default;
+
+  void append(std::string&& data)
+  {
+    append(std::make_shared<const std::string>(std::move(data)));
+  }
+
+  void append(const std::shared_ptr<const std::string>& data)
+  {
+    if (!data->empty()) {
+      segments.push_back(data);
+      size += data->size();
+    }
   }
 
 private:
-  const std::string data;
-  size_t index;
+  std::vector<std::shared_ptr<const std::string>> segments;
+  size_t size = 0;
+
+  // The position of the next data to send, both overall and as the
+  // segment and the offset within the segment.
+  size_t index = 0;
+  size_t segment = 0;
+  size_t offset = 0;
 };
 
 
 class MessageEncoder : public DataEncoder
 {
 public:
-  MessageEncoder(const Message& message)
-    : DataEncoder(encode(message)) {}
+  // If `advertise` is true we let the receiver know that we also
+  // accept messages using the binary framing (see
+  // `BinaryMessageEncoder`).
+  MessageEncoder(const Message& message, bool advertise = false)
+    : DataEncoder(encode(message, advertise)) {}
+
+  // Shares rather than copies the body if it is large enough (see
+  // `SHARED_BODY_MINIMUM_LENGTH`).
+  MessageEncoder(Message&& message, bool advertise = false)
+  {
+    if (message.body.size() < SHARED_BODY_MINIMUM_LENGTH) {
+      append(encode(message, advertise));
+    } else {
+      append(header(message, advertise));
+      append(std::move(message.body));
+      append(trailer());
+    }
+  }
 
-  static std::string encode(const Message& message)
+  static std::string encode(const Message& message, bool advertise = false)
+  {
+    std::string data = header(message, advertise);
+
+    if (message.body.size() > 0) {
+      data.append(message.body);
+      data.append(trailer());
+    }
+
+    return data;
+  }
+
+private:
+  // Returns everything up to the body, if any.
+  static std::string header(const Message& message, bool advertise)
   {
     std::ostringstream out;
 
@@ -124,19 +222,254 @@ public:
         << "Connection: Keep-Alive\r\n"
         << "Host: \r\n";
 
+    if (advertise) {
+      out << "Libprocess-Framing: binary\r\n";
+    }
+
     if (message.body.size() > 0) {
       out << "Transfer-Encoding: chunked\r\n\r\n"
           << std::hex << message.body.size() << "\r\n";
-      out.write(message.body.data(), message.body.size());
-      out << "\r\n"
-          << "0\r\n"
-          << "\r\n";
     } else {
       out << "\r\n";
     }
 
     return out.str();
   }
+
+  // Returns everything after a (non-empty) body.
+  static std::string trailer()
+  {
+    return "\r\n0\r\n\r\n";
+  }
+};
+
+
+// Encodes a message using a compact binary framing rather than as an
+// HTTP request, which saves both bytes and CPU for small messages. We
+// only use it for peers that have advertised that they accept it
+// (see `MessageEncoder`) and never mix it with HTTP on a connection.
+//
+// Each message is encoded as a frame with an 18 byte header followed
+// by the stringified 'from' UPID, the 'to' ID, the name, and the body:
+//
+//   +-------+---------+--------+--------+--------+--------+------+----+
+//   | MAGIC | VERSION | from   | to     | name   | body   | from | .. |
+//   |       |         | length | length | length | length |      |    |
+//   +-------+---------+--------+--------+--------+--------+------+----+
+//       1        1        4        4        4        4
+//
+// where all lengths are in network byte order. Since MAGIC is not a
+// valid first byte of an HTTP request the receiver can tell which
+// framing a connection uses from its first byte.
+class BinaryMessageEncoder : public DataEncoder
+{
+public:
+  static constexpr char MAGIC = '\0';
+  static constexpr char VERSION = 1;
+  static constexpr size_t HEADER_SIZE = 18;
+
+  BinaryMessageEncoder(const Message& message)
+    : DataEncoder(encode(message)) {}
+
+  // Shares rather than copies the body if it is large enough (see
+  // `SHARED_BODY_MINIMUM_LENGTH`).
+  BinaryMessageEncoder(Message&& message)
+  {
+    if (message.body.size() < SHARED_BODY_MINIMUM_LENGTH) {
+      append(encode(message));
+    } else {
+      append(header(message));
+      append(std::move(message.body));
+    }
+  }
+
+  static std::string encode(const Message& message)
+  {
+    std::string frame = header(message, message.body.size());
+    frame.append(message.body);
+    return frame;
+  }
+
+private:
+  // Returns the frame up to the body, reserving `capacity` more bytes.
+  static std::string header(const Message& message, size_t capacity = 0)
+  {
+    const std::string from = stringify(message.from);
+    const std::string& to = message.to.id;
+
+    std::string frame;
+    frame.reserve(
+        HEADER_SIZE +
+        from.size() +
+        to.size() +
+        message.name.size() +
+        capacity);
+
+    frame += MAGIC;
+    frame += VERSION;
+
+    append_length(&frame, from.size());
+    append_length(&frame, to.size());
+    append_length(&frame, message.name.size());
+    append_length(&frame, message.body.size());
+
+    frame.append(from);
+    frame.append(to);
+    frame.append(message.name);
+
+    return frame;
+  }
+
+  static void append_length(std::string* frame, size_t length)
+  {
+    CHECK_LE(length, std::numeric_limits<uint32_t>::max());
+
+    frame->push_back(static_cast<char>((length >> 24) & 0xff));
+    frame->push_back(static_cast<char>((length >> 16) & 0xff));
+    frame->push_back(static_cast<char>((length >> 8) & 0xff));
+    frame->push_back(static_cast<char>(length & 0xff));
+  }
+};
+
+
+// Upper bound of the size of the status or request line and of the
+// headers we add ourselves, used to avoid reallocating when encoding
+// HTTP requests and responses.
+const size_t HEADERS_SIZE_ESTIMATE = 256;
+
+
+// Returns the size of the encoded headers.
+inline size_t headers_size(const http::Headers& headers)
+{
+  size_t size = 0;
+  foreachpair (const std::string& key, const std::string& value, headers) {
+    size += key.size() + value.size() + 4; // ": " and CRLF.
+  }
+  return size;
+}
+
+
+inline void append_header(
+    std::string* out,
+    const std::string& key,
+    const std::string& value)
+{
+  out->append(key);
+  out->append(": ");
+  out->append(value);
+  out->append("\r\n");
+}
+
+
+// Encodes a client request, i.e., the request line, the headers, and
+// the body of a 'BODY' request. The body of a 'PIPE' request must be
+// encoded chunk by chunk (see `HttpChunkEncoder`) as it gets read.
+//
+// NOTE: this does not compress the body, the caller has to do that
+// (and set the 'Content-Encoding' header) if desired.
+class HttpRequestEncoder : public DataEncoder
+{
+public:
+  explicit HttpRequestEncoder(const http::Request& request)
+    : DataEncoder(encode(request)) {}
+
+  static std::string encode(const http::Request& request)
+  {
+    // Need to specify the 'Host' header.
+    CHECK(request.url.domain.isSome() || request.url.ip.isSome());
+
+    std::string host = request.url.domain.isSome()
+      ? request.url.domain.get()
+      : stringify(request.url.ip.get());
+
+    // Add port for non-standard ports.
+    if (request.url.port.isSome() &&
+        request.url.port != 80 &&
+        request.url.port != 443) {
+      host += ":" + stringify(request.url.port.get());
+    }
+
+    Option<std::string> contentLength = None();
+
+    if (request.type == http::Request::PIPE) {
+      CHECK(!request.headers.contains("Content-Length"));
+    } else {
+      CHECK_EQ(http::Request::BODY, request.type);
+      contentLength = stringify(request.body.size());
+    }
+
+    std::string out;
+    out.reserve(
+        HEADERS_SIZE_ESTIMATE +
+        request.url.path.size() +
+        headers_size(request.headers) +
+        (request.type == http::Request::BODY ? request.body.size() : 0));
+
+    out.append(request.method);
+    out.append(" /");
+    out.append(strings::remove(request.url.path, "/", strings::PREFIX));
+
+    if (!request.url.query.empty()) {
+      // Join the query via '=' and '&'.
+      char separator = '?';
+
+      foreachpair (const std::string& key,
+                   const std::string& value,
+                   request.url.query) {
+        out += separator;
+        out.append(http::encode(key));
+        out += '=';
+        out.append(http::encode(value));
+        separator = '&';
+      }
+    }
+
+    if (request.url.fragment.isSome()) {
+      out += '#';
+      out.append(request.url.fragment.get());
+    }
+
+    out.append(" HTTP/1.1\r\n");
+
+    // Emit the headers, overwriting the ones we set.
+    http::CaseInsensitiveEqual equal;
+
+    foreachpair (const std::string& key,
+                 const std::string& value,
+                 request.headers) {
+      if (equal(key, "Host") ||
+          (equal(key, "Connection") && !request.keepAlive) ||
+          (equal(key, "Transfer-Encoding") &&
+           request.type == http::Request::PIPE) ||
+          (equal(key, "Content-Length") && contentLength.isSome())) {
+        continue;
+      }
+
+      append_header(&out, key, value);
+    }
+
+    append_header(&out, "Host", host);
+
+    if (!request.keepAlive) {
+      // Tell the server to close the connection when it's done.
+      append_header(&out, "Connection", "close");
+    }
+
+    if (request.type == http::Request::PIPE) {
+      append_header(&out, "Transfer-Encoding", "chunked");
+    } else {
+      append_header(&out, "Content-Length", contentLength.get());
+    }
+
+    // Use a CRLF to mark end of headers.
+    out.append("\r\n");
+
+    if (request.type == http::Request::BODY) {
+      out.append(request.body);
+    }
+
+    return out;
+  }
 };
 
 
@@ -152,81 +485,182 @@ public:
       const http::Response& response,
       const http::Request& request)
   {
-    std::ostringstream out;
-
     // TODO(benh): Check version?
 
-    out << "HTTP/1.1 " << response.status << "\r\n";
+    // Should we compress this response?
+    Option<std::string> compressed = None();
+
+    if (response.type == http::Response::BODY &&
+        response.body.length() >= GZIP_MINIMUM_BODY_LENGTH &&
+        !response.headers.contains("Content-Encoding") &&
+        request.acceptsEncoding("gzip")) {
+      Try<std::string> gzip = gzip::compress(response.body);
+      if (gzip.isError()) {
+        LOG(WARNING) << "Failed to gzip response body: " << gzip.error();
+      } else {
+        compressed = std::move(gzip.get());
+      }
+    }
+
+    const std::string& body =
+      compressed.isSome() ? compressed.get() : response.body;
+
+    // Add a Content-Length header if the response is of type "none"
+    // or "body" and no Content-Length header has been supplied (or
+    // it no longer applies since we compressed the body).
+    Option<std::string> contentLength = None();
+
+    if (compressed.isSome()) {
+      contentLength = stringify(body.size());
+    } else if (!response.headers.contains("Content-Length")) {
+      if (response.type == http::Response::NONE) {
+        contentLength = "0";
+      } else if (response.type == http::Response::BODY) {
+        contentLength = stringify(body.size());
+      }
+    }
+
+    // If the Content-Length header was supplied, only write as much
+    // data as the length specifies.
+    size_t length = body.size();
+
+    if (contentLength.isNone()) {
+      Result<uint32_t> supplied =
+        numify<uint32_t>(response.headers.get("Content-Length"));
+
+      if (supplied.isSome() && supplied.get() <= body.length()) {
+        length = supplied.get();
+      }
+    }
+
+    std::string out;
+    out.reserve(
+        HEADERS_SIZE_ESTIMATE +
+        response.status.size() +
+        headers_size(response.headers) +
+        (response.type == http::Response::BODY ? length : 0));
+
+    out.append("HTTP/1.1 ");
+    out.append(response.status);
+    out.append("\r\n");
+
+    // Emit the headers, overwriting the ones we set.
+    http::CaseInsensitiveEqual equal;
+
+    foreachpair (const std::string& key,
+                 const std::string& value,
+                 response.headers) {
+      if (equal(key, "Date") ||
+          (equal(key, "Content-Length") && contentLength.isSome())) {
+        continue;
+      }
 
-    auto headers = response.headers;
+      append_header(&out, key, value);
+    }
 
     // HTTP 1.1 requires the "Date" header. In the future once we
     // start checking the version (above) then we can conditionally
     // add this header, but for now, we always do.
-    time_t rawtime;
-    time(&rawtime);
+    append_header(&out, "Date", date());
 
-    char date[256];
+    if (compressed.isSome()) {
+      append_header(&out, "Content-Encoding", "gzip");
+    }
 
-    tm tm_;
-    PCHECK(os::gmtime_r(&rawtime, &tm_) != nullptr)
-      << "Failed to convert the current time to a tm struct "
-      << "using os::gmtime_r()";
+    if (contentLength.isSome()) {
+      append_header(&out, "Content-Length", contentLength.get());
+    }
 
-    // TODO(benh): Check return code of strftime!
-    strftime(date, 256, "%a, %d %b %Y %H:%M:%S GMT", &tm_);
+    // Use a CRLF to mark end of headers.
+    out.append("\r\n");
 
-    headers["Date"] = date;
+    // Add the body if necessary.
+    if (response.type == http::Response::BODY) {
+      out.append(body.data(), length);
+    }
 
-    // Should we compress this response?
-    std::string body = response.body;
+    return out;
+  }
 
-    if (response.type == http::Response::BODY &&
-        response.body.length() >= GZIP_MINIMUM_BODY_LENGTH &&
-        !headers.contains("Content-Encoding") &&
-        request.acceptsEncoding("gzip")) {
-      Try<std::string> compressed = gzip::compress(body);
-      if (compressed.isError()) {
-        LOG(WARNING) << "Failed to gzip response body: " << compressed.error();
-      } else {
-        body = std::move(compressed.get());
+  // Returns the current time formatted for the "Date" header. Since
+  // every response has one we only format it once per second (per
+  // thread) rather than for every response.
+  static const std::string& date()
+  {
+    static thread_local time_t cached = -1;
+    static thread_local std::string formatted;
 
-        headers["Content-Length"] = stringify(body.length());
-        headers["Content-Encoding"] = "gzip";
-      }
+    time_t now;
+    time(&now);
+
+    if (now != cached) {
+      tm tm_;
+      PCHECK(os::gmtime_r(&now, &tm_) != nullptr)
+        << "Failed to convert the current time to a tm struct "
+        << "using os::gmtime_r()";
+
+      char buffer[64];
+      size_t length =
+        strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm_);
+
+      CHECK_NE(0u, length) << "Failed to format the current time";
+
+      formatted.assign(buffer, length);
+      cached = now;
     }
 
-    foreachpair (const std::string& key, const std::string& value, headers) {
-      out << key << ": " << value << "\r\n";
+    return formatted;
+  }
+};
+
+
+// Encodes a chunk of a body using the "chunked" transfer coding, an
+// empty chunk being the last one.
+class HttpChunkEncoder : public DataEncoder
+{
+public:
+  explicit HttpChunkEncoder(const std::string& chunk)
+    : DataEncoder(encode(chunk)) {}
+
+  // The promise gets set once the encoder gets deleted, i.e., once
+  // the chunk has been sent (or the socket got closed).
+  HttpChunkEncoder(const std::string& chunk, Owned<Promise<Nothing>> _sent)
+    : DataEncoder(encode(chunk)), sent(std::move(_sent)) {}
+
+  ~HttpChunkEncoder() override
+  {
+    if (sent.get() != nullptr) {
+      sent->set(Nothing());
     }
+  }
 
-    // Add a Content-Length header if the response is of type "none"
-    // or "body" and no Content-Length header has been supplied.
-    if (response.type == http::Response::NONE &&
-        !headers.contains("Content-Length")) {
-      out << "Content-Length: 0\r\n";
-    } else if (response.type == http::Response::BODY &&
-               !headers.contains("Content-Length")) {
-      out << "Content-Length: " << body.size() << "\r\n";
+  static std::string encode(const std::string& chunk)
+  {
+    if (chunk.empty()) {
+      return "0\r\n\r\n";
     }
 
-    // Use a CRLF to mark end of headers.
-    out << "\r\n";
+    // Format the size in hex.
+    char size[2 * sizeof(size_t)];
+    size_t index = sizeof(size);
 
-    // Add the body if necessary.
-    if (response.type == http::Response::BODY) {
-      // If the Content-Length header was supplied, only write as much data
-      // as the length specifies.
-      Result<uint32_t> length = numify<uint32_t>(headers.get("Content-Length"));
-      if (length.isSome() && length.get() <= body.length()) {
-        out.write(body.data(), length.get());
-      } else {
-        out.write(body.data(), body.size());
-      }
+    for (size_t n = chunk.size(); n > 0; n >>= 4) {
+      size[--index] = "0123456789abcdef"[n & 0xf];
     }
 
-    return out.str();
+    std::string out;
+    out.reserve(sizeof(size) - index + chunk.size() + 4);
+
+    out.append(size + index, sizeof(size) - index);
+    out.append("\r\n");
+    out.append(chunk);
+    out.append("\r\n");
+
+    return out;
   }
+
+private:
+  Owned<Promise<Nothing>> sent;
 };
 
 
@@ -13,6 +13,8 @@
 #ifndef __EVENT_LOOP_HPP__
 #define __EVENT_LOOP_HPP__
 
+#include <stddef.h>
+
 #include <stout/duration.hpp>
 #include <stout/lambda.hpp>
 
@@ -24,8 +26,14 @@ namespace process {
 class EventLoop
 {
 public:
-  // Initializes the event loop.
-  static void initialize();
+  // Initializes the specified number of event loops, each of which
+  // must be run by its own thread (see `run`). Sockets get assigned
+  // to the event loops by hashing their file descriptor, timers all
+  // run in the first event loop. Only the first call has an effect.
+  static void initialize(size_t loops = 1);
+
+  // Returns the number of event loops.
+  static size_t loops();
 
   // Invoke the specified function in the event loop after the
   // specified duration.
@@ -37,10 +45,10 @@ public:
   // Returns the current time w.r.t. the event loop.
   static double time();
 
-  // Runs the event loop.
-  static void run();
+  // Runs the specified event loop, see `initialize`.
+  static void run(size_t index);
 
-  // Asynchronously tells the event loop to stop and then returns.
+  // Asynchronously tells the event loops to stop and then returns.
   static void stop();
 };
 
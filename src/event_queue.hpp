@@ -13,13 +13,16 @@
 #ifndef __PROCESS_EVENT_QUEUE_HPP__
 #define __PROCESS_EVENT_QUEUE_HPP__
 
+#include <algorithm>
 #include <deque>
 #include <mutex>
 #include <string>
+#include <thread>
 
 #include <process/event.hpp>
 #include <process/http.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/json.hpp>
 #include <stout/stringify.hpp>
 #include <stout/synchronized.hpp>
@@ -40,6 +43,8 @@ namespace process {
 //
 //   * Consumers _must_ call `empty()` before calling
 //     `dequeue()`. Failing to do so may result in undefined behavior.
+//     This does not apply to `dequeue_batch()` which returns 0 if
+//     there was nothing to dequeue.
 //
 //   * After a consumer calls `decomission()` they _must_ not call any
 //     thing else (not even `empty()` and especially not
@@ -90,6 +95,15 @@ public:
   {
   public:
     Event* dequeue() { return queue->dequeue(); }
+
+    // Dequeues up to `size` events into `events` and returns the
+    // number of events dequeued. With the locking implementation
+    // the events are dequeued while holding the lock only once.
+    size_t dequeue_batch(Event** events, size_t size)
+    {
+      return queue->dequeue_batch(events, size);
+    }
+
     bool empty() { return queue->empty(); }
     void decomission() { queue->decomission(); }
     template <typename T>
@@ -138,6 +152,20 @@ private:
     return CHECK_NOTNULL(event);
   }
 
+  size_t dequeue_batch(Event** batch, size_t size)
+  {
+    size_t count = 0;
+
+    synchronized (mutex) {
+      while (count < size && !events.empty()) {
+        batch[count++] = events.front();
+        events.pop_front();
+      }
+    }
+
+    return count;
+  }
+
   bool empty()
   {
     synchronized (mutex) {
@@ -187,12 +215,22 @@ private:
 #else // LOCK_FREE_EVENT_QUEUE
   bool enqueue(Event* event)
   {
+    // NOTE: we must check `comissioned` AFTER we have incremented
+    // `producers` otherwise we might race with `decomission()` and
+    // enqueue an event after the consumer has already deleted all of
+    // the events, leaking it.
+    producers.fetch_add(1);
+
+    bool enqueued = false;
+
     if (comissioned.load()) {
       queue.enqueue(event);
-      return true;
+      enqueued = true;
     }
 
-    return false;
+    producers.fetch_sub(1);
+
+    return enqueued;
   }
 
   Event* dequeue()
@@ -200,6 +238,21 @@ private:
     return queue.dequeue();
   }
 
+  size_t dequeue_batch(Event** batch, size_t size)
+  {
+    size_t count = 0;
+
+    while (count < size) {
+      Event* event = queue.dequeue();
+      if (event == nullptr) {
+        break;
+      }
+      batch[count++] = event;
+    }
+
+    return count;
+  }
+
   bool empty()
   {
     return queue.empty();
@@ -207,7 +260,16 @@ private:
 
   void decomission()
   {
-    comissioned.store(true);
+    comissioned.store(false);
+
+    // Wait for any producers that saw the queue still comissioned to
+    // finish enqueueing so that we delete their events too. This
+    // should be brief since enqueueing is wait-free, but a producer
+    // might have been preempted so we yield rather than spin.
+    while (producers.load() > 0) {
+      std::this_thread::yield();
+    }
+
     while (!empty()) {
       delete dequeue();
     }
@@ -242,6 +304,10 @@ private:
   // be atomic as it can be read by a producer even though it's only
   // written by a consumer.
   std::atomic<bool> comissioned = ATOMIC_VAR_INIT(true);
+
+  // Number of producers currently in `enqueue()`, used to make sure
+  // `decomission()` deletes every event that gets enqueued.
+  std::atomic<size_t> producers = ATOMIC_VAR_INIT(0);
 #endif // LOCK_FREE_EVENT_QUEUE
 };
 
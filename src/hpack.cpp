@@ -0,0 +1,704 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <stout/error.hpp>
+#include <stout/none.hpp>
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+#include "hpack.hpp"
+
+using std::pair;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace process {
+namespace http {
+namespace hpack {
+
+// Size of a field in the dynamic table in addition to its name and
+// value, see section 4.1.
+static constexpr size_t FIELD_OVERHEAD = 32;
+
+// Largest integer we decode, anything bigger can't be a valid index
+// or string length.
+static constexpr uint64_t MAX_INTEGER = 0xffffffff;
+
+
+// The static table, see Appendix A.
+static const vector<pair<string, string>>& statics()
+{
+  // NOTE: intentionally leaked, like the other tables below, so that
+  // it outlives any thread that might still use it during exit.
+  static const vector<pair<string, string>>* statics =
+    new vector<pair<string, string>>({
+      {":authority", ""},
+      {":method", "GET"},
+      {":method", "POST"},
+      {":path", "/"},
+      {":path", "/index.html"},
+      {":scheme", "http"},
+      {":scheme", "https"},
+      {":status", "200"},
+      {":status", "204"},
+      {":status", "206"},
+      {":status", "304"},
+      {":status", "400"},
+      {":status", "404"},
+      {":status", "500"},
+      {"accept-charset", ""},
+      {"accept-encoding", "gzip, deflate"},
+      {"accept-language", ""},
+      {"accept-ranges", ""},
+      {"accept", ""},
+      {"access-control-allow-origin", ""},
+      {"age", ""},
+      {"allow", ""},
+      {"authorization", ""},
+      {"cache-control", ""},
+      {"content-disposition", ""},
+      {"content-encoding", ""},
+      {"content-language", ""},
+      {"content-length", ""},
+      {"content-location", ""},
+      {"content-range", ""},
+      {"content-type", ""},
+      {"cookie", ""},
+      {"date", ""},
+      {"etag", ""},
+      {"expect", ""},
+      {"expires", ""},
+      {"from", ""},
+      {"host", ""},
+      {"if-match", ""},
+      {"if-modified-since", ""},
+      {"if-none-match", ""},
+      {"if-range", ""},
+      {"if-unmodified-since", ""},
+      {"last-modified", ""},
+      {"link", ""},
+      {"location", ""},
+      {"max-forwards", ""},
+      {"proxy-authenticate", ""},
+      {"proxy-authorization", ""},
+      {"range", ""},
+      {"referer", ""},
+      {"refresh", ""},
+      {"retry-after", ""},
+      {"server", ""},
+      {"set-cookie", ""},
+      {"strict-transport-security", ""},
+      {"transfer-encoding", ""},
+      {"user-agent", ""},
+      {"vary", ""},
+      {"via", ""},
+      {"www-authenticate", ""},
+    });
+
+  return *statics;
+}
+
+
+// Index of the first field with each name in the static table.
+static const unordered_map<string, size_t>& names()
+{
+  static const unordered_map<string, size_t>* names = []() {
+    unordered_map<string, size_t>* names = new unordered_map<string, size_t>();
+    for (size_t i = 0; i < statics().size(); i++) {
+      names->emplace(statics()[i].first, i);
+    }
+    return names;
+  }();
+
+  return *names;
+}
+
+
+const pair<string, string>* Table::get(size_t index) const
+{
+  if (index == 0) {
+    return nullptr;
+  }
+
+  if (index <= statics().size()) {
+    return &statics()[index - 1];
+  }
+
+  index -= statics().size() + 1;
+
+  if (index < fields.size()) {
+    return &fields[index];
+  }
+
+  return nullptr;
+}
+
+
+size_t Table::find(const string& name, const string& value, bool* exact) const
+{
+  size_t result = 0;
+
+  auto found = names().find(name);
+  if (found != names().end()) {
+    // Fields with the same name are next to each other.
+    for (size_t i = found->second;
+         i < statics().size() && statics()[i].first == name;
+         i++) {
+      if (statics()[i].second == value) {
+        *exact = true;
+        return i + 1;
+      }
+    }
+
+    result = found->second + 1;
+  }
+
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (fields[i].first == name) {
+      if (fields[i].second == value) {
+        *exact = true;
+        return statics().size() + 1 + i;
+      }
+
+      if (result == 0) {
+        result = statics().size() + 1 + i;
+      }
+    }
+  }
+
+  *exact = false;
+  return result;
+}
+
+
+void Table::add(string name, string value)
+{
+  const size_t entry = name.size() + value.size() + FIELD_OVERHEAD;
+
+  if (entry > capacity) {
+    evict(0);
+    return;
+  }
+
+  evict(capacity - entry);
+
+  fields.emplace_front(std::move(name), std::move(value));
+  size += entry;
+}
+
+
+void Table::resize(size_t _capacity)
+{
+  capacity = _capacity;
+  evict(capacity);
+}
+
+
+void Table::evict(size_t limit)
+{
+  while (size > limit) {
+    const pair<string, string>& field = fields.back();
+    size -= field.first.size() + field.second.size() + FIELD_OVERHEAD;
+    fields.pop_back();
+  }
+}
+
+
+// Appends the integer with an N-bit prefix, the remaining bits of
+// the first octet being `flags`, see section 5.1.
+static void encodeInteger(string* out, uint8_t flags, int bits, uint64_t value)
+{
+  const uint64_t max = (1u << bits) - 1;
+
+  if (value < max) {
+    out->push_back(static_cast<char>(flags | value));
+    return;
+  }
+
+  out->push_back(static_cast<char>(flags | max));
+  value -= max;
+
+  while (value >= 128) {
+    out->push_back(static_cast<char>((value % 128) + 128));
+    value /= 128;
+  }
+
+  out->push_back(static_cast<char>(value));
+}
+
+
+// Appends the string literal, Huffman encoded if that's shorter, see
+// section 5.2.
+static void encodeString(string* out, const string& s)
+{
+  const size_t length = huffman::length(s);
+
+  if (length < s.size()) {
+    encodeInteger(out, 0x80, 7, length);
+    out->append(huffman::encode(s));
+  } else {
+    encodeInteger(out, 0x00, 7, s.size());
+    out->append(s);
+  }
+}
+
+
+static Try<uint64_t> decodeInteger(
+    const uint8_t** data,
+    const uint8_t* end,
+    int bits)
+{
+  if (*data == end) {
+    return Error("Truncated integer");
+  }
+
+  const uint64_t max = (1u << bits) - 1;
+
+  uint64_t value = *(*data)++ & max;
+  if (value < max) {
+    return value;
+  }
+
+  for (int shift = 0; *data != end; shift += 7) {
+    const uint8_t octet = *(*data)++;
+
+    value += static_cast<uint64_t>(octet & 0x7f) << shift;
+
+    if (value > MAX_INTEGER) {
+      return Error("Integer overflow");
+    }
+
+    if ((octet & 0x80) == 0) {
+      return value;
+    }
+  }
+
+  return Error("Truncated integer");
+}
+
+
+static Try<string> decodeString(const uint8_t** data, const uint8_t* end)
+{
+  if (*data == end) {
+    return Error("Truncated string");
+  }
+
+  const bool huffman = (**data & 0x80) != 0;
+
+  Try<uint64_t> length = decodeInteger(data, end, 7);
+  if (length.isError()) {
+    return Error(length.error());
+  }
+
+  if (length.get() > static_cast<uint64_t>(end - *data)) {
+    return Error("Truncated string");
+  }
+
+  const char* s = reinterpret_cast<const char*>(*data);
+  *data += length.get();
+
+  if (huffman) {
+    return huffman::decode(s, length.get());
+  }
+
+  return string(s, length.get());
+}
+
+
+// Whether the value of the header field is a secret that must never
+// be added to a dynamic table, not even by an intermediary, see
+// section 7.1.3.
+static bool sensitive(const string& name)
+{
+  return name == "authorization" ||
+         name == "proxy-authorization" ||
+         name == "cookie" ||
+         name == "set-cookie";
+}
+
+
+void Encoder::encode(const HeaderList& headers, string* out)
+{
+  if (update.isSome()) {
+    if (update->first < update->second) {
+      encodeInteger(out, 0x20, 5, update->first);
+    }
+    encodeInteger(out, 0x20, 5, update->second);
+    update = None();
+  }
+
+  for (const pair<string, string>& header : headers) {
+    const string& name = header.first;
+    const string& value = header.second;
+
+    bool exact = false;
+    const size_t index = table.find(name, value, &exact);
+
+    if (exact) {
+      encodeInteger(out, 0x80, 7, index);
+      continue;
+    }
+
+    // We don't index sensitive fields, nor fields that would take up
+    // more than a quarter of the table since they'd evict a lot of
+    // fields that are more likely to be sent again.
+    const size_t entry = name.size() + value.size() + FIELD_OVERHEAD;
+
+    if (sensitive(name)) {
+      encodeInteger(out, 0x10, 4, index);
+    } else if (entry > capacity / 4) {
+      encodeInteger(out, 0x00, 4, index);
+    } else {
+      encodeInteger(out, 0x40, 6, index);
+      table.add(name, value);
+    }
+
+    if (index == 0) {
+      encodeString(out, name);
+    }
+
+    encodeString(out, value);
+  }
+}
+
+
+void Encoder::resize(size_t size)
+{
+  size = std::min(size, DEFAULT_TABLE_SIZE);
+
+  if (size == capacity) {
+    return;
+  }
+
+  capacity = size;
+  table.resize(capacity);
+
+  update = update.isSome()
+    ? std::make_pair(std::min(update->first, capacity), capacity)
+    : std::make_pair(capacity, capacity);
+}
+
+
+Try<HeaderList> Decoder::decode(const string& block)
+{
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(block.data());
+  const uint8_t* end = data + block.size();
+
+  HeaderList headers;
+
+  // The size of the header list so far, see section 4.1.
+  size_t size = 0;
+
+  auto exceeds = [&](const string& name, const string& value) {
+    size += name.size() + value.size() + 32;
+    return size > maxHeaderListSize;
+  };
+
+  while (data != end) {
+    const uint8_t octet = *data;
+
+    // Indexed header field, see section 6.1.
+    if (octet & 0x80) {
+      Try<uint64_t> index = decodeInteger(&data, end, 7);
+      if (index.isError()) {
+        return Error(index.error());
+      }
+
+      const pair<string, string>* field = table.get(index.get());
+      if (field == nullptr) {
+        return Error("Invalid index " + std::to_string(index.get()));
+      }
+
+      if (exceeds(field->first, field->second)) {
+        return Error("Header list exceeds the maximum size");
+      }
+
+      headers.push_back(*field);
+      continue;
+    }
+
+    // Dynamic table size update, which must come before any of the
+    // fields, see section 4.2.
+    if ((octet & 0xe0) == 0x20) {
+      if (!headers.empty()) {
+        return Error("Table size update after a header field");
+      }
+
+      Try<uint64_t> size = decodeInteger(&data, end, 5);
+      if (size.isError()) {
+        return Error(size.error());
+      }
+
+      if (size.get() > DEFAULT_TABLE_SIZE) {
+        return Error("Table size update exceeds the maximum");
+      }
+
+      table.resize(size.get());
+      continue;
+    }
+
+    // Literal header field with incremental indexing (6-bit index)
+    // or without indexing or never indexed (4-bit index), see
+    // section 6.2.
+    const bool indexing = (octet & 0x40) != 0;
+
+    Try<uint64_t> index = decodeInteger(&data, end, indexing ? 6 : 4);
+    if (index.isError()) {
+      return Error(index.error());
+    }
+
+    string name;
+
+    if (index.get() == 0) {
+      Try<string> decoded = decodeString(&data, end);
+      if (decoded.isError()) {
+        return Error(decoded.error());
+      }
+      name = std::move(decoded.get());
+    } else {
+      const pair<string, string>* field = table.get(index.get());
+      if (field == nullptr) {
+        return Error("Invalid index " + std::to_string(index.get()));
+      }
+      name = field->first;
+    }
+
+    Try<string> value = decodeString(&data, end);
+    if (value.isError()) {
+      return Error(value.error());
+    }
+
+    if (exceeds(name, value.get())) {
+      return Error("Header list exceeds the maximum size");
+    }
+
+    if (indexing) {
+      table.add(name, value.get());
+    }
+
+    headers.emplace_back(std::move(name), std::move(value.get()));
+  }
+
+  return headers;
+}
+
+
+namespace huffman {
+
+struct Code
+{
+  uint32_t bits;
+  uint8_t length;
+};
+
+
+// The code of every octet, see Appendix B (we never encode EOS).
+static const Code CODES[256] = {
+  {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+  {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+  {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+  {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+  {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+  {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+  {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+  {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+  {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+  {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+  {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+  {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6},
+  {0x1f, 6}, {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12},
+  {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7},
+  {0x60, 7}, {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7},
+  {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7},
+  {0x6c, 7}, {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7},
+  {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19},
+  {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6}, {0x7ffd, 15}, {0x3, 5}, {0x23, 6},
+  {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5},
+  {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6},
+  {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+  {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+  {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22},
+  {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22},
+  {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+  {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23},
+  {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24}, {0xffffed, 24},
+  {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+  {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21},
+  {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23},
+  {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+  {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23},
+  {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23}, {0x3fffdd, 22},
+  {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+  {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21},
+  {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22},
+  {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+  {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22},
+  {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26}, {0x3ffffe1, 26},
+  {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+  {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26},
+  {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26},
+  {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+  {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26},
+  {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21}, {0x1fffe5, 21},
+  {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+  {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24},
+  {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21},
+  {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+  {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24},
+  {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26}, {0x7ffffe6, 27},
+  {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+  {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28},
+  {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27}, {0x7ffffef, 27},
+  {0x7fffff0, 27}, {0x3ffffee, 26},
+};
+
+
+// The tree of the codes, which we decode with one bit at a time.
+struct Tree
+{
+  struct Node
+  {
+    int16_t children[2] = {-1, -1};
+    int16_t symbol = -1;
+  };
+
+  Tree()
+  {
+    nodes.emplace_back();
+
+    for (int16_t symbol = 0; symbol < 256; symbol++) {
+      const Code& code = CODES[symbol];
+
+      size_t node = 0;
+      for (int bit = code.length - 1; bit >= 0; bit--) {
+        const int next = (code.bits >> bit) & 1;
+        if (nodes[node].children[next] < 0) {
+          nodes[node].children[next] = static_cast<int16_t>(nodes.size());
+          nodes.emplace_back();
+        }
+        node = nodes[node].children[next];
+      }
+
+      nodes[node].symbol = symbol;
+    }
+  }
+
+  vector<Node> nodes;
+};
+
+
+static const Tree& tree()
+{
+  static const Tree* tree = new Tree();
+  return *tree;
+}
+
+
+size_t length(const string& s)
+{
+  size_t bits = 0;
+  for (char c : s) {
+    bits += CODES[static_cast<uint8_t>(c)].length;
+  }
+  return (bits + 7) / 8;
+}
+
+
+string encode(const string& s)
+{
+  string out;
+  out.reserve(length(s));
+
+  // NOTE: only the lowest `count` bits of `bits` are pending, the
+  // longest code being 30 bits they never exceed 64.
+  uint64_t bits = 0;
+  size_t count = 0;
+
+  for (char c : s) {
+    const Code& code = CODES[static_cast<uint8_t>(c)];
+
+    bits = (bits << code.length) | code.bits;
+    count += code.length;
+
+    while (count >= 8) {
+      count -= 8;
+      out.push_back(static_cast<char>(bits >> count));
+    }
+  }
+
+  // Pad with the most significant bits of EOS, i.e., ones.
+  if (count > 0) {
+    out.push_back(static_cast<char>((bits << (8 - count)) | (0xff >> count)));
+  }
+
+  return out;
+}
+
+
+Try<string> decode(const char* data, size_t length)
+{
+  const vector<Tree::Node>& nodes = tree().nodes;
+
+  string out;
+  out.reserve(length * 8 / 5);
+
+  size_t node = 0;
+
+  // Bits of the code we're decoding so far, and whether they're all
+  // ones, which is what the padding must look like.
+  size_t pending = 0;
+  bool ones = true;
+
+  for (size_t i = 0; i < length; i++) {
+    const uint8_t octet = static_cast<uint8_t>(data[i]);
+
+    for (int bit = 7; bit >= 0; bit--) {
+      const int next = (octet >> bit) & 1;
+
+      if (nodes[node].children[next] < 0) {
+        return Error("Invalid Huffman code");
+      }
+
+      node = nodes[node].children[next];
+      pending++;
+      ones = ones && next == 1;
+
+      if (nodes[node].symbol >= 0) {
+        out.push_back(static_cast<char>(nodes[node].symbol));
+        node = 0;
+        pending = 0;
+        ones = true;
+      }
+    }
+  }
+
+  if (pending > 7 || !ones) {
+    return Error("Invalid Huffman padding");
+  }
+
+  return out;
+}
+
+} // namespace huffman {
+
+} // namespace hpack {
+} // namespace http {
+} // namespace process {
@@ -0,0 +1,155 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __PROCESS_HPACK_HPP__
+#define __PROCESS_HPACK_HPP__
+
+#include <stddef.h>
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+namespace process {
+namespace http {
+namespace hpack {
+
+// HPACK, the header compression of HTTP/2, see RFC 7541.
+//
+// Every HTTP/2 connection has an `Encoder` for the header blocks it
+// sends and a `Decoder` for the ones it receives. Each of them keeps
+// a dynamic table of recently sent (or received) header fields which
+// the header blocks refer to by index, so the header blocks must be
+// decoded in the order they were encoded.
+
+// The header fields of a header block, in order. Names are lowercase
+// and pseudo-header fields (e.g., ":path") come first.
+typedef std::vector<std::pair<std::string, std::string>> HeaderList;
+
+
+// Default (and maximum) size of the dynamic tables, in octets, see
+// SETTINGS_HEADER_TABLE_SIZE.
+constexpr size_t DEFAULT_TABLE_SIZE = 4096;
+
+
+// Default maximum size of a decoded header list, see
+// SETTINGS_MAX_HEADER_LIST_SIZE. The size of a header list is the sum
+// of the sizes of its fields, each being the length of its name and
+// value plus 32 octets (see section 4.1).
+constexpr size_t DEFAULT_MAX_HEADER_LIST_SIZE = 256 * 1024;
+
+
+// The static table followed by the dynamic table, which get indexed
+// together starting from 1 (see section 2.3.3 of RFC 7541).
+class Table
+{
+public:
+  explicit Table(size_t _capacity) : capacity(_capacity), size(0) {}
+
+  // Returns the field at the index or `nullptr` if there is none.
+  const std::pair<std::string, std::string>* get(size_t index) const;
+
+  // Returns the index of a field with the name and value, or else of
+  // a field with the name (setting `exact` to false), or else 0.
+  size_t find(
+      const std::string& name,
+      const std::string& value,
+      bool* exact) const;
+
+  // Adds the field to the dynamic table, evicting the oldest fields
+  // to make room for it. A field that is bigger than the capacity
+  // empties the table without getting added (see section 4.4).
+  void add(std::string name, std::string value);
+
+  // Changes the capacity, evicting as many fields as necessary.
+  void resize(size_t capacity);
+
+private:
+  void evict(size_t limit);
+
+  size_t capacity;
+
+  // Size of the dynamic table as defined in section 4.1, i.e., the
+  // octets of the names and values plus 32 octets per field.
+  size_t size;
+
+  // Newest field first.
+  std::deque<std::pair<std::string, std::string>> fields;
+};
+
+
+class Encoder
+{
+public:
+  Encoder() : table(DEFAULT_TABLE_SIZE), capacity(DEFAULT_TABLE_SIZE) {}
+
+  // Appends the header block for the fields to `out`.
+  void encode(const HeaderList& headers, std::string* out);
+
+  // Invoked when the peer changes its SETTINGS_HEADER_TABLE_SIZE. We
+  // use at most the default size regardless, a smaller size gets
+  // signaled at the start of the next header block.
+  void resize(size_t size);
+
+private:
+  Table table;
+  size_t capacity;
+
+  // The smallest and the latest capacity since the last header block
+  // if the capacity has changed, both of which must be signaled to
+  // the decoder (see section 4.2).
+  Option<std::pair<size_t, size_t>> update;
+};
+
+
+class Decoder
+{
+public:
+  explicit Decoder(
+      size_t _maxHeaderListSize = DEFAULT_MAX_HEADER_LIST_SIZE)
+    : table(DEFAULT_TABLE_SIZE),
+      maxHeaderListSize(_maxHeaderListSize) {}
+
+  // Decodes the (complete) header block. An error is a connection
+  // error of type COMPRESSION_ERROR since the dynamic table might
+  // now be out of sync with the encoder. This includes a header list
+  // that exceeds the maximum size, which we check as we decode since
+  // a small block can refer to the (much larger) fields of the dynamic
+  // table over and over again.
+  Try<HeaderList> decode(const std::string& block);
+
+private:
+  Table table;
+  const size_t maxHeaderListSize;
+};
+
+
+namespace huffman {
+
+// The Huffman code of section 5.2 and Appendix B.
+std::string encode(const std::string& s);
+Try<std::string> decode(const char* data, size_t length);
+
+// Returns the length of the Huffman encoding of the string.
+size_t length(const std::string& s);
+
+} // namespace huffman {
+
+} // namespace hpack {
+} // namespace http {
+} // namespace process {
+
+#endif // __PROCESS_HPACK_HPP__
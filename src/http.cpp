@@ -22,6 +22,7 @@
 #include <cstring>
 #include <deque>
 #include <iomanip>
+#include <list>
 #include <ostream>
 #include <map>
 #include <memory>
@@ -32,8 +33,10 @@
 #include <vector>
 
 #include <process/after.hpp>
+#include <process/clock.hpp>
 #include <process/collect.hpp>
 #include <process/defer.hpp>
+#include <process/delay.hpp>
 #include <process/dispatch.hpp>
 #include <process/future.hpp>
 #include <process/http.hpp>
@@ -45,6 +48,9 @@
 #include <process/queue.hpp>
 #include <process/socket.hpp>
 #include <process/state_machine.hpp>
+#include <process/time.hpp>
+
+#include <process/metrics/metrics.hpp>
 
 #include <process/ssl/tls_config.hpp>
 
@@ -61,8 +67,11 @@
 #include <stout/try.hpp>
 #include <stout/unreachable.hpp>
 
+#include "buffer_pool.hpp"
 #include "decoder.hpp"
 #include "encoder.hpp"
+#include "http2.hpp"
+#include "http_connection_pool.hpp"
 
 using std::deque;
 using std::istringstream;
@@ -458,23 +467,52 @@ Pipe::Writer Pipe::writer() const
 
 Future<string> Pipe::Reader::read()
 {
+  Future<string> future;
+  queue<Owned<Promise<Nothing>>> writables;
+
   synchronized (data->lock) {
     if (data->readEnd == Reader::CLOSED) {
-      return Failure("closed");
+      future = Failure("closed");
     } else if (!data->writes.empty()) {
-      Future<string> future = data->writes.front();
+      string s = std::move(data->writes.front());
       data->writes.pop();
-      return future;
+
+      // Coalesce the buffered writes of a bounded pipe.
+      if (data->capacity.isSome()) {
+        while (!data->writes.empty() &&
+               s.size() + data->writes.front().size() <=
+                 data->capacity.get()) {
+          s.append(data->writes.front());
+          data->writes.pop();
+        }
+      }
+
+      data->size -= s.size();
+
+      if (data->capacity.isSome() && data->size < data->capacity.get()) {
+        std::swap(data->writables, writables);
+      }
+
+      future = std::move(s);
     } else if (data->writeEnd == Writer::CLOSED) {
-      return ""; // End-of-file.
+      future = ""; // End-of-file.
     } else if (data->writeEnd == Writer::FAILED) {
       CHECK_SOME(data->failure);
-      return data->failure.get();
+      future = data->failure.get();
     } else {
       data->reads.push(Owned<Promise<string>>(new Promise<string>()));
-      return data->reads.back()->future();
+      future = data->reads.back()->future();
     }
   }
+
+  // NOTE: We set the promises outside the critical section to avoid
+  // triggering callbacks that try to reacquire the lock.
+  while (!writables.empty()) {
+    writables.front()->set(Nothing());
+    writables.pop();
+  }
+
+  return future;
 }
 
 
@@ -504,6 +542,7 @@ bool Pipe::Reader::close()
   bool closed = false;
   bool notify = false;
   queue<Owned<Promise<string>>> reads;
+  queue<Owned<Promise<Nothing>>> writables;
 
   synchronized (data->lock) {
     if (data->readEnd == Reader::OPEN) {
@@ -512,8 +551,13 @@ bool Pipe::Reader::close()
         data->writes.pop();
       }
 
-      // Extract the pending reads so we can fail them.
+      data->size = 0;
+
+      // Extract the pending reads so we can fail them, and the
+      // waiting writers so we can let them find out that the
+      // read-end is closed.
       std::swap(data->reads, reads);
+      std::swap(data->writables, writables);
 
       closed = true;
       data->readEnd = Reader::CLOSED;
@@ -531,6 +575,11 @@ bool Pipe::Reader::close()
       reads.pop();
     }
 
+    while (!writables.empty()) {
+      writables.front()->set(Nothing());
+      writables.pop();
+    }
+
     if (notify) {
       data->readerClosure.set(Nothing());
     } else {
@@ -556,6 +605,7 @@ bool Pipe::Writer::write(string s)
       // Don't bother surfacing empty writes to the readers.
       if (!s.empty()) {
         if (data->reads.empty()) {
+          data->size += s.size();
           data->writes.push(std::move(s));
         } else {
           read = data->reads.front();
@@ -580,11 +630,14 @@ bool Pipe::Writer::close()
 {
   bool closed = false;
   queue<Owned<Promise<string>>> reads;
+  queue<Owned<Promise<Nothing>>> writables;
 
   synchronized (data->lock) {
     if (data->writeEnd == Writer::OPEN) {
-      // Extract all the pending reads so we can complete them.
+      // Extract all the pending reads so we can complete them, as
+      // well as any writers still waiting to write.
       std::swap(data->reads, reads);
+      std::swap(data->writables, writables);
 
       data->writeEnd = Writer::CLOSED;
       closed = true;
@@ -598,6 +651,11 @@ bool Pipe::Writer::close()
     reads.pop();
   }
 
+  while (!writables.empty()) {
+    writables.front()->set(Nothing());
+    writables.pop();
+  }
+
   return closed;
 }
 
@@ -606,11 +664,14 @@ bool Pipe::Writer::fail(const string& message)
 {
   bool failed = false;
   queue<Owned<Promise<string>>> reads;
+  queue<Owned<Promise<Nothing>>> writables;
 
   synchronized (data->lock) {
     if (data->writeEnd == Writer::OPEN) {
-      // Extract all the pending reads so we can fail them.
+      // Extract all the pending reads so we can fail them, as well
+      // as any writers still waiting to write.
       std::swap(data->reads, reads);
+      std::swap(data->writables, writables);
 
       data->writeEnd = Writer::FAILED;
       data->failure = Failure(message);
@@ -625,6 +686,11 @@ bool Pipe::Writer::fail(const string& message)
     reads.pop();
   }
 
+  while (!writables.empty()) {
+    writables.front()->set(Nothing());
+    writables.pop();
+  }
+
   return failed;
 }
 
@@ -635,6 +701,22 @@ Future<Nothing> Pipe::Writer::readerClosed() const
 }
 
 
+Future<Nothing> Pipe::Writer::writable() const
+{
+  synchronized (data->lock) {
+    if (data->capacity.isNone() ||
+        data->size < data->capacity.get() ||
+        data->readEnd != Reader::OPEN ||
+        data->writeEnd != Writer::OPEN) {
+      return Nothing();
+    }
+
+    data->writables.push(Owned<Promise<Nothing>>(new Promise<Nothing>()));
+    return data->writables.back()->future();
+  }
+}
+
+
 namespace header {
 
 Try<WWWAuthenticate> WWWAuthenticate::create(const string& value)
@@ -973,96 +1055,34 @@ ostream& operator<<(ostream& stream, const URL& url)
 
 namespace internal {
 
+// Capacity of the (bounded) pipes that a connection streams request
+// and response bodies through, see `Pipe`. The connection stops
+// reading a request body from the caller, or a response body from
+// the socket, while this much of it has not been consumed yet.
+constexpr size_t CONNECTION_PIPE_CAPACITY = 256 * 1024;
+
+
 // Encodes the request by writing into a pipe, the caller can
 // read the encoded data from the returned read end of the pipe.
 // A pipe is used since the request body can be a pipe and must
 // be read asynchronously.
 Pipe::Reader encode(const Request& request)
 {
-  // TODO(bmahler): Replace this with a RequestEncoder.
-  std::ostringstream out;
-
-  out << request.method
-      << " /" << strings::remove(request.url.path, "/", strings::PREFIX);
-
-  if (!request.url.query.empty()) {
-    // Convert the query to a string that we join via '=' and '&'.
-    vector<string> query;
-
-    foreachpair (const string& key, const string& value, request.url.query) {
-      query.push_back(http::encode(key) + "=" + http::encode(value));
-    }
-
-    out << "?" << strings::join("&", query);
-  }
-
-  if (request.url.fragment.isSome()) {
-    out << "#" << request.url.fragment.get();
-  }
-
-  out << " HTTP/1.1\r\n";
-
-  // Overwrite headers as necessary.
-  Headers headers = request.headers;
-
-  // Need to specify the 'Host' header.
-  CHECK(request.url.domain.isSome() || request.url.ip.isSome());
-
-  if (request.url.domain.isSome()) {
-    headers["Host"] = request.url.domain.get();
-  } else if (request.url.ip.isSome()) {
-    headers["Host"] = stringify(request.url.ip.get());
-  }
-
-  // Add port for non-standard ports.
-  if (request.url.port.isSome() &&
-      request.url.port != 80 &&
-      request.url.port != 443) {
-    headers["Host"] += ":" + stringify(request.url.port.get());
-  }
-
-  if (!request.keepAlive) {
-    // Tell the server to close the connection when it's done.
-    headers["Connection"] = "close";
-  }
-
-  if (request.type == Request::PIPE) {
-    CHECK(!headers.contains("Content-Length"));
-
-    // Make sure the Transfer-Encoding header is set correctly
-    // for PIPE requests.
-    headers["Transfer-Encoding"] = "chunked";
-  } else {
-    CHECK_EQ(Request::BODY, request.type);
-
-    // Make sure the Content-Length header is set correctly.
-    headers["Content-Length"] = stringify(request.body.length());
-  }
-
-  // TODO(bmahler): Use a 'Request' and a 'RequestEncoder' here!
-  // Currently this does not handle 'gzip' content encoding,
-  // unless the caller manually compresses the 'body'. For
+  // TODO(bmahler): Currently this does not handle 'gzip' content
+  // encoding, unless the caller manually compresses the 'body'. For
   // streaming requests we must wipe 'gzip' as an acceptable
   // encoding as we don't currently have streaming gzip utilities
   // to support decoding a streaming gzip response!
 
-  // Emit the headers.
-  foreachpair (const string& key, const string& value, headers) {
-    out << key << ": " << value << "\r\n";
-  }
-
-  out << "\r\n";
-
-  Pipe pipe;
+  Pipe pipe(CONNECTION_PIPE_CAPACITY);
   Pipe::Reader reader = pipe.reader();
   Pipe::Writer writer = pipe.writer();
 
-  // Write the head of the request.
-  writer.write(out.str());
+  // Write the head of the request (and the body of a 'BODY' request).
+  writer.write(HttpRequestEncoder::encode(request));
 
   switch (request.type) {
     case Request::BODY:
-      writer.write(request.body);
       writer.close();
       break;
     case Request::PIPE:
@@ -1073,22 +1093,22 @@ Pipe::Reader encode(const Request& request)
            [=]() mutable {
              return requestReader.read();
            },
-           [=](const string& chunk) mutable -> ControlFlow<Nothing> {
+           [=](const string& chunk) mutable
+               -> Future<ControlFlow<Nothing>> {
+             writer.write(HttpChunkEncoder::encode(chunk));
+
              if (chunk.empty()) {
                // EOF case.
-               writer.write("0\r\n\r\n");
                writer.close();
                return Break();
              }
 
-             std::ostringstream out;
-             out << std::hex << chunk.size() << "\r\n";
-             out << chunk;
-             out << "\r\n";
-
-             writer.write(out.str());
-
-             return Continue();
+             // Don't read more of the body until the socket has
+             // caught up with what we've encoded so far.
+             return writer.writable()
+               .then([]() -> ControlFlow<Nothing> {
+                 return Continue();
+               });
            })
         .onDiscarded([=]() mutable {
           writer.fail("discarded");
@@ -1129,6 +1149,7 @@ public:
   ConnectionProcess(const network::Socket& _socket)
     : ProcessBase(ID::generate("__http_connection__")),
       socket(_socket),
+      decoder(CONNECTION_PIPE_CAPACITY),
       sendChain(Nothing()),
       close(false) {}
 
@@ -1303,8 +1324,7 @@ private:
         promise.associate(convert(*response));
       }
 
-      if (response->headers.contains("Connection") &&
-          response->headers.at("Connection") == "close") {
+      if (internal::closesConnection(response->headers)) {
         // This is the last response the server will send!
         close = true;
 
@@ -1339,7 +1359,12 @@ private:
       return;
     }
 
-    read();
+    // Don't read more of a streamed response body until the caller
+    // has caught up with what we've decoded so far.
+    decoder.writable()
+      .onAny(defer(self(), [this](const Future<Nothing>&) {
+        read();
+      }));
   }
 
   network::Socket socket;
@@ -1371,8 +1396,17 @@ struct Connection::Data
   // on within a different execution context. More generally,
   // we should be passing Process ownership to libprocess to
   // ensure all interaction with a Process occurs through a PID.
-  Data(const network::Socket& s)
-    : process(spawn(new internal::ConnectionProcess(s), true)) {}
+  Data(const network::Socket& s, Protocol protocol)
+  {
+    switch (protocol) {
+      case Protocol::HTTP_1_1:
+        pipelined = spawn(new internal::ConnectionProcess(s), true);
+        break;
+      case Protocol::HTTP_2:
+        multiplexed = spawn(new http2::ClientProcess(s), true);
+        break;
+    }
+  }
 
   ~Data()
   {
@@ -1381,27 +1415,45 @@ struct Connection::Data
     // to ensure we don't drop any queued request dispatches
     // which would leave the caller with a future stuck in
     // a pending state.
-    terminate(process, false);
+    if (pipelined.isSome()) {
+      terminate(pipelined.get(), false);
+    }
+
+    if (multiplexed.isSome()) {
+      terminate(multiplexed.get(), false);
+    }
   }
 
-  PID<internal::ConnectionProcess> process;
+  // Exactly one of these is set, depending on the protocol.
+  Option<PID<internal::ConnectionProcess>> pipelined;
+  Option<PID<http2::ClientProcess>> multiplexed;
 };
 
 
 Connection::Connection(
     const network::Socket& s,
     const network::Address& _localAddress,
-    const network::Address& _peerAddress)
+    const network::Address& _peerAddress,
+    Protocol _protocol)
   : localAddress(_localAddress), peerAddress(_peerAddress),
-    data(std::make_shared<Connection::Data>(s)) {}
+    protocol(_protocol),
+    data(std::make_shared<Connection::Data>(s, _protocol)) {}
 
 
 Future<Response> Connection::send(
     const http::Request& request,
     bool streamedResponse)
 {
+  if (data->multiplexed.isSome()) {
+    return dispatch(
+        data->multiplexed.get(),
+        &http2::ClientProcess::send,
+        request,
+        streamedResponse);
+  }
+
   return dispatch(
-      data->process,
+      data->pipelined.get(),
       &internal::ConnectionProcess::send,
       request,
       streamedResponse);
@@ -1410,8 +1462,15 @@ Future<Response> Connection::send(
 
 Future<Nothing> Connection::disconnect()
 {
+  if (data->multiplexed.isSome()) {
+    return dispatch(
+        data->multiplexed.get(),
+        &http2::ClientProcess::disconnect,
+        None());
+  }
+
   return dispatch(
-      data->process,
+      data->pipelined.get(),
       &internal::ConnectionProcess::disconnect,
       None());
 }
@@ -1419,8 +1478,14 @@ Future<Nothing> Connection::disconnect()
 
 Future<Nothing> Connection::disconnected()
 {
+  if (data->multiplexed.isSome()) {
+    return dispatch(
+        data->multiplexed.get(),
+        &http2::ClientProcess::disconnected);
+  }
+
   return dispatch(
-      data->process,
+      data->pipelined.get(),
       &internal::ConnectionProcess::disconnected);
 }
 
@@ -1429,6 +1494,16 @@ Future<Connection> connect(
     const network::Address& address,
     Scheme scheme,
     const Option<string>& peer_hostname)
+{
+  return connect(address, scheme, peer_hostname, Protocol::HTTP_1_1);
+}
+
+
+Future<Connection> connect(
+    const network::Address& address,
+    Scheme scheme,
+    const Option<string>& peer_hostname,
+    Protocol protocol)
 {
   SocketImpl::Kind kind;
 
@@ -1451,6 +1526,11 @@ Future<Connection> connect(
     return Failure("Failed to create socket: " + socket.error());
   }
 
+  // Over HTTPS the server picks the protocol, see `Connection::protocol`.
+  if (protocol == Protocol::HTTP_2) {
+    socket->setApplicationProtocols({"h2", "http/1.1"});
+  }
+
   Future<Nothing> connected = [&]() {
     switch (scheme) {
       case Scheme::HTTP:
@@ -1466,14 +1546,22 @@ Future<Connection> connect(
   }();
 
   return connected
-    .then([socket, address]() -> Future<Connection> {
+    .then([socket, address, scheme, protocol]() -> Future<Connection> {
       Try<network::Address> localAddress = socket->address();
       if (localAddress.isError()) {
         return Failure("Failed to get socket's local address: " +
             localAddress.error());
       }
 
-      return Connection(socket.get(), localAddress.get(), address);
+      Protocol negotiated = protocol;
+
+      if (protocol == Protocol::HTTP_2 && scheme != Scheme::HTTP &&
+          socket->applicationProtocol() != string("h2")) {
+        negotiated = Protocol::HTTP_1_1;
+      }
+
+      return Connection(
+          socket.get(), localAddress.get(), address, negotiated);
     });
 }
 
@@ -1533,6 +1621,349 @@ Future<Connection> connect(const URL& url)
 
 namespace internal {
 
+// Returns the scheme, host, and port of the URL, i.e., what
+// determines whether a connection can be reused for it.
+static string authority(const URL& url)
+{
+  string host;
+  if (url.domain.isSome()) {
+    host = url.domain.get();
+  } else if (url.ip.isSome()) {
+    host = stringify(url.ip.get());
+  }
+
+  return url.scheme.getOrElse("http") + "://" + host + ":" +
+    (url.port.isSome() ? stringify(url.port.get()) : "");
+}
+
+
+// Returns whether sending a request with the method more than once
+// has the same effect as sending it once (see RFC 7231 section 4.2.2).
+static bool idempotent(const string& method)
+{
+  return method == "GET" ||
+         method == "HEAD" ||
+         method == "PUT" ||
+         method == "DELETE" ||
+         method == "OPTIONS" ||
+         method == "TRACE";
+}
+
+
+ConnectionPoolProcess::Metrics::Metrics()
+  : hits("libprocess/http_client/pool_hits"),
+    misses("libprocess/http_client/pool_misses") {}
+
+
+ConnectionPoolProcess::ConnectionPoolProcess(
+    size_t _maxIdle,
+    size_t _maxPerHost,
+    const Duration& _idleTimeout,
+    size_t _pipeliningDepth)
+  : ProcessBase(ID::generate("__http_connection_pool__")),
+    maxIdle(_maxIdle),
+    maxPerHost(_maxPerHost),
+    idleTimeout(_idleTimeout),
+    pipeliningDepth(_pipeliningDepth),
+    idle(0),
+    nextId(0) {}
+
+
+void ConnectionPoolProcess::initialize()
+{
+  metrics::add(poolMetrics.hits);
+  metrics::add(poolMetrics.misses);
+}
+
+
+void ConnectionPoolProcess::finalize()
+{
+  metrics::remove(poolMetrics.hits);
+  metrics::remove(poolMetrics.misses);
+
+  foreachvalue (list<Entry>& entries, connections) {
+    foreach (Entry& entry, entries) {
+      entry.connection.disconnect();
+    }
+  }
+
+  connections.clear();
+}
+
+
+Future<Response> ConnectionPoolProcess::send(Request request)
+{
+  if (maxPerHost == 0) {
+    request.keepAlive = false;
+    return http::request(request, false);
+  }
+
+  request.keepAlive = true;
+
+  const string authority = internal::authority(request.url);
+
+  // Pick the connection with the fewest outstanding requests that
+  // can still pipeline another one, if any.
+  Entry* entry = nullptr;
+
+  if (connections.contains(authority)) {
+    foreach (Entry& candidate, connections.at(authority)) {
+      if (candidate.outstanding < pipeliningDepth &&
+          (entry == nullptr || candidate.outstanding < entry->outstanding)) {
+        entry = &candidate;
+      }
+    }
+  }
+
+  if (entry != nullptr) {
+    ++poolMetrics.hits;
+
+    Future<Response> response = __send(authority, entry, request);
+
+    if (!idempotent(request.method)) {
+      return response;
+    }
+
+    // The server might have closed the connection just as we reused
+    // it, in which case we retry once on a new one-off connection,
+    // i.e., one that doesn't get pooled.
+    return response
+      .repair([request](const Future<Response>&) {
+        Request retry = request;
+        retry.keepAlive = false;
+        return http::request(retry, false);
+      });
+  }
+
+  ++poolMetrics.misses;
+
+  size_t size = 0;
+  if (connections.contains(authority)) {
+    size += connections.at(authority).size();
+  }
+  if (connecting.contains(authority)) {
+    size += connecting.at(authority);
+  }
+
+  if (size >= maxPerHost) {
+    request.keepAlive = false;
+    return http::request(request, false);
+  }
+
+  connecting[authority]++;
+
+  Future<Connection> connection = http::connect(request.url);
+
+  connection
+    .onAny(defer(self(), [=](const Future<Connection>&) {
+      connected(authority);
+    }));
+
+  return connection
+    .then(defer(self(), &Self::_send, authority, lambda::_1, request));
+}
+
+
+void ConnectionPoolProcess::connected(const string& authority)
+{
+  CHECK(connecting.contains(authority));
+
+  if (--connecting.at(authority) == 0) {
+    connecting.erase(authority);
+  }
+}
+
+
+Future<Response> ConnectionPoolProcess::_send(
+    const string& authority,
+    const Connection& connection,
+    const Request& request)
+{
+  list<Entry>& entries = connections[authority];
+  entries.emplace_back(nextId++, connection);
+
+  Entry* entry = &entries.back();
+  entry->idleSince = Clock::now();
+  idle++;
+
+  // Stop pooling the connection as soon as it gets disconnected,
+  // e.g., because the server closed it.
+  const uint64_t id = entry->id;
+
+  entry->connection.disconnected()
+    .onAny(defer(self(), [=](const Future<Nothing>&) {
+      remove(authority, id);
+    }));
+
+  return __send(authority, entry, request);
+}
+
+
+Future<Response> ConnectionPoolProcess::__send(
+    const string& authority,
+    Entry* entry,
+    const Request& request)
+{
+  if (entry->outstanding == 0) {
+    CHECK_GT(idle, 0u);
+    idle--;
+  }
+
+  entry->outstanding++;
+
+  Future<Response> response = entry->connection.send(request);
+
+  response
+    .onAny(defer(self(), &Self::release, authority, entry->id, lambda::_1));
+
+  return response;
+}
+
+
+void ConnectionPoolProcess::release(
+    const string& authority,
+    uint64_t id,
+    const Future<Response>& response)
+{
+  Entry* entry = find(authority, id);
+  if (entry == nullptr) {
+    return; // Already removed, e.g., because it got disconnected.
+  }
+
+  CHECK_GT(entry->outstanding, 0u);
+
+  if (--entry->outstanding == 0) {
+    entry->idleSince = Clock::now();
+    idle++;
+  }
+
+  // Stop pooling the connection if the request failed, since we
+  // don't know what state the connection is in, or if the server
+  // is closing it.
+  if (!response.isReady() ||
+      internal::closesConnection(response->headers)) {
+    remove(authority, id);
+    return;
+  }
+
+  if (entry->outstanding == 0) {
+    delay(idleTimeout,
+          self(),
+          &Self::expire,
+          authority,
+          id,
+          entry->idleSince);
+
+    evict();
+  }
+}
+
+
+void ConnectionPoolProcess::expire(
+    const string& authority,
+    uint64_t id,
+    const Time& since)
+{
+  Entry* entry = find(authority, id);
+
+  if (entry != nullptr &&
+      entry->outstanding == 0 &&
+      entry->idleSince == since) {
+    remove(authority, id);
+  }
+}
+
+
+void ConnectionPoolProcess::remove(const string& authority, uint64_t id)
+{
+  if (!connections.contains(authority)) {
+    return;
+  }
+
+  list<Entry>& entries = connections.at(authority);
+
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (it->id == id) {
+      if (it->outstanding == 0) {
+        CHECK_GT(idle, 0u);
+        idle--;
+      }
+
+      it->connection.disconnect();
+      entries.erase(it);
+      break;
+    }
+  }
+
+  if (entries.empty()) {
+    connections.erase(authority);
+  }
+}
+
+
+void ConnectionPoolProcess::evict()
+{
+  while (idle > maxIdle) {
+    Option<string> authority = None();
+    uint64_t id = 0;
+    Time since;
+
+    foreachpair (const string& key, const list<Entry>& entries, connections) {
+      foreach (const Entry& entry, entries) {
+        if (entry.outstanding == 0 &&
+            (authority.isNone() || entry.idleSince < since)) {
+          authority = key;
+          id = entry.id;
+          since = entry.idleSince;
+        }
+      }
+    }
+
+    CHECK_SOME(authority);
+
+    remove(authority.get(), id);
+  }
+}
+
+
+ConnectionPoolProcess::Entry* ConnectionPoolProcess::find(
+    const string& authority,
+    uint64_t id)
+{
+  if (connections.contains(authority)) {
+    foreach (Entry& entry, connections.at(authority)) {
+      if (entry.id == id) {
+        return &entry;
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+} // namespace internal {
+
+
+namespace internal {
+
+bool closesConnection(const Headers& headers)
+{
+  Option<string> connection = headers.get("Connection");
+
+  if (connection.isNone()) {
+    return false;
+  }
+
+  foreach (const string& option, strings::tokenize(connection.get(), ",")) {
+    if (strings::lower(strings::trim(option)) == "close") {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
 Future<Nothing> send(network::Socket socket, Encoder* encoder)
 {
   size_t* size = new size_t(0);
@@ -1663,21 +2094,10 @@ Future<Nothing> stream(
         return reader.read();
       },
       [=](const string& data) mutable {
-        bool finished = false;
+        // An empty chunk means we finished reading.
+        bool finished = data.empty();
 
-        ostringstream out;
-
-        if (data.empty()) {
-          // Finished reading.
-          out << "0\r\n" << "\r\n";
-          finished = true;
-        } else {
-          out << std::hex << data.size() << "\r\n";
-          out << data;
-          out << "\r\n";
-        }
-
-        Encoder* encoder = new DataEncoder(out.str());
+        Encoder* encoder = new HttpChunkEncoder(data);
 
         return send(socket, encoder)
           .onAny([=]() {
@@ -1803,10 +2223,8 @@ Future<Nothing> send(
               // Persist the connection if the request expects it and
               // the response doesn't include 'Connection: close'.
               bool persist = request->keepAlive;
-              if (response.headers.contains("Connection")) {
-                if (response.headers.at("Connection") == "close") {
-                  persist = false;
-                }
+              if (closesConnection(response.headers)) {
+                persist = false;
               }
               if (persist) {
                 return Continue();
@@ -1824,7 +2242,8 @@ Future<Nothing> send(
 Future<Nothing> receive(
     network::Socket socket,
     std::function<Future<Response>(const Request&)>&& f,
-    Queue<Option<Item>> pipeline)
+    Queue<Option<Item>> pipeline,
+    const string& received)
 {
   // Get the peer address to augment any requests we receive.
   Try<network::Address> address = socket.peer();
@@ -1833,14 +2252,33 @@ Future<Nothing> receive(
     return Failure("Failed to get peer address: " + address.error());
   }
 
-  const size_t size = io::BUFFERED_READ_SIZE;
-  char* data = new char[size];
-
   StreamingRequestDecoder* decoder = new StreamingRequestDecoder();
 
+  // Decode what got received while telling HTTP/1.1 apart from HTTP/2
+  // (see `serve`) before receiving anything else.
+  if (!received.empty()) {
+    const deque<Request*> requests =
+      decoder->decode(received.data(), received.size());
+
+    if (decoder->failed() && requests.empty()) {
+      delete decoder;
+      return Failure("Decoder error while receiving");
+    }
+
+    foreach (Request* request, requests) {
+      request->client = address.get();
+      pipeline.put(Item{request, f(*request)});
+    }
+  }
+
+  // The buffer we're receiving into, if any. We only borrow a buffer
+  // from the pool while there is data to receive and give it back once
+  // we've decoded the data so that idle connections don't hold one.
+  char** buffer = new char*(nullptr);
+
   return loop(
       [=]() {
-        return socket.recv(data, size);
+        return BufferPool::recv(socket, buffer);
       },
       [=](size_t length) mutable -> Future<ControlFlow<Nothing>> {
         if (length == 0) {
@@ -1848,7 +2286,10 @@ Future<Nothing> receive(
         }
 
         // Decode as much of the data as possible into HTTP requests.
-        const deque<Request*> requests = decoder->decode(data, length);
+        const deque<Request*> requests = decoder->decode(*buffer, length);
+
+        BufferPool::release(*buffer);
+        *buffer = nullptr;
 
         // NOTE: it's possible the decoder has failed but some
         // requests might be available, i.e., `requests.empty()` is
@@ -1874,14 +2315,38 @@ Future<Nothing> receive(
       })
     .onAny([=]() {
       delete decoder;
-      delete[] data;
+      BufferPool::release(*buffer);
+      delete buffer;
     });
 }
 
 
-Future<Nothing> serve(
+// Receives until the data received so far tells whether the client
+// speaks HTTP/2, i.e., starts with the connection preface (which it
+// sends first with prior knowledge as well as after negotiating "h2"
+// with ALPN), or HTTP/1.1.
+Future<string> detect(network::Socket socket, const string& received)
+{
+  return socket.recv()
+    .then([=](const string& data) -> Future<string> {
+      const string received_ = received + data;
+
+      if (data.empty() ||
+          received_.size() >= http2::PREFACE_SIZE ||
+          received_.compare(
+              0, string::npos, http2::PREFACE, received_.size()) != 0) {
+        return received_;
+      }
+
+      return detect(socket, received_);
+    });
+}
+
+
+Future<Nothing> _serve(
     network::Socket socket,
-    std::function<Future<Response>(const Request&)>&& f)
+    std::function<Future<Response>(const Request&)>&& f,
+    const string& received)
 {
   // HTTP serving is implemented by running two loops, a "receive"
   // loop and a "send" loop. The receive loop passes the pipeline of
@@ -1895,7 +2360,7 @@ Future<Nothing> serve(
   Queue<Option<Item>> pipeline;
 
   Future<Nothing> receiving =
-    receive(socket, std::move(f), pipeline)
+    receive(socket, std::move(f), pipeline, received)
       .onAny([=]() mutable {
         // Either:
         //
@@ -1988,6 +2453,27 @@ Future<Nothing> serve(
   return promise->future();
 }
 
+
+Future<Nothing> serve(
+    network::Socket socket,
+    std::function<Future<Response>(const Request&)>&& f,
+    bool enableHttp2)
+{
+  if (!enableHttp2) {
+    return _serve(socket, std::move(f), "");
+  }
+
+  return detect(socket, "")
+    .then([socket, f](const string& received) mutable {
+      if (received.size() >= http2::PREFACE_SIZE &&
+          received.compare(0, http2::PREFACE_SIZE, http2::PREFACE) == 0) {
+        return http2::serve(socket, std::move(f), received);
+      }
+
+      return _serve(socket, std::move(f), received);
+    });
+}
+
 } // namespace internal {
 
 
@@ -1995,98 +2481,72 @@ class ServerProcess : public Process<ServerProcess>
 {
 public:
   ServerProcess(
-      network::Socket&& socket,
+      std::vector<network::Socket>&& sockets,
       std::function<Future<Response>(
           const network::Socket&,
-          const Request&)>&& f)
-    : socket(std::move(socket)),
+          const Request&)>&& f,
+      bool _enableHttp2)
+    : sockets(std::move(sockets)),
       f(std::move(f)),
+      enableHttp2(_enableHttp2),
       state(State::INITIALIZED) {}
 
   // `Server` implementation.
   Future<Nothing> run()
   {
     return state.transition<State::INITIALIZED, State::RUNNING>([=]() {
-        // Start the accept loop and store the future so we can later
-        // discard it when we need to stop the server.
-        accepting = loop(
-          self(),
-          [=]() {
-            return socket.accept();
-          },
-          [=](const network::Socket& socket) -> ControlFlow<Nothing> {
-            // If we've transitioned to STOPPING we should break. It
-            // may seem like we should never get here because we
-            // discard the accept loop before we transition to
-            // STOPPING but it's possible that we've already
-            // dispatched this lambda and it is only now getting
-            // invoked. It's critical that we break because after we
-            // transition to STOPPING we assume that `clients` will
-            // not be modified by the accept loop.
-            if (state.is<State::STOPPING>()) {
-              return Break();
-            }
-
-            Client client = {
-              /* .socket = */ socket,
-              /* .serving = */ http::serve(
-                  socket,
-                  [=](const Request& request) {
-                    return f(socket, request);
-                  })
-            };
-
-            clients.put(socket, client);
-
-            client.serving
-              .onAny(defer(self(), [=](const Future<Nothing>&) {
-                clients.erase(socket);
-              }));
+        // Start an accept loop per socket and store the futures so we
+        // can later discard them when we need to stop the server.
+        foreach (const network::Socket& socket, sockets) {
+          loops.push_back(accept(socket));
+        }
 
-            return Continue();
+        accepting = collect(loops)
+          .then([]() {
+            return Nothing();
           });
 
-      // We return a _discardable_ `accepting` so the caller can stop
-      // running a server by "discarding the run", for example:
-      //
-      //   Future<Nothing> run = server.run();
-      //   run.discard();
-      //
-      // Even if we returned an _undiscardable_ `accepting` we still
-      // need to do a `recover()` on it in the event that the accept
-      // loop fails (or is abandoned) so we can stop the server (if it
-      // isn't already being stopped). If `accepting` completes
-      // successfully then we must be stopping so just wait until
-      // we've stopped!
-      return accepting
-        .then(defer(self(), [=]() {
-          return state.when<State::STOPPED>();
-        }))
-        .recover(defer(self(), [=](const Future<Nothing>& future) {
-          // If the accept loop completes because it is abandoned,
-          // discarded, or failed we want to stop the server if it
-          // isn't already being stopped. In fact, someone stopping
-          // the server might be the reason we're executing this
-          // callback because `stop()` discards `accepting`.
-          //
-          // If we're not already stopping, i.e., the state is
-          // RUNNING, then it's safe to assume that the accept loop
-          // has (1) failed or (2) been discarded because someone did
-          // a discard on the future returned from `run()`. In either
-          // of these cases we initiate a `stop()` ourselves and after
-          // that completes return a failure capturing the reason we
-          // had to initiate the stop.
-          if (state.is<State::RUNNING>()) {
-            return stop(Server::DEFAULT_STOP_OPTIONS())
-              .then([=]() -> Future<Nothing> {
-                return Failure(stringify(future));
-              });
-          }
+        // We return a _discardable_ `accepting` so the caller can stop
+        // running a server by "discarding the run", for example:
+        //
+        //   Future<Nothing> run = server.run();
+        //   run.discard();
+        //
+        // Even if we returned an _undiscardable_ `accepting` we still
+        // need to do a `recover()` on it in the event that an accept
+        // loop fails (or is abandoned) so we can stop the server (if it
+        // isn't already being stopped). If `accepting` completes
+        // successfully then we must be stopping so just wait until
+        // we've stopped!
+        return accepting
+          .then(defer(self(), [=]() {
+            return state.when<State::STOPPED>();
+          }))
+          .recover(defer(self(), [=](const Future<Nothing>& future) {
+            // If an accept loop completes because it is abandoned,
+            // discarded, or failed we want to stop the server if it
+            // isn't already being stopped. In fact, someone stopping
+            // the server might be the reason we're executing this
+            // callback because `stop()` discards the accept loops.
+            //
+            // If we're not already stopping, i.e., the state is
+            // RUNNING, then it's safe to assume that an accept loop
+            // has (1) failed or (2) been discarded because someone did
+            // a discard on the future returned from `run()`. In either
+            // of these cases we initiate a `stop()` ourselves and after
+            // that completes return a failure capturing the reason we
+            // had to initiate the stop.
+            if (state.is<State::RUNNING>()) {
+              return stop(Server::DEFAULT_STOP_OPTIONS())
+                .then([=]() -> Future<Nothing> {
+                  return Failure(stringify(future));
+                });
+            }
 
-          // Otherwise we must already be stopping so just wait till
-          // we're stopped.
-          return state.when<State::STOPPED>();
-        }));
+            // Otherwise we must already be stopping so just wait till
+            // we're stopped.
+            return state.when<State::STOPPED>();
+          }));
     });
   }
 
@@ -2099,16 +2559,20 @@ public:
       // discards the future returned from `run()` after they've
       // already called `stop()`.
       return undiscardable([=]() {
-        accepting.discard();
+        foreach (Future<Nothing> loop, loops) {
+          loop.discard();
+        }
 
-        // In addition to discarding the accept loop we also attempt
+        // In addition to discarding the accept loops we also attempt
         // to stop accepting new clients via shutting down the
-        // socket. Shutting down the socket on Linux will keep further
+        // sockets. Shutting down a socket on Linux will keep further
         // connections from being established even though we haven't
         // closed the socket but on OS X connections will keep queuing
         // (in fact, calling `shutdown()` is an error, hence we don't
         // check the return value).
-        socket.shutdown(network::Socket::Shutdown::READ_WRITE);
+        foreach (network::Socket socket, sockets) {
+          socket.shutdown(network::Socket::Shutdown::READ_WRITE);
+        }
 
         // TODO(benh): ideally we also try and shut down the read end
         // of existing clients to signal that we won't handle any new
@@ -2129,7 +2593,7 @@ public:
 
         // Wait for the current clients to finish (we know no more
         // clients will get added because we set `stopping` and the
-        // accept loop will respect that (see `run()`).
+        // accept loops will respect that (see `accept()`).
         return await(lambda::map(
             [](Client&& client) {
               return client.serving;
@@ -2150,9 +2614,9 @@ public:
           .then(defer(self(), [=]() {
             clients.clear();
 
-            // We `await()` the accept loop because we don't care how
-            // it completes, we just want it to complete.
-            return await(accepting)
+            // We `await()` the accept loops because we don't care how
+            // they complete, we just want them to complete.
+            return await(loops)
               .then(defer(self(), [=]() -> Future<Nothing> {
                 return state.transition<State::STOPPING, State::STOPPED>();
               }));
@@ -2165,12 +2629,14 @@ public:
 protected:
   void finalize() override
   {
-    // If we started the accept loop then discard it and any clients
-    // we are already serving.
-    accepting.discard();
+    // If we started the accept loops then discard them and any
+    // clients we are already serving.
+    foreach (Future<Nothing> loop, loops) {
+      loop.discard();
+    }
 
     // NOTE: we know that no more sockets will be accepted because
-    // the accept loop is on `self()` and we're in `finalize()`.
+    // the accept loops are on `self()` and we're in `finalize()`.
     foreachvalue (Client& client, clients) {
       client.serving.discard();
     }
@@ -2179,9 +2645,55 @@ protected:
   }
 
 private:
-  network::Socket socket;
+  // Accepts clients on the socket until stopping.
+  Future<Nothing> accept(const network::Socket& listener)
+  {
+    return loop(
+      self(),
+      [=]() {
+        network::Socket socket = listener; // Remove const.
+        return socket.accept();
+      },
+      [=](const network::Socket& socket) -> ControlFlow<Nothing> {
+        // If we've transitioned to STOPPING we should break. It
+        // may seem like we should never get here because we
+        // discard the accept loop before we transition to
+        // STOPPING but it's possible that we've already
+        // dispatched this lambda and it is only now getting
+        // invoked. It's critical that we break because after we
+        // transition to STOPPING we assume that `clients` will
+        // not be modified by the accept loop.
+        if (state.is<State::STOPPING>()) {
+          return Break();
+        }
+
+        Client client = {
+          /* .socket = */ socket,
+          /* .serving = */ internal::serve(
+              socket,
+              [=](const Request& request) {
+                return f(socket, request);
+              },
+              enableHttp2)
+        };
+
+        clients.put(socket, client);
+
+        client.serving
+          .onAny(defer(self(), [=](const Future<Nothing>&) {
+            clients.erase(socket);
+          }));
+
+        return Continue();
+      });
+  }
+
+  std::vector<network::Socket> sockets;
   std::function<Future<Response>(const network::Socket&, const Request&)> f;
 
+  // See `Server::CreateOptions::http2`.
+  const bool enableHttp2;
+
   enum class State
   {
     INITIALIZED,
@@ -2192,6 +2704,7 @@ private:
 
   StateMachine<State> state;
 
+  std::vector<Future<Nothing>> loops;
   Future<Nothing> accepting;
 
   struct Client
@@ -2219,12 +2732,19 @@ Try<Server> Server::create(
   // tests that try and start making connections immediately after
   // `Server::run` has returned but potentially before
   // `Socket::listen` has been invoked.
+  //
+  // Over HTTPS we negotiate either protocol with ALPN if we serve
+  // HTTP/2, `serve` tells them apart by what the client sends first.
+  if (options.http2) {
+    socket.setApplicationProtocols({"h2", "http/1.1"});
+  }
+
   Try<Nothing> listen = socket.listen(static_cast<int>(options.backlog));
   if (listen.isError()) {
     return Error("Failed to listen on socket: " + listen.error());
   }
 
-  return Server(std::move(socket), std::move(f));
+  return Server({std::move(socket)}, std::move(f), options.http2);
 }
 
 
@@ -2243,30 +2763,77 @@ Try<Server> Server::create(
     UNREACHABLE();
   }();
 
-  Try<network::Socket> socket = network::Socket::create(
-      address.family(),
-      kind);
+  const size_t listeners = std::max(options.listeners, size_t(1));
 
-  if (socket.isError()) {
-    return Error("Failed to create socket: " + socket.error());
+#ifndef SO_REUSEPORT
+  if (listeners > 1) {
+    return Error("Multiple listeners require SO_REUSEPORT");
   }
+#endif // SO_REUSEPORT
 
-  Try<network::Address> bind = socket->bind(address);
-  if (bind.isError()) {
-    return Error(
-        "Failed to bind to address '" + stringify(address) + "': "
-        + bind.error());
+  vector<network::Socket> sockets;
+
+  // NOTE: the first socket binds to the address, the others bind to
+  // the address it got bound to in case it asked for a random port.
+  Option<network::Address> bound = None();
+
+  for (size_t i = 0; i < listeners; i++) {
+    Try<network::Socket> socket = network::Socket::create(
+        address.family(),
+        kind);
+
+    if (socket.isError()) {
+      return Error("Failed to create socket: " + socket.error());
+    }
+
+#ifdef SO_REUSEPORT
+    if (listeners > 1) {
+      int on = 1;
+      if (::setsockopt(
+              socket->get(),
+              SOL_SOCKET,
+              SO_REUSEPORT,
+              reinterpret_cast<char*>(&on),
+              sizeof(on)) < 0) {
+        return ErrnoError("Failed to set SO_REUSEPORT");
+      }
+    }
+#endif // SO_REUSEPORT
+
+    Try<network::Address> bind =
+      socket->bind(bound.isSome() ? bound.get() : address);
+
+    if (bind.isError()) {
+      return Error(
+          "Failed to bind to address '" + stringify(address) + "': "
+          + bind.error());
+    }
+
+    bound = bind.get();
+
+    // See the note on ALPN above.
+    if (options.http2) {
+      socket->setApplicationProtocols({"h2", "http/1.1"});
+    }
+
+    Try<Nothing> listen = socket->listen(static_cast<int>(options.backlog));
+    if (listen.isError()) {
+      return Error("Failed to listen on socket: " + listen.error());
+    }
+
+    sockets.push_back(socket.get());
   }
 
-  return create(socket.get(), std::move(f), options);
+  return Server(std::move(sockets), std::move(f), options.http2);
 }
 
 
 Server::Server(
-    network::Socket&& socket,
-    std::function<Future<Response>(const network::Socket&, const Request&)>&& f)
-  : socket(socket),
-    process(new ServerProcess(std::move(socket), std::move(f)))
+    std::vector<network::Socket>&& sockets,
+    std::function<Future<Response>(const network::Socket&, const Request&)>&& f,
+    bool enableHttp2)
+  : socket(sockets.front()),
+    process(new ServerProcess(std::move(sockets), std::move(f), enableHttp2))
 {
   spawn(*process);
 }
@@ -2369,6 +2936,20 @@ Future<Response> request(const Request& request, bool streamedResponse)
 }
 
 
+// Sends the request on a pooled connection, see
+// `internal::ConnectionPoolProcess`.
+static Future<Response> pooled(const Request& request)
+{
+  // The connection pool is instantiated in `process::initialize`.
+  process::initialize();
+
+  return dispatch(
+      internal::connection_pool,
+      &internal::ConnectionPoolProcess::send,
+      request);
+}
+
+
 Future<Response> get(
     const URL& url,
     const Option<Headers>& headers)
@@ -2382,7 +2963,7 @@ Future<Response> get(
     _request.headers = headers.get();
   }
 
-  return request(_request, false);
+  return pooled(_request);
 }
 
 
@@ -2446,7 +3027,7 @@ Future<Response> post(
     _request.headers["Content-Type"] = contentType.get();
   }
 
-  return request(_request, false);
+  return pooled(_request);
 }
 
 
@@ -2486,7 +3067,7 @@ Future<Response> requestDelete(
     _request.headers = headers.get();
   }
 
-  return request(_request, false);
+  return pooled(_request);
 }
 
 
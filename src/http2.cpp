@@ -0,0 +1,1939 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <process/defer.hpp>
+#include <process/future.hpp>
+#include <process/http.hpp>
+#include <process/id.hpp>
+#include <process/io.hpp>
+#include <process/loop.hpp>
+#include <process/owned.hpp>
+#include <process/process.hpp>
+#include <process/socket.hpp>
+
+#include <stout/bytes.hpp>
+#include <stout/error.hpp>
+#include <stout/foreach.hpp>
+#include <stout/gzip.hpp>
+#include <stout/lambda.hpp>
+#include <stout/none.hpp>
+#include <stout/nothing.hpp>
+#include <stout/numify.hpp>
+#include <stout/option.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+#include <stout/try.hpp>
+
+#include <stout/os/close.hpp>
+#include <stout/os/int_fd.hpp>
+#include <stout/os/open.hpp>
+#include <stout/os/stat.hpp>
+
+#include "buffer_pool.hpp"
+#include "encoder.hpp"
+#include "hpack.hpp"
+#include "http2.hpp"
+
+using std::deque;
+using std::string;
+using std::vector;
+
+namespace process {
+namespace http {
+namespace http2 {
+
+// Initial flow control window of every stream and of the connection,
+// see section 6.9.2.
+constexpr int64_t DEFAULT_WINDOW = 65535;
+
+// Largest flow control window, see section 6.9.1.
+constexpr int64_t MAX_WINDOW = 0x7fffffff;
+
+// Largest stream ID, see section 5.1.1.
+constexpr uint32_t MAX_STREAM_ID = 0x7fffffff;
+
+// Receive window of every stream, which is also the capacity of the
+// pipe a received body gets written to, i.e., how much of a body we
+// buffer until the reader catches up.
+constexpr size_t STREAM_WINDOW = 256 * 1024;
+
+// Receive window of the connection. The stream windows bound what we
+// buffer so this only needs to be big enough not to hold up streams.
+constexpr size_t CONNECTION_WINDOW = 16 * 1024 * 1024;
+
+// Maximum number of streams a client may open at once. Until a server
+// tells us its limit we assume the minimum it should allow.
+constexpr uint32_t MAX_STREAMS = 256;
+constexpr uint32_t DEFAULT_MAX_STREAMS = 100;
+
+// Maximum size of a header block (before decoding it).
+constexpr size_t MAX_HEADER_BLOCK = 1024 * 1024;
+
+// We stop generating DATA frames once this much is waiting to be sent,
+// so that the streams keep taking turns rather than queueing up whole
+// bodies in `out`.
+constexpr size_t SEND_LIMIT = 64 * 1024;
+
+// We stop reading the body that a stream sends while this much of it
+// is pending.
+constexpr size_t PENDING_LIMIT = 64 * 1024;
+
+// We stop receiving while this much is waiting to be sent.
+constexpr size_t MAX_OUTPUT = 1024 * 1024;
+
+
+static uint32_t read32(const char* data)
+{
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+
+  return (static_cast<uint32_t>(bytes[0]) << 24) |
+         (static_cast<uint32_t>(bytes[1]) << 16) |
+         (static_cast<uint32_t>(bytes[2]) << 8) |
+         static_cast<uint32_t>(bytes[3]);
+}
+
+
+static void append32(string* out, uint32_t value)
+{
+  out->push_back(static_cast<char>(value >> 24));
+  out->push_back(static_cast<char>(value >> 16));
+  out->push_back(static_cast<char>(value >> 8));
+  out->push_back(static_cast<char>(value));
+}
+
+
+deque<Frame> FrameDecoder::decode(const char* data, size_t length)
+{
+  deque<Frame> frames;
+
+  if (failure) {
+    return frames;
+  }
+
+  buffer.append(data, length);
+
+  size_t offset = 0;
+
+  while (buffer.size() - offset >= FRAME_HEADER_SIZE) {
+    const char* header = buffer.data() + offset;
+
+    const size_t size =
+      (static_cast<size_t>(static_cast<uint8_t>(header[0])) << 16) |
+      (static_cast<size_t>(static_cast<uint8_t>(header[1])) << 8) |
+      static_cast<size_t>(static_cast<uint8_t>(header[2]));
+
+    if (size > maximum) {
+      failure = true;
+      break;
+    }
+
+    if (buffer.size() - offset < FRAME_HEADER_SIZE + size) {
+      break;
+    }
+
+    Frame frame;
+    frame.type = static_cast<uint8_t>(header[3]);
+    frame.flags = static_cast<uint8_t>(header[4]);
+    frame.stream = read32(header + 5) & MAX_STREAM_ID;
+    frame.payload.assign(header + FRAME_HEADER_SIZE, size);
+
+    frames.push_back(std::move(frame));
+
+    offset += FRAME_HEADER_SIZE + size;
+  }
+
+  buffer.erase(0, offset);
+
+  return frames;
+}
+
+
+void encode(
+    string* out,
+    uint8_t type,
+    uint8_t flags,
+    uint32_t stream,
+    const char* payload,
+    size_t length)
+{
+  CHECK_LT(length, 1u << 24);
+
+  const char header[FRAME_HEADER_SIZE] = {
+    static_cast<char>(length >> 16),
+    static_cast<char>(length >> 8),
+    static_cast<char>(length),
+    static_cast<char>(type),
+    static_cast<char>(flags),
+    static_cast<char>((stream >> 24) & 0x7f),
+    static_cast<char>(stream >> 16),
+    static_cast<char>(stream >> 8),
+    static_cast<char>(stream),
+  };
+
+  out->append(header, FRAME_HEADER_SIZE);
+  out->append(payload, length);
+}
+
+
+// Returns a reader of the contents of the file that a PATH response
+// refers to, like `sendfile` does for HTTP/1.1.
+static Try<Pipe::Reader> open(const string& path, Bytes* size)
+{
+  Try<int_fd> fd = os::open(path, O_CLOEXEC | O_NONBLOCK | O_RDONLY);
+  if (fd.isError()) {
+    return Error("Failed to open '" + path + "': " + fd.error());
+  }
+
+  const Try<Bytes> size_ = os::stat::size(fd.get());
+  if (size_.isError()) {
+    os::close(fd.get());
+    return Error("Failed to fstat '" + path + "': " + size_.error());
+  } else if (os::stat::isdir(fd.get())) {
+    os::close(fd.get());
+    return Error("'" + path + "' is a directory");
+  }
+
+  *size = size_.get();
+
+  Pipe pipe(STREAM_WINDOW);
+  Pipe::Writer writer = pipe.writer();
+  const int_fd file = fd.get();
+
+  loop(None(),
+       [=]() {
+         char* buffer = BufferPool::acquire();
+
+         return io::read(file, buffer, BufferPool::SIZE)
+           .then([=](size_t length) {
+             return string(buffer, length);
+           })
+           .onAny([=]() {
+             BufferPool::release(buffer);
+           });
+       },
+       [=](const string& data) mutable -> Future<ControlFlow<Nothing>> {
+         if (data.empty()) {
+           writer.close();
+           return Break();
+         }
+
+         // The reader got closed if the stream got reset.
+         if (!writer.write(data)) {
+           return Break();
+         }
+
+         return writer.writable()
+           .then([]() -> ControlFlow<Nothing> {
+             return Continue();
+           });
+       })
+    .onAny([=](const Future<Nothing>& future) mutable {
+      os::close(file);
+
+      if (!future.isReady()) {
+        writer.fail("Failed to read '" + path + "'");
+      }
+    });
+
+  return pipe.reader();
+}
+
+
+Future<Nothing> serve(
+    const network::Socket& socket,
+    std::function<Future<Response>(const Request&)>&& f,
+    const string& received)
+{
+  ServerProcess* process = new ServerProcess(socket, std::move(f), received);
+
+  Future<Nothing> served = process->served();
+
+  // Nothing else refers to the process so we let libprocess manage it
+  // and terminate it once the connection has been closed.
+  PID<ServerProcess> pid = spawn(process, true);
+
+  return served
+    .onAny([pid]() {
+      terminate(pid);
+    });
+}
+
+
+ConnectionProcess::ConnectionProcess(
+    const network::Socket& _socket,
+    bool _server,
+    const string& _received)
+  : socket(_socket),
+    server(_server),
+    lastPeerStream(0),
+    nextStream(1),
+    maxStreams(DEFAULT_MAX_STREAMS),
+    goingAway(false),
+    done(false),
+    received(_received),
+    preface(_server ? PREFACE_SIZE : 0),
+    settled(false),
+    sendWindow(DEFAULT_WINDOW),
+    receiveWindow(DEFAULT_WINDOW),
+    unacknowledged(0),
+    initialWindow(DEFAULT_WINDOW),
+    maxFrameSize(DEFAULT_MAX_FRAME_SIZE),
+    sending(false),
+    paused(false) {}
+
+
+void ConnectionProcess::initialize()
+{
+  if (!server) {
+    out.append(PREFACE, PREFACE_SIZE);
+  }
+
+  // Our settings, the others keep their defaults. Rather than limiting
+  // the streams a server may push the client disables server push.
+  string settings;
+
+  auto setting = [&settings](Setting id, uint32_t value) {
+    settings.push_back(static_cast<char>(id >> 8));
+    settings.push_back(static_cast<char>(id));
+    append32(&settings, value);
+  };
+
+  if (server) {
+    setting(MAX_CONCURRENT_STREAMS, MAX_STREAMS);
+  } else {
+    setting(ENABLE_PUSH, 0);
+  }
+
+  setting(INITIAL_WINDOW_SIZE, STREAM_WINDOW);
+  setting(MAX_HEADER_LIST_SIZE, hpack::DEFAULT_MAX_HEADER_LIST_SIZE);
+
+  encode(&out, SETTINGS, 0, 0, settings.data(), settings.size());
+
+  // The connection window can only be changed with a WINDOW_UPDATE.
+  writeWindowUpdate(0, CONNECTION_WINDOW - DEFAULT_WINDOW);
+  receiveWindow = CONNECTION_WINDOW;
+
+  flush();
+
+  if (!received.empty()) {
+    const string data = std::move(received);
+    received.clear();
+
+    if (!consume(data.data(), data.size())) {
+      return;
+    }
+  }
+
+  receive();
+}
+
+
+void ConnectionProcess::finalize()
+{
+  close(None());
+}
+
+
+void ConnectionProcess::receive()
+{
+  socket.recv()
+    .onAny(defer(self(), &Self::_receive, lambda::_1));
+}
+
+
+void ConnectionProcess::_receive(const Future<string>& data)
+{
+  if (done) {
+    return;
+  }
+
+  if (!data.isReady()) {
+    close(
+        "Failed to receive: " +
+        (data.isFailed() ? data.failure() : "discarded"));
+    return;
+  }
+
+  // EOF, e.g., because a server that is stopping shut down the read
+  // end of the socket. The streams the peer had yet to end can't
+  // complete but the others still get their responses (or requests)
+  // sent before the connection gets closed.
+  if (data->empty()) {
+    goingAway = true;
+
+    vector<uint32_t> incomplete;
+
+    foreachpair (uint32_t id, const Owned<Stream>& stream, streams) {
+      if (!stream->remoteClosed) {
+        incomplete.push_back(id);
+      }
+    }
+
+    foreach (uint32_t id, incomplete) {
+      Stream* stream = find(id);
+      if (stream != nullptr) {
+        remove(stream, "Disconnected");
+      }
+    }
+
+    if (streams.empty() && closing.isNone()) {
+      closing = Option<string>::none();
+    }
+
+    flush();
+    return;
+  }
+
+  if (!consume(data->data(), data->size())) {
+    return;
+  }
+
+  // Receiving resumes once the peer received enough, see `flush`.
+  if (out.size() >= MAX_OUTPUT) {
+    paused = true;
+    return;
+  }
+
+  receive();
+}
+
+
+bool ConnectionProcess::consume(const char* data, size_t length)
+{
+  if (preface > 0) {
+    const size_t size = std::min(length, preface);
+
+    if (memcmp(data, PREFACE + PREFACE_SIZE - preface, size) != 0) {
+      close(string("Invalid connection preface"));
+      return false;
+    }
+
+    preface -= size;
+    data += size;
+    length -= size;
+  }
+
+  deque<Frame> frames = decoder.decode(data, length);
+
+  while (!frames.empty()) {
+    handle(std::move(frames.front()));
+    frames.pop_front();
+
+    if (done || closing.isSome()) {
+      flush();
+      return false;
+    }
+  }
+
+  if (decoder.failed()) {
+    shutdown(FRAME_SIZE_ERROR, "Frame exceeds the maximum frame size");
+    return false;
+  }
+
+  // Send whatever the frames made us send (e.g., SETTINGS and PING
+  // acknowledgements, window updates, responses) at once.
+  flush();
+
+  return true;
+}
+
+
+void ConnectionProcess::handle(Frame&& frame)
+{
+  if (continuation.isSome() &&
+      (frame.type != CONTINUATION || frame.stream != continuation->stream)) {
+    shutdown(PROTOCOL_ERROR, "Expected a CONTINUATION frame");
+    return;
+  }
+
+  if (!settled && (frame.type != SETTINGS || (frame.flags & ACK))) {
+    shutdown(PROTOCOL_ERROR, "Expected a SETTINGS frame");
+    return;
+  }
+
+  switch (frame.type) {
+    case DATA:
+      handleData(std::move(frame));
+      return;
+    case HEADERS:
+      handleHeaders(std::move(frame));
+      return;
+    case PRIORITY:
+      // We don't prioritize streams, they take turns instead.
+      if (frame.stream == 0) {
+        shutdown(PROTOCOL_ERROR, "PRIORITY frame without a stream");
+      } else if (frame.payload.size() != 5) {
+        shutdown(FRAME_SIZE_ERROR, "Invalid PRIORITY frame");
+      }
+      return;
+    case RST_STREAM: {
+      if (frame.stream == 0 || idle(frame.stream)) {
+        shutdown(PROTOCOL_ERROR, "Unexpected RST_STREAM frame");
+        return;
+      }
+
+      if (frame.payload.size() != 4) {
+        shutdown(FRAME_SIZE_ERROR, "Invalid RST_STREAM frame");
+        return;
+      }
+
+      Stream* stream = find(frame.stream);
+      if (stream != nullptr) {
+        remove(
+            stream,
+            "Stream reset with error code " +
+            stringify(read32(frame.payload.data())));
+      }
+      return;
+    }
+    case SETTINGS:
+      handleSettings(frame);
+      return;
+    case PUSH_PROMISE:
+      // We disable server push and never push.
+      shutdown(PROTOCOL_ERROR, "Unexpected PUSH_PROMISE frame");
+      return;
+    case PING:
+      if (frame.stream != 0) {
+        shutdown(PROTOCOL_ERROR, "PING frame with a stream");
+      } else if (frame.payload.size() != 8) {
+        shutdown(FRAME_SIZE_ERROR, "Invalid PING frame");
+      } else if (!(frame.flags & ACK)) {
+        encode(&out, PING, ACK, 0, frame.payload.data(), frame.payload.size());
+      }
+      return;
+    case GOAWAY:
+      handleGoAway(frame);
+      return;
+    case WINDOW_UPDATE:
+      handleWindowUpdate(frame);
+      return;
+    case CONTINUATION: {
+      if (continuation.isNone()) {
+        shutdown(PROTOCOL_ERROR, "Unexpected CONTINUATION frame");
+        return;
+      }
+
+      continuation->block.append(frame.payload);
+
+      if (continuation->block.size() > MAX_HEADER_BLOCK) {
+        shutdown(ENHANCE_YOUR_CALM, "Header block is too big");
+        return;
+      }
+
+      if (frame.flags & END_HEADERS) {
+        const Continuation headers = std::move(continuation.get());
+        continuation = None();
+
+        decode(headers.stream, headers.block, headers.end);
+      }
+      return;
+    }
+  }
+
+  // Frames of unknown types must be ignored, see section 4.1.
+}
+
+
+void ConnectionProcess::handleData(Frame&& frame)
+{
+  if (frame.stream == 0 || idle(frame.stream)) {
+    shutdown(PROTOCOL_ERROR, "Unexpected DATA frame");
+    return;
+  }
+
+  const size_t size = frame.payload.size();
+
+  size_t offset = 0;
+  size_t padding = 0;
+
+  if (frame.flags & PADDED) {
+    if (size == 0) {
+      shutdown(PROTOCOL_ERROR, "Invalid DATA frame");
+      return;
+    }
+
+    padding = static_cast<uint8_t>(frame.payload[0]);
+    offset = 1;
+  }
+
+  if (offset + padding > size) {
+    shutdown(PROTOCOL_ERROR, "Invalid DATA frame");
+    return;
+  }
+
+  // The whole frame (including the padding) counts against the flow
+  // control windows, see section 6.9.1.
+  receiveWindow -= size;
+
+  if (receiveWindow < 0) {
+    shutdown(FLOW_CONTROL_ERROR, "Connection flow control window exceeded");
+    return;
+  }
+
+  unacknowledged += size;
+
+  if (unacknowledged >= CONNECTION_WINDOW / 2) {
+    writeWindowUpdate(0, unacknowledged);
+    receiveWindow += unacknowledged;
+    unacknowledged = 0;
+  }
+
+  Stream* stream = find(frame.stream);
+
+  // We've reset the stream, the frames the peer sent before it knew
+  // get ignored (but count against the connection window).
+  if (stream == nullptr) {
+    return;
+  }
+
+  if (stream->remoteClosed) {
+    reset(stream, STREAM_CLOSED, "Received DATA after the end of the stream");
+    return;
+  }
+
+  if (!stream->receiving) {
+    reset(stream, PROTOCOL_ERROR, "Received DATA before the headers");
+    return;
+  }
+
+  stream->receiveWindow -= size;
+
+  if (stream->receiveWindow < 0) {
+    reset(stream, FLOW_CONTROL_ERROR, "Stream flow control window exceeded");
+    return;
+  }
+
+  stream->unacknowledged += size;
+
+  string data = offset == 0 && padding == 0
+    ? std::move(frame.payload)
+    : frame.payload.substr(offset, size - offset - padding);
+
+  if (stream->decompressor.get() != nullptr && !data.empty()) {
+    Try<string> decompressed = stream->decompressor->decompress(data);
+
+    if (decompressed.isError()) {
+      reset(
+          stream,
+          PROTOCOL_ERROR,
+          "Failed to decompress body: " + decompressed.error());
+      return;
+    }
+
+    data = std::move(decompressed.get());
+  }
+
+  if (stream->writer.isSome()) {
+    if (!data.empty()) {
+      stream->writer->write(std::move(data));
+    }
+  } else {
+    stream->body.append(data);
+  }
+
+  if (frame.flags & END_STREAM) {
+    endRemote(stream);
+  } else {
+    grant(stream);
+  }
+}
+
+
+void ConnectionProcess::handleHeaders(Frame&& frame)
+{
+  if (frame.stream == 0) {
+    shutdown(PROTOCOL_ERROR, "HEADERS frame without a stream");
+    return;
+  }
+
+  const size_t size = frame.payload.size();
+
+  size_t offset = 0;
+  size_t padding = 0;
+
+  if (frame.flags & PADDED) {
+    if (size == 0) {
+      shutdown(PROTOCOL_ERROR, "Invalid HEADERS frame");
+      return;
+    }
+
+    padding = static_cast<uint8_t>(frame.payload[0]);
+    offset = 1;
+  }
+
+  // We ignore the priority, see PRIORITY.
+  if (frame.flags & PRIORITY_FLAG) {
+    offset += 5;
+  }
+
+  if (offset + padding > size) {
+    shutdown(PROTOCOL_ERROR, "Invalid HEADERS frame");
+    return;
+  }
+
+  string block = offset == 0 && padding == 0
+    ? std::move(frame.payload)
+    : frame.payload.substr(offset, size - offset - padding);
+
+  const bool end = frame.flags & END_STREAM;
+
+  if (!(frame.flags & END_HEADERS)) {
+    continuation = Continuation{frame.stream, end, std::move(block)};
+    return;
+  }
+
+  decode(frame.stream, block, end);
+}
+
+
+void ConnectionProcess::handleSettings(const Frame& frame)
+{
+  if (frame.stream != 0) {
+    shutdown(PROTOCOL_ERROR, "SETTINGS frame with a stream");
+    return;
+  }
+
+  if (frame.flags & ACK) {
+    if (!frame.payload.empty()) {
+      shutdown(FRAME_SIZE_ERROR, "Invalid SETTINGS frame");
+    }
+    return;
+  }
+
+  if (frame.payload.size() % 6 != 0) {
+    shutdown(FRAME_SIZE_ERROR, "Invalid SETTINGS frame");
+    return;
+  }
+
+  for (size_t i = 0; i < frame.payload.size(); i += 6) {
+    const char* data = frame.payload.data() + i;
+
+    const uint16_t id = static_cast<uint16_t>(
+        (static_cast<uint8_t>(data[0]) << 8) | static_cast<uint8_t>(data[1]));
+
+    const uint32_t value = read32(data + 2);
+
+    switch (id) {
+      case HEADER_TABLE_SIZE:
+        encoder.resize(value);
+        break;
+      case ENABLE_PUSH:
+        if (value > 1) {
+          shutdown(PROTOCOL_ERROR, "Invalid SETTINGS_ENABLE_PUSH");
+          return;
+        }
+        break;
+      case MAX_CONCURRENT_STREAMS:
+        maxStreams = value;
+        break;
+      case INITIAL_WINDOW_SIZE: {
+        if (value > MAX_WINDOW) {
+          shutdown(FLOW_CONTROL_ERROR, "Invalid SETTINGS_INITIAL_WINDOW_SIZE");
+          return;
+        }
+
+        // The change applies to the windows of the open streams too,
+        // see section 6.9.2.
+        const int64_t delta = static_cast<int64_t>(value) - initialWindow;
+        initialWindow = value;
+
+        foreachvalue (const Owned<Stream>& stream, streams) {
+          stream->sendWindow += delta;
+
+          if (stream->sendWindow > MAX_WINDOW) {
+            shutdown(FLOW_CONTROL_ERROR, "Stream flow control window overflow");
+            return;
+          }
+
+          activate(stream.get());
+        }
+        break;
+      }
+      case MAX_FRAME_SIZE:
+        if (value < DEFAULT_MAX_FRAME_SIZE || value > (1u << 24) - 1) {
+          shutdown(PROTOCOL_ERROR, "Invalid SETTINGS_MAX_FRAME_SIZE");
+          return;
+        }
+        maxFrameSize = value;
+        break;
+      default:
+        // Unknown settings (and those we don't use, e.g., the maximum
+        // header list size) must be ignored, see section 6.5.2.
+        break;
+    }
+  }
+
+  settled = true;
+
+  encode(&out, SETTINGS, ACK, 0, nullptr, 0);
+
+  // The peer might allow more streams now.
+  released();
+}
+
+
+void ConnectionProcess::handleWindowUpdate(const Frame& frame)
+{
+  if (frame.payload.size() != 4) {
+    shutdown(FRAME_SIZE_ERROR, "Invalid WINDOW_UPDATE frame");
+    return;
+  }
+
+  const uint32_t increment = read32(frame.payload.data()) & 0x7fffffff;
+
+  if (frame.stream == 0) {
+    if (increment == 0) {
+      shutdown(PROTOCOL_ERROR, "Invalid WINDOW_UPDATE frame");
+      return;
+    }
+
+    sendWindow += increment;
+
+    if (sendWindow > MAX_WINDOW) {
+      shutdown(FLOW_CONTROL_ERROR, "Connection flow control window overflow");
+    }
+    return;
+  }
+
+  if (idle(frame.stream)) {
+    shutdown(PROTOCOL_ERROR, "Unexpected WINDOW_UPDATE frame");
+    return;
+  }
+
+  Stream* stream = find(frame.stream);
+
+  // The peer might not know yet that the stream got closed.
+  if (stream == nullptr) {
+    return;
+  }
+
+  if (increment == 0) {
+    reset(stream, PROTOCOL_ERROR, "Invalid WINDOW_UPDATE frame");
+    return;
+  }
+
+  stream->sendWindow += increment;
+
+  if (stream->sendWindow > MAX_WINDOW) {
+    reset(stream, FLOW_CONTROL_ERROR, "Stream flow control window overflow");
+    return;
+  }
+
+  activate(stream);
+}
+
+
+void ConnectionProcess::handleGoAway(const Frame& frame)
+{
+  if (frame.stream != 0) {
+    shutdown(PROTOCOL_ERROR, "GOAWAY frame with a stream");
+    return;
+  }
+
+  if (frame.payload.size() < 8) {
+    shutdown(FRAME_SIZE_ERROR, "Invalid GOAWAY frame");
+    return;
+  }
+
+  const uint32_t last = read32(frame.payload.data()) & MAX_STREAM_ID;
+  const uint32_t error = read32(frame.payload.data() + 4);
+
+  goingAway = true;
+
+  // The streams we opened after the last one that the peer processed
+  // won't get processed.
+  if (!server) {
+    vector<uint32_t> unprocessed;
+
+    foreachkey (uint32_t id, streams) {
+      if (id > last) {
+        unprocessed.push_back(id);
+      }
+    }
+
+    string message = "Connection is going away";
+    if (error != NONE) {
+      message += " with error code " + stringify(error);
+    }
+
+    foreach (uint32_t id, unprocessed) {
+      Stream* stream = find(id);
+      if (stream != nullptr) {
+        remove(stream, message);
+      }
+    }
+  }
+
+  if (streams.empty() && closing.isNone()) {
+    closing = Option<string>::none();
+  }
+}
+
+
+void ConnectionProcess::decode(uint32_t id, const string& block, bool end)
+{
+  Try<hpack::HeaderList> decoded = headerDecoder.decode(block);
+
+  if (decoded.isError()) {
+    shutdown(
+        COMPRESSION_ERROR,
+        "Failed to decode header block: " + decoded.error());
+    return;
+  }
+
+  headers(id, find(id), std::move(decoded.get()), end);
+}
+
+
+ConnectionProcess::Stream* ConnectionProcess::create(uint32_t id)
+{
+  Stream* stream = new Stream(id, initialWindow, STREAM_WINDOW);
+  streams.put(id, Owned<Stream>(stream));
+  return stream;
+}
+
+
+ConnectionProcess::Stream* ConnectionProcess::find(uint32_t id)
+{
+  auto stream = streams.find(id);
+  return stream == streams.end() ? nullptr : stream->second.get();
+}
+
+
+bool ConnectionProcess::idle(uint32_t id) const
+{
+  // Clients open the odd-numbered streams. Servers open even-numbered
+  // ones only for server push, which we don't support.
+  if (id % 2 == 0) {
+    return true;
+  }
+
+  return server ? id > lastPeerStream : id >= nextStream;
+}
+
+
+void ConnectionProcess::endLocal(Stream* stream)
+{
+  stream->localClosed = true;
+
+  if (stream->remoteClosed) {
+    remove(stream, None());
+  }
+}
+
+
+void ConnectionProcess::endRemote(Stream* stream)
+{
+  stream->remoteClosed = true;
+
+  if (stream->writer.isSome()) {
+    if (stream->decompressor.get() != nullptr &&
+        !stream->decompressor->finished()) {
+      stream->writer->fail("Failed to decompress body");
+    } else {
+      stream->writer->close();
+    }
+
+    stream->writer = None();
+  }
+
+  ended(stream);
+
+  if (stream->localClosed) {
+    remove(stream, None());
+  }
+}
+
+
+void ConnectionProcess::grant(Stream* stream)
+{
+  if (stream->granting || stream->unacknowledged < STREAM_WINDOW / 2) {
+    return;
+  }
+
+  if (stream->writer.isNone()) {
+    writeWindowUpdate(stream->id, stream->unacknowledged);
+    stream->receiveWindow += stream->unacknowledged;
+    stream->unacknowledged = 0;
+    return;
+  }
+
+  // The peer may only send more once the reader caught up, which is
+  // how a slow reader pushes back on the peer (but not on the other
+  // streams).
+  stream->granting = true;
+
+  const uint32_t id = stream->id;
+
+  stream->writer->writable()
+    .onAny(defer(self(), [this, id](const Future<Nothing>&) {
+      Stream* stream = find(id);
+
+      if (stream == nullptr || stream->remoteClosed) {
+        return;
+      }
+
+      stream->granting = false;
+
+      writeWindowUpdate(id, stream->unacknowledged);
+      stream->receiveWindow += stream->unacknowledged;
+      stream->unacknowledged = 0;
+
+      flush();
+    }));
+}
+
+
+void ConnectionProcess::writeHeaders(
+    uint32_t id,
+    const hpack::HeaderList& headers,
+    bool end)
+{
+  string block;
+  encoder.encode(headers, &block);
+
+  uint8_t type = HEADERS;
+  uint8_t flags = end ? END_STREAM : 0;
+  size_t offset = 0;
+
+  do {
+    const size_t length = std::min(block.size() - offset, maxFrameSize);
+
+    if (offset + length == block.size()) {
+      flags |= END_HEADERS;
+    }
+
+    encode(&out, type, flags, id, block.data() + offset, length);
+
+    type = CONTINUATION;
+    flags = 0;
+    offset += length;
+  } while (offset < block.size());
+}
+
+
+void ConnectionProcess::writeData(
+    Stream* stream,
+    const string& data,
+    bool end)
+{
+  // Drop what got sent already before it piles up.
+  if (stream->offset > 0 && stream->offset >= stream->pending.size() / 2) {
+    stream->pending.erase(0, stream->offset);
+    stream->offset = 0;
+  }
+
+  stream->pending.append(data);
+  stream->end = stream->end || end;
+
+  activate(stream);
+}
+
+
+void ConnectionProcess::writeBody(Stream* stream, const Pipe::Reader& reader)
+{
+  stream->reader = reader;
+  read(stream);
+}
+
+
+void ConnectionProcess::read(Stream* stream)
+{
+  CHECK_SOME(stream->reader);
+  CHECK(!stream->reading);
+
+  stream->reading = true;
+
+  const uint32_t id = stream->id;
+
+  Pipe::Reader reader = stream->reader.get();
+
+  reader.read()
+    .onAny(defer(self(), [this, id](const Future<string>& chunk) {
+      Stream* stream = find(id);
+
+      // The reader got closed when the stream got removed.
+      if (stream == nullptr) {
+        return;
+      }
+
+      stream->reading = false;
+
+      if (!chunk.isReady()) {
+        reset(
+            stream,
+            INTERNAL_ERROR,
+            "Failed to read body: " +
+            (chunk.isFailed() ? chunk.failure() : "discarded"));
+        flush();
+        return;
+      }
+
+      // EOF.
+      if (chunk->empty()) {
+        stream->reader->close();
+        stream->reader = None();
+        writeData(stream, "", true);
+        flush();
+        return;
+      }
+
+      writeData(stream, chunk.get(), false);
+
+      if (stream->remaining() < PENDING_LIMIT) {
+        read(stream);
+      }
+
+      flush();
+    }));
+}
+
+
+void ConnectionProcess::activate(Stream* stream)
+{
+  if (!stream->scheduled &&
+      !stream->localClosed &&
+      (stream->remaining() > 0 || stream->end)) {
+    stream->scheduled = true;
+    active.push_back(stream->id);
+  }
+}
+
+
+void ConnectionProcess::schedule()
+{
+  if (closing.isSome()) {
+    return;
+  }
+
+  while (!active.empty() && out.size() < SEND_LIMIT) {
+    const uint32_t id = active.front();
+    active.pop_front();
+
+    Stream* stream = find(id);
+
+    if (stream == nullptr) {
+      continue;
+    }
+
+    stream->scheduled = false;
+
+    const int64_t window =
+      std::max<int64_t>(std::min(sendWindow, stream->sendWindow), 0);
+
+    const size_t length = std::min(
+        stream->remaining(),
+        std::min(maxFrameSize, static_cast<size_t>(window)));
+
+    const bool last = stream->end && length == stream->remaining();
+
+    if (length == 0 && !last) {
+      // Once the connection window is exhausted the streams wait for a
+      // WINDOW_UPDATE of the connection in the order they're in. A
+      // stream whose own window is exhausted gets activated again once
+      // it gets a WINDOW_UPDATE.
+      if (sendWindow <= 0) {
+        stream->scheduled = true;
+        active.push_front(id);
+        break;
+      }
+      continue;
+    }
+
+    encode(
+        &out,
+        DATA,
+        last ? END_STREAM : 0,
+        id,
+        stream->pending.data() + stream->offset,
+        length);
+
+    stream->offset += length;
+    sendWindow -= length;
+    stream->sendWindow -= length;
+
+    if (stream->remaining() == 0) {
+      stream->pending.clear();
+      stream->offset = 0;
+    }
+
+    if (last) {
+      endLocal(stream);
+      continue;
+    }
+
+    // Let the other streams take their turn.
+    activate(stream);
+
+    if (stream->reader.isSome() &&
+        !stream->reading &&
+        stream->remaining() < PENDING_LIMIT) {
+      read(stream);
+    }
+  }
+}
+
+
+void ConnectionProcess::writeReset(uint32_t id, ErrorCode error)
+{
+  string payload;
+  append32(&payload, error);
+
+  encode(&out, RST_STREAM, 0, id, payload.data(), payload.size());
+}
+
+
+void ConnectionProcess::writeWindowUpdate(uint32_t id, size_t increment)
+{
+  string payload;
+  append32(&payload, static_cast<uint32_t>(increment));
+
+  encode(&out, WINDOW_UPDATE, 0, id, payload.data(), payload.size());
+}
+
+
+void ConnectionProcess::reset(
+    Stream* stream,
+    ErrorCode error,
+    const string& message)
+{
+  writeReset(stream->id, error);
+  remove(stream, message);
+}
+
+
+void ConnectionProcess::remove(
+    Stream* stream,
+    const Option<string>& failure)
+{
+  removed(stream, failure);
+
+  // Anyone still reading the body we were receiving must know that it
+  // is incomplete, and whoever writes the body we were sending that
+  // nobody reads it anymore.
+  if (stream->writer.isSome()) {
+    stream->writer->fail(failure.getOrElse("Stream closed"));
+  }
+
+  if (stream->reader.isSome()) {
+    stream->reader->close();
+  }
+
+  const uint32_t id = stream->id;
+  streams.erase(id);
+
+  if (!done) {
+    released();
+
+    // Close once the frames we have so far (e.g., the end of the body
+    // of the last stream) got sent, see `flush`.
+    if (goingAway && streams.empty() && closing.isNone()) {
+      closing = Option<string>::none();
+    }
+  }
+}
+
+
+void ConnectionProcess::shutdown(ErrorCode error, const string& message)
+{
+  if (done || closing.isSome()) {
+    return;
+  }
+
+  string payload;
+  append32(&payload, lastPeerStream);
+  append32(&payload, error);
+  payload.append(message);
+
+  encode(&out, GOAWAY, 0, 0, payload.data(), payload.size());
+
+  goingAway = true;
+
+  if (error == NONE) {
+    closing = Option<string>::none();
+  } else {
+    closing = Option<string>(message);
+  }
+
+  flush();
+}
+
+
+void ConnectionProcess::close(const Option<string>& failure)
+{
+  if (done) {
+    return;
+  }
+
+  done = true;
+
+  // Like for HTTP/1.1 we shut down both directions separately, see
+  // `http::internal::serve`.
+  socket.shutdown(network::Socket::Shutdown::READ);
+  socket.shutdown(network::Socket::Shutdown::WRITE);
+
+  const string message = failure.getOrElse("Disconnected");
+
+  foreach (uint32_t id, streams.keys()) {
+    Stream* stream = find(id);
+    if (stream != nullptr) {
+      remove(stream, message);
+    }
+  }
+
+  active.clear();
+  out.clear();
+
+  closed(failure);
+}
+
+
+void ConnectionProcess::flush()
+{
+  if (done || sending) {
+    return;
+  }
+
+  schedule();
+
+  if (out.empty()) {
+    if (closing.isSome()) {
+      close(closing.get());
+    }
+    return;
+  }
+
+  sending = true;
+
+  // The socket refers to the data until the send completes.
+  std::shared_ptr<string> data(new string(std::move(out)));
+  out.clear();
+
+  socket.send(*data)
+    .onAny(defer(self(), [this, data](const Future<Nothing>& sent) {
+      sending = false;
+
+      if (done) {
+        return;
+      }
+
+      if (!sent.isReady()) {
+        close(
+            "Failed to send: " +
+            (sent.isFailed() ? sent.failure() : "discarded"));
+        return;
+      }
+
+      flush();
+
+      if (paused && out.size() < MAX_OUTPUT && !done) {
+        paused = false;
+        receive();
+      }
+    }));
+}
+
+
+Headers ConnectionProcess::convert(const hpack::HeaderList& headers)
+{
+  Headers result;
+
+  foreach (const auto& header, headers) {
+    if (!header.first.empty() && header.first[0] == ':') {
+      continue;
+    }
+
+    // Fields that appear more than once get combined like they would
+    // be for HTTP/1.1, except cookies, see section 8.1.2.5.
+    Option<string> value = result.get(header.first);
+
+    if (value.isNone()) {
+      result[header.first] = header.second;
+    } else if (header.first == "cookie") {
+      result[header.first] = value.get() + "; " + header.second;
+    } else {
+      result[header.first] = value.get() + ", " + header.second;
+    }
+  }
+
+  return result;
+}
+
+
+void ConnectionProcess::convert(
+    const Headers& headers,
+    hpack::HeaderList* fields)
+{
+  foreachpair (const string& name, const string& value, headers) {
+    const string lower = strings::lower(name);
+
+    // Connection specific fields don't apply to HTTP/2, see section
+    // 8.1.2.2, and ":authority" replaces "Host".
+    if (lower == "connection" ||
+        lower == "keep-alive" ||
+        lower == "proxy-connection" ||
+        lower == "transfer-encoding" ||
+        lower == "upgrade" ||
+        lower == "te" ||
+        lower == "host") {
+      continue;
+    }
+
+    fields->emplace_back(lower, value);
+  }
+}
+
+
+ServerProcess::ServerProcess(
+    const network::Socket& socket,
+    std::function<Future<Response>(const Request&)>&& _f,
+    const string& received)
+  : ProcessBase(ID::generate("__http2_server__")),
+    ConnectionProcess(socket, true, received),
+    f(std::move(_f)) {}
+
+
+Future<Nothing> ServerProcess::served()
+{
+  return promise.future();
+}
+
+
+void ServerProcess::initialize()
+{
+  Try<network::Address> address = socket.peer();
+  if (address.isError()) {
+    close("Failed to get peer address: " + address.error());
+    return;
+  }
+
+  peer = address.get();
+
+  promise.future()
+    .onDiscard(defer(self(), [this]() {
+      shutdown(NONE, "Server is shutting down");
+    }));
+
+  ConnectionProcess::initialize();
+}
+
+
+void ServerProcess::headers(
+    uint32_t id,
+    Stream* stream,
+    hpack::HeaderList&& headers,
+    bool end)
+{
+  if (stream != nullptr) {
+    // Trailers, which we ignore like for HTTP/1.1, must end the stream.
+    if (!end || stream->remoteClosed) {
+      reset(stream, PROTOCOL_ERROR, "Unexpected HEADERS frame");
+      return;
+    }
+
+    endRemote(stream);
+    return;
+  }
+
+  if (id % 2 == 0) {
+    shutdown(PROTOCOL_ERROR, "Invalid stream ID");
+    return;
+  }
+
+  // Like the client we ignore frames on a stream that got closed (or
+  // that we've reset) since the peer might have sent them before it
+  // knew.
+  if (!idle(id)) {
+    return;
+  }
+
+  lastPeerStream = id;
+
+  // The stream got opened after we sent GOAWAY.
+  if (goingAway) {
+    return;
+  }
+
+  if (streams.size() >= MAX_STREAMS) {
+    writeReset(id, REFUSED_STREAM);
+    return;
+  }
+
+  Request request;
+  Option<string> path;
+  Option<string> authority;
+
+  foreach (const auto& header, headers) {
+    const string& name = header.first;
+
+    if (name.empty() || name[0] != ':') {
+      continue;
+    }
+
+    if (name == ":method") {
+      request.method = header.second;
+    } else if (name == ":path") {
+      path = header.second;
+    } else if (name == ":scheme") {
+      request.url.scheme = header.second;
+    } else if (name == ":authority") {
+      authority = header.second;
+    } else {
+      writeReset(id, PROTOCOL_ERROR);
+      return;
+    }
+  }
+
+  if (request.method.empty() || path.isNone() || path->empty()) {
+    writeReset(id, PROTOCOL_ERROR);
+    return;
+  }
+
+  const size_t question = path->find('?');
+
+  request.url.path = path->substr(0, question);
+
+  if (question != string::npos) {
+    Try<hashmap<string, string>> query =
+      query::decode(path->substr(question + 1));
+
+    if (query.isError()) {
+      writeReset(id, PROTOCOL_ERROR);
+      return;
+    }
+
+    request.url.query = query.get();
+  }
+
+  request.headers = convert(headers);
+
+  if (authority.isSome() && !request.headers.contains("Host")) {
+    request.headers["Host"] = authority.get();
+  }
+
+  request.keepAlive = true;
+  request.client = peer;
+
+  stream = create(id);
+  stream->receiving = true;
+  stream->acceptsGzip = request.acceptsEncoding("gzip");
+
+  if (request.headers.get("Content-Encoding") == string("gzip")) {
+    stream->decompressor.reset(new gzip::Decompressor());
+  }
+
+  // Like for HTTP/1.1 the body gets streamed to the handler.
+  Pipe pipe(STREAM_WINDOW);
+  request.type = Request::PIPE;
+  request.reader = pipe.reader();
+  stream->writer = pipe.writer();
+
+  stream->response = f(request);
+
+  stream->response
+    .onAny(defer(self(), [this, id](const Future<Response>& response) {
+      respond(id, response);
+    }));
+
+  if (end) {
+    endRemote(stream);
+  }
+}
+
+
+void ServerProcess::respond(uint32_t id, const Future<Response>& future)
+{
+  Response response = future.isReady()
+    ? future.get()
+    : future.isFailed()
+      ? InternalServerError(future.failure())
+      : ServiceUnavailable();
+
+  Stream* stream = find(id);
+
+  if (stream == nullptr) {
+    if (response.type == Response::PIPE && response.reader.isSome()) {
+      response.reader->close();
+    }
+    return;
+  }
+
+  Option<Pipe::Reader> body = None();
+
+  if (response.type == Response::PATH) {
+    Bytes size;
+    Try<Pipe::Reader> reader = open(response.path, &size);
+
+    if (reader.isError()) {
+      response = InternalServerError(reader.error());
+    } else {
+      response.headers["Content-Length"] = stringify(size.bytes());
+      body = reader.get();
+    }
+  } else if (response.type == Response::PIPE) {
+    if (response.reader.isNone()) {
+      response = InternalServerError("Missing reader of PIPE response");
+    } else {
+      body = response.reader.get();
+    }
+  }
+
+  string data;
+
+  if (body.isNone()) {
+    if (response.type == Response::BODY) {
+      data = std::move(response.body);
+    }
+
+    if (response.type == Response::BODY &&
+        data.size() >= GZIP_MINIMUM_BODY_LENGTH &&
+        !response.headers.contains("Content-Encoding") &&
+        stream->acceptsGzip) {
+      Try<string> compressed = gzip::compress(data);
+
+      if (compressed.isError()) {
+        LOG(WARNING) << "Failed to gzip response body: " << compressed.error();
+      } else {
+        data = std::move(compressed.get());
+        response.headers["Content-Encoding"] = "gzip";
+      }
+    }
+
+    response.headers["Content-Length"] = stringify(data.size());
+  }
+
+  response.headers.erase("Date");
+
+  hpack::HeaderList headers;
+  headers.emplace_back(":status", stringify(response.code));
+  convert(response.headers, &headers);
+  headers.emplace_back("date", HttpResponseEncoder::date());
+
+  const bool end = body.isNone() && data.empty();
+
+  writeHeaders(id, headers, end);
+
+  if (end) {
+    endLocal(stream);
+  } else if (body.isSome()) {
+    writeBody(stream, body.get());
+  } else {
+    writeData(stream, data, true);
+  }
+
+  flush();
+}
+
+
+void ServerProcess::removed(Stream* stream, const Option<string>& failure)
+{
+  // Tell the handler that nobody is waiting for the response anymore.
+  if (failure.isSome()) {
+    stream->response.discard();
+  }
+}
+
+
+void ServerProcess::closed(const Option<string>& failure)
+{
+  if (failure.isSome()) {
+    promise.fail(failure.get());
+  } else {
+    promise.set(Nothing());
+  }
+}
+
+
+ClientProcess::ClientProcess(const network::Socket& socket)
+  : ProcessBase(ID::generate("__http2_connection__")),
+    ConnectionProcess(socket, false, "") {}
+
+
+Future<Response> ClientProcess::send(
+    const Request& request,
+    bool streamedResponse)
+{
+  if (done) {
+    return Failure("Disconnected");
+  }
+
+  if (goingAway) {
+    return Failure("Connection is going away");
+  }
+
+  if (request.type == Request::PIPE) {
+    if (request.reader.isNone()) {
+      return Failure("Request reader must be set for PIPE request");
+    }
+
+    if (!request.body.empty()) {
+      return Failure("Request body must be empty for PIPE request");
+    }
+
+    if (request.headers.contains("Content-Length")) {
+      return Failure("'Content-Length' cannot be set for PIPE request");
+    }
+  }
+
+  Waiting item{request, streamedResponse, Owned<Promise<Response>>(
+      new Promise<Response>())};
+
+  Future<Response> response = item.promise->future();
+
+  if (waiting.empty() && streams.size() < maxStreams) {
+    open(std::move(item));
+    flush();
+  } else {
+    waiting.push_back(std::move(item));
+  }
+
+  return response;
+}
+
+
+Future<Nothing> ClientProcess::disconnect(const Option<string>& message)
+{
+  close(message.getOrElse("Disconnected"));
+  return Nothing();
+}
+
+
+Future<Nothing> ClientProcess::disconnected()
+{
+  return disconnection.future();
+}
+
+
+void ClientProcess::finalize()
+{
+  close(string("Connection object was destructed"));
+}
+
+
+void ClientProcess::open(Waiting&& item)
+{
+  const Request& request = item.request;
+
+  if (nextStream > MAX_STREAM_ID) {
+    item.promise->fail("Exhausted the stream IDs of the connection");
+    return;
+  }
+
+  const uint32_t id = nextStream;
+  nextStream += 2;
+
+  Stream* stream = create(id);
+  stream->promise = item.promise;
+  stream->streamed = item.streamed;
+
+  // Like `HttpRequestEncoder` we take the authority from the "Host"
+  // header, or else the URL.
+  string authority;
+
+  Option<string> host = request.headers.get("Host");
+
+  if (host.isSome()) {
+    authority = host.get();
+  } else {
+    if (request.url.domain.isSome()) {
+      authority = request.url.domain.get();
+    } else if (request.url.ip.isSome()) {
+      authority = stringify(request.url.ip.get());
+    }
+
+    if (request.url.port.isSome() &&
+        request.url.port.get() != 80 &&
+        request.url.port.get() != 443) {
+      authority += ":" + stringify(request.url.port.get());
+    }
+  }
+
+  string path = "/" + strings::remove(request.url.path, "/", strings::PREFIX);
+
+  if (!request.url.query.empty()) {
+    path += "?" + query::encode(request.url.query);
+  }
+
+  hpack::HeaderList headers = {
+    {":method", request.method},
+    {":scheme", request.url.scheme.getOrElse("http")},
+    {":authority", authority},
+    {":path", path},
+  };
+
+  Headers fields = request.headers;
+
+  if (request.type == Request::BODY) {
+    fields["Content-Length"] = stringify(request.body.size());
+  }
+
+  convert(fields, &headers);
+
+  const bool end = request.type == Request::BODY && request.body.empty();
+
+  writeHeaders(id, headers, end);
+
+  if (end) {
+    endLocal(stream);
+  } else if (request.type == Request::BODY) {
+    writeData(stream, request.body, true);
+  } else {
+    writeBody(stream, request.reader.get());
+  }
+}
+
+
+void ClientProcess::headers(
+    uint32_t id,
+    Stream* stream,
+    hpack::HeaderList&& headers,
+    bool end)
+{
+  if (stream == nullptr) {
+    if (idle(id)) {
+      shutdown(PROTOCOL_ERROR, "Unexpected HEADERS frame");
+    }
+
+    // Otherwise we've reset the stream already.
+    return;
+  }
+
+  if (stream->head.isSome()) {
+    // Trailers, which we ignore like for HTTP/1.1, must end the stream.
+    if (!end || stream->remoteClosed) {
+      reset(stream, PROTOCOL_ERROR, "Unexpected HEADERS frame");
+      return;
+    }
+
+    endRemote(stream);
+    return;
+  }
+
+  Option<uint16_t> code;
+
+  foreach (const auto& header, headers) {
+    if (header.first == ":status") {
+      Try<uint16_t> status = numify<uint16_t>(header.second);
+
+      if (status.isSome() && isValidStatus(status.get())) {
+        code = status.get();
+      }
+    } else if (!header.first.empty() && header.first[0] == ':') {
+      code = None();
+      break;
+    }
+  }
+
+  if (code.isNone()) {
+    reset(stream, PROTOCOL_ERROR, "Failed to decode response");
+    return;
+  }
+
+  // Informational responses precede the final one.
+  if (code.get() / 100 == 1) {
+    if (end) {
+      reset(stream, PROTOCOL_ERROR, "Failed to decode response");
+    }
+    return;
+  }
+
+  Response response(code.get());
+  response.headers = convert(headers);
+
+  stream->receiving = true;
+
+  if (stream->streamed) {
+    Pipe pipe(STREAM_WINDOW);
+    response.type = Response::PIPE;
+    response.reader = pipe.reader();
+    stream->writer = pipe.writer();
+
+    stream->promise->set(response);
+  } else {
+    response.type = Response::BODY;
+  }
+
+  stream->head = response;
+
+  if (end) {
+    endRemote(stream);
+  }
+}
+
+
+void ClientProcess::ended(Stream* stream)
+{
+  if (!stream->streamed && stream->head.isSome()) {
+    Response response = stream->head.get();
+    response.body = std::move(stream->body);
+
+    stream->promise->set(response);
+  }
+}
+
+
+void ClientProcess::removed(Stream* stream, const Option<string>& failure)
+{
+  if (failure.isSome()) {
+    stream->promise->fail(failure.get());
+  }
+}
+
+
+void ClientProcess::released()
+{
+  while (!waiting.empty()) {
+    if (goingAway) {
+      waiting.front().promise->fail("Connection is going away");
+      waiting.pop_front();
+      continue;
+    }
+
+    if (streams.size() >= maxStreams) {
+      break;
+    }
+
+    Waiting item = std::move(waiting.front());
+    waiting.pop_front();
+
+    open(std::move(item));
+  }
+}
+
+
+void ClientProcess::closed(const Option<string>& failure)
+{
+  const string message = failure.getOrElse("Disconnected");
+
+  foreach (Waiting& item, waiting) {
+    item.promise->fail(message);
+  }
+
+  waiting.clear();
+
+  disconnection.set(Nothing());
+}
+
+} // namespace http2 {
+} // namespace http {
+} // namespace process {
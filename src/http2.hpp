@@ -0,0 +1,518 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __PROCESS_HTTP2_HPP__
+#define __PROCESS_HTTP2_HPP__
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <string>
+
+#include <process/future.hpp>
+#include <process/http.hpp>
+#include <process/owned.hpp>
+#include <process/process.hpp>
+#include <process/socket.hpp>
+
+#include <stout/gzip.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/nothing.hpp>
+#include <stout/option.hpp>
+
+#include "hpack.hpp"
+
+namespace process {
+namespace http {
+namespace http2 {
+
+// HTTP/2 (RFC 7540) for `http::serve` (and hence `http::Server`) and
+// `http::Connection`.
+//
+// Requests and responses are the same as for HTTP/1.1, i.e., request
+// handlers and callers don't need to know which version is spoken,
+// but every request gets its own stream so responses get sent as
+// soon as they're ready rather than in the order of the requests.
+
+// What a client sends first (see section 3.5), which also lets a
+// server tell HTTP/2 "with prior knowledge" apart from HTTP/1.1.
+constexpr char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr size_t PREFACE_SIZE = sizeof(PREFACE) - 1;
+
+// Size of the frame header, see section 4.1.
+constexpr size_t FRAME_HEADER_SIZE = 9;
+
+// Largest frame payload a peer may send us, i.e., the default (and
+// minimum) SETTINGS_MAX_FRAME_SIZE.
+constexpr size_t DEFAULT_MAX_FRAME_SIZE = 16384;
+
+
+enum FrameType : uint8_t
+{
+  DATA = 0x0,
+  HEADERS = 0x1,
+  PRIORITY = 0x2,
+  RST_STREAM = 0x3,
+  SETTINGS = 0x4,
+  PUSH_PROMISE = 0x5,
+  PING = 0x6,
+  GOAWAY = 0x7,
+  WINDOW_UPDATE = 0x8,
+  CONTINUATION = 0x9,
+};
+
+
+enum FrameFlag : uint8_t
+{
+  END_STREAM = 0x1,
+  ACK = 0x1,
+  END_HEADERS = 0x4,
+  PADDED = 0x8,
+  PRIORITY_FLAG = 0x20,
+};
+
+
+// NOTE: RFC 7540 calls the first error code NO_ERROR, which is a
+// macro on Windows.
+enum ErrorCode : uint32_t
+{
+  NONE = 0x0,
+  PROTOCOL_ERROR = 0x1,
+  INTERNAL_ERROR = 0x2,
+  FLOW_CONTROL_ERROR = 0x3,
+  SETTINGS_TIMEOUT = 0x4,
+  STREAM_CLOSED = 0x5,
+  FRAME_SIZE_ERROR = 0x6,
+  REFUSED_STREAM = 0x7,
+  CANCEL = 0x8,
+  COMPRESSION_ERROR = 0x9,
+  CONNECT_ERROR = 0xa,
+  ENHANCE_YOUR_CALM = 0xb,
+  INADEQUATE_SECURITY = 0xc,
+  HTTP_1_1_REQUIRED = 0xd,
+};
+
+
+enum Setting : uint16_t
+{
+  HEADER_TABLE_SIZE = 0x1,
+  ENABLE_PUSH = 0x2,
+  MAX_CONCURRENT_STREAMS = 0x3,
+  INITIAL_WINDOW_SIZE = 0x4,
+  MAX_FRAME_SIZE = 0x5,
+  MAX_HEADER_LIST_SIZE = 0x6,
+};
+
+
+struct Frame
+{
+  uint8_t type;
+  uint8_t flags;
+  uint32_t stream;
+  std::string payload;
+};
+
+
+// Splits the data received on a connection into frames.
+class FrameDecoder
+{
+public:
+  explicit FrameDecoder(size_t _maximum = DEFAULT_MAX_FRAME_SIZE)
+    : maximum(_maximum), failure(false) {}
+
+  std::deque<Frame> decode(const char* data, size_t length);
+
+  // Whether a frame was bigger than the maximum frame size, which is
+  // a connection error of type FRAME_SIZE_ERROR.
+  bool failed() const
+  {
+    return failure;
+  }
+
+private:
+  const size_t maximum;
+  bool failure;
+
+  // Data of the frame we've only partially received so far.
+  std::string buffer;
+};
+
+
+// Appends the frame to `out`.
+void encode(
+    std::string* out,
+    uint8_t type,
+    uint8_t flags,
+    uint32_t stream,
+    const char* payload,
+    size_t length);
+
+
+// Serves HTTP/2 on the socket, see `http::serve`. The data received
+// on the socket so far (e.g., the connection preface) gets handled
+// before anything else.
+Future<Nothing> serve(
+    const network::Socket& socket,
+    std::function<Future<Response>(const Request&)>&& f,
+    const std::string& received);
+
+
+// The framing, flow control and stream bookkeeping shared by both
+// ends of a connection. The server and client ends (see below) handle
+// the header blocks, i.e., the requests and responses.
+//
+// Outgoing frames get appended to a buffer that gets sent with one
+// system call whenever the previous send completes, so frames of any
+// number of streams get coalesced. DATA frames are only generated
+// right before sending, taking turns across the streams (as far as
+// their flow control windows allow), so that a stream with a big body
+// doesn't hold up the others.
+class ConnectionProcess : public Process<ConnectionProcess>
+{
+public:
+  ~ConnectionProcess() override {}
+
+protected:
+  ConnectionProcess(
+      const network::Socket& _socket,
+      bool _server,
+      const std::string& _received);
+
+  void initialize() override;
+  void finalize() override;
+
+  struct Stream
+  {
+    Stream(uint32_t _id, int64_t _sendWindow, int64_t _receiveWindow)
+      : id(_id),
+        sendWindow(_sendWindow),
+        receiveWindow(_receiveWindow) {}
+
+    const uint32_t id;
+
+    // Whether we've sent END_STREAM (local) or received it (remote).
+    bool localClosed = false;
+    bool remoteClosed = false;
+
+    // Flow control windows, i.e., how much body data we may send and
+    // the peer may send us.
+    int64_t sendWindow;
+    int64_t receiveWindow;
+
+    // Body data waiting for its turn (or window) to get sent from
+    // `offset` on, and whether to end the stream once it got sent.
+    std::string pending;
+    size_t offset = 0;
+    bool end = false;
+
+    size_t remaining() const
+    {
+      return pending.size() - offset;
+    }
+
+    // Whether the stream is in `active`.
+    bool scheduled = false;
+
+    // Body we're sending, while we're not reading it (see `reading`)
+    // the stream has enough of it pending.
+    Option<Pipe::Reader> reader;
+    bool reading = false;
+
+    // Whether we expect body data, i.e., we've got the request (at the
+    // server) or the final response headers (at the client).
+    bool receiving = false;
+
+    // Body we're receiving, if streamed, or else the body so far.
+    Option<Pipe::Writer> writer;
+    std::string body;
+    Owned<gzip::Decompressor> decompressor;
+
+    // Body data we've received that we haven't given back to the
+    // receive window yet, and whether we're waiting for the `writer`
+    // to become writable before we do.
+    size_t unacknowledged = 0;
+    bool granting = false;
+
+    // At the server: the response to the request and whether the
+    // client accepts a gzip compressed body.
+    Future<Response> response;
+    bool acceptsGzip = false;
+
+    // At the client: the response (set once the headers are received
+    // if streamed, or else once the body is) and the headers so far.
+    Owned<Promise<Response>> promise;
+    bool streamed = false;
+    Option<Response> head;
+  };
+
+  // Invoked with each complete header block. The `stream` is nullptr
+  // if there is no open stream with the ID.
+  virtual void headers(
+      uint32_t id,
+      Stream* stream,
+      hpack::HeaderList&& headers,
+      bool end) = 0;
+
+  // Invoked once the peer ended the stream.
+  virtual void ended(Stream* stream) {}
+
+  // Invoked before the stream gets removed, with the reason in case
+  // it didn't complete.
+  virtual void removed(Stream* stream, const Option<std::string>& failure) {}
+
+  // Invoked after a stream got removed, i.e., when another stream can
+  // be opened.
+  virtual void released() {}
+
+  // Invoked once the connection has been closed, with the reason in
+  // case of a failure.
+  virtual void closed(const Option<std::string>& failure) = 0;
+
+  // Opens a stream.
+  Stream* create(uint32_t id);
+
+  Stream* find(uint32_t id);
+
+  // Sends a header block on the stream, in a HEADERS frame followed
+  // by as many CONTINUATION frames as necessary.
+  void writeHeaders(uint32_t id, const hpack::HeaderList& headers, bool end);
+
+  // Sends body data on the stream once it's its turn.
+  void writeData(Stream* stream, const std::string& data, bool end);
+
+  // Sends the body that the reader reads on the stream.
+  void writeBody(Stream* stream, const Pipe::Reader& reader);
+
+  // Ends the stream locally, e.g., after sending the headers of a
+  // response without a body.
+  void endLocal(Stream* stream);
+
+  // Handles the end of the stream by the peer.
+  void endRemote(Stream* stream);
+
+  // Resets the stream with the error code.
+  void reset(Stream* stream, ErrorCode error, const std::string& message);
+
+  // Removes the stream, which is complete unless there is a failure.
+  void remove(Stream* stream, const Option<std::string>& failure);
+
+  // Sends GOAWAY and closes the connection once that got sent.
+  void shutdown(ErrorCode error, const std::string& message);
+
+  // Closes the connection right away.
+  void close(const Option<std::string>& failure);
+
+  // Sends the buffered frames unless a send is in progress.
+  void flush();
+
+  // Converts the header fields (other than the pseudo-header fields)
+  // to `Headers` and back, see section 8.1.2.
+  static Headers convert(const hpack::HeaderList& headers);
+  static void convert(const Headers& headers, hpack::HeaderList* fields);
+
+  // Returns whether the stream ID hasn't been used yet.
+  bool idle(uint32_t id) const;
+
+  network::Socket socket;
+  const bool server;
+
+  hashmap<uint32_t, Owned<Stream>> streams;
+
+  // Highest ID of a stream the peer opened, and the ID of the next
+  // stream we open (only the client opens any).
+  uint32_t lastPeerStream;
+  uint32_t nextStream;
+
+  // Maximum number of streams the peer allows us to open.
+  uint32_t maxStreams;
+
+  // Whether we've sent (or received) GOAWAY, after which no more
+  // streams get opened and the connection is closed once the open
+  // ones completed.
+  bool goingAway;
+
+  // Whether the connection has been closed.
+  bool done;
+
+private:
+  void receive();
+  void _receive(const Future<std::string>& data);
+
+  // Handles the received data, returns false if the connection got
+  // closed (or is being closed).
+  bool consume(const char* data, size_t length);
+
+  void handle(Frame&& frame);
+  void handleData(Frame&& frame);
+  void handleHeaders(Frame&& frame);
+  void handleSettings(const Frame& frame);
+  void handleWindowUpdate(const Frame& frame);
+  void handleGoAway(const Frame& frame);
+
+  // Handles a complete header block.
+  void decode(uint32_t id, const std::string& block, bool end);
+
+  // Gives back the body data received on the stream to its receive
+  // window once the writer (if any) has caught up.
+  void grant(Stream* stream);
+
+  // Reads the next chunk of the body that the stream sends.
+  void read(Stream* stream);
+
+  // Puts the stream in line to send its pending body data.
+  void activate(Stream* stream);
+
+  // Generates DATA frames from the pending body data of the streams.
+  void schedule();
+
+  void writeReset(uint32_t id, ErrorCode error);
+  void writeWindowUpdate(uint32_t id, size_t increment);
+
+  // Data received before the connection was handed to us, which gets
+  // cleared once handled.
+  std::string received;
+
+  FrameDecoder decoder;
+  hpack::Encoder encoder;
+  hpack::Decoder headerDecoder;
+
+  // Bytes of the client preface that the server has yet to receive.
+  size_t preface;
+
+  // Whether we received the SETTINGS frame that must come first.
+  bool settled;
+
+  // The header block of the HEADERS frame whose CONTINUATION frames
+  // we're receiving, if any.
+  struct Continuation
+  {
+    uint32_t stream;
+    bool end;
+    std::string block;
+  };
+
+  Option<Continuation> continuation;
+
+  // Connection flow control windows and the received data we haven't
+  // given back to the receive window yet.
+  int64_t sendWindow;
+  int64_t receiveWindow;
+  size_t unacknowledged;
+
+  // Settings of the peer.
+  int64_t initialWindow;
+  size_t maxFrameSize;
+
+  // Streams with pending body data, in the order they take turns.
+  std::deque<uint32_t> active;
+
+  // Frames waiting to be sent and whether a send is in progress.
+  std::string out;
+  bool sending;
+
+  // Whether we stopped receiving because too many frames are waiting
+  // to be sent, e.g., the peer keeps pinging but doesn't receive.
+  bool paused;
+
+  // The reason for closing once GOAWAY got sent, see `shutdown`.
+  Option<Option<std::string>> closing;
+};
+
+
+// The server end of a connection, which invokes the handler with a
+// (streamed) request for every stream the client opens and sends the
+// responses on the streams as soon as they're ready.
+class ServerProcess : public ConnectionProcess
+{
+public:
+  ServerProcess(
+      const network::Socket& socket,
+      std::function<Future<Response>(const Request&)>&& _f,
+      const std::string& received);
+
+  ~ServerProcess() override {}
+
+  // Completes once the connection has been closed, discarding it
+  // sends GOAWAY and closes the connection. The process doesn't
+  // terminate itself, see `serve`.
+  Future<Nothing> served();
+
+protected:
+  void initialize() override;
+
+  void headers(
+      uint32_t id,
+      Stream* stream,
+      hpack::HeaderList&& headers,
+      bool end) override;
+
+  void removed(Stream* stream, const Option<std::string>& failure) override;
+  void closed(const Option<std::string>& failure) override;
+
+private:
+  void respond(uint32_t id, const Future<Response>& future);
+
+  std::function<Future<Response>(const Request&)> f;
+  Option<network::Address> peer;
+  Promise<Nothing> promise;
+};
+
+
+// The client end of a connection, see `http::Connection`.
+class ClientProcess : public ConnectionProcess
+{
+public:
+  explicit ClientProcess(const network::Socket& socket);
+
+  ~ClientProcess() override {}
+
+  Future<Response> send(const Request& request, bool streamedResponse);
+  Future<Nothing> disconnect(const Option<std::string>& message);
+  Future<Nothing> disconnected();
+
+protected:
+  void finalize() override;
+
+  void headers(
+      uint32_t id,
+      Stream* stream,
+      hpack::HeaderList&& headers,
+      bool end) override;
+
+  void ended(Stream* stream) override;
+  void removed(Stream* stream, const Option<std::string>& failure) override;
+  void released() override;
+  void closed(const Option<std::string>& failure) override;
+
+private:
+  struct Waiting
+  {
+    Request request;
+    bool streamed;
+    Owned<Promise<Response>> promise;
+  };
+
+  // Opens a stream for the request.
+  void open(Waiting&& waiting);
+
+  // Requests waiting for the peer to allow another stream.
+  std::deque<Waiting> waiting;
+
+  Promise<Nothing> disconnection;
+};
+
+} // namespace http2 {
+} // namespace http {
+} // namespace process {
+
+#endif // __PROCESS_HTTP2_HPP__
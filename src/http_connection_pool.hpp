@@ -0,0 +1,160 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __PROCESS_HTTP_CONNECTION_POOL_HPP__
+#define __PROCESS_HTTP_CONNECTION_POOL_HPP__
+
+#include <stdint.h>
+
+#include <list>
+#include <string>
+
+#include <process/future.hpp>
+#include <process/http.hpp>
+#include <process/pid.hpp>
+#include <process/process.hpp>
+#include <process/time.hpp>
+
+#include <process/metrics/counter.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/hashmap.hpp>
+
+namespace process {
+namespace http {
+namespace internal {
+
+// Provides a process that keeps persistent (i.e., keep-alive)
+// connections open per authority (scheme, host, and port) so that
+// the convenience functions (e.g., `http::get` and `http::post`)
+// don't need to set up a new connection (and TLS session) for every
+// request, see the LIBPROCESS_HTTP_POOL_* flags.
+//
+// A request gets sent on a pooled connection that has fewer than
+// `pipeliningDepth` outstanding requests, preferring idle ones, or
+// on a new pooled connection unless there already are `maxPerHost`
+// connections to the authority, in which case it gets sent on a
+// one-off connection like `http::request` does. Idle connections get
+// closed after `idleTimeout` and the least recently used ones get
+// closed whenever there are more than `maxIdle`. A `maxPerHost` of 0,
+// the default, turns pooling off.
+//
+// Since the server might close an idle connection just as we reuse
+// it, requests with an idempotent method that fail on a reused
+// connection get retried once on a one-off connection.
+class ConnectionPoolProcess : public Process<ConnectionPoolProcess>
+{
+public:
+  ConnectionPoolProcess(
+      size_t _maxIdle,
+      size_t _maxPerHost,
+      const Duration& _idleTimeout,
+      size_t _pipeliningDepth);
+
+  ~ConnectionPoolProcess() override {}
+
+  // Sends the request, which must not stream its body, and returns
+  // the (non-streamed) response. The `keepAlive` of the request gets
+  // ignored.
+  Future<Response> send(Request request);
+
+protected:
+  void initialize() override;
+  void finalize() override;
+
+private:
+  struct Entry
+  {
+    Entry(uint64_t _id, const Connection& _connection)
+      : id(_id), connection(_connection) {}
+
+    const uint64_t id;
+    Connection connection;
+
+    // Number of requests sent that have not gotten a response yet.
+    size_t outstanding = 0;
+
+    // When `outstanding` last dropped to zero.
+    Time idleSince;
+  };
+
+  // Invoked once a connection to the authority is established (or
+  // failed to be established).
+  void connected(const std::string& authority);
+
+  // Adds the new connection to the pool and sends the request on it.
+  Future<Response> _send(
+      const std::string& authority,
+      const Connection& connection,
+      const Request& request);
+
+  // Sends the request on the pooled connection.
+  Future<Response> __send(
+      const std::string& authority,
+      Entry* entry,
+      const Request& request);
+
+  // Invoked once the response to a request sent on the pooled
+  // connection is ready (or failed or got discarded).
+  void release(
+      const std::string& authority,
+      uint64_t id,
+      const Future<Response>& response);
+
+  // Removes the connection from the pool if it is still idle since
+  // the specified time.
+  void expire(const std::string& authority, uint64_t id, const Time& since);
+
+  // Removes the connection from the pool and disconnects it.
+  void remove(const std::string& authority, uint64_t id);
+
+  // Removes the least recently used idle connections while there
+  // are more than `maxIdle`.
+  void evict();
+
+  Entry* find(const std::string& authority, uint64_t id);
+
+  const size_t maxIdle;
+  const size_t maxPerHost;
+  const Duration idleTimeout;
+  const size_t pipeliningDepth;
+
+  // Pooled connections, and the number of connections that are
+  // being established, per authority.
+  hashmap<std::string, std::list<Entry>> connections;
+  hashmap<std::string, size_t> connecting;
+
+  // Total number of pooled connections without outstanding requests.
+  size_t idle;
+
+  uint64_t nextId;
+
+  struct Metrics
+  {
+    Metrics();
+
+    // Number of requests sent on a pooled connection (hits) or that
+    // had to set up a new connection (misses).
+    metrics::Counter hits;
+    metrics::Counter misses;
+  } poolMetrics;
+};
+
+
+// Global connection pool process. Defined in process.cpp.
+extern PID<ConnectionPoolProcess> connection_pool;
+
+} // namespace internal {
+} // namespace http {
+} // namespace process {
+
+#endif // __PROCESS_HTTP_CONNECTION_POOL_HPP__
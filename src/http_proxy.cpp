@@ -10,9 +10,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License
 
+#include <utility>
+#include <vector>
+
+#include <process/clock.hpp>
 #include <process/id.hpp>
 #include <process/defer.hpp>
 
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+
 #include "encoder.hpp"
 #include "http_proxy.hpp"
 #include "socket_manager.hpp"
@@ -27,12 +34,29 @@ using process::http::Request;
 
 using std::string;
 using std::stringstream;
+using std::vector;
 
 namespace process {
 
-HttpProxy::HttpProxy(const Socket& _socket)
+HttpProxy::HttpProxy(const Socket& _socket, bool _preparing)
   : ProcessBase(ID::generate("__http__")),
-    socket(_socket) {}
+    socket(_socket),
+    preparing(_preparing) {}
+
+
+HttpProxy::Metrics::Metrics()
+  : blocked("libprocess/http_proxy/responses_blocked"),
+    blocked_time("libprocess/http_proxy/blocked_time_us", Minutes(1)),
+    prepared("libprocess/http_proxy/responses_prepared") {}
+
+
+HttpProxy::Metrics& HttpProxy::metrics()
+{
+  // NOTE: the metrics get intentionally leaked so that they outlive
+  // any proxy. They get added by `ProcessManager::installMetrics`.
+  static Metrics* metrics = new Metrics();
+  return *metrics;
+}
 
 
 void HttpProxy::finalize()
@@ -64,7 +88,7 @@ void HttpProxy::finalize()
       }
     });
 
-    items.pop();
+    items.pop_front();
     delete item;
   }
 
@@ -82,10 +106,14 @@ void HttpProxy::enqueue(const Response& response, const Request& request)
 
 void HttpProxy::handle(const Future<Response>& future, const Request& request)
 {
-  items.push(new Item(request, future));
+  items.push_back(new Item(request, future));
 
-  if (items.size() == 1) {
+  // NOTE: while streaming we start waiting on the next response once
+  // the stream has finished, see `stream`.
+  if (items.size() == 1 && pipe.isNone()) {
     next();
+  } else {
+    future.onReady(defer(self(), &HttpProxy::ready, future));
   }
 }
 
@@ -107,12 +135,25 @@ void HttpProxy::waited(const Future<Response>& future)
 
   CHECK(future == item->future);
 
+  if (preparing) {
+    prepare(item);
+  }
+
   // Process the item and determine if we're done or not (so we know
-  // whether to start waiting on the next responses).
-  bool processed = process(item->future, item->request);
+  // whether to start waiting on the next responses). Prepared
+  // responses get sent along with the ones prepared behind them.
+  bool processed = true;
+
+  if (item->encoded.isSome()) {
+    flush();
+  } else {
+    unblocked(*item);
 
-  items.pop();
-  delete item;
+    processed = process(item->future, item->request);
+
+    items.pop_front();
+    delete item;
+  }
 
   if (processed) {
     next();
@@ -120,6 +161,88 @@ void HttpProxy::waited(const Future<Response>& future)
 }
 
 
+void HttpProxy::ready(const Future<Response>& future)
+{
+  foreach (Item* item, items) {
+    if (item->future == future && item->ready.isNone()) {
+      // The response might have become the head of the queue (and
+      // hence not be blocked) in the meantime.
+      if (item == items.front() && pipe.isNone()) {
+        return;
+      }
+
+      item->ready = Clock::now();
+
+      if (preparing) {
+        prepare(item);
+
+        if (item->encoded.isSome()) {
+          ++metrics().prepared;
+        }
+      }
+
+      return;
+    }
+  }
+}
+
+
+void HttpProxy::prepare(Item* item)
+{
+  if (item->encoded.isSome() || !item->future.isReady()) {
+    return;
+  }
+
+  const Response& response = item->future.get();
+
+  if (response.type != Response::NONE && response.type != Response::BODY) {
+    return;
+  }
+
+  // See `SocketManager::send`.
+  item->persist = item->request.keepAlive &&
+    response.headers.get("Connection") != "close";
+
+  item->encoded = HttpResponseEncoder::encode(response, item->request);
+}
+
+
+void HttpProxy::flush()
+{
+  vector<string> responses;
+  bool persist = true;
+
+  // Stop at the first response that closes the connection, just like
+  // `process` would, since nothing may get sent after it (the rest of
+  // the responses are left to `next`).
+  while (persist && !items.empty() && items.front()->encoded.isSome()) {
+    Item* item = items.front();
+
+    unblocked(*item);
+
+    responses.push_back(std::move(item->encoded.get()));
+    persist = item->persist;
+
+    items.pop_front();
+    delete item;
+  }
+
+  CHECK(!responses.empty());
+
+  socket_manager->send(new DataEncoder(std::move(responses)), persist, socket);
+}
+
+
+void HttpProxy::unblocked(const Item& item)
+{
+  if (item.ready.isSome()) {
+    ++metrics().blocked;
+    metrics().blocked_time =
+      static_cast<int64_t>((Clock::now() - item.ready.get()).us());
+  }
+}
+
+
 bool HttpProxy::process(const Future<Response>& future, const Request& request)
 {
   if (!future.isReady()) {
@@ -227,8 +350,7 @@ bool HttpProxy::process(const Future<Response>& future, const Request& request)
     // process::Shared from the point where it is decoded.
     Owned<Request> request_(new Request(request));
 
-    reader.read()
-      .onAny(defer(self(), &Self::stream, request_, lambda::_1));
+    read(request_);
 
     return false; // Streaming, don't process next response (yet)!
   } else {
@@ -251,25 +373,32 @@ void HttpProxy::stream(
   bool finished = false; // Whether we're done streaming.
 
   if (chunk.isReady()) {
-    std::ostringstream out;
+    // Set once the chunk has been sent, if we need to wait for that.
+    Owned<Promise<Nothing>> sent;
 
     if (chunk->empty()) {
       // Finished reading.
-      out << "0\r\n" << "\r\n";
       finished = true;
     } else {
-      out << std::hex << chunk->size() << "\r\n";
-      out << chunk.get();
-      out << "\r\n";
+      queued += chunk->size();
 
-      // Keep reading.
-      reader.read()
-        .onAny(defer(self(), &Self::stream, request, lambda::_1));
+      if (queued < STREAM_WINDOW) {
+        // Keep reading.
+        read(request);
+      } else {
+        // Keep reading once the socket has caught up.
+        queued = 0;
+        sent.reset(new Promise<Nothing>());
+        sent->future()
+          .onAny(defer(self(), [=](const Future<Nothing>&) {
+            read(request);
+          }));
+      }
     }
 
     // Always persist the connection when streaming is not finished.
     socket_manager->send(
-        new DataEncoder(out.str()),
+        new HttpChunkEncoder(chunk.get(), sent),
         finished ? request->keepAlive : true,
         socket);
   } else if (chunk.isFailed()) {
@@ -287,8 +416,20 @@ void HttpProxy::stream(
   if (finished) {
     reader.close();
     pipe = None();
+    queued = 0;
     next();
   }
 }
 
+
+void HttpProxy::read(const Owned<Request>& request)
+{
+  CHECK_SOME(pipe);
+
+  http::Pipe::Reader reader = pipe.get();
+
+  reader.read()
+    .onAny(defer(self(), &Self::stream, request, lambda::_1));
+}
+
 } // namespace process {
@@ -13,12 +13,17 @@
 #ifndef __PROCESS_HTTP_PROXY_HPP__
 #define __PROCESS_HTTP_PROXY_HPP__
 
-#include <queue>
+#include <deque>
+#include <string>
 
 #include <process/future.hpp>
 #include <process/http.hpp>
 #include <process/process.hpp>
 #include <process/socket.hpp>
+#include <process/time.hpp>
+
+#include <process/metrics/counter.hpp>
+#include <process/metrics/push_gauge.hpp>
 
 #include <stout/option.hpp>
 
@@ -33,10 +38,16 @@ namespace process {
 // might still be outstanding responses even though the client might
 // have closed the connection (see more discussion in
 // SocketManager::close and SocketManager::proxy).
+//
+// Since the responses are sent in order a slow response blocks the
+// responses behind it even if they are ready, i.e., head-of-line
+// blocking. If `preparing` is set the responses that get ready while
+// blocked are encoded (and compressed) right away so that they can
+// be sent along with the blocking response with a single write.
 class HttpProxy : public Process<HttpProxy>
 {
 public:
-  explicit HttpProxy(const network::inet::Socket& _socket);
+  HttpProxy(const network::inet::Socket& _socket, bool _preparing = false);
 
   ~HttpProxy() override {}
 
@@ -53,16 +64,52 @@ public:
       const Future<http::Response>& future,
       const http::Request& request);
 
+  // Metrics about head-of-line blocking, across all proxies.
+  struct Metrics
+  {
+    Metrics();
+
+    // Number of responses that were ready before the responses ahead
+    // of them had been sent.
+    metrics::Counter blocked;
+
+    // How long such responses waited for the responses ahead of them.
+    // The windowed history gets exposed as percentiles.
+    metrics::PushGauge blocked_time;
+
+    // Number of responses that got encoded while blocked.
+    metrics::Counter prepared;
+  };
+
+  static Metrics& metrics();
+
 protected:
   void finalize() override;
 
 private:
+  struct Item;
+
   // Starts "waiting" on the next available future response.
   void next();
 
   // Invoked once a future response has been satisfied.
   void waited(const Future<http::Response>& future);
 
+  // Invoked once a future response that isn't at the head of the
+  // queue (or that is blocked by a stream) has been satisfied.
+  void ready(const Future<http::Response>& future);
+
+  // Encodes the item's response if it can be sent as is, i.e., if
+  // it's a response without a path or a stream.
+  void prepare(Item* item);
+
+  // Sends the prepared responses at the head of the queue with a
+  // single encoder.
+  void flush();
+
+  // Accounts for the time the item's response was blocked, if any.
+  void unblocked(const Item& item);
+
   // Demuxes and handles a response.
   bool process(
       const Future<http::Response>& future,
@@ -73,8 +120,19 @@ private:
       const Owned<http::Request>& request,
       const Future<std::string>& chunk);
 
+  // Reads the next chunk of the current stream.
+  void read(const Owned<http::Request>& request);
+
+  // Number of bytes of a stream that we queue on the socket before we
+  // wait for them to be sent, so that we don't read a stream (much)
+  // faster than the client receives it. This pushes back on writers
+  // that wait for a bounded pipe to be writable.
+  static constexpr size_t STREAM_WINDOW = 256 * 1024;
+
   network::inet::Socket socket; // Store the socket to keep it open.
 
+  const bool preparing;
+
   // Describes a queue "item" that wraps the future to the response
   // and the original request.
   // The original request contains needed information such as what encodings
@@ -86,11 +144,23 @@ private:
 
     const http::Request request; // Make a copy.
     Future<http::Response> future; // Make a copy.
+
+    // When the response got ready if it was blocked at the time.
+    Option<Time> ready;
+
+    // The encoded response if it got prepared, and whether to keep
+    // the connection open after sending it.
+    Option<std::string> encoded;
+    bool persist = true;
   };
 
-  std::queue<Item*> items;
+  std::deque<Item*> items;
 
   Option<http::Pipe::Reader> pipe; // Current pipe, if streaming.
+
+  // Number of bytes of the current stream queued on the socket since
+  // we last waited for the socket to catch up.
+  size_t queued = 0;
 };
 
 } // namespace process {
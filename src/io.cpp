@@ -30,6 +30,7 @@
 #include <stout/os/strerror.hpp>
 #include <stout/os/write.hpp>
 
+#include "buffer_pool.hpp"
 #include "io_internal.hpp"
 
 using std::string;
@@ -164,22 +165,23 @@ Future<string> read(int_fd fd)
   // TODO(benh): Wrap up this data as a struct, use 'Owner'.
   // TODO(bmahler): For efficiency, use a rope for the buffer.
   std::shared_ptr<string> buffer(new string());
-  boost::shared_array<char> data(new char[BUFFERED_READ_SIZE]);
+  char* data = BufferPool::acquire();
 
   return loop(
       None(),
       [=]() {
-        return io::read(fd, data.get(), BUFFERED_READ_SIZE);
+        return io::read(fd, data, BufferPool::SIZE);
       },
       [=](size_t length) -> ControlFlow<string> {
         if (length == 0) { // EOF.
           return Break(std::move(*buffer));
         }
-        buffer->append(data.get(), length);
+        buffer->append(data, length);
         return Continue();
       })
-    .onAny([fd]() {
+    .onAny([fd, data]() {
       os::close(fd);
+      BufferPool::release(data);
     });
 }
 
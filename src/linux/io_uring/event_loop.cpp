@@ -0,0 +1,97 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#include <sys/time.h>
+
+#include <process/logging.hpp>
+#include <process/once.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/lambda.hpp>
+
+#include "event_loop.hpp"
+
+#include "linux/io_uring/libiouring.hpp"
+
+namespace process {
+
+// Number of submission queue entries of each ring. This only bounds
+// how many operations get submitted at once, not how many can be
+// in flight.
+constexpr unsigned RING_ENTRIES = 1024;
+
+
+void EventLoop::initialize(size_t loops)
+{
+  static Once* initialized = new Once();
+
+  if (initialized->once()) {
+    return;
+  }
+
+  CHECK_GT(loops, 0u);
+
+  for (size_t i = 0; i < loops; i++) {
+    Try<uring::Ring*> ring = uring::Ring::create(RING_ENTRIES);
+    if (ring.isError()) {
+      LOG(FATAL) << "Failed to initialize, " << ring.error();
+    }
+
+    uring::rings->push_back(ring.get());
+  }
+
+  initialized->done();
+}
+
+
+size_t EventLoop::loops()
+{
+  return uring::rings->size();
+}
+
+
+void EventLoop::delay(
+    const Duration& duration,
+    const lambda::function<void()>& function)
+{
+  uring::delay(duration, function);
+}
+
+
+double EventLoop::time()
+{
+  timeval t;
+  if (::gettimeofday(&t, nullptr) < 0) {
+    PLOG(FATAL) << "Failed to get time, gettimeofday";
+  }
+
+  return Duration(t).secs();
+}
+
+
+void EventLoop::run(size_t index)
+{
+  CHECK_LT(index, uring::rings->size());
+
+  (*uring::rings)[index]->run();
+}
+
+
+void EventLoop::stop()
+{
+  foreach (uring::Ring* ring, *uring::rings) {
+    ring->stop();
+  }
+}
+
+} // namespace process {
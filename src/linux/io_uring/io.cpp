@@ -0,0 +1,82 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#include <process/future.hpp>
+#include <process/io.hpp>
+#include <process/process.hpp> // For process::initialize.
+
+#include <stout/os.hpp>
+
+#include <stout/os/int_fd.hpp>
+
+#include "io_internal.hpp"
+
+#include "linux/io_uring/libiouring.hpp"
+
+namespace process {
+namespace io {
+
+Future<short> poll(int_fd fd, short events)
+{
+  process::initialize();
+
+  return uring::poll(fd, events);
+}
+
+
+namespace internal {
+
+Future<size_t> read(int_fd fd, void* data, size_t size)
+{
+  // TODO(benh): Let the system calls do what ever they're supposed to
+  // rather than return 0 here?
+  if (size == 0) {
+    return 0;
+  }
+
+  // Unlike the readiness based backends we read with a single
+  // operation (unless the kernel tells us to poll first, see
+  // `uring::read`).
+  return uring::read(fd, data, size);
+}
+
+
+Future<size_t> write(int_fd fd, const void* data, size_t size)
+{
+  // TODO(benh): Let the system calls do what ever they're supposed to
+  // rather than return 0 here?
+  if (size == 0) {
+    return 0;
+  }
+
+  return uring::write(fd, data, size);
+}
+
+
+// NOTE: io_uring doesn't need non-blocking file descriptors but we
+// still make them non-blocking so that "asynchronous" means the same
+// for all of the POSIX backends and code that does system calls on
+// them directly never blocks.
+Try<Nothing> prepare_async(int_fd fd)
+{
+  return os::nonblock(fd);
+}
+
+
+Try<bool> is_async(int_fd fd)
+{
+  return os::isNonblock(fd);
+}
+
+} // namespace internal {
+} // namespace io {
+} // namespace process {
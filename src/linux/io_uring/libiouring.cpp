@@ -0,0 +1,776 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <process/address.hpp>
+#include <process/io.hpp>
+#include <process/logging.hpp>
+#include <process/loop.hpp>
+#include <process/network.hpp>
+
+#include <stout/error.hpp>
+#include <stout/none.hpp>
+#include <stout/stringify.hpp>
+#include <stout/synchronized.hpp>
+
+#include <stout/os/strerror.hpp>
+
+#include "linux/io_uring/libiouring.hpp"
+
+using std::string;
+using std::vector;
+
+namespace process {
+namespace uring {
+
+// Values of `user_data` that don't point to an operation: completions
+// we ignore (e.g., of cancellations) and the reads on `wakeup`.
+constexpr uint64_t USER_DATA_IGNORE = 0;
+constexpr uint64_t USER_DATA_WAKEUP = 1;
+
+
+std::vector<Ring*>* rings = new std::vector<Ring*>();
+
+
+// The ring run by this thread, if any.
+static thread_local Ring* _ring_ = nullptr;
+
+
+struct Ring::Operation
+{
+  lambda::function<void(io_uring_sqe*)> prepare;
+  Promise<int> promise;
+
+  // Keeps the operation around while the kernel might complete it
+  // since it's what the `user_data` of its entries points to.
+  std::shared_ptr<Operation> self;
+};
+
+
+static int io_uring_setup(unsigned entries, io_uring_params* params)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+
+static int io_uring_enter(
+    int fd,
+    unsigned to_submit,
+    unsigned min_complete,
+    unsigned flags)
+{
+  return static_cast<int>(::syscall(
+      __NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+
+// The kernel reads the submission queue tail and writes the
+// completion queue tail concurrently with us.
+static unsigned load_acquire(const unsigned* p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+
+static void store_release(unsigned* p, unsigned value)
+{
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+
+Try<Ring*> Ring::create(unsigned entries)
+{
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  int fd = io_uring_setup(entries, &params);
+  if (fd < 0) {
+    return ErrnoError("Failed to set up io_uring");
+  }
+
+  std::unique_ptr<Ring> ring(new Ring());
+  ring->fd = fd;
+
+  // Fast poll (Linux 5.7) means that the kernel polls sockets for us
+  // rather than blocking a worker thread, and implies all of the
+  // operations that we use as well as a single mapping for both
+  // queue rings (`IORING_FEAT_SINGLE_MMAP`).
+  if ((params.features & IORING_FEAT_FAST_POLL) == 0) {
+    return Error("io_uring requires Linux 5.7 or later");
+  }
+
+  ring->queues_size = std::max(
+      params.sq_off.array + params.sq_entries * sizeof(unsigned),
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+
+  ring->queues = ::mmap(
+      nullptr,
+      ring->queues_size,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE,
+      fd,
+      IORING_OFF_SQ_RING);
+
+  if (ring->queues == MAP_FAILED) {
+    return ErrnoError("Failed to map io_uring queues");
+  }
+
+  ring->sq.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+  ring->sq.sqes = static_cast<io_uring_sqe*>(::mmap(
+      nullptr,
+      ring->sq.sqes_size,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE,
+      fd,
+      IORING_OFF_SQES));
+
+  if (ring->sq.sqes == MAP_FAILED) {
+    return ErrnoError("Failed to map io_uring submission queue entries");
+  }
+
+  char* queues = static_cast<char*>(ring->queues);
+
+  ring->sq.head = reinterpret_cast<unsigned*>(queues + params.sq_off.head);
+  ring->sq.tail = reinterpret_cast<unsigned*>(queues + params.sq_off.tail);
+  ring->sq.mask =
+    reinterpret_cast<unsigned*>(queues + params.sq_off.ring_mask);
+  ring->sq.array = reinterpret_cast<unsigned*>(queues + params.sq_off.array);
+  ring->sq.entries = params.sq_entries;
+  ring->sq.next = *ring->sq.tail;
+
+  ring->cq.head = reinterpret_cast<unsigned*>(queues + params.cq_off.head);
+  ring->cq.tail = reinterpret_cast<unsigned*>(queues + params.cq_off.tail);
+  ring->cq.mask =
+    reinterpret_cast<unsigned*>(queues + params.cq_off.ring_mask);
+  ring->cq.cqes =
+    reinterpret_cast<io_uring_cqe*>(queues + params.cq_off.cqes);
+
+  ring->wakeup = ::eventfd(0, EFD_CLOEXEC);
+  if (ring->wakeup < 0) {
+    return ErrnoError("Failed to create eventfd");
+  }
+
+  return ring.release();
+}
+
+
+Ring::~Ring()
+{
+  if (wakeup >= 0) {
+    ::close(wakeup);
+  }
+
+  if (sq.sqes != MAP_FAILED) {
+    ::munmap(sq.sqes, sq.sqes_size);
+  }
+
+  if (queues != MAP_FAILED) {
+    ::munmap(queues, queues_size);
+  }
+
+  ::close(fd);
+}
+
+
+void Ring::run()
+{
+  _ring_ = this;
+  stopping = false;
+
+  while (!stopping) {
+    arm();
+    enter(1);
+    reap();
+  }
+
+  // Submit anything that got prepared after the last `enter`.
+  enter(0);
+
+  _ring_ = nullptr;
+}
+
+
+void Ring::stop()
+{
+  dispatch([this]() {
+    stopping = true;
+  });
+}
+
+
+void Ring::dispatch(const lambda::function<void()>& f)
+{
+  if (_ring_ == this) {
+    f();
+    return;
+  }
+
+  synchronized (mutex) {
+    functions.push(f);
+  }
+
+  const uint64_t one = 1;
+  if (::write(wakeup, &one, sizeof(one)) != sizeof(one)) {
+    PLOG(FATAL) << "Failed to wake up io_uring";
+  }
+}
+
+
+Future<int> Ring::submit(const lambda::function<void(io_uring_sqe*)>& prepare)
+{
+  std::shared_ptr<Operation> operation(new Operation());
+  operation->prepare = prepare;
+
+  Future<int> future = operation->promise.future();
+
+  // We capture a `weak_ptr` since the operation (and its promise)
+  // must not outlive the completion and the future would otherwise
+  // keep it around.
+  std::weak_ptr<Operation> weak_operation(operation);
+
+  future.onDiscard([this, weak_operation]() {
+    std::shared_ptr<Operation> operation = weak_operation.lock();
+    if (operation != nullptr) {
+      dispatch([this, operation]() {
+        cancel(operation);
+      });
+    }
+  });
+
+  dispatch([this, operation]() {
+    submit(operation);
+  });
+
+  return future;
+}
+
+
+io_uring_sqe* Ring::sqe()
+{
+  // We don't use a submission queue polling thread so the kernel
+  // consumes all of the entries that we submit right away, unless the
+  // completion queue has overflown in which case we need to handle
+  // some completions first.
+  while (sq.next - load_acquire(sq.head) >= sq.entries) {
+    enter(0);
+
+    if (sq.next - load_acquire(sq.head) >= sq.entries) {
+      reap();
+    }
+  }
+
+  const unsigned index = sq.next & *sq.mask;
+
+  io_uring_sqe* entry = &sq.sqes[index];
+  memset(entry, 0, sizeof(*entry));
+
+  sq.array[index] = index;
+  sq.next++;
+
+  return entry;
+}
+
+
+void Ring::enter(unsigned wait)
+{
+  store_release(sq.tail, sq.next);
+
+  const unsigned submit = sq.next - load_acquire(sq.head);
+
+  if (submit == 0 && wait == 0) {
+    return;
+  }
+
+  int result = io_uring_enter(
+      fd,
+      submit,
+      wait,
+      wait > 0 ? IORING_ENTER_GETEVENTS : 0);
+
+  // We get `EBUSY` (or `EAGAIN`) if we need to handle some completions
+  // before the kernel takes more submissions, and `EINTR` if a signal
+  // interrupted the wait, in which cases the caller handles whatever
+  // completions there are and enters again.
+  if (result < 0 && errno != EBUSY && errno != EAGAIN && errno != EINTR) {
+    PLOG(FATAL) << "Failed to enter io_uring";
+  }
+}
+
+
+void Ring::submit(const std::shared_ptr<Operation>& operation)
+{
+  if (operation->promise.future().hasDiscard()) {
+    operation->promise.discard();
+    return;
+  }
+
+  io_uring_sqe* entry = sqe();
+  operation->prepare(entry);
+  entry->user_data = reinterpret_cast<uint64_t>(operation.get());
+
+  operation->self = operation;
+}
+
+
+void Ring::cancel(const std::shared_ptr<Operation>& operation)
+{
+  // Nothing to cancel if the operation completed already.
+  if (operation->self == nullptr) {
+    return;
+  }
+
+  io_uring_sqe* entry = sqe();
+  entry->opcode = IORING_OP_ASYNC_CANCEL;
+  entry->fd = -1;
+  entry->addr = reinterpret_cast<uint64_t>(operation.get());
+  entry->user_data = USER_DATA_IGNORE;
+}
+
+
+void Ring::reap()
+{
+  // NOTE: We reload the head for every entry and advance it before
+  // handling the entry since handling it might submit operations,
+  // which can end up reaping completions too (see `sqe`).
+  while (true) {
+    const unsigned head = *cq.head;
+    if (head == load_acquire(cq.tail)) {
+      break;
+    }
+
+    const io_uring_cqe& cqe = cq.cqes[head & *cq.mask];
+    const uint64_t user_data = cqe.user_data;
+    const int result = cqe.res;
+
+    store_release(cq.head, head + 1);
+
+    if (user_data == USER_DATA_IGNORE) {
+      continue;
+    }
+
+    if (user_data == USER_DATA_WAKEUP) {
+      armed = false;
+
+      // Run the functions outside of the mutex since they can take a
+      // long time and might call `dispatch` themselves.
+      std::queue<lambda::function<void()>> q;
+
+      synchronized (mutex) {
+        std::swap(q, functions);
+      }
+
+      while (!q.empty()) {
+        q.front()();
+        q.pop();
+      }
+
+      continue;
+    }
+
+    std::shared_ptr<Operation> operation =
+      std::move(reinterpret_cast<Operation*>(user_data)->self);
+
+    if (result == -ECANCELED) {
+      operation->promise.discard();
+    } else {
+      operation->promise.set(result);
+    }
+  }
+}
+
+
+void Ring::arm()
+{
+  if (armed) {
+    return;
+  }
+
+  io_uring_sqe* entry = sqe();
+  entry->opcode = IORING_OP_READ;
+  entry->fd = wakeup;
+  entry->addr = reinterpret_cast<uint64_t>(&wakeups);
+  entry->len = sizeof(wakeups);
+  entry->user_data = USER_DATA_WAKEUP;
+
+  armed = true;
+}
+
+
+Ring* ring_for(int_fd fd)
+{
+  return (*rings)[std::hash<int_fd>()(fd) % rings->size()];
+}
+
+
+// Returns a failure for a negated errno value.
+static Failure failure(const string& message, int result)
+{
+  return Failure(message + ": " + os::strerror(-result));
+}
+
+
+// Submits the operation to the ring that owns the file descriptor and
+// retries it once the file descriptor is ready for `events` if it
+// fails with `EAGAIN`, which it can for non-blocking file descriptors
+// (the kernel doesn't always poll them for us).
+static Future<int> submit(
+    int_fd fd,
+    short events,
+    const lambda::function<void(io_uring_sqe*)>& prepare)
+{
+  Ring* ring = ring_for(fd);
+
+  return loop(
+      None(),
+      [ring, prepare]() {
+        return ring->submit(prepare);
+      },
+      [fd, events](int result) -> Future<ControlFlow<int>> {
+        if (result == -EINTR) {
+          return Continue();
+        } else if (result == -EAGAIN) {
+          return uring::poll(fd, events)
+            .then([]() -> ControlFlow<int> {
+              return Continue();
+            });
+        }
+        return Break(result);
+      });
+}
+
+
+Future<short> poll(int_fd fd, short events)
+{
+  uint32_t mask =
+    ((events & io::READ) ? POLLIN : 0) | ((events & io::WRITE) ? POLLOUT : 0);
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+  // The kernel expects the 16 bit halves swapped, see `poll32_events`.
+  mask = (mask << 16) | (mask >> 16);
+#endif // __BYTE_ORDER == __BIG_ENDIAN
+
+  return ring_for(fd)->submit([fd, mask](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = fd;
+      sqe->poll32_events = mask;
+    })
+    .then([events](int result) -> Future<short> {
+      if (result < 0) {
+        return failure("Failed to poll", result);
+      }
+
+      // Like the other backends we report errors (and hang ups) as
+      // the requested events so that the subsequent operation fails.
+      short ready = 0;
+      if ((events & io::READ) && (result & (POLLIN | POLLERR | POLLHUP))) {
+        ready |= io::READ;
+      }
+      if ((events & io::WRITE) && (result & (POLLOUT | POLLERR | POLLHUP))) {
+        ready |= io::WRITE;
+      }
+      return ready;
+    });
+}
+
+
+// Returns the number of bytes transferred by the operation.
+static Future<size_t> transferred(
+    const string& message,
+    const Future<int>& future)
+{
+  return future.then([message](int result) -> Future<size_t> {
+    if (result < 0) {
+      return failure(message, result);
+    }
+    return static_cast<size_t>(result);
+  });
+}
+
+
+Future<size_t> read(int_fd fd, void* data, size_t size)
+{
+  return transferred(
+      "Failed to read",
+      submit(fd, io::READ, [fd, data, size](io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = static_cast<uint32_t>(std::min<size_t>(size, UINT_MAX));
+
+        // Read from (and advance) the current file position.
+        sqe->off = static_cast<uint64_t>(-1);
+      }));
+}
+
+
+Future<size_t> write(int_fd fd, const void* data, size_t size)
+{
+  return transferred(
+      "Failed to write",
+      submit(fd, io::WRITE, [fd, data, size](io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = static_cast<uint32_t>(std::min<size_t>(size, UINT_MAX));
+
+        // Write at (and advance) the current file position.
+        sqe->off = static_cast<uint64_t>(-1);
+      }));
+}
+
+
+Future<size_t> recv(int_fd fd, void* data, size_t size)
+{
+  return transferred(
+      "Failed to recv",
+      submit(fd, io::READ, [fd, data, size](io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = static_cast<uint32_t>(std::min<size_t>(size, UINT_MAX));
+      }));
+}
+
+
+Future<size_t> send(int_fd fd, const void* data, size_t size)
+{
+  return transferred(
+      "Failed to send",
+      submit(fd, io::WRITE, [fd, data, size](io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = static_cast<uint32_t>(std::min<size_t>(size, UINT_MAX));
+        sqe->msg_flags = MSG_NOSIGNAL;
+      }));
+}
+
+
+Future<size_t> send(
+    int_fd fd,
+    const vector<network::internal::SocketImpl::Buffer>& buffers)
+{
+  struct Message
+  {
+    vector<struct iovec> iov;
+    struct msghdr header;
+  };
+
+  // The kernel reads the message header and the I/O vectors once it
+  // gets to the operation so they need to stay around until then.
+  //
+  // We can't send more than `IOV_MAX` buffers at once, the caller
+  // will have to send the rest.
+  std::shared_ptr<Message> message(new Message());
+  message->iov.resize(std::min(buffers.size(), static_cast<size_t>(IOV_MAX)));
+
+  for (size_t i = 0; i < message->iov.size(); i++) {
+    message->iov[i].iov_base = const_cast<char*>(buffers[i].data);
+    message->iov[i].iov_len = buffers[i].size;
+  }
+
+  memset(&message->header, 0, sizeof(message->header));
+  message->header.msg_iov = message->iov.data();
+  message->header.msg_iovlen = message->iov.size();
+
+  return transferred(
+      "Failed to send",
+      submit(fd, io::WRITE, [fd, message](io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&message->header);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+      }));
+}
+
+
+Future<int_fd> accept(int_fd fd)
+{
+  return submit(fd, io::READ, [fd](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->fd = fd;
+      sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    })
+    .then([](int result) -> Future<int_fd> {
+      if (result < 0) {
+        return failure("Failed to accept", result);
+      }
+      return int_fd(result);
+    });
+}
+
+
+Future<Nothing> connect(int_fd fd, const network::Address& address)
+{
+  // The kernel copies the address when it gets to the operation so it
+  // needs to stay around until then.
+  std::shared_ptr<sockaddr_storage> storage(new sockaddr_storage(address));
+  const socklen_t length = static_cast<socklen_t>(address.size());
+
+  return ring_for(fd)->submit([fd, storage, length](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_CONNECT;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(storage.get());
+      sqe->off = length;
+    })
+    .then([fd, address](int result) -> Future<Nothing> {
+      if (result == 0) {
+        return Nothing();
+      }
+
+      if (result != -EINPROGRESS && result != -EALREADY && result != -EAGAIN) {
+        return Failure(SocketError(
+            -result, "Failed to connect to " + stringify(address)));
+      }
+
+      // The kernel doesn't always wait for a non-blocking socket to
+      // connect so we need to poll it like the other backends.
+      return uring::poll(fd, io::WRITE)
+        .then([fd, address]() -> Future<Nothing> {
+          int opt;
+          socklen_t optlen = sizeof(opt);
+
+          if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &opt, &optlen) < 0) {
+            return Failure(SocketError(
+                "Failed to get status of connect to " + stringify(address)));
+          }
+
+          if (opt != 0) {
+            return Failure(SocketError(
+                opt, "Failed to connect to " + stringify(address)));
+          }
+
+          return Nothing();
+        });
+    });
+}
+
+
+Future<size_t> sendfile(int_fd fd, int_fd file_fd, off_t offset, size_t size)
+{
+  // There is no sendfile operation so we splice the file into a pipe
+  // and the pipe into the socket instead, which is what `sendfile`
+  // does within the kernel anyway.
+  struct Pipe
+  {
+    ~Pipe()
+    {
+      ::close(read);
+      ::close(write);
+    }
+
+    int read;
+    int write;
+  };
+
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC) < 0) {
+    return Failure(ErrnoError("Failed to create pipe"));
+  }
+
+  std::shared_ptr<Pipe> pipe(new Pipe{fds[0], fds[1]});
+
+  // Splicing into the pipe moves at most the capacity of the pipe,
+  // like a `sendfile` that sends less than requested.
+  return ring_for(fd)->submit([=](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_SPLICE;
+      sqe->splice_fd_in = file_fd;
+      sqe->splice_off_in = static_cast<uint64_t>(offset);
+      sqe->fd = pipe->write;
+      sqe->off = static_cast<uint64_t>(-1);
+      sqe->len = static_cast<uint32_t>(std::min<size_t>(size, UINT_MAX));
+    })
+    .then([=](int spliced) -> Future<size_t> {
+      if (spliced < 0) {
+        return failure("Failed to sendfile", spliced);
+      } else if (spliced == 0) {
+        return 0;
+      }
+
+      // Move everything that is in the pipe into the socket since the
+      // caller only knows about the file.
+      std::shared_ptr<size_t> remaining(new size_t(spliced));
+
+      return loop(
+          None(),
+          [=]() {
+            return submit(fd, io::WRITE, [=](io_uring_sqe* sqe) {
+              sqe->opcode = IORING_OP_SPLICE;
+              sqe->splice_fd_in = pipe->read;
+              sqe->splice_off_in = static_cast<uint64_t>(-1);
+              sqe->fd = fd;
+              sqe->off = static_cast<uint64_t>(-1);
+              sqe->len = static_cast<uint32_t>(*remaining);
+            });
+          },
+          [=](int result) -> Future<ControlFlow<size_t>> {
+            if (result < 0) {
+              return failure("Failed to sendfile", result);
+            } else if (result == 0) {
+              return Failure("Failed to sendfile: socket closed");
+            }
+
+            *remaining -= result;
+            if (*remaining > 0) {
+              return Continue();
+            }
+
+            return Break(static_cast<size_t>(spliced));
+          });
+    });
+}
+
+
+void delay(const Duration& duration, const lambda::function<void()>& function)
+{
+  // The kernel reads the timeout when it gets to the operation so it
+  // needs to stay around until then.
+  std::shared_ptr<__kernel_timespec> timeout(new __kernel_timespec());
+  if (duration > Seconds(0)) {
+    timeout->tv_sec = duration.ns() / Seconds(1).ns();
+    timeout->tv_nsec = duration.ns() % Seconds(1).ns();
+  }
+
+  // NOTE: the timeout completes with `ETIME` when it expires.
+  rings->front()->submit([timeout](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_TIMEOUT;
+      sqe->fd = -1;
+      sqe->addr = reinterpret_cast<uint64_t>(timeout.get());
+      sqe->len = 1;
+    })
+    .onReady([function](int) {
+      function();
+    });
+}
+
+} // namespace uring {
+} // namespace process {
@@ -0,0 +1,185 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __LIBIOURING_HPP__
+#define __LIBIOURING_HPP__
+
+#include <linux/io_uring.h>
+
+#include <stdint.h>
+
+#include <sys/mman.h>
+
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include <process/address.hpp>
+#include <process/future.hpp>
+#include <process/socket.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/lambda.hpp>
+#include <stout/nothing.hpp>
+#include <stout/try.hpp>
+
+#include <stout/os/int_fd.hpp>
+
+namespace process {
+namespace uring {
+
+// An io_uring instance along with the thread that runs it (see
+// `run`). Only that thread touches the submission and completion
+// queues, every other thread hands it functions to run instead (see
+// `dispatch`), so we don't need any locking around the queues.
+//
+// We use the io_uring system calls directly (rather than liburing)
+// since we only need a small part of liburing and don't want to add
+// a dependency for it.
+class Ring
+{
+public:
+  // Creates a ring with (at least) the specified number of submission
+  // queue entries. Requires Linux 5.7 or later.
+  static Try<Ring*> create(unsigned entries);
+
+  ~Ring();
+
+  // Runs the ring until `stop` is called. Must only be called by one
+  // thread at a time.
+  void run();
+
+  // Asynchronously tells the ring to stop and then returns.
+  void stop();
+
+  // Runs the function in the thread that runs the ring, right away if
+  // this is that thread.
+  void dispatch(const lambda::function<void()>& f);
+
+  // Submits the operation that `prepare` fills in and returns its
+  // result, i.e., the `res` of its completion queue entry, which is a
+  // negated errno value on error. `prepare` (and anything it captures,
+  // e.g., the buffers that the operation points to) is kept until the
+  // operation completes. Discarding the returned future cancels the
+  // operation, it gets discarded once the kernel completes it.
+  Future<int> submit(const lambda::function<void(io_uring_sqe*)>& prepare);
+
+private:
+  struct Operation;
+
+  Ring() = default;
+
+  // Returns a submission queue entry to fill in, submitting the ones
+  // filled in so far if the queue is full.
+  io_uring_sqe* sqe();
+
+  // Submits the filled in submission queue entries, waiting for at
+  // least `wait` completions.
+  void enter(unsigned wait);
+
+  void submit(const std::shared_ptr<Operation>& operation);
+  void cancel(const std::shared_ptr<Operation>& operation);
+
+  // Handles all of the available completion queue entries.
+  void reap();
+
+  // Makes sure there is a read on `wakeup` so that `dispatch` can
+  // interrupt the ring.
+  void arm();
+
+  int fd = -1;
+
+  // Eventfd that `dispatch` writes to in order to interrupt the ring.
+  int wakeup = -1;
+
+  // The submission and completion queue rings share one mapping.
+  void* queues = MAP_FAILED;
+  size_t queues_size = 0;
+
+  struct
+  {
+    unsigned* head;
+    unsigned* tail;
+    unsigned* mask;
+    unsigned* array;
+    unsigned entries;
+
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size = 0;
+
+    // Index of the next entry to fill in. The entries from `*tail` up
+    // to here have been filled in but not submitted yet.
+    unsigned next;
+  } sq;
+
+  struct
+  {
+    unsigned* head;
+    unsigned* tail;
+    unsigned* mask;
+    io_uring_cqe* cqes;
+  } cq;
+
+  // Buffer for the read on `wakeup` and whether it's in flight.
+  uint64_t wakeups = 0;
+  bool armed = false;
+
+  // Only accessed by the thread that runs the ring.
+  bool stopping = false;
+
+  std::mutex mutex;
+  std::queue<lambda::function<void()>> functions;
+};
+
+
+// The rings, one per event loop (see `EventLoop::initialize`). The
+// first ring also runs all of the timers (see `EventLoop::delay`).
+extern std::vector<Ring*>* rings;
+
+
+// Returns the ring that owns the specified file descriptor, i.e., the
+// one to submit its operations to.
+Ring* ring_for(int_fd fd);
+
+
+// All of these functions do an asynchronous IO operation in the ring
+// that owns the file descriptor. The returned future can be discarded
+// to cancel the operation, see `Ring::submit`.
+Future<short> poll(int_fd fd, short events);
+
+Future<size_t> read(int_fd fd, void* data, size_t size);
+
+Future<size_t> write(int_fd fd, const void* data, size_t size);
+
+// Socket only functions.
+Future<size_t> recv(int_fd fd, void* data, size_t size);
+
+Future<size_t> send(int_fd fd, const void* data, size_t size);
+
+Future<size_t> send(
+    int_fd fd,
+    const std::vector<network::internal::SocketImpl::Buffer>& buffers);
+
+Future<int_fd> accept(int_fd fd);
+
+Future<Nothing> connect(int_fd fd, const network::Address& address);
+
+Future<size_t> sendfile(int_fd fd, int_fd file_fd, off_t offset, size_t size);
+
+// Invokes the function in the first ring after the duration.
+void delay(const Duration& duration, const lambda::function<void()>& function);
+
+} // namespace uring {
+} // namespace process {
+
+#endif // __LIBIOURING_HPP__
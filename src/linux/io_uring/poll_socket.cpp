@@ -0,0 +1,208 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#include <netinet/tcp.h>
+
+#include <vector>
+
+#include <process/future.hpp>
+#include <process/io.hpp>
+#include <process/network.hpp>
+#include <process/socket.hpp>
+
+#include <stout/os.hpp>
+
+#include <stout/os/strerror.hpp>
+
+#include "poll_socket.hpp"
+
+#include "linux/io_uring/libiouring.hpp"
+
+using std::string;
+
+namespace process {
+namespace network {
+namespace internal {
+
+// NOTE: Despite its name this implementation doesn't poll, every
+// operation is a single io_uring operation whose completion satisfies
+// the returned future.
+
+Try<std::shared_ptr<SocketImpl>> PollSocketImpl::create(int_fd s)
+{
+  return std::make_shared<PollSocketImpl>(s);
+}
+
+
+Try<Nothing> PollSocketImpl::listen(int backlog)
+{
+  if (::listen(get(), backlog) < 0) {
+    return ErrnoError();
+  }
+  return Nothing();
+}
+
+
+Future<std::shared_ptr<SocketImpl>> PollSocketImpl::accept()
+{
+  // Need to hold a copy of `this` so that the underlying socket
+  // doesn't end up getting reused before the accept completes and we
+  // end up accepting a socket incorrectly.
+  auto self = shared(this);
+
+  return uring::accept(get())
+    .then([self](int_fd s) -> Future<std::shared_ptr<SocketImpl>> {
+      Try<Address> address = network::address(s);
+      if (address.isError()) {
+        os::close(s);
+        return Failure("Failed to get address: " + address.error());
+      }
+
+      // Turn off Nagle (TCP_NODELAY) so pipelined requests don't wait.
+      if (address->family() == Address::Family::INET4 ||
+          address->family() == Address::Family::INET6) {
+        int on = 1;
+        if (::setsockopt(s, SOL_TCP, TCP_NODELAY, &on, sizeof(on)) < 0) {
+          const string error = os::strerror(errno);
+          os::close(s);
+          return Failure("Failed to turn off the Nagle algorithm: " + error);
+        }
+      }
+
+      Try<std::shared_ptr<SocketImpl>> impl = create(s);
+      if (impl.isError()) {
+        os::close(s);
+        return Failure("Failed to create socket: " + impl.error());
+      }
+
+      return impl.get();
+    });
+}
+
+
+Future<Nothing> PollSocketImpl::connect(
+    const Address& address)
+{
+  // Need to hold a copy of `this` so that the underlying socket
+  // doesn't end up getting reused before the connect completes.
+  auto self = shared(this);
+
+  return uring::connect(get(), address)
+    .then([self]() {
+      return Nothing();
+    });
+}
+
+#ifdef USE_SSL_SOCKET
+Future<Nothing> PollSocketImpl::connect(
+    const Address& address,
+    const openssl::TLSClientConfig& config)
+{
+  LOG(FATAL) << "TLS config was passed to a PollSocket.";
+}
+#endif
+
+Future<size_t> PollSocketImpl::recv(char* data, size_t size)
+{
+  // Need to hold a copy of `this` so that the underlying socket
+  // doesn't end up getting reused before the receive completes and
+  // we end up reading data incorrectly.
+  auto self = shared(this);
+
+  return uring::recv(get(), data, size)
+    .then([self](size_t length) {
+      return length;
+    });
+}
+
+
+Future<Nothing> PollSocketImpl::readable()
+{
+  auto self = shared(this);
+
+  return uring::poll(get(), io::READ)
+    .then([self]() {
+      return Nothing();
+    });
+}
+
+
+Try<Option<size_t>> PollSocketImpl::try_recv(char* data, size_t size)
+{
+  while (true) {
+    ssize_t length = net::recv(get(), data, size, MSG_DONTWAIT);
+
+    if (length >= 0) {
+      return static_cast<size_t>(length);
+    }
+
+    ErrnoError error;
+
+    if (net::is_restartable_error(error.code)) {
+      // Interrupted, try again now.
+      continue;
+    } else if (net::is_retryable_error(error.code)) {
+      return None();
+    }
+
+    return error;
+  }
+}
+
+
+Future<size_t> PollSocketImpl::send(const char* data, size_t size)
+{
+  CHECK(size > 0); // TODO(benh): Just return 0 if `size` is 0?
+
+  // Need to hold a copy of `this` so that the underlying socket
+  // doesn't end up getting reused before we return.
+  auto self = shared(this);
+
+  return uring::send(get(), data, size)
+    .then([self](size_t length) {
+      return length;
+    });
+}
+
+
+Future<size_t> PollSocketImpl::send(const std::vector<Buffer>& buffers)
+{
+  CHECK(!buffers.empty());
+
+  // Need to hold a copy of `this` so that the underlying socket
+  // doesn't end up getting reused before we return.
+  auto self = shared(this);
+
+  return uring::send(get(), buffers)
+    .then([self](size_t length) {
+      return length;
+    });
+}
+
+
+Future<size_t> PollSocketImpl::sendfile(int_fd fd, off_t offset, size_t size)
+{
+  CHECK(size > 0); // TODO(benh): Just return 0 if `size` is 0?
+
+  // Need to hold a copy of `this` so that the underlying socket
+  // doesn't end up getting reused before we return.
+  auto self = shared(this);
+
+  return uring::sendfile(get(), fd, offset, size)
+    .then([self](size_t length) {
+      return length;
+    });
+}
+
+} // namespace internal {
+} // namespace network {
+} // namespace process {
@@ -0,0 +1,256 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __PROCESS_MEMORY_POOL_HPP__
+#define __PROCESS_MEMORY_POOL_HPP__
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <stout/synchronized.hpp>
+
+namespace process {
+
+// A pool of memory for small objects that get allocated and
+// deallocated at a very high rate, e.g., events.
+//
+// Every thread caches the blocks it deallocates in a free-list per
+// size class so that most allocations and deallocations are just a
+// few pointer operations without any synchronization. Objects are
+// often allocated on one thread and deallocated on another (e.g., an
+// event gets allocated by the sender and deallocated by the worker
+// that ran the receiver) so to keep the free-lists of the threads
+// that mostly deallocate from growing without bound, and to let the
+// threads that mostly allocate reuse those blocks, full free-lists
+// get moved in batches to a global "depot" that threads with empty
+// free-lists take batches from.
+//
+// NOTE: every block is individually allocated with `::operator new`
+// so a block can always be released with `::operator delete`, which
+// is what we do once a thread's cache has been destroyed.
+class MemoryPool
+{
+public:
+  // Objects larger than this are not pooled.
+  static constexpr size_t MAX_SIZE = 512;
+
+  static void* allocate(size_t size)
+  {
+    if (size > MAX_SIZE) {
+      return ::operator new(size);
+    }
+
+    const size_t index = klass(size);
+
+    Cache* cache = local();
+
+    if (cache != nullptr) {
+      FreeList& list = cache->lists[index];
+
+      if (list.head == nullptr) {
+        depot()->take(index, &list);
+      }
+
+      if (list.head != nullptr) {
+        Block* block = list.head;
+        list.head = block->next;
+        list.count--;
+        return block;
+      }
+    }
+
+    return ::operator new(blocksize(index));
+  }
+
+  static void deallocate(void* pointer, size_t size)
+  {
+    if (pointer == nullptr) {
+      return;
+    }
+
+    if (size > MAX_SIZE) {
+      ::operator delete(pointer);
+      return;
+    }
+
+    Cache* cache = local();
+
+    if (cache == nullptr) {
+      ::operator delete(pointer);
+      return;
+    }
+
+    FreeList& list = cache->lists[klass(size)];
+
+    Block* block = static_cast<Block*>(pointer);
+    block->next = list.head;
+    list.head = block;
+    list.count++;
+
+    if (list.count >= LOCAL_LIMIT) {
+      depot()->put(klass(size), &list, BATCH_SIZE);
+    }
+  }
+
+private:
+  // Size classes are multiples of the alignment guaranteed by
+  // `::operator new` so that every block is suitably aligned.
+  static constexpr size_t GRANULARITY = alignof(std::max_align_t);
+  static constexpr size_t CLASSES = MAX_SIZE / GRANULARITY;
+
+  // Maximum number of blocks a thread caches per size class, and the
+  // number of blocks moved to or from the depot at once.
+  static constexpr size_t LOCAL_LIMIT = 512;
+  static constexpr size_t BATCH_SIZE = 128;
+
+  // Maximum number of batches the depot keeps per size class, any
+  // more blocks get released.
+  static constexpr size_t DEPOT_LIMIT = 64;
+
+  static_assert(MAX_SIZE % GRANULARITY == 0, "Invalid MAX_SIZE");
+  static_assert(BATCH_SIZE < LOCAL_LIMIT, "Invalid BATCH_SIZE");
+
+  struct Block
+  {
+    Block* next;
+  };
+
+  struct FreeList
+  {
+    Block* head = nullptr;
+    size_t count = 0;
+  };
+
+  static size_t klass(size_t size)
+  {
+    return size == 0 ? 0 : (size - 1) / GRANULARITY;
+  }
+
+  static size_t blocksize(size_t index)
+  {
+    return (index + 1) * GRANULARITY;
+  }
+
+  static void release(Block* block)
+  {
+    while (block != nullptr) {
+      Block* next = block->next;
+      ::operator delete(block);
+      block = next;
+    }
+  }
+
+  class Depot
+  {
+  public:
+    // Moves a batch, if there is one, onto the (empty) `list`.
+    void take(size_t index, FreeList* list)
+    {
+      synchronized (mutexes[index]) {
+        std::vector<FreeList>& batches = classes[index];
+        if (!batches.empty()) {
+          *list = batches.back();
+          batches.pop_back();
+        }
+      }
+    }
+
+    // Moves `count` blocks off of the front of `list`, keeping them
+    // as a batch or releasing them if the depot is full.
+    void put(size_t index, FreeList* list, size_t count)
+    {
+      FreeList batch;
+      batch.head = list->head;
+      batch.count = count;
+
+      Block* last = list->head;
+      for (size_t i = 1; i < count; i++) {
+        last = last->next;
+      }
+
+      list->head = last->next;
+      list->count -= count;
+      last->next = nullptr;
+
+      synchronized (mutexes[index]) {
+        std::vector<FreeList>& batches = classes[index];
+        if (batches.size() < DEPOT_LIMIT) {
+          batches.push_back(batch);
+          return;
+        }
+      }
+
+      release(batch.head);
+    }
+
+  private:
+    std::array<std::mutex, CLASSES> mutexes;
+    std::array<std::vector<FreeList>, CLASSES> classes;
+  };
+
+  struct Cache
+  {
+    ~Cache()
+    {
+      // Hand off what we've cached so other threads can use it. Any
+      // deallocations on this thread from now on (e.g., from other
+      // thread local destructors) go straight to `::operator delete`.
+      for (size_t index = 0; index < CLASSES; index++) {
+        FreeList& list = lists[index];
+        while (list.count > 0) {
+          depot()->put(
+              index,
+              &list,
+              std::min(list.count, static_cast<size_t>(BATCH_SIZE)));
+        }
+      }
+
+      destroyed() = true;
+    }
+
+    std::array<FreeList, CLASSES> lists;
+  };
+
+  // NOTE: the depot gets intentionally leaked so that it outlives any
+  // thread that might still use it during process exit.
+  static Depot* depot()
+  {
+    static Depot* depot = new Depot();
+    return depot;
+  }
+
+  static bool& destroyed()
+  {
+    static thread_local bool destroyed = false;
+    return destroyed;
+  }
+
+  // Returns this thread's cache or `nullptr` if it has already been
+  // destroyed because this thread is exiting.
+  static Cache* local()
+  {
+    if (destroyed()) {
+      return nullptr;
+    }
+
+    static thread_local Cache cache;
+    return &cache;
+  }
+};
+
+} // namespace process {
+
+#endif // __PROCESS_MEMORY_POOL_HPP__
@@ -17,7 +17,9 @@
 #include <vector>
 
 #include <process/after.hpp>
+#include <process/clock.hpp>
 #include <process/collect.hpp>
+#include <process/defer.hpp>
 #include <process/dispatch.hpp>
 #include <process/help.hpp>
 #include <process/owned.hpp>
@@ -92,12 +94,33 @@ MetricsProcess* MetricsProcess::create(
 }
 
 
+// How often the metrics get sampled, see `Metric::sample`.
+static Duration SAMPLE_INTERVAL() { return Seconds(1); }
+
+
 void MetricsProcess::initialize()
 {
   route("/snapshot",
         authenticationRealm,
         help(),
         &MetricsProcess::_snapshot);
+
+  sample();
+}
+
+
+void MetricsProcess::sample()
+{
+  foreachvalue (const Owned<Metric>& metric, windowed) {
+    metric->sample();
+  }
+
+  // The sampling need not be exact, let it share a wakeup with other
+  // timers.
+  Clock::timer(
+      SAMPLE_INTERVAL(),
+      SAMPLE_INTERVAL() / 10,
+      defer(self(), &MetricsProcess::sample));
 }
 
 
@@ -126,6 +149,10 @@ Future<Nothing> MetricsProcess::add(Owned<Metric> metric)
     return Failure("Metric '" + metric->name() + "' was already added");
   }
 
+  if (metric->windowed()) {
+    windowed.emplace(metric->name(), metric);
+  }
+
   return Nothing();
 }
 
@@ -134,6 +161,8 @@ Future<Nothing> MetricsProcess::remove(const string& name)
 {
   size_t erased = metrics.erase(name);
 
+  windowed.erase(name);
+
   if (erased == 0) {
     return Failure("Metric '" + name + "' not found");
   }
@@ -156,14 +185,21 @@ Future<map<string, double>> MetricsProcess::snapshot(
   futures.reserve(metrics.size());
   statistics.reserve(metrics.size());
 
+  foreachvalue (const Owned<Metric>& metric, windowed) {
+    metric->sample();
+  }
+
   for (auto iter = metrics.begin(); iter != metrics.end(); ++iter) {
     keys.emplace_back(iter->first);
     futures.emplace_back(iter->second->value());
     statistics.emplace_back(iter->second->statistics());
   }
 
-  Future<Nothing> timedout =
-    after(timeout.getOrElse(Duration::max()));
+  // The timeout need not be exact, let it be up to a tenth late so
+  // that the timers of concurrent snapshots can elapse together.
+  Future<Nothing> timedout = timeout.isSome()
+    ? after(timeout.get(), timeout.get() / 10)
+    : after(Duration::max());
 
   // Return the response once it finishes or we time out.
   //
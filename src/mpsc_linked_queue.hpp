@@ -75,7 +75,14 @@ public:
 
     // Exchange is guaranteed to only give the old value to one
     // producer, so this is safe and wait-free.
-    auto oldhead = head.exchange(newNode, std::memory_order_acq_rel);
+    //
+    // NOTE: this needs to be sequentially consistent, rather than
+    // just acquire/release, because the `EventQueue` relies on a
+    // producer that enqueues and then reads the state of a process
+    // and a consumer that writes the state of a process and then
+    // checks `empty()` not both missing each other's write (see
+    // `ProcessManager::resume`).
+    auto oldhead = head.exchange(newNode, std::memory_order_seq_cst);
 
     // At this point if this thread context switches out we may block
     // the consumer from doing a dequeue (see below). Eventually we'll
@@ -161,10 +168,12 @@ public:
   }
 
   // Single consumer only.
+  //
+  // NOTE: `head` is loaded sequentially consistent, see `enqueue()`.
   bool empty()
   {
     return tail->next.load(std::memory_order_relaxed) == nullptr &&
-      head.load(std::memory_order_relaxed) == tail;
+      head.load(std::memory_order_seq_cst) == tail;
   }
 
 private:
@@ -80,6 +80,59 @@ static constexpr Duration SLOW_DNS_WARN_THRESHOLD = Milliseconds(100);
 static SSL_CTX* ctx = nullptr;
 
 
+// Index of the extra data of an SSL object that holds the application
+// protocols to pick from with ALPN, see `set_application_protocols`.
+// The protocols get deleted along with the SSL object.
+static int application_protocols_index()
+{
+  static int index = SSL_get_ex_new_index(
+      0,
+      nullptr,
+      nullptr,
+      nullptr,
+      [](void*, void* protocols, CRYPTO_EX_DATA*, int, long, void*) {
+        delete static_cast<string*>(protocols);
+      });
+
+  return index;
+}
+
+
+// Picks the first of the server's application protocols (if any were
+// set) that the client offers, otherwise ALPN is left out.
+static int select_application_protocol(
+    SSL* ssl,
+    const unsigned char** out,
+    unsigned char* outlen,
+    const unsigned char* in,
+    unsigned int inlen,
+    void*)
+{
+  const string* protocols = static_cast<const string*>(
+      SSL_get_ex_data(ssl, application_protocols_index()));
+
+  if (protocols == nullptr) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+
+  unsigned char* selected = nullptr;
+
+  if (SSL_select_next_proto(
+          &selected,
+          outlen,
+          reinterpret_cast<const unsigned char*>(protocols->data()),
+          static_cast<unsigned int>(protocols->size()),
+          in,
+          inlen) != OPENSSL_NPN_NEGOTIATED) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+
+  *out = selected;
+
+  return SSL_TLSEXT_ERR_OK;
+}
+
+
 Flags::Flags()
 {
   add(&Flags::enabled,
@@ -501,6 +554,10 @@ void reinitialize()
   // Disable SSL session caching.
   SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
 
+  // Server sockets negotiate the application protocols that got set on
+  // them (if any) with ALPN.
+  SSL_CTX_set_alpn_select_cb(ctx, &select_application_protocol, nullptr);
+
   // Set a session id to avoid connection termination upon
   // re-connect. We can use something more relevant when we care
   // about session caching.
@@ -993,6 +1050,16 @@ Try<Nothing> verify(
 }
 
 
+void set_application_protocols(SSL* ssl, const string& protocols)
+{
+  const int index = application_protocols_index();
+
+  delete static_cast<string*>(SSL_get_ex_data(ssl, index));
+
+  CHECK_EQ(1, SSL_set_ex_data(ssl, index, new string(protocols)));
+}
+
+
 // A callback to configure the `SSL` object before the connection is
 // established.
 Try<Nothing> configure_socket(
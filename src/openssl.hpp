@@ -85,6 +85,11 @@ Try<Nothing> verify(
     const Option<std::string>& hostname = None(),
     const Option<net::IP>& ip = None());
 
+// Sets the application protocols that the server end of the SSL
+// connection picks from with ALPN, in order of preference and in the
+// wire format of ALPN, i.e., each prefixed with its length.
+void set_application_protocols(SSL* ssl, const std::string& protocols);
+
 // Callback for setting SSL options after the TCP connection was
 // established but before the TLS handshake has started.
 Try<Nothing> configure_socket(
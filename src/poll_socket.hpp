@@ -11,6 +11,9 @@
 // limitations under the License
 
 #include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
 
 #include <process/socket.hpp>
 
@@ -29,7 +32,11 @@ public:
 
   PollSocketImpl(int_fd s) : SocketImpl(s) {}
 
+#if defined(__WINDOWS__) || defined(ENABLE_IO_URING)
   ~PollSocketImpl() override {}
+#else
+  ~PollSocketImpl() override;
+#endif // __WINDOWS__ || ENABLE_IO_URING
 
   // Implementation of the SocketImpl interface.
   Try<Nothing> listen(int backlog) override;
@@ -43,8 +50,23 @@ public:
 #endif
   Future<size_t> recv(char* data, size_t size) override;
   Future<size_t> send(const char* data, size_t size) override;
+#ifndef __WINDOWS__
+  Future<size_t> send(const std::vector<Buffer>& buffers) override;
+#endif // __WINDOWS__
   Future<size_t> sendfile(int_fd fd, off_t offset, size_t size) override;
+#ifndef __WINDOWS__
+  Future<Nothing> readable() override;
+  Try<Option<size_t>> try_recv(char* data, size_t size) override;
+#endif // __WINDOWS__
   Kind kind() const override { return SocketImpl::Kind::POLL; }
+
+#if !defined(__WINDOWS__) && !defined(ENABLE_IO_URING)
+private:
+  // Connections accepted along with an earlier one that `accept` has
+  // not returned yet.
+  std::queue<int_fd> accepted;
+  std::mutex mutex;
+#endif // !__WINDOWS__ && !ENABLE_IO_URING
 };
 
 } // namespace internal {
@@ -13,10 +13,16 @@
 #include <ev.h>
 #include <signal.h>
 
+#include <functional>
 #include <mutex>
 #include <queue>
+#include <vector>
+
+#include <process/logging.hpp>
+#include <process/once.hpp>
 
 #include <stout/duration.hpp>
+#include <stout/foreach.hpp>
 #include <stout/lambda.hpp>
 #include <stout/nothing.hpp>
 
@@ -25,47 +31,40 @@
 
 namespace process {
 
-ev_async async_watcher;
-// We need an asynchronous watcher to receive the request to shutdown.
-ev_async shutdown_watcher;
-
 // Define the initial values for all of the declarations made in
 // libev.hpp (since these need to live in the static data space).
-struct ev_loop* loop = nullptr;
+std::vector<EvLoop*>* event_loops = new std::vector<EvLoop*>();
 
-std::queue<ev_io*>* watchers = new std::queue<ev_io*>();
+struct ev_loop* loop = nullptr;
 
-std::mutex* watchers_mutex = new std::mutex();
+thread_local bool* _in_event_loop_ = nullptr;
+thread_local EvLoop* _event_loop_ = nullptr;
 
-std::queue<lambda::function<void()>>* functions =
-  new std::queue<lambda::function<void()>>();
 
-thread_local bool* _in_event_loop_ = nullptr;
+EvLoop* loop_for(int_fd fd)
+{
+  return (*event_loops)[std::hash<int_fd>()(fd) % event_loops->size()];
+}
 
 
-void handle_async(struct ev_loop* loop, ev_async* _, int revents)
+void handle_async(struct ev_loop* loop, ev_async* watcher, int revents)
 {
-  std::queue<lambda::function<void()>> run_functions;
-  synchronized (watchers_mutex) {
-    // Start all the new I/O watchers.
-    while (!watchers->empty()) {
-      ev_io* watcher = watchers->front();
-      watchers->pop();
-      ev_io_start(loop, watcher);
-    }
+  EvLoop* event_loop = reinterpret_cast<EvLoop*>(watcher->data);
 
-    // Swap the functions into a temporary queue so that we can invoke
-    // them outside of the mutex.
-    std::swap(run_functions, *functions);
+  // Swap the functions into a temporary queue so that we can invoke
+  // them outside of the mutex.
+  std::queue<lambda::function<void()>> run_functions;
+  synchronized (event_loop->mutex) {
+    std::swap(run_functions, event_loop->functions);
   }
 
   // Running the functions outside of the mutex reduces locking
   // contention as these are arbitrary functions that can take a long
   // time to execute. Doing this also avoids a deadlock scenario where
   // (A) mutexes are acquired before calling `run_in_event_loop`,
-  // followed by locking (B) `watchers_mutex`. If we executed the
-  // functions inside the mutex, then the locking order violation
-  // would be this function acquiring the (B) `watchers_mutex`
+  // followed by locking (B) the event loop's mutex. If we executed
+  // the functions inside the mutex, then the locking order violation
+  // would be this function acquiring the (B) event loop's mutex
   // followed by the arbitrary function acquiring the (A) mutexes.
   while (!run_functions.empty()) {
     (run_functions.front())();
@@ -80,25 +79,59 @@ void handle_shutdown(struct ev_loop* loop, ev_async* _, int revents)
 }
 
 
-void EventLoop::initialize()
+void EventLoop::initialize(size_t loops)
 {
-  // libev, when built with child process watcher support (the
-  // EV_CHILD_ENABLE feature flag), will install a SIGCHLD handler
-  // and wait on all processes. We need to save and restore the
-  // current signal handler in order to disable this behavior.
-  struct sigaction chldHandler;
+  static Once* initialized = new Once();
+
+  if (initialized->once()) {
+    return;
+  }
+
+  CHECK_GT(loops, 0u);
+
+  for (size_t i = 0; i < loops; i++) {
+    EvLoop* event_loop = new EvLoop();
 
-  PCHECK(::sigaction(SIGCHLD, nullptr, &chldHandler) == 0);
+    if (i == 0) {
+      // libev, when built with child process watcher support (the
+      // EV_CHILD_ENABLE feature flag), will install a SIGCHLD handler
+      // and wait on all processes. We need to save and restore the
+      // current signal handler in order to disable this behavior.
+      struct sigaction chldHandler;
 
-  loop = ev_default_loop(EVFLAG_AUTO);
+      PCHECK(::sigaction(SIGCHLD, nullptr, &chldHandler) == 0);
 
-  PCHECK(::sigaction(SIGCHLD, &chldHandler, nullptr) == 0);
+      event_loop->loop = ev_default_loop(EVFLAG_AUTO);
 
-  ev_async_init(&async_watcher, handle_async);
-  ev_async_init(&shutdown_watcher, handle_shutdown);
+      PCHECK(::sigaction(SIGCHLD, &chldHandler, nullptr) == 0);
+    } else {
+      // Only the default loop handles signals so there is no need to
+      // save and restore the SIGCHLD handler here.
+      event_loop->loop = ev_loop_new(EVFLAG_AUTO);
+    }
+
+    CHECK_NOTNULL(event_loop->loop);
+
+    ev_async_init(&event_loop->async_watcher, handle_async);
+    ev_async_init(&event_loop->shutdown_watcher, handle_shutdown);
+
+    event_loop->async_watcher.data = event_loop;
+
+    ev_async_start(event_loop->loop, &event_loop->async_watcher);
+    ev_async_start(event_loop->loop, &event_loop->shutdown_watcher);
+
+    event_loops->push_back(event_loop);
+  }
+
+  loop = event_loops->front()->loop;
 
-  ev_async_start(loop, &async_watcher);
-  ev_async_start(loop, &shutdown_watcher);
+  initialized->done();
+}
+
+
+size_t EventLoop::loops()
+{
+  return event_loops->size();
 }
 
 
@@ -148,6 +181,7 @@ void EventLoop::delay(
     const lambda::function<void()>& function)
 {
   run_in_event_loop<Nothing>(
+      event_loops->front(),
       lambda::bind(&internal::delay, duration, function));
 }
 
@@ -159,19 +193,27 @@ double EventLoop::time()
 }
 
 
-void EventLoop::run()
+void EventLoop::run(size_t index)
 {
+  CHECK_LT(index, event_loops->size());
+
+  EvLoop* event_loop = (*event_loops)[index];
+
   __in_event_loop__ = true;
+  _event_loop_ = event_loop;
 
-  ev_loop(loop, 0);
+  ev_loop(event_loop->loop, 0);
 
+  _event_loop_ = nullptr;
   __in_event_loop__ = false;
 }
 
 
 void EventLoop::stop()
 {
-  ev_async_send(loop, &shutdown_watcher);
+  foreach (EvLoop* event_loop, *event_loops) {
+    ev_async_send(event_loop->loop, &event_loop->shutdown_watcher);
+  }
 }
 
 } // namespace process {
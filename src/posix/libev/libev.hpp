@@ -17,6 +17,7 @@
 
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include <process/future.hpp>
 #include <process/owned.hpp>
@@ -24,25 +25,39 @@
 #include <stout/lambda.hpp>
 #include <stout/synchronized.hpp>
 
+#include <stout/os/int_fd.hpp>
+
 namespace process {
 
-// Event loop.
+// An event loop along with the asynchronous watchers for interrupting
+// it to deal with functions (via run_in_event_loop) and to shut it
+// down, each run by its own thread (see `EventLoop::run`).
+struct EvLoop
+{
+  struct ev_loop* loop = nullptr;
+
+  ev_async async_watcher;
+  ev_async shutdown_watcher;
+
+  // Queue of functions to be invoked asynchronously within the event
+  // loop (protected by 'mutex' below).
+  std::queue<lambda::function<void()>> functions;
+  std::mutex mutex;
+};
+
+
+// Event loops, the first one being the default loop which also runs
+// all of the timers (see `EventLoop::delay`).
+extern std::vector<EvLoop*>* event_loops;
+
+// The default loop.
 extern struct ev_loop* loop;
 
-// Asynchronous watcher for interrupting loop to specifically deal
-// with IO watchers and functions (via run_in_event_loop).
-extern ev_async async_watcher;
 
-// Queue of I/O watchers to be asynchronously added to the event loop
-// (protected by 'watchers' below).
-// TODO(benh): Replace this queue with functions that we put in
-// 'functions' below that perform the ev_io_start themselves.
-extern std::queue<ev_io*>* watchers;
-extern std::mutex* watchers_mutex;
+// Returns the event loop that owns the specified file descriptor,
+// i.e., the one to start its watchers in.
+EvLoop* loop_for(int_fd fd);
 
-// Queue of functions to be invoked asynchronously within the vent
-// loop (protected by 'watchers' above).
-extern std::queue<lambda::function<void()>>* functions;
 
 // Per thread bool pointer. We use a pointer to lazily construct the
 // actual bool.
@@ -52,6 +67,10 @@ extern thread_local bool* _in_event_loop_;
   _in_event_loop_ = new bool(false) : _in_event_loop_)
 
 
+// The event loop run by this thread, if any.
+extern thread_local EvLoop* _event_loop_;
+
+
 // Wrapper around function we want to run in the event loop.
 template <typename T>
 void _run_in_event_loop(
@@ -67,12 +86,14 @@ void _run_in_event_loop(
 }
 
 
-// Helper for running a function in the event loop.
+// Helper for running a function in the specified event loop.
 template <typename T>
-Future<T> run_in_event_loop(const lambda::function<Future<T>()>& f)
+Future<T> run_in_event_loop(
+    EvLoop* event_loop,
+    const lambda::function<Future<T>()>& f)
 {
   // If this is already the event loop then just run the function.
-  if (__in_event_loop__) {
+  if (_event_loop_ == event_loop) {
     return f();
   }
 
@@ -81,12 +102,13 @@ Future<T> run_in_event_loop(const lambda::function<Future<T>()>& f)
   Future<T> future = promise->future();
 
   // Enqueue the function.
-  synchronized (watchers_mutex) {
-    functions->push(lambda::bind(&_run_in_event_loop<T>, f, promise));
+  synchronized (event_loop->mutex) {
+    event_loop->functions.push(
+        lambda::bind(&_run_in_event_loop<T>, f, promise));
   }
 
   // Interrupt the loop.
-  ev_async_send(loop, &async_watcher);
+  ev_async_send(event_loop->loop, &event_loop->async_watcher);
 
   return future;
 }
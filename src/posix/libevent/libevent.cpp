@@ -14,7 +14,11 @@
 #include <unistd.h>
 #endif // __WINDOWS__
 
+#include <algorithm>
+#include <functional>
 #include <mutex>
+#include <queue>
+#include <vector>
 
 #include <event2/event.h>
 #include <event2/thread.h>
@@ -23,6 +27,7 @@
 #include <process/logging.hpp>
 #include <process/once.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/synchronized.hpp>
 
 #include "event_loop.hpp"
@@ -30,26 +35,46 @@
 
 namespace process {
 
+std::vector<event_base*>* bases = new std::vector<event_base*>();
 event_base* base = nullptr;
 
 
-static std::mutex* functions_mutex = new std::mutex();
-std::queue<lambda::function<void()>>* functions =
-  new std::queue<lambda::function<void()>>();
+thread_local bool* _in_event_loop_ = nullptr;
+thread_local event_base* _event_loop_base_ = nullptr;
 
 
-thread_local bool* _in_event_loop_ = nullptr;
+namespace {
+
+// Functions to be run in an event loop, see `run_in_event_loop`.
+struct Functions
+{
+  // Event that gets activated to interrupt the event loop.
+  event* async = nullptr;
+
+  std::mutex mutex;
+  std::queue<lambda::function<void()>> queue;
+};
+
+// Indexed like `bases`.
+std::vector<Functions*>* functions = new std::vector<Functions*>();
+
+} // namespace {
+
+
+event_base* base_for(int_fd fd)
+{
+  return (*bases)[std::hash<int_fd>()(fd) % bases->size()];
+}
 
 
 void async_function(evutil_socket_t socket, short which, void* arg)
 {
-  event* ev = reinterpret_cast<event*>(arg);
-  event_free(ev);
+  Functions* functions_ = reinterpret_cast<Functions*>(arg);
 
   std::queue<lambda::function<void()>> q;
 
-  synchronized (functions_mutex) {
-    std::swap(q, *functions);
+  synchronized (functions_->mutex) {
+    std::swap(q, functions_->queue);
   }
 
   while (!q.empty()) {
@@ -60,42 +85,44 @@ void async_function(evutil_socket_t socket, short which, void* arg)
 
 
 void run_in_event_loop(
+    event_base* ev_base,
     const lambda::function<void()>& f,
     EventLoopLogicFlow event_loop_logic_flow)
 {
-  if (__in_event_loop__ && event_loop_logic_flow == ALLOW_SHORT_CIRCUIT) {
+  if (_event_loop_base_ == ev_base &&
+      event_loop_logic_flow == ALLOW_SHORT_CIRCUIT) {
     f();
     return;
   }
 
-  synchronized (functions_mutex) {
-    functions->push(f);
-
-    // Add an event and activate it to interrupt the event loop.
-    // TODO(jmlvanre): after libevent v 2.1 we can use
-    // event_self_cbarg instead of re-assigning the event. For now we
-    // manually re-assign the event to pass in the pointer to the
-    // event itself as the callback argument.
-    event* ev = evtimer_new(base, async_function, nullptr);
-
-    // 'event_assign' is only valid on non-pending AND non-active
-    // events. This means we have to assign the callback before
-    // calling 'event_active'.
-    if (evtimer_assign(ev, base, async_function, ev) < 0) {
-      LOG(FATAL) << "Failed to assign callback on event";
-    }
+  auto it = std::find(bases->begin(), bases->end(), ev_base);
+  CHECK(it != bases->end());
+
+  Functions* functions_ = (*functions)[it - bases->begin()];
 
-    event_active(ev, EV_TIMEOUT, 0);
+  synchronized (functions_->mutex) {
+    functions_->queue.push(f);
   }
+
+  // Activate the event to interrupt the event loop. Activating an
+  // event that is already active is a no-op, so we only run
+  // `async_function` once for all of the functions queued before it
+  // swaps the queue.
+  event_active(functions_->async, EV_TIMEOUT, 0);
 }
 
 
-void EventLoop::run()
+void EventLoop::run(size_t index)
 {
+  CHECK_LT(index, bases->size());
+
+  event_base* ev_base = (*bases)[index];
+
   __in_event_loop__ = true;
+  _event_loop_base_ = ev_base;
 
   do {
-    int result = event_base_loop(base, EVLOOP_ONCE);
+    int result = event_base_loop(ev_base, EVLOOP_ONCE);
     if (result < 0) {
       LOG(FATAL) << "Failed to run event loop";
     } else if (result > 0) {
@@ -103,21 +130,30 @@ void EventLoop::run()
       continue;
     } else {
       CHECK_EQ(0, result);
-      if (event_base_got_break(base)) {
+      if (event_base_got_break(ev_base)) {
         break;
-      } else if (event_base_got_exit(base)) {
+      } else if (event_base_got_exit(ev_base)) {
         break;
       }
     }
   } while (true);
 
+  _event_loop_base_ = nullptr;
   __in_event_loop__ = false;
 }
 
 
 void EventLoop::stop()
 {
-  event_base_loopexit(base, nullptr);
+  foreach (event_base* ev_base, *bases) {
+    event_base_loopexit(ev_base, nullptr);
+  }
+}
+
+
+size_t EventLoop::loops()
+{
+  return bases->size();
 }
 
 
@@ -177,7 +213,7 @@ double EventLoop::time()
 }
 
 
-void EventLoop::initialize()
+void EventLoop::initialize(size_t loops)
 {
   static Once* initialized = new Once();
 
@@ -199,12 +235,39 @@ void EventLoop::initialize()
 #error "Libevent must be compiled with either pthread or Windows thread support"
 #endif
 
-  base = event_base_new();
+  CHECK_GT(loops, 0u);
 
-  if (base == nullptr) {
-    LOG(FATAL) << "Failed to initialize, event_base_new";
+  for (size_t i = 0; i < loops; i++) {
+    event_base* ev_base = event_base_new();
+
+    if (ev_base == nullptr) {
+      LOG(FATAL) << "Failed to initialize, event_base_new";
+    }
+
+    Functions* functions_ = new Functions();
+    functions_->async =
+      event_new(ev_base, -1, EV_PERSIST, &async_function, functions_);
+
+    if (functions_->async == nullptr) {
+      LOG(FATAL) << "Failed to initialize, event_new";
+    }
+
+    // We keep the event pending (with a long timeout, after which
+    // `async_function` just finds an empty queue) because
+    // `event_base_loop` returns right away if there are no pending
+    // events, which would make `EventLoop::run` spin on an event
+    // loop that has no sockets (yet).
+    timeval keepalive = Hours(1).timeval();
+    if (event_add(functions_->async, &keepalive) < 0) {
+      LOG(FATAL) << "Failed to initialize, event_add";
+    }
+
+    bases->push_back(ev_base);
+    functions->push_back(functions_);
   }
 
+  base = bases->front();
+
   initialized->done();
 }
 
@@ -15,14 +15,28 @@
 
 #include <event2/event.h>
 
+#include <vector>
+
 #include <stout/lambda.hpp>
 
+#include <stout/os/int_fd.hpp>
+
 namespace process {
 
-// Event loop.
+// Event loops, each run by its own thread (see `EventLoop::run`).
+extern std::vector<event_base*>* bases;
+
+// The first event loop, which also runs all of the timers (see
+// `EventLoop::delay`).
 extern event_base* base;
 
 
+// Returns the event loop that owns the specified socket (or file
+// descriptor), i.e., the one to create its events and bufferevents
+// in and to run any continuations for them in.
+event_base* base_for(int_fd fd);
+
+
 // Per thread bool pointer. We use a pointer to lazily construct the
 // actual bool.
 extern thread_local bool* _in_event_loop_;
@@ -32,6 +46,10 @@ extern thread_local bool* _in_event_loop_;
   _in_event_loop_ = new bool(false) : _in_event_loop_)
 
 
+// The event loop run by this thread, if any.
+extern thread_local event_base* _event_loop_base_;
+
+
 enum EventLoopLogicFlow
 {
   ALLOW_SHORT_CIRCUIT,
@@ -39,7 +57,10 @@ enum EventLoopLogicFlow
 };
 
 
+// Runs the function in the specified event loop. The function gets
+// run right away if allowed and this thread runs that event loop.
 void run_in_event_loop(
+    event_base* ev_base,
     const lambda::function<void()>& f,
     EventLoopLogicFlow event_loop_logic_flow = ALLOW_SHORT_CIRCUIT);
 
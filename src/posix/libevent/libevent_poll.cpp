@@ -53,11 +53,14 @@ void pollCallback(evutil_socket_t, short what, void* arg)
 }
 
 
-void pollDiscard(const std::weak_ptr<event>& ev, short events)
+void pollDiscard(
+    event_base* ev_base,
+    const std::weak_ptr<event>& ev,
+    short events)
 {
   // Discarding inside the event loop prevents `pollCallback()` from being
   // called twice if the future is discarded.
-  run_in_event_loop([=]() {
+  run_in_event_loop(ev_base, [=]() {
     std::shared_ptr<event> shared = ev.lock();
     // If `ev` cannot be locked `pollCallback` already ran. If it was locked
     // but not pending, `pollCallback` is scheduled to be executed.
@@ -85,10 +88,13 @@ Future<short> poll(int_fd fd, short events)
   short what =
     ((events & io::READ) ? EV_READ : 0) | ((events & io::WRITE) ? EV_WRITE : 0);
 
+  // Poll in the event loop that owns the file descriptor.
+  event_base* ev_base = base_for(fd);
+
   // Bind `event_free` to the destructor of the `ev` shared pointer
   // guaranteeing that the event will be freed only once.
   poll->ev.reset(
-      event_new(base, fd, what, &internal::pollCallback, poll),
+      event_new(ev_base, fd, what, &internal::pollCallback, poll),
       event_free);
 
   if (poll->ev == nullptr) {
@@ -105,7 +111,7 @@ Future<short> poll(int_fd fd, short events)
   event_add(poll->ev.get(), nullptr);
 
   return future
-    .onDiscard(lambda::bind(&internal::pollDiscard, ev, what));
+    .onDiscard(lambda::bind(&internal::pollDiscard, ev_base, ev, what));
 }
 
 } // namespace io {
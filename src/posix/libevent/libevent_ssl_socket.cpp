@@ -25,6 +25,7 @@
 
 #include <process/ssl/flags.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/net.hpp>
 #include <stout/stopwatch.hpp>
 #include <stout/synchronized.hpp>
@@ -61,6 +62,11 @@
 // modifying the bufferevent (bev) from another thread (not the event
 // loop). To avoid this we run all bufferevent manipulation logic in
 // continuations that are executed within the event loop.
+//
+// With multiple event loops the bufferevent (and listener) of a
+// socket get created in the event loop that owns the socket (see
+// 'base_for') and all of the continuations for the socket get run in
+// that same event loop so that they remain ordered.
 
 // DISALLOW_SHORT_CIRCUIT:
 //
@@ -119,6 +125,7 @@ LibeventSSLSocketImpl::~LibeventSSLSocketImpl()
   std::weak_ptr<LibeventSSLSocketImpl>* _event_loop_handle = event_loop_handle;
 
   run_in_event_loop(
+      base_for(fd),
       [_listener, _bev, _event_loop_handle, fd]() {
         // Once this lambda is called, it should not be possible for
         // more event loop callbacks to be triggered with 'this->bev'.
@@ -186,6 +193,7 @@ Try<Nothing, SocketError> LibeventSSLSocketImpl::shutdown(int how)
   auto self = shared(this);
 
   run_in_event_loop(
+      base_for(s),
       [self]() {
         CHECK(__in_event_loop__);
         CHECK(self);
@@ -542,6 +550,15 @@ Future<Nothing> LibeventSSLSocketImpl::connect(
 
   client_config = config;
 
+  if (!application_protocols.empty() &&
+      SSL_set_alpn_protos(
+          ssl,
+          reinterpret_cast<const unsigned char*>(application_protocols.data()),
+          static_cast<unsigned int>(application_protocols.size())) != 0) {
+    SSL_free(ssl);
+    return Failure("Failed to connect: SSL_set_alpn_protos");
+  }
+
   if (config.configure_socket) {
     Try<Nothing> configured = config.configure_socket(
         ssl, address, config.servername);
@@ -556,7 +573,7 @@ Future<Nothing> LibeventSSLSocketImpl::connect(
   // 'event_callback' before 'bufferevent_socket_connect' returns.
   CHECK(bev == nullptr);
   bev = bufferevent_openssl_socket_new(
-      base,
+      base_for(s),
       s,
       ssl,
       BUFFEREVENT_SSL_CONNECTING,
@@ -607,6 +624,7 @@ Future<Nothing> LibeventSSLSocketImpl::connect(
   auto self = shared(this);
 
   run_in_event_loop(
+      base_for(s),
       [self, address]() {
         sockaddr_storage addr = address;
 
@@ -678,6 +696,7 @@ Future<size_t> LibeventSSLSocketImpl::recv(char* data, size_t size)
 
       if (self != nullptr) {
         run_in_event_loop(
+            base_for(self->get()),
             [self]() {
               CHECK(__in_event_loop__);
               CHECK(self);
@@ -716,6 +735,7 @@ Future<size_t> LibeventSSLSocketImpl::recv(char* data, size_t size)
   auto self = shared(this);
 
   run_in_event_loop(
+      base_for(s),
       [self]() {
         CHECK(__in_event_loop__);
         CHECK(self);
@@ -786,6 +806,7 @@ Future<size_t> LibeventSSLSocketImpl::send(const char* data, size_t size)
   auto self = shared(this);
 
   run_in_event_loop(
+      base_for(s),
       [self, buffer]() {
         CHECK(__in_event_loop__);
         CHECK(self);
@@ -880,6 +901,7 @@ Future<size_t> LibeventSSLSocketImpl::sendfile(
   auto self = shared(this);
 
   run_in_event_loop(
+      base_for(s),
       [self, owned_fd, offset, size]() {
         CHECK(__in_event_loop__);
         CHECK(self);
@@ -920,6 +942,40 @@ Future<size_t> LibeventSSLSocketImpl::sendfile(
 }
 
 
+void LibeventSSLSocketImpl::setApplicationProtocols(
+    const std::vector<string>& protocols)
+{
+  application_protocols.clear();
+
+  foreach (const string& protocol, protocols) {
+    CHECK(!protocol.empty() && protocol.size() < 256)
+      << "Invalid application protocol '" << protocol << "'";
+
+    application_protocols.push_back(static_cast<char>(protocol.size()));
+    application_protocols.append(protocol);
+  }
+}
+
+
+Option<string> LibeventSSLSocketImpl::applicationProtocol() const
+{
+  if (bev == nullptr) {
+    return None();
+  }
+
+  const unsigned char* data = nullptr;
+  unsigned int length = 0;
+
+  SSL_get0_alpn_selected(bufferevent_openssl_get_ssl(bev), &data, &length);
+
+  if (length == 0) {
+    return None();
+  }
+
+  return string(reinterpret_cast<const char*>(data), length);
+}
+
+
 Try<Nothing> LibeventSSLSocketImpl::listen(int backlog)
 {
   if (listener != nullptr) {
@@ -932,7 +988,7 @@ Try<Nothing> LibeventSSLSocketImpl::listen(int backlog)
   // can be set to block via the `LEV_OPT_LEAVE_SOCKETS_BLOCKING`
   // flag for `evconnlistener_new`.
   listener = evconnlistener_new(
-      base,
+      base_for(s),
       [](evconnlistener* listener,
          evutil_socket_t socket,
          sockaddr* addr,
@@ -972,9 +1028,6 @@ Try<Nothing> LibeventSSLSocketImpl::listen(int backlog)
             VLOG(2) << "Could not convert sockaddr to net::IP: " << ip.error();
           }
 
-          // We pass the 'listener' into the 'AcceptRequest' because
-          // this function could be executed before 'this->listener'
-          // is set.
           AcceptRequest* request =
             new AcceptRequest(
                   // NOTE: The `int_fd` must be explicitly constructed
@@ -982,8 +1035,8 @@ Try<Nothing> LibeventSSLSocketImpl::listen(int backlog)
                   // resulting in a `HANDLE` instead of a `SOCKET` on
                   // Windows.
                   int_fd(socket),
-                  listener,
-                  ip.isSome() ? Option<net::IP>(ip.get()) : None());
+                  ip.isSome() ? Option<net::IP>(ip.get()) : None(),
+                  impl->application_protocols);
 
           impl->accept_callback(request);
         }
@@ -1114,14 +1167,22 @@ void LibeventSSLSocketImpl::accept_callback(AcceptRequest* request)
   // whether we want to dispatch as SSL or non-SSL.
   if (openssl::flags().support_downgrade) {
     request->peek_event = event_new(
-        base,
+        base_for(request->socket),
         request->socket,
         EV_READ,
         &LibeventSSLSocketImpl::peek_callback,
         request);
     event_add(request->peek_event, nullptr);
   } else {
-    accept_SSL_callback(request);
+    // Continue in the event loop that owns the accepted socket, which
+    // need not be the one of the listener that we're running in, so
+    // that its bufferevent gets created and configured there (just
+    // like the peek event above gets its callback run there).
+    run_in_event_loop(
+        base_for(request->socket),
+        [request]() {
+          accept_SSL_callback(request);
+        });
   }
 }
 
@@ -1138,6 +1199,10 @@ void LibeventSSLSocketImpl::accept_SSL_callback(AcceptRequest* request)
     return;
   }
 
+  if (!request->application_protocols.empty()) {
+    openssl::set_application_protocols(ssl, request->application_protocols);
+  }
+
   Try<Address> peer_address = network::peer(request->socket);
   if (!peer_address.isSome()) {
     request->promise.fail("Could not determine peer IP for connection.");
@@ -1157,15 +1222,12 @@ void LibeventSSLSocketImpl::accept_SSL_callback(AcceptRequest* request)
     return;
   }
 
-  // We use 'request->listener' because 'this->listener' may not have
-  // been set by the time this function is executed. See comment in
-  // the lambda for evconnlistener_new in
-  // 'LibeventSSLSocketImpl::listen'.
-  event_base* ev_base = evconnlistener_get_base(request->listener);
-
-  // Construct the bufferevent in the accepting state.
+  // Construct the bufferevent in the accepting state, in the event
+  // loop that owns the accepted socket (rather than the one of the
+  // listener) since that's where the continuations of the accepted
+  // socket get run.
   bufferevent* bev = bufferevent_openssl_socket_new(
-      ev_base,
+      base_for(request->socket),
       request->socket,
       ssl,
       BUFFEREVENT_SSL_ACCEPTING,
@@ -21,6 +21,8 @@
 
 #include <atomic>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <process/queue.hpp>
 #include <process/socket.hpp>
@@ -53,6 +55,11 @@ public:
   Future<std::shared_ptr<SocketImpl>> accept() override;
   SocketImpl::Kind kind() const override { return SocketImpl::Kind::SSL; }
 
+  void setApplicationProtocols(
+      const std::vector<std::string>& protocols) override;
+
+  Option<std::string> applicationProtocol() const override;
+
   // Shuts down the socket.
   //
   // NOTE: Although this method accepts an integer which specifies the
@@ -76,17 +83,17 @@ private:
   {
     AcceptRequest(
         int_fd _socket,
-        evconnlistener* _listener,
-        const Option<net::IP>& _ip)
+        const Option<net::IP>& _ip,
+        const std::string& _application_protocols)
       : peek_event(nullptr),
-        listener(_listener),
         socket(_socket),
-        ip(_ip) {}
+        ip(_ip),
+        application_protocols(_application_protocols) {}
     event* peek_event;
     Promise<std::shared_ptr<SocketImpl>> promise;
-    evconnlistener* listener;
     int_fd socket;
     Option<net::IP> ip;
+    std::string application_protocols;
   };
 
   struct RecvRequest
@@ -192,6 +199,10 @@ private:
 
   Option<net::IP> peer_ip;
   Option<openssl::TLSClientConfig> client_config;
+
+  // The protocols to negotiate with ALPN in its wire format, i.e.,
+  // each prefixed with its length.
+  std::string application_protocols;
 };
 
 } // namespace internal {
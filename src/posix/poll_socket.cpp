@@ -14,9 +14,15 @@
 #ifdef __WINDOWS__
 #include <stout/windows.hpp>
 #else
+#include <limits.h>
+
 #include <netinet/tcp.h>
+#include <sys/uio.h>
 #endif // __WINDOWS__
 
+#include <algorithm>
+#include <vector>
+
 #include <process/io.hpp>
 #include <process/loop.hpp>
 #include <process/network.hpp>
@@ -25,6 +31,7 @@
 #include <stout/os/sendfile.hpp>
 #include <stout/os/strerror.hpp>
 #include <stout/os.hpp>
+#include <stout/synchronized.hpp>
 
 #include "config.hpp"
 #include "poll_socket.hpp"
@@ -50,8 +57,116 @@ Try<Nothing> PollSocketImpl::listen(int backlog)
 }
 
 
+// Maximum number of connections we accept per readiness event of a
+// listening socket, see `PollSocketImpl::accept`.
+static const size_t MAX_ACCEPTS_PER_POLL = 64;
+
+
+// Accepts a connection and makes the accepted socket non-blocking and
+// close-on-exec, atomically if possible.
+static Try<int_fd> accept_nonblock_cloexec(int_fd s)
+{
+#ifdef __linux__
+  int_fd accepted =
+    ::accept4(s, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  if (accepted < 0) {
+    return ErrnoError("Failed to accept");
+  }
+
+  return accepted;
+#else
+  Try<int_fd> accepted = network::accept(s);
+  if (accepted.isError()) {
+    return accepted;
+  }
+
+  Try<Nothing> nonblock = os::nonblock(accepted.get());
+  if (nonblock.isError()) {
+    os::close(accepted.get());
+    return Error("Failed to accept, nonblock: " + nonblock.error());
+  }
+
+  Try<Nothing> cloexec = os::cloexec(accepted.get());
+  if (cloexec.isError()) {
+    os::close(accepted.get());
+    return Error("Failed to accept, cloexec: " + cloexec.error());
+  }
+
+  return accepted;
+#endif // __linux__
+}
+
+
+// Sets up an accepted socket, closing it on error.
+static Try<std::shared_ptr<SocketImpl>> setup(int_fd s)
+{
+  Try<Address> address = network::address(s);
+  if (address.isError()) {
+    os::close(s);
+    return Error("Failed to get address: " + address.error());
+  }
+
+  // Turn off Nagle (TCP_NODELAY) so pipelined requests don't wait.
+  // NOTE: We cast to `char*` here because the function prototypes
+  // on Windows use `char*` instead of `void*`.
+  if (address->family() == Address::Family::INET4 ||
+      address->family() == Address::Family::INET6) {
+    int on = 1;
+    if (::setsockopt(
+            s,
+            SOL_TCP,
+            TCP_NODELAY,
+            reinterpret_cast<const char*>(&on),
+            sizeof(on)) < 0) {
+      const string error = os::strerror(errno);
+      os::close(s);
+      return Error(
+          "Failed to turn off the Nagle algorithm: " + stringify(error));
+    }
+  }
+
+  Try<std::shared_ptr<SocketImpl>> impl = PollSocketImpl::create(s);
+  if (impl.isError()) {
+    os::close(s);
+    return Error("Failed to create socket: " + impl.error());
+  }
+
+  return impl;
+}
+
+
+PollSocketImpl::~PollSocketImpl()
+{
+  synchronized (mutex) {
+    while (!accepted.empty()) {
+      os::close(accepted.front());
+      accepted.pop();
+    }
+  }
+}
+
+
 Future<std::shared_ptr<SocketImpl>> PollSocketImpl::accept()
 {
+  // Return a connection that we already accepted, if any.
+  Option<int_fd> s = None();
+
+  synchronized (mutex) {
+    if (!accepted.empty()) {
+      s = accepted.front();
+      accepted.pop();
+    }
+  }
+
+  if (s.isSome()) {
+    Try<std::shared_ptr<SocketImpl>> impl = setup(s.get());
+    if (impl.isError()) {
+      return Failure(impl.error());
+    }
+    return impl.get();
+  }
+
   // Need to hold a copy of `this` so that the underlying socket
   // doesn't end up getting reused before we return from the call to
   // `io::poll` and end up accepting a socket incorrectly.
@@ -59,53 +174,30 @@ Future<std::shared_ptr<SocketImpl>> PollSocketImpl::accept()
 
   return io::poll(get(), io::READ)
     .then([self]() -> Future<std::shared_ptr<SocketImpl>> {
-      Try<int_fd> accepted = network::accept(self->get());
-      if (accepted.isError()) {
-        return Failure(accepted.error());
-      }
-
-      int_fd s = accepted.get();
-      Try<Nothing> nonblock = os::nonblock(s);
-      if (nonblock.isError()) {
-        os::close(s);
-        return Failure("Failed to accept, nonblock: " + nonblock.error());
-      }
-
-      Try<Nothing> cloexec = os::cloexec(s);
-      if (cloexec.isError()) {
-        os::close(s);
-        return Failure("Failed to accept, cloexec: " + cloexec.error());
+      Try<int_fd> first = accept_nonblock_cloexec(self->get());
+      if (first.isError()) {
+        return Failure(first.error());
       }
 
-      Try<Address> address = network::address(s);
-      if (address.isError()) {
-        os::close(s);
-        return Failure("Failed to get address: " + address.error());
-      }
+      // When lots of clients connect at once (e.g., agents
+      // reconnecting after a master failover) we'd otherwise go
+      // through the event loop for every connection, so we accept
+      // all pending connections (up to a limit) right away and hand
+      // them out on subsequent calls.
+      for (size_t i = 1; i < MAX_ACCEPTS_PER_POLL; i++) {
+        Try<int_fd> next = accept_nonblock_cloexec(self->get());
+        if (next.isError()) {
+          break; // Most likely there are no more pending connections.
+        }
 
-      // Turn off Nagle (TCP_NODELAY) so pipelined requests don't wait.
-      // NOTE: We cast to `char*` here because the function prototypes
-      // on Windows use `char*` instead of `void*`.
-      if (address->family() == Address::Family::INET4 ||
-          address->family() == Address::Family::INET6) {
-        int on = 1;
-        if (::setsockopt(
-                s,
-                SOL_TCP,
-                TCP_NODELAY,
-                reinterpret_cast<const char*>(&on),
-                sizeof(on)) < 0) {
-          const string error = os::strerror(errno);
-          os::close(s);
-          return Failure(
-              "Failed to turn off the Nagle algorithm: " + stringify(error));
+        synchronized (self->mutex) {
+          self->accepted.push(next.get());
         }
       }
 
-      Try<std::shared_ptr<SocketImpl>> impl = create(s);
+      Try<std::shared_ptr<SocketImpl>> impl = setup(first.get());
       if (impl.isError()) {
-        os::close(s);
-        return Failure("Failed to create socket: " + impl.error());
+        return Failure(impl.error());
       }
 
       return impl.get();
@@ -182,6 +274,42 @@ Future<size_t> PollSocketImpl::recv(char* data, size_t size)
 }
 
 
+#ifndef __WINDOWS__
+Future<Nothing> PollSocketImpl::readable()
+{
+  auto self = shared(this);
+
+  return io::poll(get(), io::READ)
+    .then([self]() {
+      return Nothing();
+    });
+}
+
+
+Try<Option<size_t>> PollSocketImpl::try_recv(char* data, size_t size)
+{
+  while (true) {
+    ssize_t length = net::recv(get(), data, size, MSG_DONTWAIT);
+
+    if (length >= 0) {
+      return static_cast<size_t>(length);
+    }
+
+    ErrnoError error;
+
+    if (net::is_restartable_error(error.code)) {
+      // Interrupted, try again now.
+      continue;
+    } else if (net::is_retryable_error(error.code)) {
+      return None();
+    }
+
+    return error;
+  }
+}
+#endif // __WINDOWS__
+
+
 Future<size_t> PollSocketImpl::send(const char* data, size_t size)
 {
   CHECK(size > 0); // TODO(benh): Just return 0 if `size` is 0?
@@ -235,6 +363,69 @@ Future<size_t> PollSocketImpl::send(const char* data, size_t size)
 }
 
 
+#ifndef __WINDOWS__
+Future<size_t> PollSocketImpl::send(const std::vector<Buffer>& buffers)
+{
+  CHECK(!buffers.empty());
+
+  // Need to hold a copy of `this` so that the underlying socket
+  // doesn't end up getting reused before we return.
+  auto self = shared(this);
+
+  // We can't send more than `IOV_MAX` buffers at once, the caller
+  // will have to send the rest.
+  std::shared_ptr<std::vector<struct iovec>> iov(
+      new std::vector<struct iovec>(
+          std::min(buffers.size(), static_cast<size_t>(IOV_MAX))));
+
+  for (size_t i = 0; i < iov->size(); i++) {
+    CHECK(buffers[i].size > 0);
+    (*iov)[i].iov_base = const_cast<char*>(buffers[i].data);
+    (*iov)[i].iov_len = buffers[i].size;
+  }
+
+  return loop(
+      None(),
+      [self, iov]() -> Future<Option<size_t>> {
+        struct msghdr message = {};
+        message.msg_iov = iov->data();
+        message.msg_iovlen = iov->size();
+
+        while (true) {
+          ssize_t length = ::sendmsg(self->get(), &message, MSG_NOSIGNAL);
+
+          if (length < 0) {
+            int error = errno;
+
+            if (net::is_restartable_error(error)) {
+              // Interrupted, try again now.
+              continue;
+            } else if (!net::is_retryable_error(error)) {
+              VLOG(1) << "Socket error while sending: " << os::strerror(error);
+              return Failure(os::strerror(error));
+            }
+
+            return None();
+          }
+
+          return length;
+        }
+      },
+      [self](const Option<size_t>& length) -> Future<ControlFlow<size_t>> {
+        // Retry after we've polled if we don't yet have a result.
+        if (length.isNone()) {
+          return io::poll(self->get(), io::WRITE)
+            .then([](short event) -> ControlFlow<size_t> {
+              CHECK_EQ(io::WRITE, event);
+              return Continue();
+            });
+        }
+        return Break(length.get());
+      });
+}
+#endif // __WINDOWS__
+
+
 Future<size_t> PollSocketImpl::sendfile(int_fd fd, off_t offset, size_t size)
 {
   CHECK(size > 0); // TODO(benh): Just return 0 if `size` is 0?
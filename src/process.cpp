@@ -86,7 +86,11 @@
 #include <process/time.hpp>
 #include <process/timer.hpp>
 
+#include <process/metrics/counter.hpp>
+#include <process/metrics/histogram.hpp>
 #include <process/metrics/metrics.hpp>
+#include <process/metrics/pull_gauge.hpp>
+#include <process/metrics/push_gauge.hpp>
 
 #include <process/ssl/flags.hpp>
 
@@ -94,6 +98,7 @@
 #include <process/windows/jobobject.hpp>
 #endif // __WINDOWS__
 
+#include <stout/bytes.hpp>
 #include <stout/duration.hpp>
 #include <stout/error.hpp>
 #include <stout/flags.hpp>
@@ -105,20 +110,25 @@
 #include <stout/os.hpp>
 #include <stout/os/strerror.hpp>
 #include <stout/path.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/stringify.hpp>
 #include <stout/strings.hpp>
 #include <stout/synchronized.hpp>
 
 #include "authenticator_manager.hpp"
+#include "buffer_pool.hpp"
 #include "config.hpp"
 #include "decoder.hpp"
 #include "encoder.hpp"
 #include "event_loop.hpp"
 #include "event_queue.hpp"
 #include "gate.hpp"
+#include "http_connection_pool.hpp"
 #include "http_proxy.hpp"
+#include "memory_pool.hpp"
 #include "memory_profiler.hpp"
 #include "process_reference.hpp"
+#include "process_table.hpp"
 #include "socket_manager.hpp"
 #include "run_queue.hpp"
 
@@ -169,6 +179,10 @@ using std::vector;
 
 namespace process {
 
+// Maximum number of events that a worker thread dequeues from a
+// process's event queue at once (see `--event_batch_size`).
+static constexpr int MAX_EVENT_BATCH_SIZE = 128;
+
 namespace internal {
 
 // These are environment variables expected in `process::initialize`.
@@ -240,6 +254,52 @@ struct Flags : public virtual flags::FlagsBase
           return None();
         });
 
+    add(&Flags::listeners,
+        "listeners",
+        "The number of sockets that listen for connections to libprocess.\n"
+        "If greater than 1 the sockets share the address using\n"
+        "SO_REUSEPORT and the kernel spreads incoming connections across\n"
+        "them, each having its own accept queue, which helps when lots\n"
+        "of peers connect at once (e.g., after a failover).",
+        1,
+        [](size_t value) -> Option<Error> {
+          if (value == 0) {
+            return Error("LIBPROCESS_LISTENERS must be positive");
+          }
+
+#ifndef SO_REUSEPORT
+          if (value > 1) {
+            return Error(
+                "LIBPROCESS_LISTENERS must be 1 on platforms without"
+                " SO_REUSEPORT");
+          }
+#endif // SO_REUSEPORT
+
+          return None();
+        });
+
+    add(&Flags::event_loops,
+        "event_loops",
+        "The number of event loops, each run by its own thread, that\n"
+        "handle socket I/O. Sockets get assigned to event loops by\n"
+        "hashing their file descriptor while timers all run in the\n"
+        "first event loop. Using more than 1 helps when a single event\n"
+        "loop thread saturates (e.g., with lots of connections).",
+        1,
+        [](size_t value) -> Option<Error> {
+          if (value == 0) {
+            return Error("LIBPROCESS_EVENT_LOOPS must be positive");
+          }
+
+#ifdef __WINDOWS__
+          if (value > 1) {
+            return Error("LIBPROCESS_EVENT_LOOPS must be 1 on Windows");
+          }
+#endif // __WINDOWS__
+
+          return None();
+        });
+
     add(&Flags::require_peer_address_ip_match,
         "require_peer_address_ip_match",
         "If set, the IP address portion of the libprocess UPID in\n"
@@ -254,6 +314,81 @@ struct Flags : public virtual flags::FlagsBase
         "which libprocess connects to other actors.\n",
         false);
 
+    add(&Flags::binary_framing,
+        "binary_framing",
+        "If set, libprocess advertises to its peers that it accepts\n"
+        "messages using a compact binary framing rather than HTTP, and\n"
+        "uses that framing for new connections to peers that have\n"
+        "advertised the same. Peers that don't set this flag (or that\n"
+        "run an older version of libprocess) keep using HTTP.",
+        false);
+
+    add(&Flags::send_batch_size,
+        "send_batch_size",
+        "The maximum amount of queued outgoing data that libprocess\n"
+        "sends on a socket with a single (vectored) write, i.e., how\n"
+        "many queued messages or responses get coalesced. Set to a\n"
+        "size of at most one message to write each one on its own.",
+        Kilobytes(64),
+        [](const Bytes& value) -> Option<Error> {
+          if (value == Bytes(0)) {
+            return Error("LIBPROCESS_SEND_BATCH_SIZE must be positive");
+          }
+
+          return None();
+        });
+
+    add(&Flags::http_pool_max_per_host,
+        "http_pool_max_per_host",
+        "The maximum number of persistent connections per host (i.e.,\n"
+        "scheme, host, and port) that the HTTP client keeps open to\n"
+        "reuse for requests made with `http::get`, `http::post`, and\n"
+        "`http::requestDelete`. Requests that find all of them busy use\n"
+        "a one-off connection that gets closed after the response.\n"
+        "Defaults to 0, i.e., no pooling: every request uses a one-off\n"
+        "connection.",
+        0);
+
+    add(&Flags::http_pool_max_idle,
+        "http_pool_max_idle",
+        "The maximum number of idle persistent connections, across all\n"
+        "hosts, that the HTTP client keeps open. The least recently\n"
+        "used ones get closed first.",
+        64);
+
+    add(&Flags::http_pool_idle_timeout,
+        "http_pool_idle_timeout",
+        "How long the HTTP client keeps an idle persistent connection\n"
+        "open before closing it.",
+        Seconds(15));
+
+    add(&Flags::http_pool_pipelining_depth,
+        "http_pool_pipelining_depth",
+        "The maximum number of requests that the HTTP client pipelines\n"
+        "on a persistent connection, i.e., sends before receiving the\n"
+        "responses to the previous ones. Defaults to 1, i.e., no\n"
+        "pipelining, since a slow response delays all the responses\n"
+        "pipelined after it.",
+        1,
+        [](size_t value) -> Option<Error> {
+          if (value == 0) {
+            return Error(
+                "LIBPROCESS_HTTP_POOL_PIPELINING_DEPTH must be positive");
+          }
+
+          return None();
+        });
+
+    add(&Flags::http_prepare_responses,
+        "http_prepare_responses",
+        "If set, the responses to pipelined requests that are ready\n"
+        "while an earlier response is still pending get encoded (and\n"
+        "compressed) right away rather than once it's their turn, and\n"
+        "then get sent along with the earlier response with a single\n"
+        "write. See the 'libprocess/http_proxy/*' metrics for how much\n"
+        "responses get blocked by earlier ones.",
+        false);
+
     // TODO(bevers): Set the default to `true` after gathering some
     // real-world experience with this.
     add(&Flags::memory_profiling,
@@ -261,6 +396,115 @@ struct Flags : public virtual flags::FlagsBase
         "If set to false, disables the memory profiling functionality\n"
         "of libprocess.",
         false);
+
+    add(&Flags::run_queue,
+        "run_queue",
+        "The run queue implementation used to schedule processes onto\n"
+        "worker threads. Possible values:\n"
+        "  'global':        a single run queue shared by all workers.\n"
+        "  'work_stealing': a run queue per worker; idle workers steal\n"
+        "                   processes from the other workers' queues.",
+        "global",
+        [](const string& value) -> Option<Error> {
+          if (value != "global" && value != "work_stealing") {
+            return Error(
+                "LIBPROCESS_RUN_QUEUE=" + value + " is not a valid run queue,"
+                " expecting 'global' or 'work_stealing'");
+          }
+
+          return None();
+        });
+
+    add(&Flags::process_affinity,
+        "process_affinity",
+        "If set, a process that becomes runnable is enqueued onto the\n"
+        "run queue of the worker thread that last ran it so that it is\n"
+        "likely to find its state still in that CPU's caches. Idle\n"
+        "workers may still steal it. Only has an effect when\n"
+        "`--run_queue=work_stealing`.",
+        false);
+
+    add(&Flags::resume_event_quantum,
+        "resume_event_quantum",
+        "The maximum number of events a worker thread serves for a\n"
+        "process before putting the process back at the end of the run\n"
+        "queue so that other processes get a chance to run. If not set,\n"
+        "a process is run until it has no more events.",
+        [](const Option<int>& value) -> Option<Error> {
+          if (value.isSome() && value.get() <= 0) {
+            return Error(
+                "LIBPROCESS_RESUME_EVENT_QUANTUM=" + stringify(value.get()) +
+                " must be positive");
+          }
+
+          return None();
+        });
+
+    add(&Flags::resume_time_quantum,
+        "resume_time_quantum",
+        "The maximum amount of time a worker thread spends serving\n"
+        "events for a process before putting the process back at the\n"
+        "end of the run queue so that other processes get a chance to\n"
+        "run. This is checked between events so a single long running\n"
+        "event may exceed it. If not set, a process is run until it has\n"
+        "no more events.");
+
+    add(&Flags::event_batch_size,
+        "event_batch_size",
+        "The maximum number of events a worker thread dequeues from a\n"
+        "process's event queue at once. Note that events which have been\n"
+        "dequeued but not yet served are no longer counted by\n"
+        "`ProcessBase::eventCount`.",
+        1,
+        [](const int& value) -> Option<Error> {
+          if (value <= 0 || value > MAX_EVENT_BATCH_SIZE) {
+            return Error(
+                "LIBPROCESS_EVENT_BATCH_SIZE=" + stringify(value) +
+                " is not valid, expecting a value in the range 1 to " +
+                stringify(MAX_EVENT_BATCH_SIZE));
+          }
+
+          return None();
+        });
+
+    add(&Flags::worker_idle_strategy,
+        "worker_idle_strategy",
+        "What an idle worker thread does while it waits for a process to\n"
+        "become runnable. Possible values:\n"
+        "  'park':     sleep in the kernel right away.\n"
+        "  'adaptive': spin, and then yield, for up to\n"
+        "              `--worker_spin_budget` before sleeping. This\n"
+        "              lowers the latency of waking up a worker, and\n"
+        "              avoids making a syscall to wake it up, at the\n"
+        "              expense of CPU. At most half of the workers spin\n"
+        "              at once and the time spent spinning shrinks when\n"
+        "              spinning does not pay off.",
+        "park",
+        [](const string& value) -> Option<Error> {
+          if (value != "park" && value != "adaptive") {
+            return Error(
+                "LIBPROCESS_WORKER_IDLE_STRATEGY=" + value + " is not a"
+                " valid idle strategy, expecting 'park' or 'adaptive'");
+          }
+
+          return None();
+        });
+
+    add(&Flags::worker_spin_budget,
+        "worker_spin_budget",
+        "The maximum amount of time an idle worker thread spins before\n"
+        "sleeping when `--worker_idle_strategy=adaptive`.",
+        Microseconds(50),
+        [](const Duration& value) -> Option<Error> {
+          if (value <= Duration::zero() || value > Milliseconds(100)) {
+            return Error(
+                "LIBPROCESS_WORKER_SPIN_BUDGET=" + stringify(value) +
+                " is not valid, expecting a positive duration of at most"
+                " 100ms");
+          }
+
+          return None();
+        });
   }
 
   Option<net::IP> ip;
@@ -268,8 +512,24 @@ struct Flags : public virtual flags::FlagsBase
   Option<net::IP> advertise_ip;
   Option<int> port;
   Option<int> advertise_port;
+  size_t listeners;
+  size_t event_loops;
   bool require_peer_address_ip_match;
+  bool binary_framing;
+  Bytes send_batch_size;
+  size_t http_pool_max_per_host;
+  size_t http_pool_max_idle;
+  Duration http_pool_idle_timeout;
+  size_t http_pool_pipelining_depth;
+  bool http_prepare_responses;
   bool memory_profiling;
+  string run_queue;
+  bool process_affinity;
+  Option<int> resume_event_quantum;
+  Option<Duration> resume_time_quantum;
+  int event_batch_size;
+  string worker_idle_strategy;
+  Duration worker_spin_budget;
 };
 
 } // namespace internal {
@@ -300,6 +560,22 @@ map<string, string> types;
 } // namespace mime {
 
 
+// State shared between a process that has been pinned (see
+// `ProcessBase::pin`) and the thread dedicated to running it. This is
+// kept alive by both so the thread can safely outlive the process.
+class PinnedThread
+{
+public:
+  // Signaled once for every time the process is made runnable.
+  // Decomissioned when the process terminates so the thread exits.
+  DecomissionableKernelSemaphore semaphore;
+
+  // The dedicated thread, which gets detached once the process
+  // terminates (see `ProcessManager::cleanup`).
+  std::thread thread;
+};
+
+
 // Helper for creating routes without a process.
 // TODO(benh): Move this into route.hpp.
 class Route
@@ -373,6 +649,11 @@ public:
       const Socket& socket,
       Request* request);
 
+  // Handles a message received using the binary framing.
+  void handle(
+      const Socket& socket,
+      Message* message);
+
   // Returns whether the event was delivered to the destination's
   // queue. This function takes ownership over `event` and will
   // delete it if it was not delivered.
@@ -429,14 +710,20 @@ public:
     return static_cast<long>(threads.size() - 1);
   }
 
+  // Adds the metrics of the worker threads. Must be called after the
+  // global metrics process has been spawned.
+  void installMetrics();
+
 private:
   bool _deliver(ProcessBase* destination, Event* event, ProcessBase* sender);
 
   // Delegate process name to receive root HTTP requests.
   const Option<string> delegate;
 
-  // Map of all local spawned and running processes.
-  hashmap<string, ProcessBase*> processes;
+  // Table of all local spawned and running processes. Lookups are
+  // lock-free, modifications are done while holding `processes_mutex`
+  // (see process_table.hpp).
+  ProcessTable processes;
   std::recursive_mutex processes_mutex;
 
   // Queue of runnable processes.
@@ -445,9 +732,85 @@ private:
   // implementation.
   RunQueue runq;
 
+  // Per-worker queues of runnable processes, used _instead_ of `runq`
+  // when `stealing` is true (i.e., `LIBPROCESS_RUN_QUEUE` is set to
+  // 'work_stealing'). Only set in `init_threads` before any worker
+  // threads are created so it need not be atomic.
+  WorkStealingRunQueue stealq;
+  bool stealing = false;
+
+  // Whether or not to enqueue processes onto the run queue of the
+  // worker that last ran them. Only set in `init_threads`.
+  bool affinity = false;
+
+  // Limits on how many events, or for how long, a process gets served
+  // in `resume` before it is put back on the run queue, and how many
+  // events get dequeued at once. Only set in `init_threads`.
+  Option<size_t> event_quantum;
+  Option<Duration> time_quantum;
+  size_t event_batch_size = 1;
+
+  // Number of threads dedicated to pinned processes (see
+  // `ProcessBase::pin`) that have not exited yet. A thread gets
+  // detached once its process terminates so `finalize` waits for
+  // this to drop to zero rather than joining them.
+  std::atomic_long pinned_threads;
+
+  // Number of pinned processes that have been made runnable but whose
+  // dedicated thread has not yet woken up to run them, to support
+  // Clock::settle operation (this is akin to checking `runq.empty()`).
+  std::atomic_long pinned_runnable;
+
   // Number of running processes, to support Clock::settle operation.
   std::atomic_long running;
 
+  // Metrics about how idle worker threads got woken up, see
+  // `DecomissionableAdaptiveSemaphore::Wakeup`.
+  struct WorkerMetrics
+  {
+    WorkerMetrics()
+      : wakeups_spinning("libprocess/workers/wakeups_spinning"),
+        wakeups_parked("libprocess/workers/wakeups_parked"),
+        wake_latency("libprocess/workers/wake_latency_us") {}
+
+    // Number of times an idle worker found a runnable process while
+    // spinning, i.e., without sleeping.
+    metrics::Counter wakeups_spinning;
+
+    // Number of times an idle worker had to sleep and be woken up.
+    metrics::Counter wakeups_parked;
+
+    // Time it took to wake up a sleeping worker, exposed as percentiles.
+    // We use a histogram (rather than a windowed metric) since every
+    // parked wakeup records a value.
+    metrics::Histogram wake_latency;
+  } worker_metrics;
+
+  // Metrics about the pool of receive buffers, see `BufferPool`.
+  struct BufferMetrics
+  {
+    BufferMetrics()
+      : allocated(
+            "libprocess/receive_buffers/allocated",
+            []() -> Future<double> {
+              return static_cast<double>(BufferPool::allocated());
+            }),
+        borrowed(
+            "libprocess/receive_buffers/borrowed",
+            []() -> Future<double> {
+              return static_cast<double>(BufferPool::borrowed());
+            }) {}
+
+    // Number of buffers the pool has allocated, i.e., the ones that
+    // are borrowed plus the ones that are cached for reuse. Every
+    // buffer is `BufferPool::SIZE` bytes.
+    metrics::PullGauge allocated;
+
+    // Number of buffers that are borrowed, i.e., that sockets are
+    // currently receiving into.
+    metrics::PullGauge borrowed;
+  } buffer_metrics;
+
   // Stores the thread handles so that we can join during shutdown.
   vector<std::thread*> threads;
 
@@ -481,17 +844,19 @@ static std::atomic_bool initialize_complete(false);
 // Server socket listen backlog.
 static const int LISTEN_BACKLOG = 500000;
 
-// Local server socket.
-static Socket* __s__ = nullptr;
+// Local server sockets, more than one if LIBPROCESS_LISTENERS is
+// set, in which case they all listen on the same address.
+static std::vector<Socket>* __s__ = nullptr;
 
 // This mutex is only used to prevent a race between the `on_accept`
-// callback loop and closing/deleting `__s__` in `process::finalize`.
+// callback loops and closing/deleting `__s__` in `process::finalize`.
 static std::mutex* socket_mutex = new std::mutex();
 
-// The future returned by the last call to `__s__->accept()`.
-// This is used in `process::finalize` to explicitly terminate the
-// `__s__` socket's callback loop.
-static Future<Socket> future_accept;
+// The futures returned by the last call to `accept()` on each of the
+// `__s__` sockets. These are used in `process::finalize` to
+// explicitly terminate the sockets' callback loops.
+static std::vector<Future<Socket>>* future_accepts =
+  new std::vector<Future<Socket>>();
 
 // Local socket address.
 static inet::Address __address__ = inet4::Address::ANY_ANY();
@@ -537,6 +902,10 @@ PID<Logging> _logging;
 // Per-thread process pointer.
 thread_local ProcessBase* __process__ = nullptr;
 
+// Per-thread index of the worker thread, or -1 if this thread is not
+// a worker thread (e.g., the event loop thread).
+static thread_local long __worker__ = -1;
+
 // Per-thread executor pointer.
 thread_local Executor* _executor_ = nullptr;
 
@@ -548,6 +917,15 @@ PID<metrics::internal::MetricsProcess> metrics;
 } // namespace internal {
 } // namespace metrics {
 
+namespace http {
+namespace internal {
+
+// Global HTTP client connection pool.
+PID<ConnectionPoolProcess> connection_pool;
+
+} // namespace internal {
+} // namespace http {
+
 namespace internal {
 
 // Global reaper.
@@ -783,16 +1161,27 @@ static Future<MessageEvent*> parse(const Request& request)
   CHECK_SOME(request.reader);
   http::Pipe::Reader reader = request.reader.get(); // Remove const.
 
-  return reader.readAll()
-    .then([from, name, to](const string& body) {
-      Message message;
-      message.name = name;
-      message.from = from.get();
-      message.to = to;
-      message.body = body;
+  // NOTE: we read the body straight into the message (rather than
+  // use `readAll`) so that we can move it into the event instead of
+  // copying it, which matters for large messages.
+  std::shared_ptr<Message> message(new Message());
+  message->name = name;
+  message->from = from.get();
+  message->to = to;
 
-      return new MessageEvent(std::move(message));
-    });
+  return loop(
+      None(),
+      [=]() mutable {
+        return reader.read();
+      },
+      [=](const string& data) -> ControlFlow<MessageEvent*> {
+        if (data.empty()) { // EOF.
+          return Break(new MessageEvent(std::move(*message)));
+        }
+
+        message->body.append(data);
+        return Continue();
+      });
 }
 
 
@@ -802,41 +1191,79 @@ void receive(Socket socket)
 {
   StreamingRequestDecoder* decoder = new StreamingRequestDecoder();
 
-  const size_t size = 80 * 1024;
-  char* data = new char[size];
+  // Used instead of `decoder` if the peer uses the binary framing,
+  // which we can tell from the first byte it sends. Peers only use it
+  // if we've opted in (and advertised it), otherwise we always decode
+  // HTTP so that we don't expose the binary decoder at all.
+  BinaryMessageDecoder* binary = libprocess_flags->binary_framing
+    ? new BinaryMessageDecoder()
+    : nullptr;
+  Option<bool>* framed = new Option<bool>();
+
+  // The buffer we're receiving into, if any. We only borrow a buffer
+  // from the pool while there is data to receive and give it back once
+  // we've decoded the data so that idle connections don't hold one.
+  char** buffer = new char*(nullptr);
+
+  auto decode = [=](const char* data, size_t length)
+      -> Future<ControlFlow<Nothing>> {
+    if (length == 0) {
+      return Break(); // EOF.
+    }
 
-  Future<Nothing> recv_loop = process::loop(
-      None(),
-      [=] {
-        return socket.recv(data, size);
-      },
-      [=](size_t length) -> Future<ControlFlow<Nothing>> {
-        if (length == 0) {
-          return Break(); // EOF.
-        }
+    if (framed->isNone()) {
+      *framed =
+        binary != nullptr && data[0] == BinaryMessageEncoder::MAGIC;
+    }
 
-        // Decode as much of the data as possible into HTTP requests.
-        const deque<Request*> requests = decoder->decode(data, length);
+    if (framed->get()) {
+      const deque<Message*> messages = binary->decode(data, length);
 
-        if (requests.empty() && decoder->failed()) {
-          return Failure("Decoder error");
-        }
+      if (messages.empty() && binary->failed()) {
+        return Failure("Decoder error");
+      }
 
-        if (!requests.empty()) {
-          // Get the peer address to augment the requests.
-          Try<Address> address = socket.peer();
+      foreach (Message* message, messages) {
+        process_manager->handle(socket, message);
+      }
 
-          if (address.isError()) {
-            return Failure("Failed to get peer address: " + address.error());
-          }
+      return Continue();
+    }
 
-          foreach (Request* request, requests) {
-            request->client = address.get();
-            process_manager->handle(socket, request);
-          }
-        }
+    // Decode as much of the data as possible into HTTP requests.
+    const deque<Request*> requests = decoder->decode(data, length);
 
-        return Continue();
+    if (requests.empty() && decoder->failed()) {
+      return Failure("Decoder error");
+    }
+
+    if (!requests.empty()) {
+      // Get the peer address to augment the requests.
+      Try<Address> address = socket.peer();
+
+      if (address.isError()) {
+        return Failure("Failed to get peer address: " + address.error());
+      }
+
+      foreach (Request* request, requests) {
+        request->client = address.get();
+        process_manager->handle(socket, request);
+      }
+    }
+
+    return Continue();
+  };
+
+  Future<Nothing> recv_loop = process::loop(
+      None(),
+      [=] {
+        return BufferPool::recv(socket, buffer);
+      },
+      [=](size_t length) {
+        Future<ControlFlow<Nothing>> result = decode(*buffer, length);
+        BufferPool::release(*buffer);
+        *buffer = nullptr;
+        return result;
       });
 
   recv_loop.onAny([=](const Future<Nothing> f) {
@@ -850,16 +1277,86 @@ void receive(Socket socket)
     }
 
     socket_manager->close(socket);
-    delete[] data;
+    BufferPool::release(*buffer);
+    delete buffer;
     delete decoder;
+    delete binary;
+    delete framed;
   });
 }
 
 } // namespace internal {
 
 
+namespace internal {
+
+// Invokes expired timers on the worker threads rather than on the
+// event loop thread that found them expired (see `timedout`).
+class TimerExecutor : public Process<TimerExecutor>
+{
+public:
+  TimerExecutor() : ProcessBase(ID::generate("__timer_executor__")) {}
+
+  struct Metrics
+  {
+    Metrics()
+      : ticks("libprocess/timers/ticks"),
+        fired("libprocess/timers/fired"),
+        lag("libprocess/timers/lag_us", Minutes(1)) {}
+
+    // Number of times the event loop handled expired timers, i.e.,
+    // woke up because of a timer.
+    metrics::Counter ticks;
+
+    // Number of timers that got invoked.
+    metrics::Counter fired;
+
+    // Time between the timeout of the earliest timer of a batch and
+    // the batch getting invoked. The windowed history gets exposed
+    // as percentiles.
+    metrics::PushGauge lag;
+  };
+
+  static Metrics& metrics()
+  {
+    // NOTE: the metrics get intentionally leaked so that they outlive
+    // the executors. They get added by `ProcessManager::installMetrics`.
+    static Metrics* metrics = new Metrics();
+    return *metrics;
+  }
+
+  void fire(const vector<Timer>& timers)
+  {
+    // The lag is meaningless while the clock is paused.
+    if (!Clock::paused()) {
+      metrics().lag = static_cast<int64_t>(
+          (Clock::now() - timers.front().timeout().time()).us());
+    }
+
+    metrics().fired += static_cast<int64_t>(timers.size());
+
+    foreach (const Timer& timer, timers) {
+      timer();
+    }
+  }
+};
+
+
+// Maximum number of timers an executor gets to invoke at once.
+static constexpr size_t MAX_TIMER_BATCH_SIZE = 128;
+
+
+// The executors, set once they have been spawned during
+// `process::initialize`.
+static std::atomic<vector<PID<TimerExecutor>>*> timer_executors(nullptr);
+
+} // namespace internal {
+
+
 void timedout(const list<Timer>& timers)
 {
+  ++internal::TimerExecutor::metrics().ticks;
+
   // Update current time of process (if it's present/valid). Note that
   // current time may be greater than the timeout if a local message
   // was received (and happens-before kicks in).
@@ -871,10 +1368,47 @@ void timedout(const list<Timer>& timers)
     }
   }
 
-  // Invoke the timers that timed out (TODO(benh): Do this
-  // asynchronously so that we don't tie up the event thread!).
+  const vector<PID<internal::TimerExecutor>>* executors =
+    internal::timer_executors.load();
+
+  // Until the executors have been spawned we invoke the timers that
+  // timed out right here.
+  if (executors == nullptr) {
+    foreach (const Timer& timer, timers) {
+      timer();
+    }
+    return;
+  }
+
+  // Hand the timers to the executors in batches. All timers of the
+  // same creator go to the same executor so that they still get
+  // invoked in the order in which they timed out.
+  vector<vector<Timer>> batches(executors->size());
+
+  std::hash<UPID> hash;
+
   foreach (const Timer& timer, timers) {
-    timer();
+    size_t index = hash(timer.creator()) % executors->size();
+
+    batches[index].push_back(timer);
+
+    if (batches[index].size() >= internal::MAX_TIMER_BATCH_SIZE) {
+      dispatch(
+          executors->at(index),
+          &internal::TimerExecutor::fire,
+          std::move(batches[index]));
+
+      batches[index].clear();
+    }
+  }
+
+  for (size_t index = 0; index < batches.size(); index++) {
+    if (!batches[index].empty()) {
+      dispatch(
+          executors->at(index),
+          &internal::TimerExecutor::fire,
+          std::move(batches[index]));
+    }
   }
 }
 
@@ -898,7 +1432,7 @@ void timedout(const list<Timer>& timers)
 
 namespace internal {
 
-void on_accept(const Future<Socket>& socket)
+void on_accept(size_t index, const Future<Socket>& socket)
 {
   // We stop the accept loop when libprocess is finalizing.
   // Either we'll see a discarded socket here, or we'll see
@@ -923,8 +1457,8 @@ void on_accept(const Future<Socket>& socket)
   if (!stopped) {
     synchronized (socket_mutex) {
       if (__s__ != nullptr) {
-        future_accept = __s__->accept()
-          .onAny(lambda::bind(&on_accept, lambda::_1));
+        future_accepts->at(index) = __s__->at(index).accept()
+          .onAny(lambda::bind(&on_accept, index, lambda::_1));
       } else {
         stopped = true;
       }
@@ -1057,12 +1591,26 @@ bool initialize(
   }
 #endif
 
+  // Fetch and parse the libprocess environment variables. This must
+  // be done before setting up the processing threads below as some of
+  // the flags determine how they get set up.
+  Try<flags::Warnings> load = libprocess_flags->load("LIBPROCESS_");
+
+  if (load.isError()) {
+    EXIT(EXIT_FAILURE) << libprocess_flags->usage(load.error());
+  }
+
+  // Log any flag warnings.
+  foreach (const flags::Warning& warning, load->warnings) {
+    LOG(WARNING) << warning.message;
+  }
+
   // Create a new ProcessManager and SocketManager.
   process_manager = new ProcessManager(delegate);
   socket_manager = new SocketManager();
 
-  // Initialize the event loop.
-  EventLoop::initialize();
+  // Initialize the event loops.
+  EventLoop::initialize(libprocess_flags->event_loops);
 
   // Setup processing threads.
   long num_worker_threads = process_manager->init_threads();
@@ -1072,18 +1620,6 @@ bool initialize(
   // Fill in the local IP and port for inter-libprocess communication.
   __address__ = inet4::Address::ANY_ANY();
 
-  // Fetch and parse the libprocess environment variables.
-  Try<flags::Warnings> load = libprocess_flags->load("LIBPROCESS_");
-
-  if (load.isError()) {
-    EXIT(EXIT_FAILURE) << libprocess_flags->usage(load.error());
-  }
-
-  // Log any flag warnings.
-  foreach (const flags::Warning& warning, load->warnings) {
-    LOG(WARNING) << warning.message;
-  }
-
   uint16_t port = 0;
 
   if (libprocess_flags->port.isSome()) {
@@ -1099,31 +1635,57 @@ bool initialize(
     __address6__ = inet6::Address(libprocess_flags->ip6.get(), port);
   }
 
-  // Create a "server" socket for communicating.
-  Try<Socket> create = Socket::create();
-  if (create.isError()) {
-    LOG(FATAL) << "Failed to construct server socket:" << create.error();
-  }
-  __s__ = new Socket(create.get());
+  // Create the "server" sockets for communicating.
+  __s__ = new std::vector<Socket>();
+
+  for (size_t i = 0; i < libprocess_flags->listeners; i++) {
+    Try<Socket> create = Socket::create();
+    if (create.isError()) {
+      LOG(FATAL) << "Failed to construct server socket:" << create.error();
+    }
+    __s__->push_back(create.get());
+
+    // Allow address reuse.
+    // NOTE: We cast to `char*` here because the function prototypes on
+    // Windows use `char*` instead of `void*`.
+    int on = 1;
+    if (::setsockopt(
+            create->get(),
+            SOL_SOCKET,
+            SO_REUSEADDR,
+            reinterpret_cast<char*>(&on),
+            sizeof(on)) < 0) {
+      PLOG(FATAL) << "Failed to initialize, setsockopt(SO_REUSEADDR)";
+    }
 
-  // Allow address reuse.
-  // NOTE: We cast to `char*` here because the function prototypes on Windows
-  // use `char*` instead of `void*`.
-  int on = 1;
-  if (::setsockopt(
-          __s__->get(),
-          SOL_SOCKET,
-          SO_REUSEADDR,
-          reinterpret_cast<char*>(&on),
-          sizeof(on)) < 0) {
-    PLOG(FATAL) << "Failed to initialize, setsockopt(SO_REUSEADDR)";
+#ifdef SO_REUSEPORT
+    // Allow the sockets to listen on the same address.
+    if (libprocess_flags->listeners > 1 &&
+        ::setsockopt(
+            create->get(),
+            SOL_SOCKET,
+            SO_REUSEPORT,
+            reinterpret_cast<char*>(&on),
+            sizeof(on)) < 0) {
+      PLOG(FATAL) << "Failed to initialize, setsockopt(SO_REUSEPORT)";
+    }
+#endif // SO_REUSEPORT
   }
 
-  Try<Address> bind = __s__->bind(__address__);
+  Try<Address> bind = __s__->front().bind(__address__);
   if (bind.isError()) {
     LOG(FATAL) << "Failed to initialize: " << bind.error();
   }
 
+  // Bind the other sockets to the address that the first one got
+  // bound to, i.e., to the same port if we asked for a random one.
+  for (size_t i = 1; i < __s__->size(); i++) {
+    Try<Address> bound = __s__->at(i).bind(bind.get());
+    if (bound.isError()) {
+      LOG(FATAL) << "Failed to initialize: " << bound.error();
+    }
+  }
+
   __address__ = bind.get();
 
   // If advertised IP and port are present, use them instead.
@@ -1158,17 +1720,23 @@ bool initialize(
     __address__.ip = ip.get();
   }
 
-  Try<Nothing> listen = __s__->listen(LISTEN_BACKLOG);
-  if (listen.isError()) {
-    LOG(FATAL) << "Failed to initialize: " << listen.error();
+  foreach (Socket& socket, *__s__) {
+    Try<Nothing> listen = socket.listen(LISTEN_BACKLOG);
+    if (listen.isError()) {
+      LOG(FATAL) << "Failed to initialize: " << listen.error();
+    }
   }
 
   // Need to set `initialize_complete` here so that we can actually
   // invoke `accept()` and `spawn()` below.
   initialize_complete.store(true);
 
-  future_accept = __s__->accept()
-    .onAny(lambda::bind(&internal::on_accept, lambda::_1));
+  future_accepts->resize(__s__->size());
+
+  for (size_t i = 0; i < __s__->size(); i++) {
+    future_accepts->at(i) = __s__->at(i).accept()
+      .onAny(lambda::bind(&internal::on_accept, i, lambda::_1));
+  }
 
   // TODO(benh): Make sure creating the logging process, and profiler
   // always succeeds and use supervisors to make sure that none
@@ -1207,6 +1775,8 @@ bool initialize(
       metrics::internal::MetricsProcess::create(readonlyAuthenticationRealm),
       true);
 
+  process_manager->installMetrics();
+
   // Create the global logging process.
   _logging = spawn(new Logging(readwriteAuthenticationRealm), true);
 
@@ -1229,6 +1799,27 @@ bool initialize(
   process::internal::reaper =
     spawn(new process::internal::ReaperProcess(), true);
 
+  // Create the global HTTP client connection pool process.
+  http::internal::connection_pool = spawn(
+      new http::internal::ConnectionPoolProcess(
+          libprocess_flags->http_pool_max_idle,
+          libprocess_flags->http_pool_max_per_host,
+          libprocess_flags->http_pool_idle_timeout,
+          libprocess_flags->http_pool_pipelining_depth),
+      true);
+
+  // Create the processes that invoke expired timers, one per worker
+  // thread so that timers of different creators can be invoked in
+  // parallel (see `timedout`).
+  vector<PID<internal::TimerExecutor>>* executors =
+    new vector<PID<internal::TimerExecutor>>();
+
+  for (long i = 0; i < num_worker_threads; i++) {
+    executors->push_back(spawn(new internal::TimerExecutor(), true));
+  }
+
+  internal::timer_executors.store(executors);
+
   // Create the global job object manager process.
 #ifdef __WINDOWS__
   process::internal::job_object_manager =
@@ -1268,13 +1859,16 @@ void finalize(bool finalize_wsa)
   delete processes_route;
   processes_route = nullptr;
 
-  // Close the server socket.
+  // Close the server sockets.
   // This will prevent any further connections managed by the `SocketManager`.
   synchronized (socket_mutex) {
-    // Explicitly terminate the callback loop used to accept incoming
-    // connections. This is necessary as the server socket ignores
-    // most errors, including when the server socket has been closed.
-    future_accept.discard();
+    // Explicitly terminate the callback loops used to accept incoming
+    // connections. This is necessary as the server sockets ignore
+    // most errors, including when a server socket has been closed.
+    foreach (Future<Socket>& future_accept, *future_accepts) {
+      future_accept.discard();
+    }
+    future_accepts->clear();
 
     delete __s__;
     __s__ = nullptr;
@@ -1286,6 +1880,10 @@ void finalize(bool finalize_wsa)
   // libprocess should be single-threaded.
   process_manager->finalize();
 
+  // The timer executors have been terminated along with all other
+  // processes, they get spawned again if libprocess is reinitialized.
+  delete internal::timer_executors.exchange(nullptr);
+
   // Now that all threads except for the main thread have joined, we should
   // delete the one remaining `_executor_` pointer.
   delete _executor_;
@@ -1418,29 +2016,42 @@ void SocketManager::accepted(const Socket& socket)
 
 namespace internal {
 
-void ignore_recv_data(
-    const Future<size_t>& length,
-    Socket socket,
-    char* data,
-    size_t size)
+// Receives and drops data from the socket until EOF (or an error),
+// then closes the socket. We only borrow a buffer from the pool to
+// receive into while there is data to receive.
+void ignore_recv_data(Socket socket)
 {
-  if (!length.isReady() || length.get() == 0) {
-    if (length.isFailed()) {
-      Try<Address> peer = socket.peer();
+  char** buffer = new char*(nullptr);
 
-      LOG(WARNING)
-        << "Failed to recv on socket " << socket.get() << " to peer '"
-        << (peer.isSome() ? stringify(peer.get()) : "unknown")
-        << "': " << length.failure();
-    }
+  process::loop(
+      None(),
+      [=] {
+        return BufferPool::recv(socket, buffer);
+      },
+      [=](size_t length) -> ControlFlow<Nothing> {
+        BufferPool::release(*buffer);
+        *buffer = nullptr;
 
-    socket_manager->close(socket);
-    delete[] data;
-    return;
-  }
+        if (length == 0) {
+          return Break(); // EOF.
+        }
+
+        return Continue();
+      })
+    .onAny([=](const Future<Nothing>& future) {
+      if (future.isFailed()) {
+        Try<Address> peer = socket.peer();
 
-  socket.recv(data, size)
-    .onAny(lambda::bind(&ignore_recv_data, lambda::_1, socket, data, size));
+        LOG(WARNING)
+          << "Failed to recv on socket " << socket.get() << " to peer '"
+          << (peer.isSome() ? stringify(peer.get()) : "unknown")
+          << "': " << future.failure();
+      }
+
+      socket_manager->close(socket);
+      BufferPool::release(*buffer);
+      delete buffer;
+    });
 }
 
 
@@ -1550,16 +2161,7 @@ void SocketManager::link_connect(
       return;
     }
 
-    size_t size = 80 * 1024;
-    char* data = new char[size];
-
-    socket.recv(data, size)
-      .onAny(lambda::bind(
-          &internal::ignore_recv_data,
-          lambda::_1,
-          socket,
-          data,
-          size));
+    internal::ignore_recv_data(socket);
   }
 
   // In order to avoid a race condition where internal::send() is
@@ -1631,6 +2233,10 @@ void SocketManager::link(
 
         persists.emplace(to.address, s);
 
+        if (binary_peers.contains(to.address)) {
+          binary_sockets.insert(s);
+        }
+
         // Initialize 'outgoing' to prevent a race with
         // SocketManager::send() while the socket is not yet connected.
         // Initializing the 'outgoing' queue prevents
@@ -1740,7 +2346,9 @@ PID<HttpProxy> SocketManager::proxy(const Socket& socket)
       if (proxies.count(socket) > 0) {
         return proxies[socket]->self();
       } else {
-        proxy = new HttpProxy(sockets.at(socket));
+        proxy = new HttpProxy(
+            sockets.at(socket),
+            libprocess_flags->http_prepare_responses);
         proxies[socket] = proxy;
       }
     }
@@ -1776,83 +2384,146 @@ void SocketManager::unproxy(const Socket& socket)
 
 namespace internal {
 
-Future<Nothing> _send(Encoder* encoder, Socket socket);
+// The encoders being sent on a socket, in order. Either a single
+// `FileEncoder` or any number of `DataEncoder`s that get sent with a
+// single (vectored) write, see `SocketManager::coalesce`.
+typedef std::deque<Encoder*> Encoders;
+
+Future<Nothing> _send(
+    const std::shared_ptr<Encoders>& encoders,
+    Socket socket);
 
 void send(Encoder* encoder, Socket socket)
 {
-  _send(encoder, socket)
-    .then([socket] {
-      // Continue sending until this socket has no more
-      // queued outgoing messages.
-      return process::loop(
-          None(),
-          [=] { return socket_manager->next(socket); },
-          [=](Encoder* encoder) -> Future<ControlFlow<Nothing>> {
-            if (encoder == nullptr) {
-              return Break();
-            }
+  std::shared_ptr<Encoders> encoders(new Encoders({encoder}));
 
-            return _send(encoder, socket)
-              .then([]() -> ControlFlow<Nothing> { return Continue(); });
-        });
-    });
-}
-
-
-Future<Nothing> _send(Encoder* encoder, Socket socket)
-{
-  // Loop until all of the data in the provided encoder is sent.
-  return process::loop(
+  // Continue sending until this socket has no more queued outgoing
+  // messages.
+  process::loop(
       None(),
       [=] {
-        size_t size;
-        Future<size_t> send;
-
-        switch (encoder->kind()) {
-          case Encoder::DATA: {
-            const char* data =
-              static_cast<DataEncoder*>(encoder)->next(&size);
-            send = socket.send(data, size);
-            break;
-          }
-          case Encoder::FILE: {
-            off_t offset;
-            int_fd fd =
-              static_cast<FileEncoder*>(encoder)->next(&offset, &size);
-            send = socket.sendfile(fd, offset, size);
-            break;
-          }
-        }
+        socket_manager->coalesce(
+            socket,
+            libprocess_flags->send_batch_size.bytes(),
+            encoders.get());
 
-        return send
-          .then([=](size_t sent) {
-            // Update the encoder with the amount sent.
-            encoder->backup(size - sent);
-            return Nothing();
-          })
-          .recover([=](const Future<Nothing>& f) {
-            if (f.isFailed()) {
-              Try<Address> peer = socket.peer();
-
-              LOG(WARNING)
-                << "Failed to send on socket " << socket.get() << " to peer '"
-                << (peer.isSome() ? stringify(peer.get()) : "unknown")
-                << "': " << f.failure();
-            }
-            socket_manager->close(socket);
-            delete encoder;
-            return f; // Break the loop by propagating the "failure".
-          });
+        return _send(encoders, socket);
       },
       [=](Nothing) -> ControlFlow<Nothing> {
-        if (encoder->remaining() == 0) {
-          delete encoder;
-          return Break();
+        if (encoders->empty()) {
+          Encoder* encoder = socket_manager->next(socket);
+          if (encoder == nullptr) {
+            return Break();
+          }
+          encoders->push_back(encoder);
         }
         return Continue();
       });
 }
 
+
+// Sends as much of the encoders as possible with a single write and
+// deletes the encoders that have been sent completely.
+Future<Nothing> _send(
+    const std::shared_ptr<Encoders>& encoders,
+    Socket socket)
+{
+  CHECK(!encoders->empty());
+
+  // The sizes of the data we're attempting to send, per encoder.
+  std::shared_ptr<vector<size_t>> sizes(new vector<size_t>());
+
+  Future<size_t> send;
+
+  switch (encoders->front()->kind()) {
+    case Encoder::DATA: {
+      vector<SocketImpl::Buffer> buffers;
+      buffers.reserve(encoders->size());
+
+      foreach (Encoder* encoder, *encoders) {
+        CHECK_EQ(Encoder::DATA, encoder->kind());
+
+        // An encoder might consist of more than one segment (e.g., a
+        // message with a shared body), each of which is a buffer.
+        size_t total = 0;
+        while (encoder->remaining() > 0) {
+          size_t size;
+          const char* data = static_cast<DataEncoder*>(encoder)->next(&size);
+
+          buffers.push_back({data, size});
+          total += size;
+        }
+
+        sizes->push_back(total);
+      }
+
+      // NOTE: we only use a vectored send when we have more than one
+      // buffer so that sockets that don't support it (e.g., SSL) can
+      // still send the data of a single encoder at once.
+      if (buffers.empty()) {
+        send = size_t(0); // Only empty encoders, nothing to send.
+      } else if (buffers.size() == 1) {
+        send = socket.send(buffers[0].data, buffers[0].size);
+      } else {
+        send = socket.send(buffers);
+      }
+      break;
+    }
+    case Encoder::FILE: {
+      CHECK_EQ(1u, encoders->size());
+
+      size_t size;
+      off_t offset;
+      int_fd fd =
+        static_cast<FileEncoder*>(encoders->front())->next(&offset, &size);
+
+      sizes->push_back(size);
+
+      send = socket.sendfile(fd, offset, size);
+      break;
+    }
+  }
+
+  return send
+    .then([=](size_t sent) {
+      // Update the encoders with the amount sent.
+      for (size_t i = 0; i < sizes->size(); i++) {
+        const size_t size = sizes->at(i);
+        if (sent >= size) {
+          sent -= size;
+        } else {
+          encoders->at(i)->backup(size - sent);
+          sent = 0;
+        }
+      }
+
+      while (!encoders->empty() && encoders->front()->remaining() == 0) {
+        delete encoders->front();
+        encoders->pop_front();
+      }
+
+      return Nothing();
+    })
+    .recover([=](const Future<Nothing>& f) {
+      if (f.isFailed()) {
+        Try<Address> peer = socket.peer();
+
+        LOG(WARNING)
+          << "Failed to send on socket " << socket.get() << " to peer '"
+          << (peer.isSome() ? stringify(peer.get()) : "unknown")
+          << "': " << f.failure();
+      }
+      socket_manager->close(socket);
+
+      foreach (Encoder* encoder, *encoders) {
+        delete encoder;
+      }
+      encoders->clear();
+
+      return f; // Break the loop by propagating the "failure".
+    });
+}
+
 } // namespace internal {
 
 
@@ -1897,10 +2568,8 @@ void SocketManager::send(
 
   // Don't persist the connection if the headers include
   // 'Connection: close'.
-  if (response.headers.contains("Connection")) {
-    if (response.headers.get("Connection").get() == "close") {
-      persist = false;
-    }
+  if (http::internal::closesConnection(response.headers)) {
+    persist = false;
   }
 
   send(new HttpResponseEncoder(response, request), persist, socket);
@@ -1973,21 +2642,12 @@ void SocketManager::send_connect(
     return;
   }
 
-  Encoder* encoder = new MessageEncoder(message);
+  Encoder* encoder = encode(socket.get(), std::move(message));
 
   // Receive and ignore data from this socket. Note that we don't
   // expect to receive anything other than HTTP '202 Accepted'
   // responses which we just ignore.
-  size_t size = 80 * 1024;
-  char* data = new char[size];
-
-  socket.recv(data, size)
-    .onAny(lambda::bind(
-        &internal::ignore_recv_data,
-        lambda::_1,
-        socket,
-        data,
-        size));
+  internal::ignore_recv_data(socket);
 
   internal::send(encoder, socket);
 }
@@ -2016,7 +2676,8 @@ void SocketManager::send(Message&& message, const SocketImpl::Kind& kind)
       }
 
       if (outgoing.count(socket.get()) > 0) {
-        outgoing[socket.get()].push(new MessageEncoder(message));
+        outgoing[socket.get()].push(
+            encode(socket.get(), std::move(message)));
         return;
       } else {
         // Initialize the outgoing queue.
@@ -2045,6 +2706,10 @@ void SocketManager::send(Message&& message, const SocketImpl::Kind& kind)
       addresses.emplace(s, address);
       temps.emplace(address, s);
 
+      if (binary_peers.contains(address)) {
+        binary_sockets.insert(s);
+      }
+
       dispose.insert(s);
 
       // Initialize the outgoing queue.
@@ -2066,7 +2731,73 @@ void SocketManager::send(Message&& message, const SocketImpl::Kind& kind)
   } else {
     // If we're not connecting and we haven't added the encoder to
     // the 'outgoing' queue then schedule it to be sent.
-    internal::send(new MessageEncoder(message), socket.get());
+    internal::send(encode(socket.get(), std::move(message)), socket.get());
+  }
+}
+
+
+void SocketManager::coalesce(
+    int_fd s,
+    size_t bytes,
+    std::deque<Encoder*>* encoders)
+{
+  CHECK(!encoders->empty());
+
+  // Files are always sent on their own.
+  if (encoders->back()->kind() != Encoder::DATA) {
+    return;
+  }
+
+  size_t size = 0;
+  foreach (Encoder* encoder, *encoders) {
+    size += encoder->remaining();
+  }
+
+  synchronized (mutex) {
+    // See `SocketManager::next` for why the socket might be gone.
+    if (sockets.count(s) == 0 || outgoing.count(s) == 0) {
+      return;
+    }
+
+    std::queue<Encoder*>& queue = outgoing[s];
+
+    while (size < bytes &&
+           !queue.empty() &&
+           queue.front()->kind() == Encoder::DATA) {
+      size += queue.front()->remaining();
+      encoders->push_back(queue.front());
+      queue.pop();
+    }
+  }
+}
+
+
+Encoder* SocketManager::encode(int_fd s, Message&& message)
+{
+  synchronized (mutex) {
+    if (binary_sockets.contains(s)) {
+      return new BinaryMessageEncoder(std::move(message));
+    }
+  }
+
+  return new MessageEncoder(
+      std::move(message),
+      libprocess_flags->binary_framing);
+}
+
+
+void SocketManager::set_binary_framing(const Address& address, bool binary)
+{
+  if (!libprocess_flags->binary_framing) {
+    return;
+  }
+
+  synchronized (mutex) {
+    if (binary) {
+      binary_peers.insert(address);
+    } else {
+      binary_peers.erase(address);
+    }
   }
 }
 
@@ -2204,6 +2935,7 @@ void SocketManager::close(int_fd s)
         proxies.erase(s);
       }
 
+      binary_sockets.erase(s);
       dispose.erase(s);
       auto iterator = sockets.find(s);
 
@@ -2410,10 +3142,16 @@ void SocketManager::swap_implementing_socket(
       // No need to erase as we're changing the value, not the key.
     }
 
-    // Move any encoders queued against this link to the new socket.
+    // Move any encoders queued against this link to the new socket,
+    // which must therefore use the same framing.
     outgoing[to_fd] = std::move(outgoing[from_fd]);
     outgoing.erase(from_fd);
 
+    if (binary_sockets.contains(from_fd)) {
+      binary_sockets.insert(to_fd);
+      binary_sockets.erase(from_fd);
+    }
+
     // Update the fd any proxies are associated with.
     if (proxies.count(from_fd) > 0) {
       proxies[to_fd] = proxies[from_fd];
@@ -2427,7 +3165,9 @@ ProcessManager::ProcessManager(const Option<string>& _delegate)
   : delegate(_delegate),
     running(0),
     joining_threads(false),
-    finalizing(false) {}
+    finalizing(false),
+    pinned_threads(0),
+    pinned_runnable(0) {}
 
 
 ProcessManager::~ProcessManager() {}
@@ -2456,7 +3196,9 @@ void ProcessManager::finalize()
       }
 
       // Grab the `UPID` for the next process we'll terminate.
-      pid = processes.begin()->second->self();
+      Option<ProcessBase*> process = processes.any();
+      CHECK_SOME(process);
+      pid = process.get()->self();
     }
 
     // Terminate this process but do not inject the message,
@@ -2467,7 +3209,11 @@ void ProcessManager::finalize()
 
   // Send signal to all processing threads to stop running.
   joining_threads.store(true);
-  runq.decomission();
+  if (stealing) {
+    stealq.decomission();
+  } else {
+    runq.decomission();
+  }
   EventLoop::stop();
 
   // Join all threads.
@@ -2475,6 +3221,12 @@ void ProcessManager::finalize()
     thread->join();
     delete thread;
   }
+
+  // All pinned processes have been terminated above so their threads
+  // have been detached and have exited (or are just about to).
+  while (pinned_threads.load() > 0) {
+    std::this_thread::yield();
+  }
 }
 
 
@@ -2520,9 +3272,42 @@ long ProcessManager::init_threads()
     }
   }
 
-  if (runq.capacity() < (size_t) num_worker_threads) {
+  stealing = libprocess_flags->run_queue == "work_stealing";
+
+  size_t capacity = stealing ? stealq.capacity() : runq.capacity();
+
+  if (capacity < (size_t) num_worker_threads) {
     EXIT(EXIT_FAILURE) << "Number of worker threads can not exceed "
-                       << runq.capacity() << " at this time";
+                       << capacity << " at this time";
+  }
+
+  if (stealing) {
+    stealq.initialize(num_worker_threads);
+  }
+
+  affinity = libprocess_flags->process_affinity;
+
+  if (affinity && !stealing) {
+    LOG(WARNING) << "Ignoring LIBPROCESS_PROCESS_AFFINITY as it requires "
+                 << "LIBPROCESS_RUN_QUEUE=work_stealing";
+    affinity = false;
+  }
+
+  if (libprocess_flags->resume_event_quantum.isSome()) {
+    event_quantum = libprocess_flags->resume_event_quantum.get();
+  }
+
+  time_quantum = libprocess_flags->resume_time_quantum;
+  event_batch_size = libprocess_flags->event_batch_size;
+
+  if (libprocess_flags->worker_idle_strategy == "adaptive") {
+    const size_t spinners = std::max(1L, num_worker_threads / 2);
+
+    if (stealing) {
+      stealq.configure(libprocess_flags->worker_spin_budget, spinners);
+    } else {
+      runq.configure(libprocess_flags->worker_spin_budget, spinners);
+    }
   }
 
   threads.reserve(num_worker_threads + 1);
@@ -2531,7 +3316,8 @@ long ProcessManager::init_threads()
   for (long i = 0; i < num_worker_threads; i++) {
     // Retain the thread handles so that we can join when shutting down.
     threads.emplace_back(new std::thread(
-        [this]() {
+        [this, i]() {
+          __worker__ = i;
           running.fetch_add(1);
           do {
             ProcessBase* process = dequeue();
@@ -2552,13 +3338,31 @@ long ProcessManager::init_threads()
         }));
   }
 
-  // Create a thread for the event loop.
-  threads.emplace_back(new std::thread(&EventLoop::run));
+  // Create a thread for each event loop.
+  for (size_t i = 0; i < EventLoop::loops(); i++) {
+    threads.emplace_back(new std::thread(&EventLoop::run, i));
+  }
 
   return num_worker_threads;
 }
 
 
+void ProcessManager::installMetrics()
+{
+  metrics::add(worker_metrics.wakeups_spinning);
+  metrics::add(worker_metrics.wakeups_parked);
+  metrics::add(worker_metrics.wake_latency);
+  metrics::add(buffer_metrics.allocated);
+  metrics::add(buffer_metrics.borrowed);
+  metrics::add(HttpProxy::metrics().blocked);
+  metrics::add(HttpProxy::metrics().blocked_time);
+  metrics::add(HttpProxy::metrics().prepared);
+  metrics::add(internal::TimerExecutor::metrics().ticks);
+  metrics::add(internal::TimerExecutor::metrics().fired);
+  metrics::add(internal::TimerExecutor::metrics().lag);
+}
+
+
 ProcessReference ProcessManager::use(const UPID& pid)
 {
   if (pid.reference.isSome()) {
@@ -2568,12 +3372,21 @@ ProcessReference ProcessManager::use(const UPID& pid)
   }
 
   if (pid.address == __address__) {
-    synchronized (processes_mutex) {
-      Option<ProcessBase*> process = processes.get(pid.id);
-      if (process.isSome()) {
-        return ProcessReference(process.get()->reference);
+    Option<std::shared_ptr<ProcessBase*>> reference = processes.find(pid.id);
+
+    // If the process is terminating we wait for it to get cleaned up
+    // by `ProcessManager::cleanup()` (which holds `processes_mutex`
+    // throughout) so that the process appears to be removed from the
+    // table at once, just as if every lookup held the mutex.
+    if (reference.isSome() && !reference.get()) {
+      synchronized (processes_mutex) {
+        reference = processes.find(pid.id);
       }
     }
+
+    if (reference.isSome() && reference.get()) {
+      return ProcessReference(std::move(reference.get()));
+    }
   }
 
   return ProcessReference();
@@ -2663,6 +3476,15 @@ void ProcessManager::handle(
           }
         }
 
+        // Remember whether or not the sender accepts the binary
+        // framing, which also lets us notice if it gets replaced by
+        // an older version of libprocess.
+        Option<string> framing = request->headers.get("Libprocess-Framing");
+
+        socket_manager->set_binary_framing(
+            event->message.from.address,
+            framing.isSome() && framing.get() == "binary");
+
         // TODO(benh): Use the sender PID when delivering in order to
         // capture happens-before timing relationships for testing.
         bool accepted = process_manager->deliver(event->message.to, event);
@@ -2791,6 +3613,46 @@ void ProcessManager::handle(
   delete request;
 }
 
+void ProcessManager::handle(
+    const Socket& socket,
+    Message* message)
+{
+  CHECK(message != nullptr);
+
+  // Verify that the UPID this peer is claiming is on the same IP
+  // address the peer is sending from (see the HTTP case above).
+  if (libprocess_flags->require_peer_address_ip_match) {
+    Try<Address> peer = socket.peer();
+
+    if (peer.isError() || message->from.address.ip != peer->ip) {
+      VLOG(1) << "Dropping message '" << message->name << "' from "
+              << message->from << " sent from "
+              << (peer.isSome() ? stringify(peer.get()) : "unknown")
+              << ": UPID IP address validation failed";
+
+      delete message;
+      return;
+    }
+  }
+
+  // A peer using the binary framing accepts it as well.
+  socket_manager->set_binary_framing(message->from.address, true);
+
+  message->to.address = __address__;
+
+  const UPID to = message->to;
+
+  // NOTE: unlike with HTTP we don't respond to messages, the sender
+  // can't tell whether or not they got delivered anyway.
+  if (deliver(to, new MessageEvent(std::move(*message)))) {
+    VLOG(2) << "Delivered libprocess message to " << to;
+  } else {
+    VLOG(1) << "Failed to deliver libprocess message to " << to;
+  }
+
+  delete message;
+}
+
 
 bool ProcessManager::deliver(
     ProcessBase* destination,
@@ -2873,12 +3735,11 @@ UPID ProcessManager::spawn(ProcessBase* process, bool manage)
       << ") that has already been initialized";
   } else {
     synchronized (processes_mutex) {
-      if (processes.count(process->pid.id) > 0) {
+      if (!processes.insert(
+              process->pid.id, process, process->reference)) {
         LOG(WARNING)
           << "Attempted to spawn already running process " << process->pid;
       } else {
-        processes[process->pid.id] = process;
-
         // NOTE: we set process reference on it's `UPID` _after_ we've
         // spawned so that we make sure that we'll take the
         // `ProcessManager::use()` code path in the event that we
@@ -2906,6 +3767,54 @@ UPID ProcessManager::spawn(ProcessBase* process, bool manage)
     process->manage = true;
   }
 
+  // Start the dedicated thread for a pinned process. This must be
+  // done before we enqueue the process below as enqueueing a pinned
+  // process only signals its thread.
+  if (process->pinned) {
+    std::shared_ptr<PinnedThread> pinned = process->pinned;
+
+    pinned_threads.fetch_add(1);
+
+    // NOTE: it's safe to capture `process` because the thread will
+    // only ever resume it after `semaphore` got signaled and
+    // `ProcessManager::cleanup` decomissions `semaphore` before the
+    // process might get deleted.
+    //
+    // NOTE: the thread doesn't touch `pinned->thread` before it gets
+    // resumed which can only happen once we've enqueued the process
+    // below, after having set `pinned->thread`.
+    pinned->thread = std::thread(
+        [this, process, pinned]() {
+          running.fetch_add(1);
+          do {
+            running.fetch_sub(1);
+            pinned->semaphore.wait();
+
+            // Need to increment `running` before we decrement
+            // `pinned_runnable` so that `Clock::settle` properly waits.
+            running.fetch_add(1);
+
+            if (pinned->semaphore.decomissioned()) {
+              break;
+            }
+
+            pinned_runnable.fetch_sub(1);
+
+            resume(process);
+          } while (true);
+          running.fetch_sub(1);
+
+          // Delete the thread local `_executor_` pointer to prevent a
+          // memory leak, see the worker threads in `init_threads`.
+          delete _executor_;
+          _executor_ = nullptr;
+
+          // NOTE: this must be the last thing we do with the process
+          // manager since `finalize` might delete it right after.
+          pinned_threads.fetch_sub(1);
+        });
+  }
+
   // We save the PID before enqueueing the process to avoid the race
   // condition that occurs when a user has a very short process and
   // the process gets run and cleaned up before we return from enqueue
@@ -2925,6 +3834,12 @@ void ProcessManager::resume(ProcessBase* process)
 {
   __process__ = process;
 
+  // Remember which worker ran this process so that it can be enqueued
+  // onto the same worker's run queue next time (see `enqueue`).
+  if (affinity && __worker__ >= 0) {
+    process->worker.store(__worker__, std::memory_order_relaxed);
+  }
+
   VLOG(3) << "Resuming " << process->pid << " at " << Clock::now();
 
   bool manage = process->manage;
@@ -2960,15 +3875,45 @@ void ProcessManager::resume(ProcessBase* process)
   // we set the state to BLOCKED (see the comment below).
   ProcessReference reference = process->reference;
 
-  while (!terminate && !blocked) {
+  // Events that have been dequeued from the event queue (at most
+  // `event_batch_size` at a time) but not yet served.
+  Event* batch[MAX_EVENT_BATCH_SIZE];
+  size_t batched = 0;
+  size_t next = 0;
+
+  // Number of events served so far, and for how long, used to decide
+  // whether or not we should yield to other processes (see below).
+  size_t served = 0;
+
+  Stopwatch stopwatch;
+  if (time_quantum.isSome()) {
+    stopwatch.start();
+  }
+
+  bool yield = false;
+
+  while (!terminate && !blocked && !yield) {
     Event* event = nullptr;
 
     // NOTE: the event queue requires only a _single_ consumer at a
     // time ... this is where we act as that single consumer (and down
     // in `ProcessManager::cleanup` which we call from here).
 
-    if (!process->events->consumer.empty()) {
-      event = process->events->consumer.dequeue();
+    if (next < batched) {
+      event = batch[next++];
+    } else if (!process->events->consumer.empty()) {
+      // Never dequeue more events than we're going to serve before
+      // yielding since we can't put them back on the event queue.
+      size_t size = event_batch_size;
+      if (event_quantum.isSome()) {
+        size = std::min(size, event_quantum.get() - served);
+      }
+
+      batched = process->events->consumer.dequeue_batch(batch, size);
+      next = 0;
+
+      CHECK_GT(batched, 0u);
+      event = batch[next++];
     } else {
       // We now transition the process to BLOCKED. It's possible that
       // events get enqueued while we're still in the READY state.
@@ -3015,7 +3960,9 @@ void ProcessManager::resume(ProcessBase* process)
         // Now purge all events until the terminate event.
         while (!event->is<TerminateEvent>()) {
           delete event;
-          event = process->events->consumer.dequeue();
+          event = next < batched
+            ? batch[next++]
+            : process->events->consumer.dequeue();
           CHECK_NOTNULL(event);
         }
       }
@@ -3062,6 +4009,17 @@ void ProcessManager::resume(ProcessBase* process)
       }
 
       delete event;
+
+      served++;
+
+      // Yield to other processes if this process has used up its
+      // quantum, but only once we've served all of the events we've
+      // already dequeued.
+      if (!terminate && next == batched) {
+        yield =
+          (event_quantum.isSome() && served >= event_quantum.get()) ||
+          (time_quantum.isSome() && stopwatch.elapsed() >= time_quantum.get());
+      }
     }
   }
 
@@ -3069,6 +4027,12 @@ void ProcessManager::resume(ProcessBase* process)
   reference = ProcessReference();
 
   if (terminate) {
+    // Delete any events that we dequeued after the terminate event
+    // just like `cleanup` deletes those still in the event queue.
+    while (next < batched) {
+      delete batch[next++];
+    }
+
     cleanup(process);
   }
 
@@ -3080,6 +4044,16 @@ void ProcessManager::resume(ProcessBase* process)
   if (terminate && manage) {
     delete process;
   }
+
+  // Put the process back at the end of the run queue if it yielded.
+  // Note that the process is still READY so nobody else will have
+  // enqueued it, but once we've enqueued it another worker might run
+  // it so we must not dereference it after this.
+  if (yield) {
+    VLOG(3) << "Yielding " << process->pid << " after serving "
+            << served << " events";
+    enqueue(process);
+  }
 }
 
 
@@ -3107,19 +4081,31 @@ void ProcessManager::cleanup(ProcessBase* process)
 
   process->events->consumer.decomission();
 
+  // Let the dedicated thread of a pinned process exit once it returns
+  // from `resume` (which is what invoked us). We're running on that
+  // thread so we can't join it, instead we detach it so that nothing
+  // is left behind for it once it has exited.
+  if (process->pinned) {
+    process->pinned->semaphore.decomission();
+    process->pinned->thread.detach();
+  }
+
   // Remove help strings for all installed routes for this process.
   dispatch(help, &Help::remove, process->pid.id);
 
     // Possible gate non-libprocess threads are waiting at.
   std::shared_ptr<Gate> gate = process->gate;
 
+  // We can't dereference `process` once we've told the socket manager
+  // that it has exited (see below) but we need its ID to remove it.
+  const UPID::ID id = process->pid.id;
+
   // Remove process.
   synchronized (processes_mutex) {
-    // Reset the reference so that we don't keep giving out references
-    // in `ProcessManager::use`.
-    //
-    // NOTE: this must be done from within the `processes_mutex` since
-    // that is where we read it and this is considered a write.
+    // Stop giving out references in `ProcessManager::use`. Any lookup
+    // from now on waits on `processes_mutex` until we're done here.
+    processes.terminate(id);
+
     process->reference.reset();
 
     // Wait for all process references to get cleaned up.
@@ -3130,8 +4116,6 @@ void ProcessManager::cleanup(ProcessBase* process)
 #endif
     }
 
-    processes.erase(process->pid.id);
-
     // Note that we don't remove the process from the clock during
     // cleanup, but rather the clock is reset for a process when it is
     // created (see ProcessBase::ProcessBase). We do this so that
@@ -3148,7 +4132,7 @@ void ProcessManager::cleanup(ProcessBase* process)
     // otherwise another process could attempt to link this process
     // and `SocketManager::link()` would see that the processes
     // doesn't exist when it attempts to get a `ProcessReference`
-    // (since we removed the process above) thus causing an exited
+    // (since we terminated the process above) thus causing an exited
     // event, which could cause the process to get deleted if someone
     // is not properly doing a `wait()` but just waiting for exited
     // events.
@@ -3168,6 +4152,11 @@ void ProcessManager::cleanup(ProcessBase* process)
     // process starting with the same `UPID`.
     CHECK(gate);
     gate->open();
+
+    // Only now do we remove the process from the table, lookups that
+    // found it terminating until now are waiting on `processes_mutex`
+    // and will not find it anymore.
+    processes.erase(id);
   }
 }
 
@@ -3242,9 +4231,8 @@ bool ProcessManager::wait(const UPID& pid)
         running.fetch_add(1);
 
         // Try and extract the process from the run queue. This may
-        // fail because another thread might resume the process first
-        // or the run queue might not support arbitrary extraction.
-        if (!runq.extract(process)) {
+        // fail because another thread might resume the process first.
+        if (!(stealing ? stealq.extract(process) : runq.extract(process))) {
           running.fetch_sub(1);
           process = nullptr;
         }
@@ -3316,7 +4304,7 @@ string ProcessManager::absolutePath(const string& path)
     return path;
   }
 
-  if (processes.find(decode.get()) != processes.end()) {
+  if (processes.contains(decode.get())) {
     // Return path when the first token is a process id.
     return path;
   } else {
@@ -3338,33 +4326,64 @@ void ProcessManager::enqueue(ProcessBase* process)
     return;
   }
 
-  // TODO(benh): Check and see if this process has its own thread. If
-  // it does, push it on that threads runq, and wake up that thread if
-  // it's not running. Otherwise, check and see which thread this
-  // process was last running on, and put it on that threads runq.
+  // A pinned process has its own thread, wake up that thread. Note
+  // that we bump `epoch` just like enqueueing into the run queue
+  // would so that `Clock::settle` notices that something ran.
+  if (process->pinned) {
+    pinned_runnable.fetch_add(1);
+    (stealing ? stealq.epoch : runq.epoch).fetch_add(1);
+    process->pinned->semaphore.signal();
+    return;
+  }
+
+  if (stealing) {
+    // With affinity we put the process on the run queue of the worker
+    // it last ran on, otherwise we use the current worker's run queue
+    // (if this is a worker thread at all).
+    long worker = affinity ? process->worker.load(std::memory_order_relaxed)
+                           : -1;
 
-  runq.enqueue(process);
+    if (worker < 0) {
+      worker = __worker__;
+    }
+
+    stealq.enqueue(
+        process,
+        worker >= 0 ? Option<size_t>(worker) : None());
+  } else {
+    runq.enqueue(process);
+  }
 }
 
 
 ProcessBase* ProcessManager::dequeue()
 {
-  // TODO(benh): Remove a process from this thread's runq. If there
-  // are no processes to run, and this is not a dedicated thread, then
-  // steal one from another threads runq.
-
   running.fetch_sub(1);
 
-  runq.wait();
+  const RunQueueSemaphore::Wakeup wakeup =
+    stealing ? stealq.wait() : runq.wait();
 
   // Need to increment `running` before we dequeue from `runq` so that
   // `Clock::settle` properly waits.
   running.fetch_add(1);
 
+  if (wakeup.spun) {
+    ++worker_metrics.wakeups_spinning;
+  } else if (wakeup.parked) {
+    ++worker_metrics.wakeups_parked;
+    worker_metrics.wake_latency.record(wakeup.latency.us());
+  }
+
   ////////////////////////////////////////////////////////////
   // NOTE: contract with the run queue is that we'll always //
   // call `wait` _BEFORE_ we call `dequeue`.                //
   ////////////////////////////////////////////////////////////
+  if (stealing) {
+    // NOTE: only worker threads dequeue.
+    CHECK_GE(__worker__, 0);
+    return stealq.dequeue(__worker__);
+  }
+
   return runq.dequeue();
 }
 
@@ -3377,13 +4396,17 @@ ProcessBase* ProcessManager::dequeue()
 // in the Mesos project.
 void ProcessManager::settle()
 {
+  // NOTE: when work stealing the comments below about `runq` apply
+  // equally to `stealq`, i.e., _all_ of the per-worker queues.
+  std::atomic_long& epoch = stealing ? stealq.epoch : runq.epoch;
+
   bool done = true;
   do {
     done = true; // Assume to start that we are settled.
 
     // See comments below as to how `epoch` helps us mitigate races
     // with `running` and `runq`.
-    long old = runq.epoch.load();
+    long old = epoch.load();
 
     if (running.load() > 0) {
       done = false;
@@ -3394,7 +4417,12 @@ void ProcessManager::settle()
     // because the semaphore had been signaled but nobody has woken
     // up yet.
 
-    if (!runq.empty()) {
+    if (stealing ? !stealq.empty() : !runq.empty()) {
+      done = false;
+      continue;
+    }
+
+    if (pinned_runnable.load() > 0) {
       done = false;
       continue;
     }
@@ -3427,7 +4455,7 @@ void ProcessManager::settle()
       continue;
     }
 
-    if (old != runq.epoch.load()) {
+    if (old != epoch.load()) {
       done = false;
       continue;
     }
@@ -3481,6 +4509,18 @@ Future<Response> ProcessManager::__processes__(const Request& request)
 }
 
 
+void* Event::operator new(size_t size)
+{
+  return MemoryPool::allocate(size);
+}
+
+
+void Event::operator delete(void* pointer, size_t size)
+{
+  MemoryPool::deallocate(pointer, size);
+}
+
+
 ProcessBase::ProcessBase(const string& id)
   : events(new EventQueue()),
     reference(std::make_shared<ProcessBase*>(this)),
@@ -3508,6 +4548,18 @@ ProcessBase::~ProcessBase()
 }
 
 
+void ProcessBase::pin()
+{
+  // NOTE: the `UPID` reference only gets set once spawned.
+  CHECK(pid.reference.isNone())
+    << "Process " << pid << " must be pinned before it is spawned";
+
+  if (!pinned) {
+    pinned = std::make_shared<PinnedThread>();
+  }
+}
+
+
 template <>
 size_t ProcessBase::eventCount<MessageEvent>()
 {
@@ -3662,7 +4714,7 @@ void ProcessBase::consume(MessageEvent&& event)
 
 void ProcessBase::consume(DispatchEvent&& event)
 {
-  std::move(*event.f)(this);
+  std::move(event.f)(this);
 }
 
 
@@ -4121,7 +5173,7 @@ namespace internal {
 
 void dispatch(
     const UPID& pid,
-    std::unique_ptr<lambda::CallableOnce<void(ProcessBase*)>> f,
+    DispatchFunction&& f,
     const Option<const std::type_info*>& functionType)
 {
   process::initialize();
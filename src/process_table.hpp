@@ -0,0 +1,391 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __PROCESS_PROCESS_TABLE_HPP__
+#define __PROCESS_PROCESS_TABLE_HPP__
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <process/pid.hpp>
+
+#include <stout/option.hpp>
+
+namespace process {
+
+// Forward declaration.
+class ProcessBase;
+
+
+// Table of all local spawned and running processes keyed by their ID,
+// optimized for looking up processes (see `ProcessManager::use`) which
+// happens for every message, HTTP request, and dispatch to a `UPID`
+// without a cached reference.
+//
+// Lookups are lock-free: a reader announces itself to the shard the
+// ID hashes to, walks the bucket using the hash that the `UPID::ID`
+// already computed, and tries to get a reference to the process.
+// Writers (`insert`, `terminate`, and `erase`) must be externally
+// synchronized (the `ProcessManager` uses `processes_mutex`) and
+// only delete unlinked entries (or buckets after a resize) once
+// every reader that might still see them has left the shard, i.e.,
+// after a "grace period" as in read-copy-update (RCU).
+//
+// NOTE: all atomic operations use sequentially consistent ordering on
+// purpose: a writer must not miss a reader that announced itself
+// before it loaded an entry the writer just unlinked.
+class ProcessTable
+{
+public:
+  ProcessTable() = default;
+
+  ProcessTable(const ProcessTable&) = delete;
+  ProcessTable& operator=(const ProcessTable&) = delete;
+
+  ~ProcessTable()
+  {
+    for (Shard& shard : shards) {
+      Buckets* buckets = shard.buckets.load();
+      if (buckets != nullptr) {
+        release(buckets);
+      }
+    }
+  }
+
+  // Returns `None` if there is no process with the specified ID, a
+  // reference to the process if there is one, or an empty reference
+  // if there is one but it is terminating (see `terminate`).
+  Option<std::shared_ptr<ProcessBase*>> find(const UPID::ID& id) const
+  {
+    return find(id.hash(), id);
+  }
+
+  Option<std::shared_ptr<ProcessBase*>> find(const std::string& id) const
+  {
+    return find(std::hash<std::string>()(id), id);
+  }
+
+  bool contains(const std::string& id) const
+  {
+    return find(id).isSome();
+  }
+
+  // The following must only be called by a writer.
+
+  // Returns false if there already is a process with the specified ID.
+  bool insert(
+      const UPID::ID& id,
+      ProcessBase* process,
+      const std::weak_ptr<ProcessBase*>& reference)
+  {
+    const size_t hash = id.hash();
+    Shard& shard = shards[hash % SHARDS];
+
+    Buckets* buckets = shard.buckets.load();
+
+    if (buckets == nullptr) {
+      buckets = new Buckets(INITIAL_BUCKETS);
+      shard.buckets.store(buckets);
+    } else if (lookup(buckets, hash, id) != nullptr) {
+      return false;
+    }
+
+    if (shard.size >= buckets->size) {
+      buckets = resize(&shard, buckets->size * 2);
+    }
+
+    std::atomic<Entry*>& head = buckets->bucket(hash / SHARDS);
+
+    Entry* entry = new Entry(hash, id, process, reference);
+    entry->next.store(head.load());
+    head.store(entry);
+
+    shard.size++;
+    size++;
+
+    return true;
+  }
+
+  // Stops handing out references to the process with the specified
+  // ID, if any. The process remains in the table until it gets erased
+  // so that readers can tell that it is terminating.
+  void terminate(const UPID::ID& id)
+  {
+    Buckets* buckets = shards[id.hash() % SHARDS].buckets.load();
+    if (buckets != nullptr) {
+      Entry* entry = lookup(buckets, id.hash(), id);
+      if (entry != nullptr) {
+        entry->terminating.store(true);
+      }
+    }
+  }
+
+  void erase(const UPID::ID& id)
+  {
+    const size_t hash = id.hash();
+    Shard& shard = shards[hash % SHARDS];
+
+    Buckets* buckets = shard.buckets.load();
+    if (buckets == nullptr) {
+      return;
+    }
+
+    std::atomic<Entry*>* link = &buckets->bucket(hash / SHARDS);
+    for (Entry* entry = link->load();
+         entry != nullptr;
+         entry = link->load()) {
+      if (entry->hash == hash &&
+          entry->id == static_cast<const std::string&>(id)) {
+        link->store(entry->next.load());
+
+        synchronize(&shard);
+        delete entry;
+
+        shard.size--;
+        size--;
+
+        return;
+      }
+      link = &entry->next;
+    }
+  }
+
+  bool empty() const
+  {
+    return size == 0;
+  }
+
+  // Returns any process in the table or `None` if it is empty.
+  Option<ProcessBase*> any() const
+  {
+    for (const Shard& shard : shards) {
+      Buckets* buckets = shard.buckets.load();
+      if (buckets != nullptr && shard.size > 0) {
+        for (size_t i = 0; i < buckets->size; i++) {
+          Entry* entry = buckets->bucket(i).load();
+          if (entry != nullptr) {
+            return entry->process;
+          }
+        }
+      }
+    }
+    return None();
+  }
+
+  std::vector<ProcessBase*> values() const
+  {
+    std::vector<ProcessBase*> result;
+    result.reserve(size);
+
+    for (const Shard& shard : shards) {
+      Buckets* buckets = shard.buckets.load();
+      if (buckets != nullptr) {
+        for (size_t i = 0; i < buckets->size; i++) {
+          for (Entry* entry = buckets->bucket(i).load();
+               entry != nullptr;
+               entry = entry->next.load()) {
+            result.push_back(entry->process);
+          }
+        }
+      }
+    }
+
+    return result;
+  }
+
+private:
+  // Number of shards, each with its own buckets and reader counts so
+  // that readers of different processes don't contend on the same
+  // cache lines and writers only wait for the readers of one shard.
+  static constexpr size_t SHARDS = 64;
+
+  // Initial number of buckets of a shard, always a power of 2.
+  static constexpr size_t INITIAL_BUCKETS = 16;
+
+  struct Entry
+  {
+    Entry(
+        size_t _hash,
+        const UPID::ID& _id,
+        ProcessBase* _process,
+        const std::weak_ptr<ProcessBase*>& _reference)
+      : hash(_hash),
+        id(_id),
+        process(_process),
+        reference(_reference) {}
+
+    const size_t hash;
+    const UPID::ID id;
+    ProcessBase* const process;
+    const std::weak_ptr<ProcessBase*> reference;
+    std::atomic<bool> terminating{false};
+    std::atomic<Entry*> next{nullptr};
+  };
+
+  struct Buckets
+  {
+    explicit Buckets(size_t _size)
+      : size(_size),
+        heads(new std::atomic<Entry*>[_size])
+    {
+      for (size_t i = 0; i < size; i++) {
+        heads[i].store(nullptr);
+      }
+    }
+
+    // NOTE: the low bits of the hash pick the shard so we pick the
+    // bucket using the hash divided by the number of shards.
+    std::atomic<Entry*>& bucket(size_t index) const
+    {
+      return heads[index & (size - 1)];
+    }
+
+    const size_t size;
+    const std::unique_ptr<std::atomic<Entry*>[]> heads;
+  };
+
+  // We align shards to 64 bytes (x86 cache line size) so that the
+  // reader counts of different shards never share a cache line.
+  struct alignas(64) Shard
+  {
+    std::atomic<Buckets*> buckets{nullptr};
+
+    // Number of readers that announced themselves during even and
+    // odd grace period phases, see `synchronize`.
+    mutable std::atomic<size_t> readers[2] = {{0}, {0}};
+    std::atomic<size_t> phase{0};
+
+    // Only accessed by writers.
+    size_t size = 0;
+  };
+
+  Option<std::shared_ptr<ProcessBase*>> find(
+      size_t hash,
+      const std::string& id) const
+  {
+    const Shard& shard = shards[hash % SHARDS];
+
+    std::atomic<size_t>& readers = shard.readers[shard.phase.load() & 1];
+    readers.fetch_add(1);
+
+    Option<std::shared_ptr<ProcessBase*>> result = None();
+
+    Buckets* buckets = shard.buckets.load();
+    if (buckets != nullptr) {
+      Entry* entry = lookup(buckets, hash, id);
+      if (entry != nullptr) {
+        std::shared_ptr<ProcessBase*> reference = entry->reference.lock();
+
+        // Check for termination _after_ getting the reference so that
+        // we never hand out a reference once the writer that set
+        // `terminating` starts waiting for references to expire.
+        if (entry->terminating.load()) {
+          reference.reset();
+        }
+
+        result = std::move(reference);
+      }
+    }
+
+    readers.fetch_sub(1);
+
+    return result;
+  }
+
+  static Entry* lookup(
+      const Buckets* buckets,
+      size_t hash,
+      const std::string& id)
+  {
+    for (Entry* entry = buckets->bucket(hash / SHARDS).load();
+         entry != nullptr;
+         entry = entry->next.load()) {
+      if (entry->hash == hash && entry->id == id) {
+        return entry;
+      }
+    }
+    return nullptr;
+  }
+
+  // Waits until every reader that might have loaded anything the
+  // caller unlinked from the shard before calling us has left.
+  //
+  // A single reader count could starve the writer if readers kept
+  // arriving, so readers count themselves in the phase they observe
+  // and we wait for each phase to drain after flipping to the other,
+  // which only new readers (that can't see what we unlinked) observe.
+  static void synchronize(Shard* shard)
+  {
+    for (int i = 0; i < 2; i++) {
+      const size_t phase = shard->phase.fetch_add(1);
+      while (shard->readers[phase & 1].load() != 0) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  // Replaces the buckets of the shard with `size` buckets. Readers
+  // might be walking the old buckets so we copy all of the entries
+  // rather than relink them.
+  Buckets* resize(Shard* shard, size_t size)
+  {
+    Buckets* buckets = shard->buckets.load();
+    Buckets* resized = new Buckets(size);
+
+    for (size_t i = 0; i < buckets->size; i++) {
+      for (Entry* entry = buckets->bucket(i).load();
+           entry != nullptr;
+           entry = entry->next.load()) {
+        std::atomic<Entry*>& head = resized->bucket(entry->hash / SHARDS);
+
+        Entry* copy =
+          new Entry(entry->hash, entry->id, entry->process, entry->reference);
+        copy->terminating.store(entry->terminating.load());
+        copy->next.store(head.load());
+        head.store(copy);
+      }
+    }
+
+    shard->buckets.store(resized);
+
+    synchronize(shard);
+    release(buckets);
+
+    return resized;
+  }
+
+  static void release(Buckets* buckets)
+  {
+    for (size_t i = 0; i < buckets->size; i++) {
+      Entry* entry = buckets->bucket(i).load();
+      while (entry != nullptr) {
+        Entry* next = entry->next.load();
+        delete entry;
+        entry = next;
+      }
+    }
+    delete buckets;
+  }
+
+  std::array<Shard, SHARDS> shards;
+
+  // Total number of processes, only accessed by writers.
+  size_t size = 0;
+};
+
+} // namespace process {
+
+#endif // __PROCESS_PROCESS_TABLE_HPP__
@@ -17,7 +17,8 @@
 #include <sys/wait.h>
 #endif
 
-#include <process/delay.hpp>
+#include <process/clock.hpp>
+#include <process/defer.hpp>
 #include <process/future.hpp>
 #include <process/id.hpp>
 #include <process/once.hpp>
@@ -109,7 +110,10 @@ void ReaperProcess::wait()
     }
   }
 
-  delay(interval(), self(), &ReaperProcess::wait); // Reap forever!
+  // Reap forever! Polling a tenth of the interval late is fine.
+  const Duration duration = interval();
+
+  Clock::timer(duration, duration / 10, defer(self(), &ReaperProcess::wait));
 }
 
 
@@ -16,8 +16,9 @@
 // At _configuration_ (i.e., build) time you can specify a few
 // optimizations:
 //
-//  (1) --enable-lock-free-run-queue (autotools) or
-//      -DENABLE_LOCK_FREE_RUN_QUEUE (cmake) which enables the
+//  (1) --enable-lock-free-run-queue (autotools),
+//      -DENABLE_LOCK_FREE_RUN_QUEUE (cmake) or
+//      --define=lock_free_run_queue=true (Bazel) which enables the
 //      lock-free run queue implementation (see below for more details).
 //
 //  (2) --enable-last-in-first-out-fixed-size-semaphore (autotools) or
@@ -31,22 +32,51 @@
 // We choose to make these _compile-time_ decisions rather than
 // _runtime_ decisions because we wanted the run queue implementation
 // to be compile-time optimized (e.g., inlined, etc).
+//
+// In addition to the global `RunQueue` there is also a
+// `WorkStealingRunQueue` which gives every worker thread its own
+// queue. Which of the two gets used is a _runtime_ decision made at
+// `process::initialize` time via the `LIBPROCESS_RUN_QUEUE`
+// environment variable (see `ProcessManager::init_threads`).
+//
+// Both run queues put idle workers to sleep using a
+// `DecomissionableAdaptiveSemaphore` on top of the semaphore chosen
+// above, which can be configured at runtime to spin for a while
+// before sleeping (see `LIBPROCESS_WORKER_IDLE_STRATEGY`).
 
 #ifdef LOCK_FREE_RUN_QUEUE
 #include <concurrentqueue.h>
 #endif // LOCK_FREE_RUN_QUEUE
 
 #include <algorithm>
+#include <deque>
 #include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <process/process.hpp>
 
+#include <stout/check.hpp>
+#include <stout/duration.hpp>
+#include <stout/option.hpp>
 #include <stout/synchronized.hpp>
 
+#include "memory_pool.hpp"
 #include "semaphore.hpp"
 
 namespace process {
 
+// Semaphore used by the run queues for idle threads to wait.
+#ifndef LAST_IN_FIRST_OUT_FIXED_SIZE_SEMAPHORE
+typedef DecomissionableAdaptiveSemaphore<DecomissionableKernelSemaphore>
+  RunQueueSemaphore;
+#else
+typedef DecomissionableAdaptiveSemaphore<
+    DecomissionableLastInFirstOutFixedSizeSemaphore> RunQueueSemaphore;
+#endif // LAST_IN_FIRST_OUT_FIXED_SIZE_SEMAPHORE
+
 #ifndef LOCK_FREE_RUN_QUEUE
 class RunQueue
 {
@@ -68,9 +98,9 @@ public:
     return false;
   }
 
-  void wait()
+  RunQueueSemaphore::Wakeup wait()
   {
-    semaphore.wait();
+    return semaphore.wait();
   }
 
   void enqueue(ProcessBase* process)
@@ -115,6 +145,12 @@ public:
     return semaphore.capacity();
   }
 
+  // See `DecomissionableAdaptiveSemaphore::configure`.
+  void configure(const Duration& budget, size_t spinners)
+  {
+    semaphore.configure(budget, spinners);
+  }
+
   // Epoch used to capture changes to the run queue when settling.
   std::atomic_long epoch = ATOMIC_VAR_INIT(0L);
 
@@ -123,33 +159,104 @@ private:
   std::mutex mutex;
 
   // Semaphore used for threads to wait.
-#ifndef LAST_IN_FIRST_OUT_FIXED_SIZE_SEMAPHORE
-  DecomissionableKernelSemaphore semaphore;
-#else
-  DecomissionableLastInFirstOutFixedSizeSemaphore semaphore;
-#endif // LAST_IN_FIRST_OUT_FIXED_SIZE_SEMAPHORE
+  RunQueueSemaphore semaphore;
 };
 
 #else // LOCK_FREE_RUN_QUEUE
 
+// Entry in the lock-free run queue for a process.
+//
+// moodycamel::ConcurrentQueue does not provide a way to remove an
+// arbitrary item, so in order to `extract` a process we instead
+// "claim" its ticket, which leaves a stale ticket in the queue that
+// gets skipped (and deleted) once a worker dequeues it. A ticket is
+// referenced by the queue and by the process it was enqueued for
+// (see `ProcessBase::ticket`) and gets deleted once both of those
+// references have been released. The process's reference gets
+// released by whoever takes the ticket off of the process, either a
+// worker that claimed the ticket or `extract`. Since a stale ticket
+// may outlive its process a worker must only ever dereference the
+// process after having claimed the ticket.
+struct RunQueueTicket
+{
+  explicit RunQueueTicket(ProcessBase* _process) : process(_process) {}
+
+  // A ticket gets allocated for every enqueue so, like events, they
+  // get allocated from the `MemoryPool`.
+  static void* operator new(size_t size)
+  {
+    return MemoryPool::allocate(size);
+  }
+
+  static void operator delete(void* pointer, size_t size)
+  {
+    MemoryPool::deallocate(pointer, size);
+  }
+
+  // Returns true if this is the first and only claim of the ticket.
+  bool claim()
+  {
+    return !claimed.exchange(true);
+  }
+
+  void release()
+  {
+    if (references.fetch_sub(1) == 1) {
+      delete this;
+    }
+  }
+
+  ProcessBase* const process;
+
+  std::atomic<bool> claimed = ATOMIC_VAR_INIT(false);
+  std::atomic<int> references = ATOMIC_VAR_INIT(2);
+};
+
+
 class RunQueue
 {
 public:
-  bool extract(ProcessBase*)
+  ~RunQueue()
   {
-    // NOTE: moodycamel::ConcurrentQueue does not provide a way to
-    // implement extract so we simply return false here.
-    return false;
+    // Release the queue's reference to any tickets still enqueued.
+    RunQueueTicket* ticket = nullptr;
+    while (queue.try_dequeue(ticket)) {
+      ticket->release();
+    }
   }
 
-  void wait()
+  bool extract(ProcessBase* process)
+  {
+    // Take the ticket off of the process, if it hasn't already been
+    // taken off by a worker that dequeued it, and then try and claim
+    // it before a worker does.
+    RunQueueTicket* ticket = process->ticket.exchange(nullptr);
+
+    if (ticket == nullptr) {
+      return false;
+    }
+
+    bool claimed = ticket->claim();
+
+    ticket->release();
+
+    return claimed;
+  }
+
+  RunQueueSemaphore::Wakeup wait()
   {
-    semaphore.wait();
+    return semaphore.wait();
   }
 
   void enqueue(ProcessBase* process)
   {
-    queue.enqueue(process);
+    RunQueueTicket* ticket = new RunQueueTicket(process);
+
+    // A process can only be enqueued once it has been dequeued (or
+    // extracted) which always takes the ticket off of the process.
+    CHECK(process->ticket.exchange(ticket) == nullptr);
+
+    queue.enqueue(ticket);
     epoch.fetch_add(1);
     semaphore.signal();
   }
@@ -157,20 +264,43 @@ public:
   // Precondition: `wait` must get called before `dequeue`!
   ProcessBase* dequeue()
   {
-    // NOTE: we loop _forever_ until we actually dequeue a process
+    // NOTE: we loop _forever_ until we actually dequeue a ticket
     // because the contract for using the run queue is that `wait`
     // must be called first so we know that there is something to be
     // dequeued or the run queue has been decommissioned and we should
     // just return `nullptr`.
-    ProcessBase* process = nullptr;
-    while (!queue.try_dequeue(process)) {
+    RunQueueTicket* ticket = nullptr;
+    while (!queue.try_dequeue(ticket)) {
       if (semaphore.decomissioned()) {
-        break;
+        return nullptr;
       }
     }
+
+    // Just like the locking `RunQueue` we return `nullptr` if the
+    // process was extracted.
+    ProcessBase* process = nullptr;
+
+    if (ticket->claim()) {
+      process = ticket->process;
+
+      // Take the ticket off of the process unless `extract` has
+      // already taken it (and failed to claim it), in which case it
+      // releases the process's reference instead.
+      RunQueueTicket* expected = ticket;
+      if (process->ticket.compare_exchange_strong(expected, nullptr)) {
+        ticket->release();
+      }
+    }
+
+    ticket->release();
+
     return process;
   }
 
+  // NOTE: this includes any stale tickets of extracted processes but
+  // since each of those will get dequeued by a worker (because each
+  // was signaled for when it was enqueued) `Clock::settle` will still
+  // make progress.
   bool empty() const
   {
     return queue.size_approx() == 0;
@@ -186,21 +316,203 @@ public:
     return semaphore.capacity();
   }
 
+  // See `DecomissionableAdaptiveSemaphore::configure`.
+  void configure(const Duration& budget, size_t spinners)
+  {
+    semaphore.configure(budget, spinners);
+  }
+
   // Epoch used to capture changes to the run queue when settling.
   std::atomic_long epoch = ATOMIC_VAR_INIT(0L);
 
 private:
-  moodycamel::ConcurrentQueue<ProcessBase*> queue;
+  moodycamel::ConcurrentQueue<RunQueueTicket*> queue;
 
-#ifndef LAST_IN_FIRST_OUT_FIXED_SIZE_SEMAPHORE
-  DecomissionableKernelSemaphore semaphore;
-#else
-  DecomissionableLastInFirstOutFixedSizeSemaphore semaphore;
-#endif // LAST_IN_FIRST_OUT_FIXED_SIZE_SEMAPHORE
+  RunQueueSemaphore semaphore;
 };
 
 #endif // LOCK_FREE_RUN_QUEUE
 
+
+// A run queue that gives each worker thread its own queue of
+// processes. A worker first tries to dequeue from its own queue and
+// if that is empty it tries to "steal" from the other workers'
+// queues. Processes enqueued by a worker thread go onto that worker's
+// queue and processes enqueued by any other thread (e.g., the event
+// loop or a non-libprocess thread) are spread round-robin across all
+// of the queues. This replaces the one mutex that every worker
+// contends on with the global `RunQueue` with a mutex per worker that
+// is mostly only contended when stealing.
+//
+// We still use a single semaphore to put idle workers to sleep. Every
+// `enqueue` signals the semaphore exactly once and every worker
+// `wait`s exactly once before it tries to `dequeue` so there are
+// always at least as many processes across all of the queues as there
+// are workers that have returned from `wait` and not yet dequeued,
+// except for processes that got removed via `extract` (in which case
+// `dequeue` returns `nullptr`, just like the `RunQueue`).
+class WorkStealingRunQueue
+{
+public:
+  // Creates a queue for each of the specified number of workers. Must
+  // be called exactly once before any process gets enqueued.
+  void initialize(size_t workers)
+  {
+    CHECK(queues.empty());
+    CHECK_GT(workers, 0u);
+
+    queues.reserve(workers);
+    for (size_t i = 0; i < workers; i++) {
+      queues.emplace_back(new Queue());
+    }
+  }
+
+  bool extract(ProcessBase* process)
+  {
+    for (const std::unique_ptr<Queue>& queue : queues) {
+      synchronized (queue->mutex) {
+        std::deque<ProcessBase*>::iterator it = std::find(
+            queue->processes.begin(),
+            queue->processes.end(),
+            process);
+
+        if (it != queue->processes.end()) {
+          queue->processes.erase(it);
+
+          // The process was signaled for when it was enqueued, see
+          // `dequeue` for how that signal gets accounted for.
+          stale.fetch_add(1);
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  RunQueueSemaphore::Wakeup wait()
+  {
+    return semaphore.wait();
+  }
+
+  // Enqueues the process onto the queue of `worker` if this is being
+  // called from a worker thread, otherwise onto the next queue in
+  // round-robin order.
+  void enqueue(ProcessBase* process, const Option<size_t>& worker)
+  {
+    CHECK(!queues.empty());
+
+    Queue* queue = worker.isSome()
+      ? queues[worker.get()].get()
+      : queues[next.fetch_add(1) % queues.size()].get();
+
+    synchronized (queue->mutex) {
+      queue->processes.push_back(process);
+    }
+
+    epoch.fetch_add(1);
+    semaphore.signal();
+  }
+
+  // Precondition: `wait` must get called before `dequeue`!
+  ProcessBase* dequeue(size_t worker)
+  {
+    CHECK_LT(worker, queues.size());
+
+    // NOTE: `wait` consumed a signal for a process that has been
+    // enqueued, so we keep looking until we dequeue a process (or the
+    // run queue has been decomissioned). A single pass over the queues
+    // is not enough: another worker might steal "our" process from a
+    // queue we haven't looked at yet while the process it was signaled
+    // for lands in a queue we have already looked at, and returning
+    // `nullptr` would then leave that process without a signal. The
+    // only exception are the signals of extracted processes, which we
+    // take over when we find nothing to dequeue.
+    while (!semaphore.decomissioned()) {
+      // Start with our own queue and then try and steal from the other
+      // queues in order so that two thieves don't always end up
+      // contending on the same queue.
+      for (size_t i = 0; i < queues.size(); i++) {
+        Queue* queue = queues[(worker + i) % queues.size()].get();
+
+        synchronized (queue->mutex) {
+          if (!queue->processes.empty()) {
+            ProcessBase* process = queue->processes.front();
+            queue->processes.pop_front();
+            return process;
+          }
+        }
+      }
+
+      size_t extracted = stale.load();
+      while (extracted > 0) {
+        if (stale.compare_exchange_weak(extracted, extracted - 1)) {
+          return nullptr;
+        }
+      }
+
+      std::this_thread::yield();
+    }
+
+    return nullptr;
+  }
+
+  // NOTE: this function can't be const because `synchronized (mutex)`
+  // is not const ...
+  bool empty()
+  {
+    for (const std::unique_ptr<Queue>& queue : queues) {
+      synchronized (queue->mutex) {
+        if (!queue->processes.empty()) {
+          return false;
+        }
+      }
+    }
+
+    return true;
+  }
+
+  void decomission()
+  {
+    semaphore.decomission();
+  }
+
+  size_t capacity() const
+  {
+    return semaphore.capacity();
+  }
+
+  // See `DecomissionableAdaptiveSemaphore::configure`.
+  void configure(const Duration& budget, size_t spinners)
+  {
+    semaphore.configure(budget, spinners);
+  }
+
+  // Epoch used to capture changes to the run queue when settling.
+  std::atomic_long epoch = ATOMIC_VAR_INIT(0L);
+
+private:
+  // Each queue is allocated separately so that the mutexes of
+  // different workers are unlikely to share a cache line.
+  struct Queue
+  {
+    std::deque<ProcessBase*> processes;
+    std::mutex mutex;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+
+  // Used to spread processes enqueued by non-worker threads.
+  std::atomic<size_t> next = ATOMIC_VAR_INIT(0);
+
+  // Number of signals of extracted processes that no worker has taken
+  // over yet, see `dequeue`.
+  std::atomic<size_t> stale = ATOMIC_VAR_INIT(0);
+
+  // Semaphore used for threads to wait.
+  RunQueueSemaphore semaphore;
+};
+
 } // namespace process {
 
 #endif // __PROCESS_RUN_QUEUE_HPP__
@@ -21,10 +21,13 @@
 #include <semaphore.h>
 #endif // __MACH__
 
-#include <stout/check.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
-// TODO(benh): Introduce a user-level semaphore that _only_ traps into
-// the kernel if the thread would actually need to wait.
+#include <stout/check.hpp>
+#include <stout/duration.hpp>
 
 // TODO(benh): Add tests for these!
 
@@ -232,7 +235,10 @@ private:
 // used to wait on the actual semaphore. Because a thread can only be
 // waiting on a single semaphore at a time it's safe for each thread
 // to only have one.
-thread_local KernelSemaphore* __semaphore__ = nullptr;
+//
+// NOTE: this is `static` so that this header can be included in more
+// than one translation unit (e.g., in benchmarks).
+static thread_local KernelSemaphore* __semaphore__ = nullptr;
 
 // Using Clang we weren't able to initialize `__semaphore__` likely
 // because it is declared `thread_local` so instead we dereference the
@@ -415,4 +421,218 @@ private:
   std::array<std::atomic<KernelSemaphore*>, THREADS> semaphores;
 };
 
+
+// A user-level semaphore layered on top of one of the semaphores
+// above which _only_ traps into the kernel if a waiter actually needs
+// to sleep or a signaler actually needs to wake up a sleeping waiter.
+//
+// `count` is the number of available "units of resource" when it is
+// positive and the (negated) number of waiters that have committed to
+// parking in the underlying semaphore when it is negative. This means
+// that while every waiter is either busy or spinning a `signal()` is
+// just an atomic increment and never a syscall.
+//
+// Once configured with a non-zero spin budget a waiter first spins,
+// and then yields, for a bounded amount of time in the hopes that a
+// "unit of resource" shows up before it parks. Spinning burns CPU so
+// the time spent spinning adapts: it gets doubled (up to the budget)
+// every time spinning pays off and halved every time a waiter ends up
+// parking anyway. We also bound the number of threads spinning at
+// once so that an otherwise idle system doesn't have every one of its
+// threads spinning.
+template <typename Semaphore>
+class DecomissionableAdaptiveSemaphore
+{
+public:
+  // Describes how a call to `wait()` returned.
+  struct Wakeup
+  {
+    // Whether a "unit of resource" was acquired while spinning.
+    bool spun = false;
+
+    // Whether the waiter had to park (i.e., sleep in the kernel).
+    bool parked = false;
+
+    // For a parked waiter, the time from the last `signal()` that had
+    // to wake up a parked waiter until this waiter was running again.
+    // When many waiters get woken up at once this is an approximation
+    // since we only keep track of the last such `signal()`.
+    Duration latency = Duration::zero();
+  };
+
+  // Sets how long waiters may spin before parking and how many may
+  // spin at once. Must be called before any thread waits. A zero
+  // `budget` (the default) means waiters park right away.
+  void configure(const Duration& budget, size_t spinners)
+  {
+    CHECK_GE(budget, Duration::zero());
+
+    maximum = budget.ns();
+    spin.store(maximum);
+    max_spinners = spinners;
+  }
+
+  void signal()
+  {
+    if (count.fetch_add(1) < 0) {
+      signaled.store(now());
+      semaphore.signal();
+    }
+  }
+
+  Wakeup wait()
+  {
+    Wakeup wakeup;
+
+    // Whether or not we spun, successfully or not.
+    bool spun = false;
+
+    if (maximum > 0) {
+      if (spinning.fetch_add(1) < max_spinners) {
+        spun = true;
+        wakeup.spun = _spin();
+      }
+
+      spinning.fetch_sub(1);
+
+      if (wakeup.spun) {
+        spin.store(std::min(maximum, spin.load() * 2));
+        return wakeup;
+      }
+    }
+
+    if (count.fetch_sub(1) > 0) {
+      return wakeup;
+    }
+
+    if (spun) {
+      spin.store(std::max(maximum / MINIMUM_SPIN_DIVISOR, spin.load() / 2));
+    }
+
+    semaphore.wait();
+
+    // NOTE: the underlying semaphore doesn't wait once it has been
+    // decomissioned so we don't count that as having parked.
+    if (!semaphore.decomissioned()) {
+      wakeup.parked = true;
+      wakeup.latency = Nanoseconds(std::max<int64_t>(
+          0, now() - signaled.load()));
+    }
+
+    return wakeup;
+  }
+
+  void decomission()
+  {
+    // NOTE: any waiters parked in the underlying semaphore are
+    // accounted for by it and any waiters that are spinning will
+    // notice the semaphore has been decomissioned and stop.
+    semaphore.decomission();
+  }
+
+  bool decomissioned() const
+  {
+    return semaphore.decomissioned();
+  }
+
+  size_t capacity() const
+  {
+    return semaphore.capacity();
+  }
+
+private:
+  // Lower bound on the adapted spin time, as a fraction of `maximum`.
+  static constexpr int64_t MINIMUM_SPIN_DIVISOR = 16;
+
+  // Number of times a waiter yields after spinning before it parks.
+  static constexpr size_t YIELDS = 8;
+
+  // Number of spins between checking if the spin time has elapsed so
+  // that we don't read the clock on every spin.
+  static constexpr size_t SPINS_PER_CLOCK_CHECK = 64;
+
+  static int64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static void relax()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+  // Tries to acquire a "unit of resource" without ever making `count`
+  // negative, i.e., without committing to park.
+  bool acquire()
+  {
+    int64_t old = count.load();
+    while (old > 0) {
+      if (count.compare_exchange_weak(old, old - 1)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Spins and then yields until either a "unit of resource" has been
+  // acquired, the spin time has elapsed, or the semaphore has been
+  // decomissioned. Returns whether or not a unit was acquired.
+  bool _spin()
+  {
+    const int64_t deadline = now() + spin.load();
+
+    for (size_t spins = 1;; spins++) {
+      if (acquire()) {
+        return true;
+      } else if (semaphore.decomissioned()) {
+        return false;
+      }
+
+      relax();
+
+      if (spins % SPINS_PER_CLOCK_CHECK == 0 && now() >= deadline) {
+        break;
+      }
+    }
+
+    for (size_t i = 0; i < YIELDS; i++) {
+      if (acquire()) {
+        return true;
+      } else if (semaphore.decomissioned()) {
+        return false;
+      }
+
+      std::this_thread::yield();
+    }
+
+    return acquire();
+  }
+
+  // Count of available "units of resource" if positive, or the
+  // negated number of parked waiters if negative.
+  std::atomic<int64_t> count = ATOMIC_VAR_INIT(0);
+
+  // Number of threads currently spinning in `wait()`.
+  std::atomic<size_t> spinning = ATOMIC_VAR_INIT(0);
+
+  // Current (adapted) amount of time in nanoseconds to spin for.
+  std::atomic<int64_t> spin = ATOMIC_VAR_INIT(0);
+
+  // Time (see `now()`) of the last `signal()` that woke up a waiter.
+  std::atomic<int64_t> signaled = ATOMIC_VAR_INIT(0);
+
+  // Configured spin budget in nanoseconds and number of threads that
+  // may spin at once. Only set in `configure()`.
+  int64_t maximum = 0;
+  size_t max_spinners = 0;
+
+  // Semaphore used for waiters to park.
+  Semaphore semaphore;
+};
+
 #endif // __PROCESS_SEMAPHORE_HPP__
@@ -10,10 +10,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License
 
+#include <algorithm>
 #include <memory>
 #include <string>
-
-#include <boost/shared_array.hpp>
+#include <vector>
 
 #include <process/io.hpp>
 #include <process/loop.hpp>
@@ -26,6 +26,8 @@
 #include <stout/os.hpp>
 #include <stout/unreachable.hpp>
 
+#include "buffer_pool.hpp"
+
 #ifdef USE_SSL_SOCKET
 #include "posix/libevent/libevent_ssl_socket.hpp"
 #endif
@@ -144,51 +146,82 @@ Try<Address> SocketImpl::bind(const Address& address)
 
 Future<string> SocketImpl::recv(const Option<ssize_t>& size)
 {
+  if (size.isSome() && size.get() == 0) {
+    return string();
+  }
+
   // Extend lifetime by holding onto a reference to ourself!
   auto self = shared_from_this();
 
-  // Default chunk size to attempt to receive when nothing is
-  // specified represents roughly 16 pages.
-  static const size_t DEFAULT_CHUNK = 16 * os::pagesize();
-
-  const size_t chunk = (size.isNone() || size.get() < 0)
-    ? DEFAULT_CHUNK
-    : size.get();
-
-  boost::shared_array<char> data(new char[chunk]);
-  string buffer;
+  std::shared_ptr<string> buffer(new string());
 
+  // We only borrow a buffer from the pool to receive into while there
+  // is data to receive, and give it back as soon as we've copied the
+  // data we received out of it.
   return loop(
       None(),
-      [=]() {
-        return self->recv(data.get(), chunk);
+      [=]() -> Future<size_t> {
+        size_t chunk = BufferPool::SIZE;
+        if (size.isSome() && size.get() > 0) {
+          chunk = std::min(
+              chunk, static_cast<size_t>(size.get()) - buffer->size());
+        }
+
+        // Try to receive without waiting first, see `BufferPool::recv`.
+        char* borrowed = BufferPool::acquire();
+
+        Try<Option<size_t>> received = self->try_recv(borrowed, chunk);
+
+        if (received.isSome() && received->isSome()) {
+          buffer->append(borrowed, received->get());
+        }
+
+        BufferPool::release(borrowed);
+
+        if (received.isError()) {
+          return Failure(received.error());
+        } else if (received->isSome()) {
+          return received->get();
+        }
+
+        return self->readable()
+          .then([=]() {
+            char* data = BufferPool::acquire();
+
+            return self->recv(data, chunk)
+              .then([=](size_t length) {
+                buffer->append(data, length);
+                return length;
+              })
+              .onAny([=]() {
+                BufferPool::release(data);
+              });
+          });
       },
-      [=](size_t length) mutable -> ControlFlow<string> {
+      [=](size_t length) -> ControlFlow<string> {
         if (length == 0) { // EOF.
           // Return everything we've received thus far, a subsequent
           // receive will return an empty string.
-          return Break(std::move(buffer));
+          return Break(std::move(*buffer));
         }
 
-        buffer.append(data.get(), length);
-
         if (size.isNone()) {
           // We've been asked just to return any data that we receive!
-          return Break(std::move(buffer));
+          return Break(std::move(*buffer));
         } else if (size.get() < 0) {
           // We've been asked to receive until EOF so keep receiving
           // since according to the 'length == 0' check above we
           // haven't reached EOF yet.
           return Continue();
         } else if (
-            static_cast<string::size_type>(size.get()) > buffer.size()) {
+            static_cast<string::size_type>(size.get()) > buffer->size()) {
           // We've been asked to receive a particular amount of data and we
           // haven't yet received that much data so keep receiving.
           return Continue();
         }
 
         // We've received as much data as requested, so return that data!
-        return Break(std::move(buffer));
+        return Break(std::move(*buffer));
       });
 }
 
@@ -218,6 +251,26 @@ Future<Nothing> SocketImpl::send(const string& data)
       });
 }
 
+
+Future<size_t> SocketImpl::send(const std::vector<Buffer>& buffers)
+{
+  CHECK(!buffers.empty());
+
+  return send(buffers.front().data, buffers.front().size);
+}
+
+
+Future<Nothing> SocketImpl::readable()
+{
+  return Nothing();
+}
+
+
+Try<Option<size_t>> SocketImpl::try_recv(char* data, size_t size)
+{
+  return None();
+}
+
 } // namespace internal {
 } // namespace network {
 } // namespace process {
@@ -13,6 +13,7 @@
 #ifndef __PROCESS_SOCKET_MANAGER_HPP__
 #define __PROCESS_SOCKET_MANAGER_HPP__
 
+#include <deque>
 #include <mutex>
 #include <queue>
 
@@ -81,6 +82,18 @@ public:
 
   Encoder* next(int_fd s);
 
+  // Moves data encoders queued for the socket onto the back of
+  // `encoders` (unless it ends with a file encoder) for as long as
+  // they have less than `bytes` left to send in total, so that they
+  // can be sent with a single write. Unlike `next` this never cleans
+  // up the socket if there are no more queued encoders.
+  void coalesce(int_fd s, size_t bytes, std::deque<Encoder*>* encoders);
+
+  // Records whether or not the peer at the specified address accepts
+  // messages using the binary framing (see `BinaryMessageEncoder`),
+  // which we'll use for any new connection to it.
+  void set_binary_framing(const network::inet::Address& address, bool binary);
+
   void close(int_fd s);
 
   void exited(const network::inet::Address& address);
@@ -121,6 +134,10 @@ private:
       network::inet::Socket socket,
       Message&& message);
 
+  // Returns an encoder for the message using the framing of the
+  // outbound socket.
+  Encoder* encode(int_fd s, Message&& message);
+
   // Collection of all active sockets (both inbound and outbound).
   hashmap<int_fd, network::inet::Socket> sockets;
 
@@ -143,6 +160,12 @@ private:
   // (and thus generate ExitedEvents).
   hashmap<network::inet::Address, int_fd> persists;
 
+  // Addresses of the peers that accept the binary framing, and the
+  // outbound sockets that use it. The framing of a socket is decided
+  // when it is created and never changes.
+  hashset<network::inet::Address> binary_peers;
+  hashset<int_fd> binary_sockets;
+
   // Map from outbound socket to outgoing queue.
   hashmap<int_fd, std::queue<Encoder*>> outgoing;
 
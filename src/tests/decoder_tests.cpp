@@ -18,18 +18,24 @@
 #include <process/gtest.hpp>
 #include <process/owned.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
+#include <stout/ip.hpp>
 
 #include "decoder.hpp"
 
 namespace http = process::http;
 
+using process::BinaryMessageDecoder;
+using process::BinaryMessageEncoder;
 using process::DataDecoder;
 using process::Future;
+using process::Message;
 using process::Owned;
 using process::ResponseDecoder;
 using process::StreamingRequestDecoder;
 using process::StreamingResponseDecoder;
+using process::UPID;
 
 using std::deque;
 using std::string;
@@ -134,6 +140,46 @@ TYPED_TEST(RequestDecoderTest, HeaderCaseInsensitive)
 }
 
 
+// Tests that headers get decoded when split across reads, and that
+// the headers of a request don't leak into the next one.
+TYPED_TEST(RequestDecoderTest, SplitHeaders)
+{
+  TypeParam decoder;
+
+  const string data =
+    "GET /path/file.json HTTP/1.1\r\n"
+    "host: localhost\r\n"
+    "X-Custom: value\r\n"
+    "x-custom: overwritten\r\n"
+    "\r\n"
+    "GET /path/file.json HTTP/1.1\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+  deque<http::Request*> requests;
+
+  foreach (char c, data) {
+    deque<http::Request*> decoded = decoder.decode(&c, 1);
+    ASSERT_FALSE(decoder.failed());
+    requests.insert(requests.end(), decoded.begin(), decoded.end());
+  }
+
+  ASSERT_EQ(2u, requests.size());
+
+  Owned<http::Request> request1(requests[0]);
+  Owned<http::Request> request2(requests[1]);
+
+  EXPECT_EQ(2u, request1->headers.size());
+  EXPECT_SOME_EQ("localhost", request1->headers.get("Host"));
+  EXPECT_SOME_EQ("overwritten", request1->headers.get("X-Custom"));
+  EXPECT_TRUE(request1->keepAlive);
+
+  EXPECT_EQ(1u, request2->headers.size());
+  EXPECT_SOME_EQ("close", request2->headers.get("Connection"));
+  EXPECT_FALSE(request2->keepAlive);
+}
+
+
 TYPED_TEST(RequestDecoderTest, InvalidQueryArgs)
 {
   TypeParam decoder;
@@ -325,3 +371,112 @@ TEST(DecoderTest, StreamingResponseInvalidHeader)
 
   EXPECT_TRUE(decoder.failed());
 }
+
+
+TEST(DecoderTest, BinaryMessage)
+{
+  BinaryMessageDecoder decoder;
+
+  Message message1;
+  message1.name = "name";
+  message1.from = UPID("from", net::IP(INADDR_LOOPBACK), 1234);
+  message1.to = UPID("to", net::IP(INADDR_LOOPBACK), 5678);
+  message1.body = string("body\0with\0nulls", 15);
+
+  Message message2;
+  message2.name = "empty";
+  message2.from = message1.from;
+  message2.to = message1.to;
+
+  const string data =
+    BinaryMessageEncoder::encode(message1) +
+    BinaryMessageEncoder::encode(message2);
+
+  // Feed the decoder one byte at a time to make sure it waits for
+  // frames to be complete.
+  deque<Message*> messages;
+  for (size_t i = 0; i < data.size(); i++) {
+    foreach (Message* message, decoder.decode(data.data() + i, 1)) {
+      messages.push_back(message);
+    }
+    ASSERT_FALSE(decoder.failed());
+  }
+
+  ASSERT_EQ(2u, messages.size());
+
+  Owned<Message> decoded1(messages[0]);
+  EXPECT_EQ(message1.name, decoded1->name);
+  EXPECT_EQ(message1.from, decoded1->from);
+  EXPECT_EQ(message1.to.id, decoded1->to.id);
+  EXPECT_EQ(message1.body, decoded1->body);
+
+  Owned<Message> decoded2(messages[1]);
+  EXPECT_EQ(message2.name, decoded2->name);
+  EXPECT_EQ(message2.from, decoded2->from);
+  EXPECT_EQ(message2.to.id, decoded2->to.id);
+  EXPECT_EQ("", decoded2->body);
+}
+
+
+TEST(DecoderTest, BinaryMessageInvalid)
+{
+  BinaryMessageDecoder decoder;
+
+  // An HTTP request is not a valid frame.
+  const string data =
+    "POST /to/name HTTP/1.1\r\n"
+    "Libprocess-From: from@127.0.0.1:1234\r\n"
+    "\r\n";
+
+  deque<Message*> messages = decoder.decode(data.data(), data.length());
+  EXPECT_TRUE(messages.empty());
+  EXPECT_TRUE(decoder.failed());
+}
+
+
+TEST(DecoderTest, BinaryMessageTooLarge)
+{
+  Message message;
+  message.name = "name";
+  message.from = UPID("from", net::IP(INADDR_LOOPBACK), 1234);
+  message.to = UPID("to", net::IP(INADDR_LOOPBACK), 5678);
+  message.body = string(1024, 'x');
+
+  const string data = BinaryMessageEncoder::encode(message);
+
+  // A frame that fits is decoded as usual.
+  {
+    BinaryMessageDecoder decoder(data.size());
+
+    deque<Message*> messages = decoder.decode(data.data(), data.length());
+    EXPECT_FALSE(decoder.failed());
+    ASSERT_EQ(1u, messages.size());
+
+    delete messages[0];
+  }
+
+  // A frame that exceeds the maximum size fails as soon as its header
+  // arrives rather than after buffering the whole frame.
+  {
+    BinaryMessageDecoder decoder(data.size() - 1);
+
+    deque<Message*> messages = decoder.decode(
+        data.data(), BinaryMessageEncoder::HEADER_SIZE);
+
+    EXPECT_TRUE(messages.empty());
+    EXPECT_TRUE(decoder.failed());
+  }
+
+  // The same holds for the default maximum size: a header announcing
+  // the largest possible body fails without waiting for the body.
+  {
+    string header = data.substr(0, BinaryMessageEncoder::HEADER_SIZE);
+    header.replace(14, 4, "\xff\xff\xff\xff");
+
+    BinaryMessageDecoder decoder;
+
+    deque<Message*> messages = decoder.decode(header.data(), header.length());
+    EXPECT_TRUE(messages.empty());
+    EXPECT_TRUE(decoder.failed());
+  }
+}
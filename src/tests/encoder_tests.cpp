@@ -12,6 +12,7 @@
 
 #include <gmock/gmock.h>
 
+#include <algorithm>
 #include <deque>
 #include <string>
 #include <vector>
@@ -21,15 +22,25 @@
 #include <process/socket.hpp>
 
 #include <stout/gtest.hpp>
+#include <stout/ip.hpp>
 
 #include "encoder.hpp"
 #include "decoder.hpp"
 
 namespace http = process::http;
 
+using process::BinaryMessageEncoder;
+using process::DataDecoder;
+using process::DataEncoder;
+using process::HttpChunkEncoder;
+using process::HttpRequestEncoder;
 using process::HttpResponseEncoder;
+using process::Message;
+using process::MessageEncoder;
 using process::Owned;
 using process::ResponseDecoder;
+using process::SHARED_BODY_MINIMUM_LENGTH;
+using process::UPID;
 
 using std::deque;
 using std::string;
@@ -115,3 +126,138 @@ TEST(EncoderTest, AcceptableEncodings)
       << gzipRequest.headers.get("Accept-Encoding").get() << "'";
   }
 }
+
+
+TEST(EncoderTest, Request)
+{
+  http::Request request;
+  request.method = "POST";
+  request.url = http::URL("http", "localhost", 8080, "/path");
+  request.url.query["key"] = "value with spaces";
+  request.keepAlive = false;
+  request.headers["Content-Type"] = "text/plain";
+  request.headers["Content-Length"] = "12345";
+  request.body = "body";
+
+  const string encoded = HttpRequestEncoder::encode(request);
+
+  DataDecoder decoder;
+  deque<http::Request*> requests =
+    decoder.decode(encoded.data(), encoded.length());
+
+  ASSERT_FALSE(decoder.failed());
+  ASSERT_EQ(1u, requests.size());
+
+  Owned<http::Request> decoded(requests[0]);
+  EXPECT_EQ("POST", decoded->method);
+  EXPECT_EQ("/path", decoded->url.path);
+  EXPECT_SOME_EQ("value with spaces", decoded->url.query.get("key"));
+  EXPECT_FALSE(decoded->keepAlive);
+  EXPECT_EQ("body", decoded->body);
+
+  // The supplied 'Content-Length' header must have been overwritten.
+  EXPECT_EQ(4u, decoded->headers.size());
+  EXPECT_SOME_EQ("localhost:8080", decoded->headers.get("Host"));
+  EXPECT_SOME_EQ("close", decoded->headers.get("Connection"));
+  EXPECT_SOME_EQ("4", decoded->headers.get("Content-Length"));
+  EXPECT_SOME_EQ("text/plain", decoded->headers.get("Content-Type"));
+}
+
+
+TEST(EncoderTest, Chunk)
+{
+  EXPECT_EQ("0\r\n\r\n", HttpChunkEncoder::encode(""));
+  EXPECT_EQ("5\r\nhello\r\n", HttpChunkEncoder::encode("hello"));
+
+  const string chunk(0x1a2b, '.');
+  EXPECT_EQ("1a2b\r\n" + chunk + "\r\n", HttpChunkEncoder::encode(chunk));
+}
+
+
+// Returns the rest of the data of the encoder, pretending that the
+// last `unsent` bytes of every call to `next` did not get sent.
+static string drain(DataEncoder* encoder, size_t unsent)
+{
+  string data;
+
+  while (encoder->remaining() > 0) {
+    size_t length;
+    const char* next = encoder->next(&length);
+
+    const size_t backup = std::min(unsent, length - 1);
+    data.append(next, length - backup);
+    encoder->backup(backup);
+  }
+
+  return data;
+}
+
+
+TEST(EncoderTest, Data)
+{
+  DataEncoder encoder("data");
+
+  EXPECT_EQ(4u, encoder.remaining());
+  EXPECT_EQ("data", drain(&encoder, 3));
+  EXPECT_EQ(0u, encoder.remaining());
+
+  // Backing up after everything has been sent resumes at the right
+  // place.
+  encoder.backup(2);
+  EXPECT_EQ(2u, encoder.remaining());
+  EXPECT_EQ("ta", drain(&encoder, 0));
+}
+
+
+// This test verifies that encoding a message with a shared body (i.e.,
+// without copying it) produces the same data as copying the body.
+TEST(EncoderTest, SharedMessageBody)
+{
+  Message message;
+  message.name = "name";
+  message.from = UPID("from", net::IP(INADDR_LOOPBACK), 1234);
+  message.to = UPID("to", net::IP(INADDR_LOOPBACK), 5678);
+  message.body = string(SHARED_BODY_MINIMUM_LENGTH * 2, 'x');
+
+  const string encoded = MessageEncoder::encode(message);
+  const string binary = BinaryMessageEncoder::encode(message);
+
+  const char* body = message.body.data();
+
+  MessageEncoder encoder(Message(message), true);
+  EXPECT_EQ(MessageEncoder::encode(message, true), drain(&encoder, 0));
+
+  // Back up across the segments of the encoder, as happens when a
+  // (vectored) send only sends some of them.
+  MessageEncoder backup{Message(message)};
+  EXPECT_EQ(encoded.size(), backup.remaining());
+
+  size_t size = 0;
+  while (backup.remaining() > 0) {
+    size_t length;
+    backup.next(&length);
+    size += length;
+  }
+
+  EXPECT_EQ(encoded.size(), size);
+
+  backup.backup(encoded.size() - 10);
+  EXPECT_EQ(encoded.substr(10), drain(&backup, 100));
+
+  // The body must be sent from the memory of the moved message.
+  MessageEncoder shared{std::move(message)};
+
+  size_t length;
+  shared.next(&length);
+  EXPECT_EQ(body, shared.next(&length));
+  EXPECT_EQ(SHARED_BODY_MINIMUM_LENGTH * 2, length);
+
+  Message copy;
+  copy.name = "name";
+  copy.from = UPID("from", net::IP(INADDR_LOOPBACK), 1234);
+  copy.to = UPID("to", net::IP(INADDR_LOOPBACK), 5678);
+  copy.body = string(SHARED_BODY_MINIMUM_LENGTH * 2, 'x');
+
+  BinaryMessageEncoder frame{std::move(copy)};
+  EXPECT_EQ(binary, drain(&frame, 100));
+}
@@ -0,0 +1,586 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#include <gmock/gmock.h>
+
+#include <deque>
+#include <string>
+
+#include <process/address.hpp>
+#include <process/future.hpp>
+#include <process/gmock.hpp>
+#include <process/gtest.hpp>
+#include <process/http.hpp>
+#include <process/socket.hpp>
+
+#include <stout/foreach.hpp>
+#include <stout/gtest.hpp>
+#include <stout/none.hpp>
+#include <stout/nothing.hpp>
+#include <stout/option.hpp>
+#include <stout/try.hpp>
+
+#include "hpack.hpp"
+#include "http2.hpp"
+
+namespace hpack = process::http::hpack;
+namespace http = process::http;
+namespace http2 = process::http::http2;
+namespace inet = process::network::inet;
+namespace inet4 = process::network::inet4;
+namespace network = process::network;
+
+using process::Future;
+using process::Promise;
+
+using std::deque;
+using std::string;
+
+using testing::_;
+using testing::DoAll;
+using testing::Return;
+
+
+// Header blocks of the request examples in Appendix C.4 of RFC 7541,
+// which must be encoded (and decoded) in this order.
+static const string BLOCKS[] = {
+  string("\x82\x86\x84\x41\x8c\xf1\xe3\xc2\xe5\xf2\x3a\x6b\xa0\xab\x90\xf4"
+         "\xff", 17),
+  string("\x82\x86\x84\xbe\x58\x86\xa8\xeb\x10\x64\x9c\xbf", 12),
+  string("\x82\x87\x85\xbf\x40\x88\x25\xa8\x49\xe9\x5b\xa9\x7d\x7f\x89\x25"
+         "\xa8\x49\xe9\x5b\xb8\xe8\xb4\xbf", 24),
+};
+
+
+static const hpack::HeaderList HEADERS[] = {
+  {{":method", "GET"},
+   {":scheme", "http"},
+   {":path", "/"},
+   {":authority", "www.example.com"}},
+  {{":method", "GET"},
+   {":scheme", "http"},
+   {":path", "/"},
+   {":authority", "www.example.com"},
+   {"cache-control", "no-cache"}},
+  {{":method", "GET"},
+   {":scheme", "https"},
+   {":path", "/index.html"},
+   {":authority", "www.example.com"},
+   {"custom-key", "custom-value"}},
+};
+
+
+TEST(HpackTest, Encode)
+{
+  hpack::Encoder encoder;
+
+  for (size_t i = 0; i < 3; i++) {
+    string block;
+    encoder.encode(HEADERS[i], &block);
+    EXPECT_EQ(BLOCKS[i], block);
+  }
+}
+
+
+TEST(HpackTest, Decode)
+{
+  hpack::Decoder decoder;
+
+  for (size_t i = 0; i < 3; i++) {
+    Try<hpack::HeaderList> headers = decoder.decode(BLOCKS[i]);
+    ASSERT_SOME(headers);
+    EXPECT_EQ(HEADERS[i], headers.get());
+  }
+
+  // Index 0 is not a valid index.
+  EXPECT_ERROR(hpack::Decoder().decode(string("\x80", 1)));
+
+  // A truncated literal.
+  EXPECT_ERROR(hpack::Decoder().decode(string("\x40\x85\x61", 3)));
+}
+
+
+// Returns a header block that adds a field of about 4KB to the dynamic
+// table and then refers to it with a (1 octet) index 'references'
+// times, i.e., an "HPACK bomb".
+static string bomb(size_t references)
+{
+  // Literal header field with incremental indexing and a new name
+  // "x", followed by the value's length of 4000 (a 7-bit prefix
+  // integer, see section 5.1) and the value.
+  string block("\x40\x01x\x7f\xa1\x1e", 6);
+  block.append(4000, 'a');
+
+  // The field is the first one of the dynamic table, i.e., index 62.
+  block.append(references, '\xbe');
+
+  return block;
+}
+
+
+// Tests that the decoder limits the size of the decoded header list
+// rather than only the size of the header block.
+TEST(HpackTest, HeaderListSize)
+{
+  Try<hpack::HeaderList> headers = hpack::Decoder().decode(bomb(10));
+  ASSERT_SOME(headers);
+  EXPECT_EQ(11u, headers->size());
+
+  EXPECT_ERROR(hpack::Decoder().decode(bomb(1000)));
+
+  // The same limit applies to literal fields.
+  EXPECT_ERROR(hpack::Decoder(1000).decode(bomb(0)));
+}
+
+
+TEST(HpackTest, Huffman)
+{
+  string s;
+  for (int i = 0; i < 256; i++) {
+    s.push_back(static_cast<char>(i));
+  }
+
+  string encoded = hpack::huffman::encode(s);
+  EXPECT_EQ(encoded.size(), hpack::huffman::length(s));
+
+  Try<string> decoded =
+    hpack::huffman::decode(encoded.data(), encoded.size());
+
+  ASSERT_SOME(decoded);
+  EXPECT_EQ(s, decoded.get());
+
+  // Padding that isn't the most significant bits of EOS is an error.
+  EXPECT_ERROR(hpack::huffman::decode("\x00", 1));
+}
+
+
+TEST(Http2Test, FrameDecoder)
+{
+  string data;
+  http2::encode(&data, http2::HEADERS, http2::END_HEADERS, 1, "abc", 3);
+  http2::encode(&data, http2::DATA, http2::END_STREAM, 1, "", 0);
+
+  // Feed the decoder one byte at a time.
+  http2::FrameDecoder decoder;
+  deque<http2::Frame> frames;
+
+  foreach (char c, data) {
+    foreach (http2::Frame& frame, decoder.decode(&c, 1)) {
+      frames.push_back(std::move(frame));
+    }
+  }
+
+  EXPECT_FALSE(decoder.failed());
+  ASSERT_EQ(2u, frames.size());
+
+  EXPECT_EQ(http2::HEADERS, frames[0].type);
+  EXPECT_EQ(http2::END_HEADERS, frames[0].flags);
+  EXPECT_EQ(1u, frames[0].stream);
+  EXPECT_EQ("abc", frames[0].payload);
+
+  EXPECT_EQ(http2::DATA, frames[1].type);
+  EXPECT_EQ(http2::END_STREAM, frames[1].flags);
+  EXPECT_EQ("", frames[1].payload);
+
+  // A frame that is bigger than the maximum frame size.
+  http2::FrameDecoder small(2);
+
+  data.clear();
+  http2::encode(&data, http2::DATA, 0, 1, "abc", 3);
+
+  EXPECT_TRUE(small.decode(data.data(), data.size()).empty());
+  EXPECT_TRUE(small.failed());
+}
+
+
+// Returns the options to create a server that serves HTTP/2.
+static http::Server::CreateOptions http2Options()
+{
+  http::Server::CreateOptions options = http::Server::DEFAULT_CREATE_OPTIONS();
+  options.http2 = true;
+  return options;
+}
+
+
+// Tests that a server answers the connection preface of a client that
+// talks HTTP/2 with prior knowledge with its SETTINGS.
+TEST(Http2ServerTest, Preface)
+{
+  Try<http::Server> server = http::Server::create(
+      inet4::Address::ANY_ANY(),
+      [](const network::Socket&, const http::Request&) {
+        return http::OK();
+      },
+      http2Options());
+
+  ASSERT_SOME(server);
+
+  Future<Nothing> run = server->run();
+
+  Try<inet::Address> address =
+    network::convert<inet::Address>(server->address());
+
+  ASSERT_SOME(address);
+
+  Try<inet::Socket> socket = inet::Socket::create();
+  ASSERT_SOME(socket);
+
+  AWAIT_READY(socket->connect(
+      inet::Address(process::address().ip, address->port)));
+
+  string data(http2::PREFACE, http2::PREFACE_SIZE);
+  http2::encode(&data, http2::SETTINGS, 0, 0, "", 0);
+
+  AWAIT_READY(socket->send(data));
+
+  http2::FrameDecoder decoder;
+  deque<http2::Frame> frames;
+
+  while (frames.empty()) {
+    Future<string> received = socket->recv();
+    AWAIT_READY(received);
+    ASSERT_FALSE(received->empty());
+
+    frames = decoder.decode(received->data(), received->size());
+  }
+
+  EXPECT_EQ(http2::SETTINGS, frames.front().type);
+  EXPECT_EQ(0u, frames.front().flags & http2::ACK);
+
+  AWAIT_EXPECT_READY(server->stop());
+  AWAIT_EXPECT_READY(run);
+}
+
+
+// Tests that a server closes a connection with a COMPRESSION_ERROR
+// when a header block decodes into a header list that exceeds the
+// SETTINGS_MAX_HEADER_LIST_SIZE it advertised.
+TEST(Http2ServerTest, HeaderListSize)
+{
+  Try<http::Server> server = http::Server::create(
+      inet4::Address::ANY_ANY(),
+      [](const network::Socket&, const http::Request&) {
+        return http::OK();
+      },
+      http2Options());
+
+  ASSERT_SOME(server);
+
+  Future<Nothing> run = server->run();
+
+  Try<inet::Address> address =
+    network::convert<inet::Address>(server->address());
+
+  ASSERT_SOME(address);
+
+  Try<inet::Socket> socket = inet::Socket::create();
+  ASSERT_SOME(socket);
+
+  AWAIT_READY(socket->connect(
+      inet::Address(process::address().ip, address->port)));
+
+  // About 4MB of headers in a block of about 5KB.
+  const string block = bomb(1000);
+
+  string data(http2::PREFACE, http2::PREFACE_SIZE);
+  http2::encode(&data, http2::SETTINGS, 0, 0, "", 0);
+  http2::encode(
+      &data,
+      http2::HEADERS,
+      http2::END_HEADERS | http2::END_STREAM,
+      1,
+      block.data(),
+      block.size());
+
+  AWAIT_READY(socket->send(data));
+
+  http2::FrameDecoder decoder;
+  Option<http2::Frame> goaway;
+
+  while (goaway.isNone()) {
+    Future<string> received = socket->recv();
+    AWAIT_READY(received);
+    ASSERT_FALSE(received->empty());
+
+    foreach (const http2::Frame& frame,
+             decoder.decode(received->data(), received->size())) {
+      if (frame.type == http2::GOAWAY) {
+        goaway = frame;
+      }
+    }
+  }
+
+  // The payload is the last stream ID followed by the error code.
+  ASSERT_EQ(8u, goaway->payload.size());
+  EXPECT_EQ(
+      static_cast<char>(http2::COMPRESSION_ERROR),
+      goaway->payload[7]);
+
+  AWAIT_EXPECT_READY(server->stop());
+  AWAIT_EXPECT_READY(run);
+}
+
+
+// Tests that the responses on an HTTP/2 connection get sent as soon
+// as they are ready rather than in the order of the requests.
+TEST(Http2ServerTest, Multiplexing)
+{
+  class Handler
+  {
+  public:
+    MOCK_METHOD1(handle, Future<http::Response>(const http::Request&));
+  } handler;
+
+  Try<http::Server> server = http::Server::create(
+      inet4::Address::ANY_ANY(),
+      [&](const network::Socket&, const http::Request& request) {
+        return handler.handle(request);
+      },
+      http2Options());
+
+  ASSERT_SOME(server);
+
+  Future<Nothing> run = server->run();
+
+  Try<inet::Address> address =
+    network::convert<inet::Address>(server->address());
+
+  ASSERT_SOME(address);
+
+  Future<http::Connection> connect = http::connect(
+      inet::Address(process::address().ip, address->port),
+      http::Scheme::HTTP,
+      None(),
+      http::Protocol::HTTP_2);
+
+  AWAIT_ASSERT_READY(connect);
+
+  http::Connection connection = connect.get();
+
+  EXPECT_EQ(http::Protocol::HTTP_2, connection.protocol);
+
+  Promise<http::Response> promise1;
+  Future<http::Request> request1;
+
+  Promise<http::Response> promise2;
+  Future<http::Request> request2;
+
+  EXPECT_CALL(handler, handle(_))
+    .WillOnce(DoAll(FutureArg<0>(&request1), Return(promise1.future())))
+    .WillOnce(DoAll(FutureArg<0>(&request2), Return(promise2.future())))
+    .WillRepeatedly(Return(http::OK()));
+
+  http::URL url("http", process::address().ip, address->port, "/");
+
+  http::Request request;
+  request.method = "GET";
+  request.url = url;
+  request.keepAlive = true;
+
+  Future<http::Response> response1 = connection.send(request);
+  AWAIT_READY(request1);
+
+  Future<http::Response> response2 = connection.send(request);
+  AWAIT_READY(request2);
+
+  EXPECT_EQ("/", request1->url.path);
+  EXPECT_EQ("/", request2->url.path);
+
+  ASSERT_TRUE(response1.isPending());
+  ASSERT_TRUE(response2.isPending());
+
+  promise2.set(http::OK("2"));
+
+  AWAIT_ASSERT_READY(response2);
+  EXPECT_EQ("2", response2->body);
+
+  ASSERT_TRUE(response1.isPending());
+
+  promise1.set(http::OK("1"));
+
+  AWAIT_ASSERT_READY(response1);
+  EXPECT_EQ("1", response1->body);
+
+  AWAIT_READY(connection.disconnect());
+
+  AWAIT_EXPECT_READY(server->stop());
+  AWAIT_EXPECT_READY(run);
+}
+
+
+// Tests streamed request and response bodies over HTTP/2.
+TEST(Http2ServerTest, Streaming)
+{
+  http::Pipe pipe;
+
+  Try<http::Server> server = http::Server::create(
+      inet4::Address::ANY_ANY(),
+      [&](const network::Socket&, const http::Request& request) {
+        CHECK_EQ(http::Request::PIPE, request.type);
+        CHECK_SOME(request.reader);
+
+        http::Response response(http::Status::OK);
+        response.type = http::Response::PIPE;
+        response.reader = pipe.reader();
+
+        // Echo the request body once the response is streamed.
+        http::Pipe::Reader reader = request.reader.get();
+        http::Pipe::Writer writer = pipe.writer();
+
+        reader.readAll()
+          .onAny([writer](const Future<string>& body) mutable {
+            if (body.isReady()) {
+              writer.write(body.get());
+              writer.close();
+            } else {
+              writer.fail("Failed to read request body");
+            }
+          });
+
+        return response;
+      },
+      http2Options());
+
+  ASSERT_SOME(server);
+
+  Future<Nothing> run = server->run();
+
+  Try<inet::Address> address =
+    network::convert<inet::Address>(server->address());
+
+  ASSERT_SOME(address);
+
+  Future<http::Connection> connect = http::connect(
+      inet::Address(process::address().ip, address->port),
+      http::Scheme::HTTP,
+      None(),
+      http::Protocol::HTTP_2);
+
+  AWAIT_ASSERT_READY(connect);
+
+  http::Connection connection = connect.get();
+
+  http::Pipe body;
+
+  http::Request request;
+  request.method = "POST";
+  request.url = http::URL("http", process::address().ip, address->port, "/");
+  request.keepAlive = true;
+  request.type = http::Request::PIPE;
+  request.reader = body.reader();
+
+  Future<http::Response> response = connection.send(request, true);
+
+  AWAIT_ASSERT_READY(response);
+  ASSERT_EQ(http::Response::PIPE, response->type);
+  ASSERT_SOME(response->reader);
+
+  http::Pipe::Writer writer = body.writer();
+  writer.write("hello ");
+  writer.write("world");
+  writer.close();
+
+  AWAIT_EXPECT_EQ("hello world", response->reader->readAll());
+
+  AWAIT_READY(connection.disconnect());
+
+  AWAIT_EXPECT_READY(server->stop());
+  AWAIT_EXPECT_READY(run);
+}
+
+
+// Tests that a server still serves HTTP/1.1 clients.
+TEST(Http2ServerTest, Http1)
+{
+  Try<http::Server> server = http::Server::create(
+      inet4::Address::ANY_ANY(),
+      [](const network::Socket&, const http::Request&) {
+        return http::OK("ok");
+      },
+      http2Options());
+
+  ASSERT_SOME(server);
+
+  Future<Nothing> run = server->run();
+
+  Try<inet::Address> address =
+    network::convert<inet::Address>(server->address());
+
+  ASSERT_SOME(address);
+
+  Future<http::Connection> connect = http::connect(
+      inet::Address(process::address().ip, address->port),
+      http::Scheme::HTTP);
+
+  AWAIT_ASSERT_READY(connect);
+
+  http::Connection connection = connect.get();
+
+  EXPECT_EQ(http::Protocol::HTTP_1_1, connection.protocol);
+
+  http::Request request;
+  request.method = "GET";
+  request.url = http::URL("http", process::address().ip, address->port, "/");
+  request.keepAlive = true;
+
+  AWAIT_EXPECT_RESPONSE_BODY_EQ("ok", connection.send(request));
+
+  AWAIT_READY(connection.disconnect());
+
+  AWAIT_EXPECT_READY(server->stop());
+  AWAIT_EXPECT_READY(run);
+}
+
+
+// Tests that a server doesn't serve HTTP/2 unless asked to, i.e., it
+// treats the connection preface as a (bad) HTTP/1.1 request rather
+// than answering it with its SETTINGS.
+TEST(Http2ServerTest, Disabled)
+{
+  Try<http::Server> server = http::Server::create(
+      inet4::Address::ANY_ANY(),
+      [](const network::Socket&, const http::Request&) {
+        return http::OK();
+      });
+
+  ASSERT_SOME(server);
+
+  Future<Nothing> run = server->run();
+
+  Try<inet::Address> address =
+    network::convert<inet::Address>(server->address());
+
+  ASSERT_SOME(address);
+
+  Try<inet::Socket> socket = inet::Socket::create();
+  ASSERT_SOME(socket);
+
+  AWAIT_READY(socket->connect(
+      inet::Address(process::address().ip, address->port)));
+
+  string data(http2::PREFACE, http2::PREFACE_SIZE);
+  http2::encode(&data, http2::SETTINGS, 0, 0, "", 0);
+
+  AWAIT_READY(socket->send(data));
+
+  // The server either responds with an HTTP/1.1 error or just closes
+  // the connection.
+  Future<string> received = socket->recv();
+  AWAIT_READY(received);
+
+  if (!received->empty()) {
+    EXPECT_EQ(0u, received->find("HTTP/1.1"));
+  }
+
+  AWAIT_EXPECT_READY(server->stop());
+  AWAIT_EXPECT_READY(run);
+}
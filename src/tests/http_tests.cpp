@@ -22,6 +22,9 @@
 #endif // __WINDOWS__
 
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -33,9 +36,11 @@
 #include <process/http.hpp>
 #include <process/id.hpp>
 #include <process/io.hpp>
+#include <process/loop.hpp>
 #ifdef USE_SSL_SOCKET
 #include <process/jwt.hpp>
 #endif // USE_SSL_SOCKET
+#include <process/metrics/metrics.hpp>
 #include <process/owned.hpp>
 #include <process/socket.hpp>
 
@@ -55,6 +60,8 @@
 
 #include "encoder.hpp"
 
+#include "tests/reinitialize.hpp"
+
 namespace authentication = process::http::authentication;
 namespace http = process::http;
 namespace ID = process::ID;
@@ -75,6 +82,9 @@ using authentication::JWTError;
 #endif // USE_SSL_SOCKET
 using authentication::Principal;
 
+using process::Break;
+using process::Continue;
+using process::ControlFlow;
 using process::Failure;
 using process::Future;
 using process::Owned;
@@ -86,6 +96,8 @@ using process::READWRITE_HTTP_AUTHENTICATION_REALM;
 
 using process::http::URL;
 
+using process::tests::ScopedConfiguration;
+
 using std::string;
 using std::vector;
 
@@ -618,6 +630,46 @@ TEST_P(HTTPTest, PipeReaderCloses)
 }
 
 
+// This test verifies that a bounded pipe is not writable while the
+// capacity is buffered and that reads coalesce the buffered writes.
+TEST(HTTPTest, PipeBounded)
+{
+  http::Pipe pipe(10);
+  http::Pipe::Reader reader = pipe.reader();
+  http::Pipe::Writer writer = pipe.writer();
+
+  AWAIT_READY(writer.writable());
+
+  EXPECT_TRUE(writer.write("hello"));
+  AWAIT_READY(writer.writable());
+
+  EXPECT_TRUE(writer.write("world"));
+  EXPECT_TRUE(writer.write("!"));
+
+  Future<Nothing> writable = writer.writable();
+  EXPECT_TRUE(writable.isPending());
+
+  // Reads return as many of the buffered writes as fit in the
+  // capacity, and the pipe is writable once less than the capacity
+  // is buffered.
+  AWAIT_EQ("helloworld", reader.read());
+  AWAIT_READY(writable);
+
+  AWAIT_EQ("!", reader.read());
+
+  // Writes that are bigger than the capacity are not split.
+  EXPECT_TRUE(writer.write("hello world!"));
+  writable = writer.writable();
+  EXPECT_TRUE(writable.isPending());
+
+  // Closing the read end makes the pipe writable (the writes then
+  // get ignored).
+  EXPECT_TRUE(reader.close());
+  AWAIT_READY(writable);
+  EXPECT_FALSE(writer.write("!"));
+}
+
+
 TEST_P(HTTPTest, Encode)
 {
   string unencoded = "a$&+,/:;=?@ \"<>#%{}|\\^~[]`\x19\x80\xFF";
@@ -1249,6 +1301,155 @@ TEST(HTTPConnectionTest, Pipeline)
 }
 
 
+// Tests that the responses that are blocked by an earlier (pipelined)
+// response are still sent in order when they get prepared ahead of
+// time, and that the blocking is exposed as metrics.
+TEST(HTTPConnectionTest, PreparedResponses)
+{
+  // Restores the configuration once the test is done (even if it
+  // fails), i.e., after everything below got destroyed.
+  ScopedConfiguration configuration(
+      {{"LIBPROCESS_HTTP_PREPARE_RESPONSES", "true"}});
+
+  Http http;
+
+  http::URL url = http::URL(
+      "http",
+      http.process->self().address.ip,
+      http.process->self().address.port,
+      http.process->self().id + "/get");
+
+  Future<http::Connection> connect = http::connect(url);
+  AWAIT_READY(connect);
+
+  http::Connection connection = connect.get();
+
+  Promise<http::Response> promise1, promise2, promise3;
+  Future<http::Request> get1, get2, get3;
+
+  EXPECT_CALL(*http.process, get(_))
+    .WillOnce(DoAll(FutureArg<0>(&get1), Return(promise1.future())))
+    .WillOnce(DoAll(FutureArg<0>(&get2), Return(promise2.future())))
+    .WillOnce(DoAll(FutureArg<0>(&get3), Return(promise3.future())));
+
+  http::Request request;
+  request.method = "GET";
+  request.url = url;
+  request.keepAlive = true;
+  request.headers["Accept-Encoding"] = "gzip";
+
+  Future<http::Response> response1 = connection.send(request);
+  Future<http::Response> response2 = connection.send(request);
+  Future<http::Response> response3 = connection.send(request);
+
+  AWAIT_READY(get1);
+  AWAIT_READY(get2);
+  AWAIT_READY(get3);
+
+  // The (compressed) body of the second response gets prepared.
+  const string body(4096, 'a');
+
+  promise3.set(http::OK("3"));
+  promise2.set(http::OK(body));
+
+  EXPECT_TRUE(response1.isPending());
+  EXPECT_TRUE(response2.isPending());
+  EXPECT_TRUE(response3.isPending());
+
+  promise1.set(http::OK("1"));
+
+  AWAIT_EXPECT_RESPONSE_BODY_EQ("1", response1);
+  AWAIT_EXPECT_RESPONSE_BODY_EQ(body, response2);
+  AWAIT_EXPECT_RESPONSE_BODY_EQ("3", response3);
+
+  AWAIT_READY(connection.disconnect());
+
+  Future<std::map<string, double>> snapshot =
+    process::metrics::snapshot(None());
+
+  AWAIT_READY(snapshot);
+
+  ASSERT_EQ(1u, snapshot->count("libprocess/http_proxy/responses_blocked"));
+  ASSERT_EQ(1u, snapshot->count("libprocess/http_proxy/responses_prepared"));
+  ASSERT_EQ(1u, snapshot->count("libprocess/http_proxy/blocked_time_us"));
+
+  EXPECT_LE(2.0, snapshot->at("libprocess/http_proxy/responses_blocked"));
+  EXPECT_LE(2.0, snapshot->at("libprocess/http_proxy/responses_prepared"));
+}
+
+
+// Tests that prepared responses that are pipelined behind a response
+// which closes the connection don't get sent after it.
+TEST(HTTPConnectionTest, PreparedResponsesClose)
+{
+  ScopedConfiguration configuration(
+      {{"LIBPROCESS_HTTP_PREPARE_RESPONSES", "true"}});
+
+  Http http;
+
+  Try<inet::Socket> create = inet::Socket::create();
+  ASSERT_SOME(create);
+
+  inet::Socket socket = create.get();
+
+  AWAIT_READY(socket.connect(http.process->self().address));
+
+  Promise<http::Response> promise1, promise2, promise3;
+  Future<http::Request> get1, get2, get3;
+
+  EXPECT_CALL(*http.process, get(_))
+    .WillOnce(DoAll(FutureArg<0>(&get1), Return(promise1.future())))
+    .WillOnce(DoAll(FutureArg<0>(&get2), Return(promise2.future())))
+    .WillOnce(DoAll(FutureArg<0>(&get3), Return(promise3.future())));
+
+  std::ostringstream out;
+  for (int i = 0; i < 3; i++) {
+    out << "GET /" << http.process->self().id << "/get HTTP/1.1\r\n"
+        << "Host: localhost\r\n"
+        << "\r\n";
+  }
+
+  AWAIT_READY(socket.send(out.str()));
+
+  AWAIT_READY(get1);
+  AWAIT_READY(get2);
+  AWAIT_READY(get3);
+
+  // The second and third responses get prepared while they're blocked
+  // by the first one, but only the second may get sent.
+  promise3.set(http::OK("third"));
+
+  http::OK close("second");
+  close.headers["Connection"] = "close";
+  promise2.set(close);
+
+  promise1.set(http::OK("first"));
+
+  // Receive everything up to the connection getting closed.
+  std::shared_ptr<string> received(new string());
+
+  Future<Nothing> closed = process::loop(
+      None(),
+      [=]() {
+        return socket.recv();
+      },
+      [=](const string& data) -> ControlFlow<Nothing> {
+        if (data.empty()) {
+          return Break();
+        }
+
+        received->append(data);
+        return Continue();
+      });
+
+  AWAIT_READY(closed);
+
+  EXPECT_NE(string::npos, received->find("first"));
+  EXPECT_NE(string::npos, received->find("second"));
+  EXPECT_EQ(string::npos, received->find("third"));
+}
+
+
 TEST(HTTPConnectionTest, ClosingRequest)
 {
   Http http;
@@ -1482,6 +1683,228 @@ TEST(HTTPConnectionTest, RequestStreaming)
 }
 
 
+// Enables the connection pool of the HTTP client convenience
+// functions, which is off by default, allowing for one pooled
+// connection per host.
+class HTTPConnectionPoolTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    configuration.reinitialize({{"LIBPROCESS_HTTP_POOL_MAX_PER_HOST", "1"}});
+  }
+
+  void TearDown() override
+  {
+    configuration.restore();
+  }
+
+private:
+  ScopedConfiguration configuration;
+};
+
+
+// Receives from the socket until the end of the headers of a request.
+static Future<string> recvHeaders(const inet::Socket& socket)
+{
+  std::shared_ptr<string> data(new string());
+
+  return process::loop(
+      None(),
+      [=]() {
+        return socket.recv();
+      },
+      [=](const string& received) -> Future<ControlFlow<string>> {
+        if (received.empty()) {
+          return Failure("Unexpected EOF");
+        }
+
+        data->append(received);
+
+        if (data->find("\r\n\r\n") == string::npos) {
+          return Continue();
+        }
+
+        return Break(*data);
+      });
+}
+
+
+// This test verifies that consecutive requests made with the
+// convenience functions reuse the same (pooled) connection.
+TEST_F(HTTPConnectionPoolTest, Reuse)
+{
+  Http http;
+
+  Future<http::Request> request1;
+  Future<http::Request> request2;
+  EXPECT_CALL(*http.process, get(_))
+    .WillOnce(DoAll(FutureArg<0>(&request1), Return(http::OK())))
+    .WillOnce(DoAll(FutureArg<0>(&request2), Return(http::OK())));
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(
+      http::OK().status,
+      http::get(http.process->self(), "get"));
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(
+      http::OK().status,
+      http::get(http.process->self(), "get"));
+
+  AWAIT_READY(request1);
+  AWAIT_READY(request2);
+
+  EXPECT_TRUE(request1->keepAlive);
+
+  // Both requests must have come from the same client socket.
+  ASSERT_SOME(request1->client);
+  ASSERT_SOME(request2->client);
+  EXPECT_EQ(stringify(request1->client.get()),
+            stringify(request2->client.get()));
+}
+
+
+// This test verifies that a connection stops being pooled once the
+// server answers with 'Connection: close', no matter the case.
+TEST_F(HTTPConnectionPoolTest, CloseResponse)
+{
+  Http http;
+
+  http::Response close = http::OK();
+  close.headers["Connection"] = "Close";
+
+  Future<http::Request> request1;
+  Future<http::Request> request2;
+  EXPECT_CALL(*http.process, get(_))
+    .WillOnce(DoAll(FutureArg<0>(&request1), Return(close)))
+    .WillOnce(DoAll(FutureArg<0>(&request2), Return(http::OK())));
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(
+      http::OK().status,
+      http::get(http.process->self(), "get"));
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(
+      http::OK().status,
+      http::get(http.process->self(), "get"));
+
+  AWAIT_READY(request1);
+  AWAIT_READY(request2);
+
+  // The second request must have used a new connection.
+  ASSERT_SOME(request1->client);
+  ASSERT_SOME(request2->client);
+  EXPECT_NE(stringify(request1->client.get()),
+            stringify(request2->client.get()));
+}
+
+
+// This test verifies that once all the pooled connections to a host
+// are busy, requests use one-off connections rather than opening
+// more pooled ones.
+TEST_F(HTTPConnectionPoolTest, MaxPerHost)
+{
+  Http http;
+
+  Promise<http::Response> promise;
+
+  Future<http::Request> request1;
+  Future<http::Request> request2;
+  Future<http::Request> request3;
+  EXPECT_CALL(*http.process, get(_))
+    .WillOnce(DoAll(FutureArg<0>(&request1), Return(promise.future())))
+    .WillOnce(DoAll(FutureArg<0>(&request2), Return(http::OK())))
+    .WillOnce(DoAll(FutureArg<0>(&request3), Return(http::OK())));
+
+  Future<http::Response> response1 =
+    http::get(http.process->self(), "get");
+
+  AWAIT_READY(request1);
+  EXPECT_TRUE(request1->keepAlive);
+
+  // The only pooled connection is busy.
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(
+      http::OK().status,
+      http::get(http.process->self(), "get"));
+
+  AWAIT_READY(request2);
+  EXPECT_FALSE(request2->keepAlive);
+
+  promise.set(http::OK());
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(http::OK().status, response1);
+
+  // Now that it's idle the pooled connection gets reused.
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(
+      http::OK().status,
+      http::get(http.process->self(), "get"));
+
+  AWAIT_READY(request3);
+  EXPECT_TRUE(request3->keepAlive);
+
+  ASSERT_SOME(request1->client);
+  ASSERT_SOME(request2->client);
+  ASSERT_SOME(request3->client);
+  EXPECT_NE(stringify(request1->client.get()),
+            stringify(request2->client.get()));
+  EXPECT_EQ(stringify(request1->client.get()),
+            stringify(request3->client.get()));
+}
+
+
+// This test verifies that an idempotent request that fails on a
+// reused connection, e.g., because the server closed the connection
+// just as the pool reused it, gets retried once on a new one-off
+// connection.
+TEST_F(HTTPConnectionPoolTest, StaleConnectionRetry)
+{
+  Try<inet::Socket> server = inet::Socket::create();
+  ASSERT_SOME(server);
+
+  ASSERT_SOME(server->bind(inet4::Address::ANY_ANY()));
+  ASSERT_SOME(server->listen(2));
+
+  Try<inet::Address> any_address = server->address();
+  ASSERT_SOME(any_address);
+
+  http::URL url(
+      "http",
+      process::address().ip,
+      any_address->port,
+      "/get");
+
+  const string ok = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+
+  Future<inet::Socket> accept1 = server->accept();
+
+  Future<http::Response> response1 = http::get(url);
+
+  AWAIT_READY(accept1);
+  inet::Socket socket1 = accept1.get();
+
+  AWAIT_READY(recvHeaders(socket1));
+  AWAIT_READY(socket1.send(ok));
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(http::OK().status, response1);
+
+  // The second request goes out on the pooled connection, which the
+  // server then closes without responding.
+  Future<inet::Socket> accept2 = server->accept();
+
+  Future<http::Response> response2 = http::get(url);
+
+  AWAIT_READY(recvHeaders(socket1));
+  EXPECT_SOME(socket1.shutdown(inet::Socket::Shutdown::READ_WRITE));
+
+  // The request gets retried on a new connection.
+  AWAIT_READY(accept2);
+  inet::Socket socket2 = accept2.get();
+
+  AWAIT_READY(recvHeaders(socket2));
+  AWAIT_READY(socket2.send(ok));
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(http::OK().status, response2);
+}
+
+
 TEST_P(HTTPTest, QueryEncodeDecode)
 {
   // If we use Type<a, b> directly inside a macro without surrounding
@@ -2515,6 +2938,64 @@ TEST(HttpServerTest, Pipeline)
 }
 
 
+#ifdef __linux__
+// Tests that a server can listen on its address with several sockets
+// (using SO_REUSEPORT) and serves the connections of each.
+TEST(HttpServerTest, Listeners)
+{
+  http::Server::CreateOptions options = http::Server::DEFAULT_CREATE_OPTIONS();
+  options.listeners = 4;
+
+  Try<http::Server> server = http::Server::create(
+      inet4::Address::ANY_ANY(),
+      [](const network::Socket&, const http::Request& request)
+          -> Future<http::Response> {
+        return http::OK(request.url.path);
+      },
+      options);
+
+  ASSERT_SOME(server);
+
+  Future<Nothing> run = server->run();
+
+  Try<inet::Address> address =
+    network::convert<inet::Address>(server->address());
+
+  ASSERT_SOME(address);
+
+  // See the comment in `HttpServerTest.Pipeline` as to why we use
+  // the IP from the libprocess library.
+  const inet::Address connectTo(process::address().ip, address->port);
+
+  // Each connection gets accepted by one of the sockets, use enough
+  // of them that all the sockets likely get some.
+  for (int i = 0; i < 16; i++) {
+    Future<http::Connection> connect =
+      http::connect(connectTo, http::Scheme::HTTP);
+
+    AWAIT_ASSERT_READY(connect);
+
+    http::Connection connection = connect.get();
+
+    http::Request request;
+    request.method = "GET";
+    request.url = http::URL(
+        "http", address->lookup_hostname().get(), address->port, "/path");
+    request.keepAlive = false;
+
+    Future<http::Response> response = connection.send(request);
+    AWAIT_ASSERT_RESPONSE_BODY_EQ("/path", response);
+
+    AWAIT_READY(connection.disconnect());
+  }
+
+  AWAIT_EXPECT_READY(server->stop());
+
+  AWAIT_EXPECT_READY(run);
+}
+#endif // __linux__
+
+
 // Tests that we can't stop a server that's not running.
 TEST(HttpServerTest, StopNotRunning)
 {
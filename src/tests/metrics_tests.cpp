@@ -14,11 +14,16 @@
 
 #include <map>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <stout/base64.hpp>
 #include <stout/duration.hpp>
 #include <stout/gtest.hpp>
+#include <stout/none.hpp>
+#include <stout/option.hpp>
+#include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
 
 #include <process/authenticator.hpp>
 #include <process/clock.hpp>
@@ -30,6 +35,7 @@
 #include <process/time.hpp>
 
 #include <process/metrics/counter.hpp>
+#include <process/metrics/histogram.hpp>
 #include <process/metrics/metrics.hpp>
 #include <process/metrics/pull_gauge.hpp>
 #include <process/metrics/push_gauge.hpp>
@@ -48,6 +54,7 @@ using http::Response;
 using http::Unauthorized;
 
 using metrics::Counter;
+using metrics::Histogram;
 using metrics::PullGauge;
 using metrics::PushGauge;
 using metrics::Timer;
@@ -145,6 +152,40 @@ TEST_F(MetricsTest, Counter)
 }
 
 
+// Tests that no increments get lost once a counter is contended
+// and gets spread out over stripes.
+TEST_F(MetricsTest, THREADSAFE_CounterContention)
+{
+  Counter counter("test/counter");
+
+  const int threadCount = 8;
+  const int incrementCount = 100000;
+
+  vector<std::thread> threads;
+  for (int i = 0; i < threadCount; i++) {
+    threads.emplace_back([&counter]() {
+      for (int j = 0; j < incrementCount; j++) {
+        ++counter;
+      }
+    });
+  }
+
+  foreach (std::thread& thread, threads) {
+    thread.join();
+  }
+
+  AWAIT_EXPECT_EQ(
+      static_cast<double>(threadCount * incrementCount),
+      counter.value());
+
+  counter.reset();
+  AWAIT_EXPECT_EQ(0.0, counter.value());
+
+  counter += 42;
+  AWAIT_EXPECT_EQ(42.0, counter.value());
+}
+
+
 TEST_F(MetricsTest, PullGauge)
 {
   PullGaugeProcess process;
@@ -238,6 +279,39 @@ TEST_F(MetricsTest, Statistics)
 }
 
 
+// Tests that the history of a windowed counter gets filled in by the
+// periodic sampling while the clock is running, i.e., without taking
+// a snapshot.
+TEST_F(MetricsTest, SampledStatistics)
+{
+  Counter counter("test/counter", process::TIME_SERIES_WINDOW);
+
+  AWAIT_READY(metrics::add(counter));
+
+  // The increment doesn't get recorded in the history by itself, the
+  // metrics get sampled every second.
+  counter += 5;
+
+  Option<Statistics<double>> statistics = None();
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  do {
+    os::sleep(Milliseconds(100));
+    statistics = counter.statistics();
+  } while ((statistics.isNone() || statistics->max < 5.0) &&
+           stopwatch.elapsed() < process::TEST_AWAIT_TIMEOUT);
+
+  ASSERT_SOME(statistics);
+  EXPECT_LE(2u, statistics->count);
+  EXPECT_DOUBLE_EQ(0.0, statistics->min);
+  EXPECT_DOUBLE_EQ(5.0, statistics->max);
+
+  AWAIT_READY(metrics::remove(counter));
+}
+
+
 TEST_F(MetricsTest, THREADSAFE_Snapshot)
 {
   UPID upid("metrics", process::address());
@@ -600,6 +674,96 @@ TEST_F(MetricsTest, AsyncTimer)
 }
 
 
+TEST_F(MetricsTest, Histogram)
+{
+  Histogram histogram("test/histogram");
+
+  AWAIT_READY(metrics::add(histogram));
+
+  AWAIT_EXPECT_EQ(0.0, histogram.value());
+  EXPECT_NONE(histogram.statistics());
+
+  for (int i = 1; i <= 1000; i++) {
+    histogram.record(i);
+  }
+
+  AWAIT_EXPECT_EQ(1000.0, histogram.value());
+
+  Option<Statistics<double>> statistics = histogram.statistics();
+  ASSERT_SOME(statistics);
+
+  EXPECT_EQ(1000u, statistics->count);
+
+  EXPECT_DOUBLE_EQ(1.0, statistics->min);
+  EXPECT_DOUBLE_EQ(1000.0, statistics->max);
+
+  // The percentiles are estimated within about 3%.
+  EXPECT_NEAR(500.0, statistics->p50, 15.0);
+  EXPECT_NEAR(900.0, statistics->p90, 27.0);
+  EXPECT_NEAR(990.0, statistics->p99, 30.0);
+  EXPECT_NEAR(999.0, statistics->p999, 30.0);
+
+  Future<map<string, double>> snapshot = metrics::snapshot(None());
+  AWAIT_READY(snapshot);
+
+  EXPECT_EQ(1000.0, snapshot->at("test/histogram"));
+  EXPECT_EQ(1000.0, snapshot->at("test/histogram/count"));
+  EXPECT_EQ(statistics->p99, snapshot->at("test/histogram/p99"));
+
+  // Merge in a histogram with just as many values of 2000.
+  Histogram other("test/other");
+
+  for (int i = 1; i <= 1000; i++) {
+    other.record(2000);
+  }
+
+  histogram.merge(other);
+
+  statistics = histogram.statistics();
+  ASSERT_SOME(statistics);
+
+  EXPECT_EQ(2000u, statistics->count);
+  EXPECT_DOUBLE_EQ(2000.0, statistics->max);
+  EXPECT_NEAR(500.0, statistics->p25, 15.0);
+  EXPECT_NEAR(2000.0, statistics->p90, 60.0);
+
+  histogram.reset();
+
+  AWAIT_EXPECT_EQ(0.0, histogram.value());
+  EXPECT_NONE(histogram.statistics());
+
+  AWAIT_READY(metrics::remove(histogram));
+}
+
+
+// Tests that a timer records the timed events in its histogram.
+TEST_F(MetricsTest, TimerHistogram)
+{
+  // Distinguish microseconds.
+  Histogram histogram("test/timer_histogram", 0.001);
+
+  metrics::Timer<Milliseconds> timer("test/timer", histogram);
+
+  Clock::pause();
+
+  for (int i = 1; i <= 10; i++) {
+    timer.start();
+    Clock::advance(Microseconds(1500 * i));
+    timer.stop();
+  }
+
+  Clock::resume();
+
+  AWAIT_EXPECT_EQ(10.0, histogram.value());
+
+  Option<Statistics<double>> statistics = histogram.statistics();
+  ASSERT_SOME(statistics);
+
+  EXPECT_NEAR(1.5, statistics->min, 0.002);
+  EXPECT_NEAR(15.0, statistics->max, 0.002);
+}
+
+
 // Tests that the `/metrics/snapshot` endpoint rejects unauthenticated requests
 // when HTTP authentication is enabled.
 TEST_F(MetricsTest, THREADSAFE_SnapshotAuthenticationEnabled)
@@ -25,8 +25,13 @@
 #endif // __WINDOWS__
 
 #include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <process/async.hpp>
@@ -49,6 +54,8 @@
 #include <process/subprocess.hpp>
 #include <process/time.hpp>
 
+#include <process/metrics/metrics.hpp>
+
 #include <stout/duration.hpp>
 #include <stout/gtest.hpp>
 #include <stout/hashmap.hpp>
@@ -58,6 +65,7 @@
 #include <stout/os.hpp>
 #include <stout/stopwatch.hpp>
 #include <stout/stringify.hpp>
+#include <stout/synchronized.hpp>
 #include <stout/try.hpp>
 
 #include <stout/os/killtree.hpp>
@@ -65,13 +73,19 @@
 
 #include <stout/tests/utils.hpp>
 
+#include "decoder.hpp"
 #include "encoder.hpp"
+#include "process_table.hpp"
+
+#include "tests/reinitialize.hpp"
 
 namespace http = process::http;
 namespace inject = process::inject;
 namespace inet4 = process::network::inet4;
 
 using process::async;
+using process::BinaryMessageDecoder;
+using process::BinaryMessageEncoder;
 using process::Clock;
 using process::CountDownLatch;
 using process::defer;
@@ -97,12 +111,15 @@ using process::TerminateEvent;
 using process::Time;
 using process::UPID;
 
+using process::tests::ScopedConfiguration;
+
 using process::firewall::DisabledEndpointsFirewallRule;
 using process::firewall::FirewallRule;
 
 using process::network::inet::Address;
 using process::network::inet::Socket;
 
+using std::deque;
 using std::move;
 using std::string;
 using std::vector;
@@ -116,7 +133,26 @@ using testing::ReturnArg;
 
 // TODO(bmahler): Move tests into their own files as appropriate.
 
-class ProcessTest : public TemporaryDirectoryTest {};
+class ProcessTest : public TemporaryDirectoryTest
+{
+protected:
+  void TearDown() override
+  {
+    configuration.restore();
+
+    TemporaryDirectoryTest::TearDown();
+  }
+
+  // Reinitializes libprocess with the environment variables set, for
+  // the rest of the test, to test against a different configuration.
+  void reinitialize(const std::map<string, string>& variables)
+  {
+    configuration.reinitialize(variables);
+  }
+
+private:
+  ScopedConfiguration configuration;
+};
 
 
 TEST_F(ProcessTest, Event)
@@ -1274,6 +1310,497 @@ TEST_F(ProcessTest, Settle)
 }
 
 
+class CountingProcess : public Process<CountingProcess>
+{
+public:
+  explicit CountingProcess(std::atomic_long* _count) : count(_count) {}
+
+  void increment()
+  {
+    count->fetch_add(1);
+  }
+
+private:
+  std::atomic_long* count;
+};
+
+
+// Verifies that processes are run, and that `Clock::settle` waits
+// for all of them, when using the per-worker work stealing run queues.
+TEST_F(ProcessTest, WorkStealingSettle)
+{
+  reinitialize({{"LIBPROCESS_RUN_QUEUE", "work_stealing"}});
+
+  const long processes = 4 * process::workers();
+  const long dispatches = 1000;
+
+  std::atomic_long count(0L);
+
+  vector<Owned<CountingProcess>> counters;
+  for (long i = 0; i < processes; i++) {
+    counters.emplace_back(new CountingProcess(&count));
+    spawn(counters.back().get());
+  }
+
+  Clock::pause();
+
+  for (const Owned<CountingProcess>& counter : counters) {
+    for (long i = 0; i < dispatches; i++) {
+      dispatch(counter->self(), &CountingProcess::increment);
+    }
+  }
+
+  Clock::settle();
+
+  EXPECT_EQ(processes * dispatches, count.load());
+
+  Clock::resume();
+
+  // The `SettleProcess` also exercises `wait` extracting a process
+  // from one of the per-worker run queues.
+  Clock::pause();
+  SettleProcess process;
+  spawn(process);
+  Clock::settle();
+  ASSERT_TRUE(process.calledDispatch.load());
+  terminate(process);
+  wait(process);
+  Clock::resume();
+
+  for (const Owned<CountingProcess>& counter : counters) {
+    terminate(counter.get());
+    wait(counter.get());
+  }
+}
+
+
+// Stresses the per-worker work stealing run queues with many threads
+// enqueueing processes while the workers steal from each other, and
+// verifies that every enqueued process gets resumed without relying
+// on any later enqueue to wake up a worker.
+TEST_F(ProcessTest, WorkStealingStress)
+{
+  reinitialize({{"LIBPROCESS_RUN_QUEUE", "work_stealing"}});
+
+  const long processes = 4 * process::workers();
+  const long producers = 16;
+  const long dispatches = 20000;
+
+  std::atomic_long count(0L);
+
+  vector<Owned<CountingProcess>> counters;
+  for (long i = 0; i < processes; i++) {
+    counters.emplace_back(new CountingProcess(&count));
+    spawn(counters.back().get());
+  }
+
+  vector<std::thread> threads;
+  for (long i = 0; i < producers; i++) {
+    threads.emplace_back([&, i]() {
+      for (long j = 0; j < dispatches; j++) {
+        dispatch(
+            counters[(i + j) % processes]->self(),
+            &CountingProcess::increment);
+      }
+    });
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  // Nothing else gets enqueued while we wait, so a process that was
+  // left without a signal (a lost wakeup) stalls the count.
+  Stopwatch watch;
+  watch.start();
+
+  while (count.load() < producers * dispatches &&
+         watch.elapsed() < Seconds(30)) {
+    os::sleep(Milliseconds(1));
+  }
+
+  EXPECT_EQ(producers * dispatches, count.load());
+
+  for (const Owned<CountingProcess>& counter : counters) {
+    terminate(counter.get());
+    wait(counter.get());
+  }
+}
+
+
+class TableProcess : public Process<TableProcess> {};
+
+
+// Stresses the lock-free `ProcessTable` with processes getting added
+// and removed (following the same protocol as `ProcessManager`, see
+// `ProcessManager::use` and `ProcessManager::cleanup`) while other
+// threads look them up, and verifies that a lookup never returns a
+// process that has been removed (i.e., might have been freed) and
+// always finds the processes that remain in the table.
+TEST_F(ProcessTest, ProcessTableStress)
+{
+  const size_t stable = 100;
+  const size_t churned = 2000;
+  const size_t writers = 2;
+  const size_t readers = 4;
+
+  process::ProcessTable table;
+  std::mutex mutex;
+
+  vector<Owned<TableProcess>> processes;
+  vector<UPID> pids;
+
+  for (size_t i = 0; i < stable + churned; i++) {
+    processes.emplace_back(new TableProcess());
+    pids.emplace_back(processes.back()->self());
+  }
+
+  // Whether the (churned) process has been removed from the table, at
+  // which point `ProcessManager` would free it.
+  std::unique_ptr<std::atomic_bool[]> freed(
+      new std::atomic_bool[stable + churned]);
+
+  for (size_t i = 0; i < stable + churned; i++) {
+    freed[i].store(false);
+  }
+
+  // The references of the stable processes which must outlive the
+  // readers since the table only keeps weak references.
+  vector<std::shared_ptr<ProcessBase*>> references;
+  for (size_t i = 0; i < stable; i++) {
+    references.emplace_back(new ProcessBase*(processes[i].get()));
+    ASSERT_TRUE(table.insert(pids[i].id, processes[i].get(), references[i]));
+  }
+
+  std::atomic_bool done(false);
+  std::atomic_long stale(0L);
+  std::atomic_long mismatched(0L);
+  std::atomic_long missing(0L);
+
+  vector<std::thread> threads;
+
+  for (size_t i = 0; i < readers; i++) {
+    threads.emplace_back([&, i]() {
+      size_t j = i;
+
+      while (!done.load()) {
+        const size_t index = j++ % (stable + churned);
+
+        Option<std::shared_ptr<ProcessBase*>> reference =
+          table.find(pids[index].id);
+
+        if (reference.isSome() && reference.get()) {
+          // We hold a reference, so the process can't have been
+          // removed from the table yet.
+          if (freed[index].load()) {
+            stale++;
+          }
+
+          if (*reference.get() != processes[index].get()) {
+            mismatched++;
+          }
+        } else if (index < stable) {
+          missing++;
+        }
+      }
+    });
+  }
+
+  for (size_t i = 0; i < writers; i++) {
+    threads.emplace_back([&, i]() {
+      // Keep a few processes of this writer in the table at a time.
+      deque<std::pair<size_t, std::shared_ptr<ProcessBase*>>> live;
+
+      auto remove = [&]() {
+        const size_t index = live.front().first;
+        std::weak_ptr<ProcessBase*> reference = live.front().second;
+        live.pop_front();
+
+        synchronized (mutex) {
+          table.terminate(pids[index].id);
+        }
+
+        // Like `ProcessManager::cleanup`, wait for the references
+        // that have been handed out to go away before removing the
+        // process.
+        while (!reference.expired()) {
+          std::this_thread::yield();
+        }
+
+        synchronized (mutex) {
+          table.erase(pids[index].id);
+        }
+
+        freed[index].store(true);
+      };
+
+      for (size_t j = stable + i; j < stable + churned; j += writers) {
+        std::shared_ptr<ProcessBase*> reference(
+            new ProcessBase*(processes[j].get()));
+
+        synchronized (mutex) {
+          CHECK(table.insert(pids[j].id, processes[j].get(), reference));
+        }
+
+        live.emplace_back(j, std::move(reference));
+
+        if (live.size() > 16) {
+          remove();
+        }
+      }
+
+      while (!live.empty()) {
+        remove();
+      }
+    });
+  }
+
+  for (size_t i = 0; i < writers; i++) {
+    threads[readers + i].join();
+  }
+
+  done.store(true);
+
+  for (size_t i = 0; i < readers; i++) {
+    threads[i].join();
+  }
+
+  EXPECT_EQ(0, stale.load());
+  EXPECT_EQ(0, mismatched.load());
+  EXPECT_EQ(0, missing.load());
+
+  for (size_t i = 0; i < stable; i++) {
+    EXPECT_SOME(table.find(pids[i].id));
+  }
+
+  for (size_t i = stable; i < stable + churned; i++) {
+    EXPECT_NONE(table.find(pids[i].id));
+  }
+}
+
+
+class AppendProcess : public Process<AppendProcess>
+{
+public:
+  void append(int i)
+  {
+    values.push_back(i);
+  }
+
+  vector<int> values;
+};
+
+
+// Occupies the worker thread that serves it until it gets released.
+class BlockingProcess : public Process<BlockingProcess>
+{
+public:
+  BlockingProcess() : blocked(false), released(false) {}
+
+  void block()
+  {
+    blocked.store(true);
+
+    while (!released.load()) {
+      std::this_thread::yield();
+    }
+  }
+
+  std::atomic_bool blocked;
+  std::atomic_bool released;
+};
+
+
+// Verifies that events are served in order, that a flooded process
+// yields to other processes once it has used up its quantum, and that
+// termination still works, when processes are run with a bounded
+// event quantum and events are dequeued in batches.
+TEST_F(ProcessTest, ResumeEventQuantum)
+{
+  // With a single worker thread the run queue decides what runs next.
+  reinitialize({
+      {"LIBPROCESS_NUM_WORKER_THREADS", "1"},
+      {"LIBPROCESS_RESUME_EVENT_QUANTUM", "10"},
+      {"LIBPROCESS_EVENT_BATCH_SIZE", "4"}});
+
+  AppendProcess process;
+  spawn(process);
+
+  AppendProcess other;
+  spawn(other);
+
+  BlockingProcess blocking;
+  spawn(blocking);
+
+  // Block the worker so that all of the events below are queued
+  // before any of them get served.
+  dispatch(blocking, &BlockingProcess::block);
+
+  while (!blocking.blocked.load()) {
+    std::this_thread::yield();
+  }
+
+  vector<int> expected;
+  for (int i = 0; i < 1000; i++) {
+    dispatch(process, &AppendProcess::append, i);
+    expected.push_back(i);
+  }
+
+  // The flooded process is ahead of `other` in the run queue, but it
+  // only gets to serve one quantum before `other` runs.
+  Future<size_t> served = dispatch(other.self(), [&process]() {
+    return process.values.size();
+  });
+
+  blocking.released.store(true);
+
+  AWAIT_READY(served);
+  EXPECT_LE(1u, served.get());
+  EXPECT_GE(10u, served.get());
+
+  Clock::pause();
+  Clock::settle();
+  Clock::resume();
+
+  EXPECT_EQ(expected, process.values);
+
+  // Terminating (with the terminate event injected) must drop all of
+  // the events that are queued, even though they would get dequeued
+  // in batches, so none of these get appended.
+  blocking.blocked.store(false);
+  blocking.released.store(false);
+
+  dispatch(blocking, &BlockingProcess::block);
+
+  while (!blocking.blocked.load()) {
+    std::this_thread::yield();
+  }
+
+  for (int i = 0; i < 1000; i++) {
+    dispatch(process, &AppendProcess::append, i);
+  }
+
+  terminate(process);
+
+  blocking.released.store(true);
+
+  wait(process);
+
+  EXPECT_EQ(expected, process.values);
+
+  terminate(other);
+  wait(other);
+
+  terminate(blocking);
+  wait(blocking);
+}
+
+
+class ThreadIdProcess : public Process<ThreadIdProcess>
+{
+public:
+  std::thread::id id()
+  {
+    return std::this_thread::get_id();
+  }
+};
+
+
+// Verifies that a pinned process always runs on the same thread and
+// that `Clock::settle` waits for it.
+TEST_F(ProcessTest, Pin)
+{
+  ThreadIdProcess process;
+  process.pin();
+  spawn(process);
+
+  Future<std::thread::id> id1 = dispatch(process, &ThreadIdProcess::id);
+  AWAIT_READY(id1);
+
+  Clock::pause();
+
+  std::atomic_long count(0L);
+  CountingProcess counter(&count);
+  spawn(counter);
+
+  for (int i = 0; i < 100; i++) {
+    dispatch(process, [&counter]() {
+      dispatch(counter, &CountingProcess::increment);
+    });
+  }
+
+  Clock::settle();
+
+  EXPECT_EQ(100, count.load());
+
+  Clock::resume();
+
+  Future<std::thread::id> id2 = dispatch(process, &ThreadIdProcess::id);
+  AWAIT_EXPECT_EQ(id1.get(), id2);
+
+  EXPECT_NE(std::this_thread::get_id(), id1.get());
+
+  terminate(counter);
+  wait(counter);
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Verifies that processes are run, and that `Clock::settle` waits
+// for all of them, when idle workers spin before sleeping, and that
+// the way workers got woken up is exposed as metrics.
+TEST_F(ProcessTest, AdaptiveIdleStrategy)
+{
+  reinitialize({{"LIBPROCESS_WORKER_IDLE_STRATEGY", "adaptive"}});
+
+  const long processes = 4 * process::workers();
+  const long dispatches = 1000;
+
+  std::atomic_long count(0L);
+
+  vector<Owned<CountingProcess>> counters;
+  for (long i = 0; i < processes; i++) {
+    counters.emplace_back(new CountingProcess(&count));
+    spawn(counters.back().get());
+  }
+
+  Clock::pause();
+
+  for (const Owned<CountingProcess>& counter : counters) {
+    for (long i = 0; i < dispatches; i++) {
+      dispatch(counter->self(), &CountingProcess::increment);
+    }
+  }
+
+  Clock::settle();
+
+  EXPECT_EQ(processes * dispatches, count.load());
+
+  Clock::resume();
+
+  Future<std::map<string, double>> snapshot =
+    process::metrics::snapshot(None());
+
+  AWAIT_READY(snapshot);
+
+  ASSERT_EQ(1u, snapshot->count("libprocess/workers/wakeups_spinning"));
+  ASSERT_EQ(1u, snapshot->count("libprocess/workers/wakeups_parked"));
+  ASSERT_EQ(1u, snapshot->count("libprocess/workers/wake_latency_us"));
+
+  EXPECT_LT(
+      0.0,
+      snapshot->at("libprocess/workers/wakeups_spinning") +
+        snapshot->at("libprocess/workers/wakeups_parked"));
+
+  for (const Owned<CountingProcess>& counter : counters) {
+    terminate(counter.get());
+    wait(counter.get());
+  }
+}
+
+
 TEST_F(ProcessTest, Pid)
 {
   TimeoutProcess process;
@@ -1593,6 +2120,140 @@ TEST_F(ProcessTest, Http2)
 }
 
 
+// Like 'http2' but the sender advertises that it accepts the binary
+// framing, so we expect the reply to use it, and then sends a message
+// using the binary framing itself.
+TEST_F(ProcessTest, BinaryFraming)
+{
+  reinitialize({{"LIBPROCESS_BINARY_FRAMING", "true"}});
+
+  RemoteProcess process;
+  spawn(process);
+
+  // Create a receiving socket so we can get messages back.
+  Try<Socket> create = Socket::create();
+  ASSERT_SOME(create);
+
+  Socket socket = create.get();
+
+  ASSERT_SOME(socket.bind(inet4::Address::ANY_ANY()));
+
+  Try<Address> address = socket.address();
+  ASSERT_SOME(address);
+
+  UPID from("sender", process.self().address.ip, address->port);
+
+  ASSERT_SOME(socket.listen(1));
+
+  Future<UPID> pid1;
+  Future<string> body1;
+  Future<UPID> pid2;
+  Future<string> body2;
+  EXPECT_CALL(process, handler(_, _))
+    .WillOnce(DoAll(FutureArg<0>(&pid1),
+                    FutureArg<1>(&body1)))
+    .WillOnce(DoAll(FutureArg<0>(&pid2),
+                    FutureArg<1>(&body2)));
+
+  http::Headers headers;
+  headers["Libprocess-From"] = stringify(from);
+  headers["Libprocess-Framing"] = "binary";
+
+  Future<http::Response> response =
+    http::post(process.self(), "handler", headers, "hello world");
+
+  AWAIT_EXPECT_RESPONSE_STATUS_EQ(http::Accepted().status, response);
+
+  AWAIT_EXPECT_EQ(string("hello world"), body1);
+  AWAIT_EXPECT_EQ(from, pid1);
+
+  // Now post a message as though it came from the process.
+  post(process.self(), from, "reply", "hello back");
+
+  Future<Socket> accept = socket.accept();
+  AWAIT_READY(accept);
+
+  Socket client = accept.get();
+
+  BinaryMessageDecoder decoder;
+  deque<Message*> messages;
+
+  while (messages.empty()) {
+    Future<string> data = client.recv();
+    AWAIT_READY(data);
+    ASSERT_FALSE(data->empty());
+
+    messages = decoder.decode(data->data(), data->size());
+    ASSERT_FALSE(decoder.failed());
+  }
+
+  ASSERT_EQ(1u, messages.size());
+
+  Owned<Message> message(messages.front());
+  EXPECT_EQ("reply", message->name);
+  EXPECT_EQ(process.self(), message->from);
+  EXPECT_EQ(from.id, message->to.id);
+  EXPECT_EQ("hello back", message->body);
+
+  // Finally send a message to the process using the binary framing.
+  Try<Socket> sender = Socket::create();
+  ASSERT_SOME(sender);
+
+  AWAIT_READY(sender->connect(process.self().address));
+
+  Message hello;
+  hello.name = "handler";
+  hello.from = from;
+  hello.to = process.self();
+  hello.body = "hello again";
+
+  AWAIT_READY(sender->send(BinaryMessageEncoder::encode(hello)));
+
+  AWAIT_EXPECT_EQ(string("hello again"), body2);
+  AWAIT_EXPECT_EQ(from, pid2);
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Verifies that a peer can't use the binary framing unless we've
+// opted in, i.e., that the binary decoder isn't exposed by default.
+TEST_F(ProcessTest, BinaryFramingDisabled)
+{
+  RemoteProcess process;
+  spawn(process);
+
+  EXPECT_CALL(process, handler(_, _))
+    .Times(0);
+
+  Try<Socket> sender = Socket::create();
+  ASSERT_SOME(sender);
+
+  AWAIT_READY(sender->connect(process.self().address));
+
+  Message hello;
+  hello.name = "handler";
+  hello.from = UPID("sender", process.self().address);
+  hello.to = process.self();
+  hello.body = "hello";
+
+  AWAIT_READY(sender->send(BinaryMessageEncoder::encode(hello)));
+
+  // The frame gets decoded as HTTP, which fails, so we expect the
+  // connection to get closed rather than the message to get handled.
+  Future<string> data = sender->recv();
+  AWAIT(data);
+
+  if (data.isReady()) {
+    EXPECT_EQ("", data.get());
+  }
+
+  terminate(process);
+  wait(process);
+}
+
+
 static int foo()
 {
   return 1;
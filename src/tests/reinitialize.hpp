@@ -0,0 +1,117 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __PROCESS_TESTS_REINITIALIZE_HPP__
+#define __PROCESS_TESTS_REINITIALIZE_HPP__
+
+#include <map>
+#include <string>
+
+#include <process/gtest.hpp>
+
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/none.hpp>
+#include <stout/option.hpp>
+#include <stout/os.hpp>
+
+namespace process {
+
+// We need to reinitialize libprocess in order to test against
+// different configurations, such as a different run queue.
+void reinitialize(
+    const Option<std::string>& delegate,
+    const Option<std::string>& readonlyAuthenticationRealm,
+    const Option<std::string>& readwriteAuthenticationRealm);
+
+namespace tests {
+
+// Reinitializes libprocess with some environment variables set, and
+// restores the environment (and reinitializes libprocess again) when
+// restored or destroyed, so that a test which fails (i.e., returns
+// early) doesn't leave its configuration behind for later tests.
+//
+// Can be used from a fixture, calling `restore` in `TearDown`, or
+// within a single test:
+//
+//   ScopedConfiguration configuration({{"LIBPROCESS_...", "..."}});
+class ScopedConfiguration
+{
+public:
+  ScopedConfiguration() {}
+
+  explicit ScopedConfiguration(
+      const std::map<std::string, std::string>& variables)
+  {
+    reinitialize(variables);
+  }
+
+  ~ScopedConfiguration()
+  {
+    restore();
+  }
+
+  void reinitialize(const std::map<std::string, std::string>& variables)
+  {
+    foreachpair (
+        const std::string& name, const std::string& value, variables) {
+      if (!environment.contains(name)) {
+        environment[name] = os::getenv(name);
+      }
+
+      os::setenv(name, value);
+    }
+
+    process::reinitialize(
+        None(),
+        READWRITE_HTTP_AUTHENTICATION_REALM,
+        READONLY_HTTP_AUTHENTICATION_REALM);
+  }
+
+  void restore()
+  {
+    if (environment.empty()) {
+      return;
+    }
+
+    foreachpair (
+        const std::string& name,
+        const Option<std::string>& value,
+        environment) {
+      if (value.isSome()) {
+        os::setenv(name, value.get());
+      } else {
+        os::unsetenv(name);
+      }
+    }
+
+    environment.clear();
+
+    process::reinitialize(
+        None(),
+        READWRITE_HTTP_AUTHENTICATION_REALM,
+        READONLY_HTTP_AUTHENTICATION_REALM);
+  }
+
+private:
+  // Non-copyable, non-assignable.
+  ScopedConfiguration(const ScopedConfiguration&) = delete;
+  ScopedConfiguration& operator=(const ScopedConfiguration&) = delete;
+
+  // The original values of the environment variables that got set.
+  hashmap<std::string, Option<std::string>> environment;
+};
+
+} // namespace tests {
+} // namespace process {
+
+#endif // __PROCESS_TESTS_REINITIALIZE_HPP__
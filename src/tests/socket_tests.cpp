@@ -10,7 +10,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License
 
+#include <map>
+#include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <gmock/gmock.h>
 
@@ -20,26 +24,38 @@
 #include <process/process.hpp>
 #include <process/socket.hpp>
 
+#include <process/metrics/metrics.hpp>
+
 #include <process/ssl/gtest.hpp>
 
+#include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
+#include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/try.hpp>
 
 #include <stout/tests/utils.hpp>
 
+#include "buffer_pool.hpp"
+
 namespace inet4 = process::network::inet4;
 #ifndef __WINDOWS__
 namespace unix = process::network::unix;
 #endif // __WINDOWS__
 
+using process::BufferPool;
 using process::Future;
 using process::READONLY_HTTP_AUTHENTICATION_REALM;
 using process::READWRITE_HTTP_AUTHENTICATION_REALM;
 
 using process::network::inet::Address;
 using process::network::inet::Socket;
+using process::network::internal::SocketImpl;
 
+using std::map;
+using std::set;
 using std::string;
+using std::vector;
 
 using testing::WithParamInterface;
 
@@ -267,4 +283,308 @@ TEST_P(NetSocketTest, EOFAfterRecv)
 
   AWAIT_EXPECT_EQ(string(), receive);
 }
+
+// This test verifies that a vectored send writes the buffers in order.
+TEST_P(NetSocketTest, VectoredSend)
+{
+  Try<Socket> client = Socket::create();
+  ASSERT_SOME(client);
+
+  Try<Socket> server = Socket::create();
+  ASSERT_SOME(server);
+
+  Try<Address> server_address = server->bind(inet4::Address::ANY_ANY());
+  ASSERT_SOME(server_address);
+
+  ASSERT_SOME(server->listen(1));
+  Future<Socket> server_accept = server->accept();
+
+  AWAIT_READY(connectSocket(
+      *client, Address(process::address().ip, server_address->port)));
+
+  AWAIT_READY(server_accept);
+
+  Socket server_socket = server_accept.get();
+
+  const string data1 = "Lorem ipsum ";
+  const string data2 = "dolor sit ";
+  const string data3 = "amet";
+
+  const vector<SocketImpl::Buffer> buffers = {
+    {data1.data(), data1.size()},
+    {data2.data(), data2.size()},
+    {data3.data(), data3.size()}};
+
+  const string data = data1 + data2 + data3;
+
+  // NOTE: the socket may send less than all of the buffers (e.g.,
+  // SSL sockets only send the first buffer) but always a prefix.
+  Future<size_t> send = server_socket.send(buffers);
+  AWAIT_READY(send);
+  ASSERT_LT(0u, send.get());
+  ASSERT_GE(data.size(), send.get());
+
+  string received;
+  while (received.size() < send.get()) {
+    Future<string> receive = client->recv(send.get() - received.size());
+    AWAIT_READY(receive);
+    ASSERT_FALSE(receive->empty());
+    received += receive.get();
+  }
+
+  EXPECT_EQ(data.substr(0, send.get()), received);
+}
+
+
+// This test verifies that a socket becomes readable once data
+// arrives and that receiving more data than fits in one receive
+// buffer returns all of it.
+TEST_P(NetSocketTest, RecvMoreThanBuffer)
+{
+  Try<Socket> client = Socket::create();
+  ASSERT_SOME(client);
+
+  Try<Socket> server = Socket::create();
+  ASSERT_SOME(server);
+
+  Try<Address> server_address = server->bind(inet4::Address::ANY_ANY());
+  ASSERT_SOME(server_address);
+
+  ASSERT_SOME(server->listen(1));
+  Future<Socket> server_accept = server->accept();
+
+  AWAIT_READY(connectSocket(
+      *client, Address(process::address().ip, server_address->port)));
+
+  AWAIT_READY(server_accept);
+
+  Socket server_socket = server_accept.get();
+
+  // More than twice the size of a receive buffer.
+  const string data(200 * 1024, 'x');
+
+  Future<Nothing> send = server_socket.send(data);
+
+  AWAIT_READY(client->readable());
+  AWAIT_EXPECT_EQ(data, client->recv(data.size()));
+  AWAIT_READY(send);
+}
+
+
+// This test verifies that connections that are pending at once all
+// get accepted (on POSIX they get accepted with a single poll).
+TEST_P(NetSocketTest, AcceptMany)
+{
+  const size_t count = 10;
+
+  Try<Socket> server = Socket::create();
+  ASSERT_SOME(server);
+
+  Try<Address> server_address = server->bind(inet4::Address::ANY_ANY());
+  ASSERT_SOME(server_address);
+
+  ASSERT_SOME(server->listen(count));
+
+  vector<Socket> clients;
+  for (size_t i = 0; i < count; i++) {
+    Try<Socket> client = Socket::create();
+    ASSERT_SOME(client);
+
+    clients.push_back(client.get());
+  }
+
+  vector<Future<Nothing>> connects;
+  foreach (Socket& client, clients) {
+    connects.push_back(connectSocket(
+        client, Address(process::address().ip, server_address->port)));
+  }
+
+  vector<Socket> accepted;
+  for (size_t i = 0; i < count; i++) {
+    Future<Socket> accept = server->accept();
+    AWAIT_READY(accept);
+
+    accepted.push_back(accept.get());
+  }
+
+  foreach (const Future<Nothing>& connect, connects) {
+    AWAIT_READY(connect);
+  }
+
+  // Each accepted socket must be connected to one of the clients.
+  foreach (Socket& socket, accepted) {
+    AWAIT_READY(socket.send("x"));
+  }
+
+  foreach (Socket& client, clients) {
+    AWAIT_EXPECT_EQ(string("x"), client.recv(1));
+  }
+}
+
+
+// This test verifies that `try_recv` doesn't wait for data, i.e.,
+// that it returns `None` until data arrives.
+TEST_P(NetSocketTest, TryRecv)
+{
+  Try<Socket> client = Socket::create();
+  ASSERT_SOME(client);
+
+  Try<Socket> server = Socket::create();
+  ASSERT_SOME(server);
+
+  Try<Address> server_address = server->bind(inet4::Address::ANY_ANY());
+  ASSERT_SOME(server_address);
+
+  ASSERT_SOME(server->listen(1));
+  Future<Socket> server_accept = server->accept();
+
+  AWAIT_READY(connectSocket(
+      *client, Address(process::address().ip, server_address->port)));
+
+  AWAIT_READY(server_accept);
+
+  Socket server_socket = server_accept.get();
+
+  char data[16];
+
+  Try<Option<size_t>> length = client->try_recv(data, sizeof(data));
+  ASSERT_SOME(length);
+  EXPECT_NONE(length.get());
+
+  AWAIT_READY(server_socket.send("hello"));
+  AWAIT_READY(client->readable());
+
+  length = client->try_recv(data, sizeof(data));
+  ASSERT_SOME(length);
+
+  // Only poll sockets receive without waiting, the others always
+  // leave it to `recv`.
+  if (client->kind() == SocketImpl::Kind::POLL) {
+    EXPECT_SOME_EQ(5u, length.get());
+    EXPECT_EQ("hello", string(data, 5));
+  } else {
+    EXPECT_NONE(length.get());
+    AWAIT_EXPECT_EQ(string("hello"), client->recv(5));
+  }
+}
+
+
+// Tests that a thread reuses the buffers it gives back.
+TEST(BufferPoolTest, ThreadCache)
+{
+  char* buffer = BufferPool::acquire();
+  BufferPool::release(buffer);
+
+  char* reused = BufferPool::acquire();
+  EXPECT_EQ(buffer, reused);
+
+  BufferPool::release(reused);
+}
+
+
+// Tests that the buffers a thread has cached get handed off through
+// the depot to other threads once the thread exits.
+TEST(BufferPoolTest, DepotHandoff)
+{
+  set<char*> released;
+
+  std::thread([&released]() {
+    vector<char*> buffers;
+    for (size_t i = 0; i < 16; i++) {
+      buffers.push_back(BufferPool::acquire());
+    }
+
+    foreach (char* buffer, buffers) {
+      BufferPool::release(buffer);
+      released.insert(buffer);
+    }
+  }).join();
+
+  // A new thread starts out without a cache so it takes its buffers
+  // from the depot.
+  char* buffer = nullptr;
+
+  std::thread([&buffer]() {
+    buffer = BufferPool::acquire();
+    BufferPool::release(buffer);
+  }).join();
+
+  EXPECT_EQ(1u, released.count(buffer));
+}
+
+
+// Tests that the pool's metrics account for the buffers borrowed.
+TEST(BufferPoolTest, Metrics)
+{
+  const size_t borrowed = BufferPool::borrowed();
+
+  char* buffer = BufferPool::acquire();
+
+  EXPECT_EQ(borrowed + 1, BufferPool::borrowed());
+  EXPECT_LE(BufferPool::borrowed(), BufferPool::allocated());
+
+  Future<map<string, double>> snapshot =
+    process::metrics::snapshot(None());
+
+  AWAIT_READY(snapshot);
+
+  ASSERT_EQ(1u, snapshot->count("libprocess/receive_buffers/allocated"));
+  ASSERT_EQ(1u, snapshot->count("libprocess/receive_buffers/borrowed"));
+
+  EXPECT_LE(1.0, snapshot->at("libprocess/receive_buffers/borrowed"));
+  EXPECT_LE(
+      snapshot->at("libprocess/receive_buffers/borrowed"),
+      snapshot->at("libprocess/receive_buffers/allocated"));
+
+  BufferPool::release(buffer);
+
+  EXPECT_EQ(borrowed, BufferPool::borrowed());
+}
+
+
+// Tests that connections to libprocess only hold on to a receive
+// buffer while they receive, i.e., neither idle connections nor
+// closed ones keep one.
+TEST(BufferPoolTest, ReleaseOnClose)
+{
+  const size_t borrowed = BufferPool::borrowed();
+
+  auto settle = [borrowed]() {
+    Stopwatch watch;
+    watch.start();
+
+    while (BufferPool::borrowed() != borrowed &&
+           watch.elapsed() < Seconds(15)) {
+      os::sleep(Milliseconds(10));
+    }
+  };
+
+  const size_t count = 32;
+
+  vector<Socket> clients;
+  for (size_t i = 0; i < count; i++) {
+    Try<Socket> client = Socket::create();
+    ASSERT_SOME(client);
+
+    AWAIT_READY(connectSocket(*client, process::address()));
+
+    // Send part of a request so that libprocess receives something
+    // but then has to wait for the rest.
+    AWAIT_READY(client->send("GET /help HTTP/1.1\r\n"));
+
+    clients.push_back(client.get());
+  }
+
+  settle();
+  EXPECT_EQ(borrowed, BufferPool::borrowed());
+
+  foreach (Socket& client, clients) {
+    EXPECT_SOME(client.shutdown(Socket::Shutdown::READ_WRITE));
+  }
+
+  clients.clear();
+
+  settle();
+  EXPECT_EQ(borrowed, BufferPool::borrowed());
+}
 #endif // __WINDOWS__
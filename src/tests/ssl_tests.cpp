@@ -64,8 +64,21 @@ using network::internal::SocketImpl;
 using process::Clock;
 using process::Failure;
 using process::Future;
+using process::READONLY_HTTP_AUTHENTICATION_REALM;
+using process::READWRITE_HTTP_AUTHENTICATION_REALM;
 using process::Subprocess;
 
+namespace process {
+
+// We need to reinitialize libprocess in order to test against different
+// configurations, such as when libprocess runs more than one event loop.
+void reinitialize(
+    const Option<string>& delegate,
+    const Option<string>& readonlyAuthenticationRealm,
+    const Option<string>& readwriteAuthenticationRealm);
+
+} // namespace process {
+
 
 // Wait for a subprocess and test the status code for the following
 // conditions of 'expected_status':
@@ -845,6 +858,89 @@ TEST_F(SSLTest, ShutdownThenSend)
 }
 
 
+// Runs libprocess with more than one event loop so that accepted
+// sockets mostly belong to a different event loop than the listener.
+class SSLEventLoopsTest : public SSLTest
+{
+protected:
+  void SetUp() override
+  {
+    SSLTest::SetUp();
+
+    os::setenv("LIBPROCESS_EVENT_LOOPS", "4");
+    process::reinitialize(
+        None(),
+        READWRITE_HTTP_AUTHENTICATION_REALM,
+        READONLY_HTTP_AUTHENTICATION_REALM);
+  }
+
+  void TearDown() override
+  {
+    os::unsetenv("LIBPROCESS_EVENT_LOOPS");
+    set_environment_variables({});
+    process::reinitialize(
+        None(),
+        READWRITE_HTTP_AUTHENTICATION_REALM,
+        READONLY_HTTP_AUTHENTICATION_REALM);
+
+    SSLTest::TearDown();
+  }
+};
+
+
+// Tests that accepted SSL sockets complete their handshake and work
+// when they belong to a different event loop than the listener.
+TEST_F(SSLEventLoopsTest, Accept)
+{
+  Try<Socket> server = setup_server({
+      {"LIBPROCESS_SSL_ENABLED", "true"},
+      {"LIBPROCESS_SSL_KEY_FILE", key_path().string()},
+      {"LIBPROCESS_SSL_CERT_FILE", certificate_path().string()}});
+
+  ASSERT_SOME(server);
+  ASSERT_SOME(server->address());
+
+  const size_t count = 16;
+
+  vector<Socket> clients;
+  vector<Future<Nothing>> connects;
+
+  for (size_t i = 0; i < count; i++) {
+    Try<Socket> client = Socket::create(SocketImpl::Kind::SSL);
+    ASSERT_SOME(client);
+
+    // Pass `None()` as hostname because this test is still
+    // using the 'legacy' hostname validation scheme.
+    connects.push_back(client->connect(
+        server->address().get(),
+        openssl::create_tls_client_config(None())));
+
+    clients.push_back(client.get());
+  }
+
+  vector<Socket> accepted;
+
+  for (size_t i = 0; i < count; i++) {
+    Future<Socket> socket = server->accept();
+    AWAIT_ASSERT_READY(socket);
+
+    accepted.push_back(socket.get());
+  }
+
+  foreach (const Future<Nothing>& connect, connects) {
+    AWAIT_ASSERT_READY(connect);
+  }
+
+  foreach (Socket& socket, accepted) {
+    AWAIT_ASSERT_READY(socket.send(data));
+  }
+
+  foreach (Socket& client, clients) {
+    AWAIT_ASSERT_EQ(data, client.recv(data.size()));
+  }
+}
+
+
 #endif // USE_SSL_SOCKET
 
 
@@ -14,17 +14,39 @@
 
 #include <gmock/gmock.h>
 
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <process/clock.hpp>
+#include <process/future.hpp>
+#include <process/gtest.hpp>
 #include <process/time.hpp>
+#include <process/timer.hpp>
+
+#include <process/metrics/metrics.hpp>
 
 #include <stout/duration.hpp>
+#include <stout/foreach.hpp>
 #include <stout/gtest.hpp>
+#include <stout/nothing.hpp>
 #include <stout/os.hpp>
+#include <stout/synchronized.hpp>
 
 using process::Clock;
+using process::Future;
+using process::Promise;
 using process::RFC1123;
 using process::RFC3339;
 using process::Time;
+using process::Timer;
+
+using std::map;
+using std::string;
+using std::vector;
 
 TEST(TimeTest, Arithmetic)
 {
@@ -112,3 +134,251 @@ TEST(TimeTest, Output)
   EXPECT_EQ("1989-03-02 00:00:00.000001000+00:00",
             stringify(Time::epoch() + Weeks(1000) + Microseconds(1)));
 }
+
+
+// Tests that timers fire in the order of their timeouts, including
+// timers that are further out than the timer wheel covers, and that
+// timers with the same timeout fire in the order they got created.
+TEST(ClockTest, TimerOrder)
+{
+  Clock::pause();
+
+  std::mutex mutex;
+  vector<int> fired;
+
+  auto record = [&](int i) {
+    return [&mutex, &fired, i]() {
+      synchronized (mutex) {
+        fired.push_back(i);
+      }
+    };
+  };
+
+  Clock::timer(Weeks(200), record(6));
+  Clock::timer(Seconds(2), record(4));
+  Clock::timer(Milliseconds(1), record(0));
+  Clock::timer(Seconds(2), record(5));
+  Clock::timer(Milliseconds(100), record(1));
+  Clock::timer(Milliseconds(100), record(2));
+  Clock::timer(Milliseconds(101), record(3));
+
+  Clock::advance(Seconds(1));
+  Clock::settle();
+
+  synchronized (mutex) {
+    EXPECT_EQ((vector<int>{0, 1, 2, 3}), fired);
+  }
+
+  Clock::advance(Weeks(100));
+  Clock::settle();
+
+  synchronized (mutex) {
+    EXPECT_EQ((vector<int>{0, 1, 2, 3, 4, 5}), fired);
+  }
+
+  Clock::advance(Weeks(100));
+  Clock::settle();
+
+  synchronized (mutex) {
+    EXPECT_EQ((vector<int>{0, 1, 2, 3, 4, 5, 6}), fired);
+  }
+
+  Clock::resume();
+}
+
+
+TEST(ClockTest, TimerCancel)
+{
+  Clock::pause();
+
+  std::atomic_int fired(0);
+
+  Timer canceled = Clock::timer(Seconds(1), [&fired]() { fired++; });
+  Timer expired = Clock::timer(Seconds(1), [&fired]() { fired++; });
+
+  EXPECT_TRUE(Clock::cancel(canceled));
+  EXPECT_FALSE(Clock::cancel(canceled));
+
+  Clock::advance(Seconds(1));
+  Clock::settle();
+
+  EXPECT_EQ(1, fired.load());
+  EXPECT_FALSE(Clock::cancel(expired));
+
+  // A default constructed timer was never pending.
+  EXPECT_FALSE(Clock::cancel(Timer()));
+
+  Clock::resume();
+}
+
+
+// Tests that timers created outside of libprocess fire once they
+// elapse even though they only get buffered by the creating thread.
+TEST(ClockTest, TimerOtherThread)
+{
+  Promise<Nothing> promise;
+
+  std::thread thread([&promise]() {
+    Clock::timer(Milliseconds(10), [&promise]() { promise.set(Nothing()); });
+  });
+
+  thread.join();
+
+  AWAIT_READY(promise.future());
+}
+
+
+// Tests that timers created concurrently by many threads (each of
+// which buffers its own timers) all fire while the clock is running.
+TEST(ClockTest, TimerManyThreads)
+{
+  const int THREADS = 8;
+  const int TIMERS = 100;
+
+  std::atomic_int fired(0);
+  Promise<Nothing> promise;
+
+  auto fire = [&fired, &promise]() {
+    if (++fired == THREADS * TIMERS) {
+      promise.set(Nothing());
+    }
+  };
+
+  vector<std::thread> threads;
+
+  for (int i = 0; i < THREADS; i++) {
+    threads.emplace_back([&fire]() {
+      for (int j = 0; j < TIMERS; j++) {
+        Clock::timer(Milliseconds(j % 20), fire);
+      }
+    });
+  }
+
+  foreach (std::thread& thread, threads) {
+    thread.join();
+  }
+
+  AWAIT_READY(promise.future());
+
+  EXPECT_EQ(THREADS * TIMERS, fired.load());
+}
+
+
+// Tests that a thread which buffers more timers than fit its buffer
+// (i.e., that adds them to the timers itself) doesn't lose any of
+// them while the clock is running.
+TEST(ClockTest, TimerBufferLimit)
+{
+  // More than twice the number of timers a thread buffers.
+  const int TIMERS = 2500;
+
+  std::atomic_int fired(0);
+  Promise<Nothing> promise;
+
+  for (int i = 0; i < TIMERS; i++) {
+    Clock::timer(Milliseconds(10 + i % 10), [&fired, &promise]() {
+      if (++fired == TIMERS) {
+        promise.set(Nothing());
+      }
+    });
+  }
+
+  AWAIT_READY(promise.future());
+
+  EXPECT_EQ(TIMERS, fired.load());
+}
+
+
+// Tests that the timers a thread has buffered when it exits get
+// handed over and fire, by having a 'tick' scheduled before them so
+// that the thread doesn't add them to the timers itself.
+TEST(ClockTest, TimerOrphans)
+{
+  const int TIMERS = 100;
+
+  Promise<Nothing> first;
+  Clock::timer(Milliseconds(10), [&first]() { first.set(Nothing()); });
+
+  std::atomic_int fired(0);
+  Promise<Nothing> promise;
+
+  std::thread thread([&fired, &promise]() {
+    for (int i = 0; i < TIMERS; i++) {
+      Clock::timer(Milliseconds(50), [&fired, &promise]() {
+        if (++fired == TIMERS) {
+          promise.set(Nothing());
+        }
+      });
+    }
+  });
+
+  thread.join();
+
+  AWAIT_READY(first.future());
+  AWAIT_READY(promise.future());
+
+  EXPECT_EQ(TIMERS, fired.load());
+}
+
+
+TEST(ClockTest, TimerSlack)
+{
+  Promise<Nothing> promise;
+
+  Time now = Clock::now();
+
+  Timer timer = Clock::timer(Milliseconds(10), Milliseconds(8), [&]() {
+    promise.set(Nothing());
+  });
+
+  // The timeout gets rounded up to a multiple of 2^22ns (~4.2ms), the
+  // largest power of two nanoseconds that doesn't exceed the slack.
+  EXPECT_EQ(0, timer.timeout().time().duration().ns() % (1 << 22));
+  EXPECT_LE(now + Milliseconds(10), timer.timeout().time());
+  EXPECT_GE(Clock::now() + Milliseconds(18), timer.timeout().time());
+
+  AWAIT_READY(promise.future());
+
+  // The slack is ignored while the clock is paused.
+  Clock::pause();
+
+  now = Clock::now();
+  timer = Clock::timer(Milliseconds(10), Milliseconds(8), []() {});
+
+  EXPECT_EQ(now + Milliseconds(10), timer.timeout().time());
+
+  Clock::cancel(timer);
+  Clock::resume();
+}
+
+// Tests that expired timers get invoked (by the timer executors) even
+// when more of them expire at once than make up a single batch.
+TEST(ClockTest, TimerBatches)
+{
+  Future<map<string, double>> before = process::metrics::snapshot(None());
+  AWAIT_READY(before);
+  ASSERT_EQ(1u, before->count("libprocess/timers/fired"));
+
+  Clock::pause();
+
+  std::atomic_int fired(0);
+
+  for (int i = 0; i < 1000; i++) {
+    Clock::timer(Milliseconds(i % 10), [&fired]() { fired++; });
+  }
+
+  Clock::advance(Milliseconds(10));
+  Clock::settle();
+
+  EXPECT_EQ(1000, fired.load());
+
+  Clock::resume();
+
+  Future<map<string, double>> after = process::metrics::snapshot(None());
+  AWAIT_READY(after);
+  ASSERT_EQ(1u, after->count("libprocess/timers/lag_us"));
+
+  EXPECT_LE(
+      before->at("libprocess/timers/fired") + 1000,
+      after->at("libprocess/timers/fired"));
+}
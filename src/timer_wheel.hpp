@@ -0,0 +1,500 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License
+
+#ifndef __PROCESS_TIMER_WHEEL_HPP__
+#define __PROCESS_TIMER_WHEEL_HPP__
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <process/time.hpp>
+#include <process/timer.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/option.hpp>
+
+namespace process {
+
+// The pending timers of the `Clock`, kept in a hierarchical timing
+// wheel (see "Hashed and Hierarchical Timing Wheels" by Varghese and
+// Lauck) so that adding a timer takes constant time regardless of how
+// many timers are pending.
+//
+// Time is divided into ticks of `RESOLUTION`. Each of the `LEVELS`
+// levels has `SLOTS` slots, where a slot of level 0 covers a single
+// tick and a slot of level N covers all the slots of level N - 1. A
+// timer is kept in the slot of the lowest level whose slots are big
+// enough to tell its tick apart from the `cursor`, i.e., the tick the
+// wheel has been advanced to. Once the cursor reaches a slot of a
+// higher level its timers get moved ("cascaded") to the lower levels.
+// The levels cover about 2 years, timers that expire after that are
+// kept aside until the wheel has turned far enough.
+//
+// Timers get canceled by flagging them (see `Timer::pending`) which
+// doesn't need the wheel at all. The wheel deletes the entries of
+// canceled timers lazily, i.e., when it comes across them or once
+// they make up more than half of its entries (see `compact`).
+//
+// NOTE: the wheel is not thread-safe (except for `canceled`), the
+// `Clock` synchronizes all access to it.
+class TimerWheel
+{
+public:
+  // Length of a tick, in nanoseconds.
+  static constexpr int64_t RESOLUTION = 1000000;
+
+  static constexpr size_t BITS = 6;
+  static constexpr size_t SLOTS = 1 << BITS;
+  static constexpr size_t LEVELS = 6;
+
+  static_assert(SLOTS == 64, "The occupancy of a level must fit a word");
+
+  struct Entry
+  {
+    Entry(
+        const Timer& _timer,
+        const std::shared_ptr<std::atomic_bool>& _pending,
+        uint64_t _sequence)
+      : timer(_timer),
+        pending(_pending),
+        deadline(_timer.timeout().time()),
+        sequence(_sequence) {}
+
+    Timer timer;
+
+    // Shared with every copy of the timer, false once the timer has
+    // expired or got canceled.
+    std::shared_ptr<std::atomic_bool> pending;
+
+    Time deadline;
+
+    // Orders the timers that expire at the same time.
+    uint64_t sequence;
+
+    Entry* next = nullptr;
+  };
+
+  TimerWheel() = default;
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  ~TimerWheel()
+  {
+    clear();
+  }
+
+  // Adds the entry, taking ownership of it.
+  void insert(Entry* entry)
+  {
+    if (!entry->pending->load()) {
+      drop(entry);
+      return;
+    }
+
+    count++;
+    place(entry);
+  }
+
+  // Advances the wheel to `now`, appending the timers that have
+  // expired by then to `expired` ordered by their timeouts (and then
+  // by when they got created). The timers are no longer pending.
+  void advance(const Time& now, std::list<Timer>* expired)
+  {
+    // NOTE: the cursor can be ahead of `now` if the clock got paused
+    // (or the system time went backwards) but it never goes back.
+    const uint64_t target = std::max(ticks(now), cursor);
+
+    std::vector<Entry*> fired;
+
+    while (true) {
+      visit(now, &fired);
+
+      if (cursor == target) {
+        break;
+      }
+
+      // Skip ahead to the next slot that has any timers rather than
+      // going tick by tick, cascading the slot if necessary.
+      size_t level = 0;
+      size_t slot = 0;
+
+      if (!following(&level, &slot)) {
+        if (overflow == nullptr || rotation() > target) {
+          cursor = target;
+        } else {
+          cursor = rotation();
+          cascade(&overflow);
+        }
+
+        continue;
+      }
+
+      if (start(level, slot) > target) {
+        cursor = target;
+        continue;
+      }
+
+      cursor = start(level, slot);
+
+      if (level > 0) {
+        Entry* entries = take(level, slot);
+        cascade(&entries);
+      }
+    }
+
+    std::sort(
+        fired.begin(),
+        fired.end(),
+        [](const Entry* left, const Entry* right) {
+          return left->deadline < right->deadline ||
+            (left->deadline == right->deadline &&
+             left->sequence < right->sequence);
+        });
+
+    foreach (Entry* entry, fired) {
+      expired->push_back(std::move(entry->timer));
+      delete entry;
+    }
+
+    count -= fired.size();
+  }
+
+  // Returns when the next timer expires, or an earlier time if that
+  // timer hasn't been cascaded to the lowest level yet, or `None` if
+  // there are no pending timers. Once the wheel has been advanced to
+  // the returned time it returns the exact time (or a later one).
+  Option<Time> next()
+  {
+    // The slot of the cursor, which might also hold expired timers.
+    Option<Time> earliest = earliestIn(cursor & MASK);
+
+    if (earliest.isSome()) {
+      return earliest;
+    }
+
+    size_t level = 0;
+    size_t slot = 0;
+
+    while (following(&level, &slot)) {
+      if (level > 0) {
+        return time(start(level, slot));
+      }
+
+      earliest = earliestIn(slot);
+
+      if (earliest.isSome()) {
+        return earliest;
+      }
+    }
+
+    if (overflow != nullptr) {
+      return time(rotation());
+    }
+
+    return None();
+  }
+
+  // Notes that one of the timers got canceled. Unlike the rest of the
+  // wheel this is thread-safe.
+  void canceled()
+  {
+    cancellations.fetch_add(1);
+  }
+
+  // Deletes the entries of canceled timers if they make up more than
+  // half of the entries, so that canceling timers takes (amortized)
+  // constant time without letting their entries pile up.
+  void compact()
+  {
+    if (count < COMPACT_MINIMUM ||
+        cancellations.load() <= static_cast<int64_t>(count / 2)) {
+      return;
+    }
+
+    for (size_t level = 0; level < LEVELS; level++) {
+      for (size_t slot = 0; slot < SLOTS; slot++) {
+        Entry* entries = take(level, slot);
+        cascade(&entries);
+      }
+    }
+
+    cascade(&overflow);
+  }
+
+  // Deletes all entries without expiring their timers.
+  void clear()
+  {
+    for (size_t level = 0; level < LEVELS; level++) {
+      for (size_t slot = 0; slot < SLOTS; slot++) {
+        destroy(take(level, slot));
+      }
+    }
+
+    destroy(overflow);
+    overflow = nullptr;
+
+    count = 0;
+  }
+
+  // Number of entries, including the ones of canceled timers that
+  // haven't been deleted yet.
+  size_t size() const
+  {
+    return count;
+  }
+
+private:
+  static constexpr uint64_t MASK = SLOTS - 1;
+
+  // Ticks covered by all the levels together, i.e., a rotation.
+  static constexpr uint64_t RANGE = static_cast<uint64_t>(1) << (BITS * LEVELS);
+
+  // Minimum number of entries before compacting.
+  static constexpr size_t COMPACT_MINIMUM = 1024;
+
+  static uint64_t ticks(const Time& time)
+  {
+    const int64_t ns = time.duration().ns();
+    return ns <= 0 ? 0 : static_cast<uint64_t>(ns / RESOLUTION);
+  }
+
+  static Time time(uint64_t ticks)
+  {
+    return Time::epoch() +
+      Nanoseconds(static_cast<int64_t>(ticks) * RESOLUTION);
+  }
+
+  // Returns the index of the lowest set bit.
+  static size_t lowest(uint64_t bits)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<size_t>(index);
+#else
+    return static_cast<size_t>(__builtin_ctzll(bits));
+#endif // _MSC_VER
+  }
+
+  // Returns the first tick of the next rotation of the wheel.
+  uint64_t rotation() const
+  {
+    return (cursor | (RANGE - 1)) + 1;
+  }
+
+  // Returns the first tick covered by the slot, which must not be
+  // behind the cursor.
+  uint64_t start(size_t level, size_t slot) const
+  {
+    const size_t shift = (level + 1) * BITS;
+    return ((cursor >> shift) << shift) |
+      (static_cast<uint64_t>(slot) << (level * BITS));
+  }
+
+  // Finds the first slot with any timers after the cursor's slot,
+  // looking at the lowest level first. Since a timer is kept in the
+  // lowest level possible the slots of a lower level always come
+  // before the ones of a higher level.
+  bool following(size_t* level, size_t* slot) const
+  {
+    for (size_t l = 0; l < LEVELS; l++) {
+      const uint64_t digit = (cursor >> (l * BITS)) & MASK;
+
+      const uint64_t bits = digit == MASK
+        ? 0
+        : levels[l].occupied & (~static_cast<uint64_t>(0) << (digit + 1));
+
+      if (bits != 0) {
+        *level = l;
+        *slot = lowest(bits);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void place(Entry* entry)
+  {
+    // Overdue timers go into the cursor's slot and timers that expire
+    // after this rotation of the wheel get placed again once the wheel
+    // gets to the next rotation.
+    const uint64_t tick = std::max(ticks(entry->deadline), cursor);
+
+    if (tick >= rotation()) {
+      entry->next = overflow;
+      overflow = entry;
+      return;
+    }
+
+    const uint64_t difference = tick ^ cursor;
+
+    size_t level = 0;
+    while (level + 1 < LEVELS && (difference >> ((level + 1) * BITS)) != 0) {
+      level++;
+    }
+
+    put(level, (tick >> (level * BITS)) & MASK, entry);
+  }
+
+  void put(size_t level, size_t slot, Entry* entry)
+  {
+    entry->next = levels[level].slots[slot];
+    levels[level].slots[slot] = entry;
+    levels[level].occupied |= static_cast<uint64_t>(1) << slot;
+  }
+
+  Entry* take(size_t level, size_t slot)
+  {
+    Entry* entry = levels[level].slots[slot];
+    levels[level].slots[slot] = nullptr;
+    levels[level].occupied &= ~(static_cast<uint64_t>(1) << slot);
+    return entry;
+  }
+
+  void drop(Entry* entry)
+  {
+    cancellations.fetch_sub(1);
+    delete entry;
+  }
+
+  // Expires the timers in the cursor's slot that have expired by
+  // `now`, keeping the others.
+  void visit(const Time& now, std::vector<Entry*>* fired)
+  {
+    Entry* entry = take(0, cursor & MASK);
+
+    while (entry != nullptr) {
+      Entry* next = entry->next;
+
+      bool pending = true;
+
+      if (entry->deadline > now) {
+        place(entry);
+      } else if (entry->pending->compare_exchange_strong(pending, false)) {
+        fired->push_back(entry);
+      } else {
+        count--;
+        drop(entry);
+      }
+
+      entry = next;
+    }
+  }
+
+  // Places the entries again, e.g., to move the timers of a slot that
+  // the cursor just reached to the lower levels, deleting the entries
+  // of canceled timers.
+  void cascade(Entry** entries)
+  {
+    Entry* entry = *entries;
+    *entries = nullptr;
+
+    while (entry != nullptr) {
+      Entry* next = entry->next;
+
+      if (entry->pending->load()) {
+        place(entry);
+      } else {
+        count--;
+        drop(entry);
+      }
+
+      entry = next;
+    }
+  }
+
+  // Returns the earliest deadline of the timers in the slot of the
+  // lowest level, deleting the entries of canceled timers.
+  Option<Time> earliestIn(size_t slot)
+  {
+    Option<Time> earliest;
+
+    Entry* entry = take(0, slot);
+
+    while (entry != nullptr) {
+      Entry* next = entry->next;
+
+      if (entry->pending->load()) {
+        if (earliest.isNone() || entry->deadline < earliest.get()) {
+          earliest = entry->deadline;
+        }
+
+        put(0, slot, entry);
+      } else {
+        count--;
+        drop(entry);
+      }
+
+      entry = next;
+    }
+
+    return earliest;
+  }
+
+  void destroy(Entry* entry)
+  {
+    while (entry != nullptr) {
+      Entry* next = entry->next;
+
+      if (!entry->pending->load()) {
+        cancellations.fetch_sub(1);
+      }
+
+      delete entry;
+      entry = next;
+    }
+  }
+
+  struct Level
+  {
+    Level()
+    {
+      slots.fill(nullptr);
+    }
+
+    std::array<Entry*, SLOTS> slots;
+
+    // Bit N is set if slot N has any timers.
+    uint64_t occupied = 0;
+  };
+
+  std::array<Level, LEVELS> levels;
+
+  // Timers that expire after this rotation of the wheel.
+  Entry* overflow = nullptr;
+
+  uint64_t cursor = 0;
+
+  // Number of entries.
+  size_t count = 0;
+
+  // Number of canceled timers whose entries haven't been deleted yet,
+  // including entries that haven't been inserted yet.
+  std::atomic<int64_t> cancellations{0};
+};
+
+} // namespace process {
+
+#endif // __PROCESS_TIMER_WHEEL_HPP__
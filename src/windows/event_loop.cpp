@@ -26,7 +26,7 @@ namespace process {
 
 windows::EventLoop* libwinio_loop;
 
-void EventLoop::initialize()
+void EventLoop::initialize(size_t loops)
 {
   static Once* initialized = new Once();
 
@@ -34,6 +34,8 @@ void EventLoop::initialize()
     return;
   }
 
+  CHECK_EQ(1u, loops) << "Only one event loop is supported on Windows";
+
   Try<windows::EventLoop*> try_loop = windows::EventLoop::create();
   if (try_loop.isError()) {
     LOG(FATAL) << "Failed to initialize Windows IOCP event loop";
@@ -65,8 +67,16 @@ double EventLoop::time()
 }
 
 
-void EventLoop::run()
+size_t EventLoop::loops()
+{
+  return 1;
+}
+
+
+void EventLoop::run(size_t index)
 {
+  CHECK_EQ(0u, index);
+
   if (!libwinio_loop) {
     // TODO(andschwa): Remove this check, see MESOS-9097.
     LOG(FATAL) << "Windows IOCP event loop is not initialized";